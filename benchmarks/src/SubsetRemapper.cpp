@@ -0,0 +1,77 @@
+#include <benchmark/benchmark.h>
+
+#include "singlepp/SubsetRemapper.hpp"
+
+#include "simulate.h"
+
+#include <vector>
+#include <random>
+#include <cstdint>
+
+// Adding a percentage of the markers to the remapper, to mimic the shrinking marker sets in successive fine-tuning iterations.
+static std::vector<int> choose_markers(int num_markers, double fraction) {
+    std::vector<int> chosen;
+    std::mt19937_64 rng(num_markers);
+    std::uniform_real_distribution<> udist;
+    for (int m = 0; m < num_markers; ++m) {
+        if (udist(rng) <= fraction) {
+            chosen.push_back(m);
+        }
+    }
+    return chosen;
+}
+
+static void BM_SubsetRemapper_remap(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const double fraction = state.range(1) / 100.0;
+    singlepp::SubsetRemapper<int> remapper(num_markers);
+    for (auto m : choose_markers(num_markers, fraction)) {
+        remapper.add(m);
+    }
+
+    const auto vals = simulate_values(num_markers, 1, 42);
+    const auto ranked = rank_values(vals.data(), num_markers);
+    singlepp::RankedVector<double, int> output;
+    for (auto _ : state) {
+        remapper.remap(ranked, output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_SubsetRemapper_remap)->ArgsProduct({ marker_sweep, { 10, 50, 90 } });
+
+static void BM_SubsetRemapper_add(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const double fraction = state.range(1) / 100.0;
+    singlepp::SubsetRemapper<int> remapper(num_markers);
+    const auto chosen = choose_markers(num_markers, fraction);
+    for (auto _ : state) {
+        remapper.clear();
+        for (auto m : chosen) {
+            remapper.add(m);
+        }
+        benchmark::DoNotOptimize(remapper.size());
+    }
+    state.SetItemsProcessed(state.iterations() * chosen.size());
+}
+
+BENCHMARK(BM_SubsetRemapper_add)->ArgsProduct({ marker_sweep, { 10, 50, 90 } });
+
+static void BM_SubsetRemapper_set(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const double fraction = state.range(1) / 100.0;
+    singlepp::SubsetRemapper<int> remapper(num_markers);
+    const auto chosen = choose_markers(num_markers, fraction);
+    std::vector<std::uint64_t> words((num_markers + 63) / 64);
+    for (auto m : chosen) {
+        words[m / 64] |= static_cast<std::uint64_t>(1) << (m % 64);
+    }
+    for (auto _ : state) {
+        remapper.set(words);
+        benchmark::DoNotOptimize(remapper.size());
+    }
+    state.SetItemsProcessed(state.iterations() * chosen.size());
+}
+
+BENCHMARK(BM_SubsetRemapper_set)->ArgsProduct({ marker_sweep, { 10, 50, 90 } });
@@ -0,0 +1,119 @@
+#include <benchmark/benchmark.h>
+
+#include "singlepp/build_reference.hpp"
+#include "singlepp/correlations_to_score.hpp"
+#include "singlepp/SearchCounters.hpp"
+
+#include "simulate.h"
+
+#include <vector>
+#include <cmath>
+#include <type_traits>
+
+template<bool sparse_>
+using PerLabel = typename std::conditional<sparse_, singlepp::SparsePerLabel<int, double>, singlepp::DensePerLabel<int, double> >::type;
+
+static std::vector<double> create_centers(int num_markers, int num_samples) {
+    const int num_groups = std::max(1.0, std::sqrt(num_samples));
+    return simulate_centers(num_markers, num_groups, 42);
+}
+
+// Creating the scaled ranks for a single label, before the index is built by select_seeds().
+template<bool sparse_>
+PerLabel<sparse_> create_unindexed(int num_markers, int num_samples, const std::vector<double>& centers, double density, unsigned long long seed) {
+    const auto profiles = simulate_profiles(num_markers, num_samples, centers, density, seed);
+    PerLabel<sparse_> output;
+
+    if constexpr(sparse_) {
+        output.indptrs.push_back(0);
+        singlepp::SparseScaled<int, double> scaled;
+        for (int s = 0; s < num_samples; ++s) {
+            const auto ranked = rank_sparse_values(profiles.data() + static_cast<std::size_t>(num_markers) * s, num_markers);
+            singlepp::scaled_ranks_sparse<int, double, double>(num_markers, ranked.first.begin(), ranked.first.end(), ranked.second.begin(), ranked.second.end(), scaled);
+            singlepp::sort_by_first(scaled.nonzero);
+            for (const auto& y : scaled.nonzero) {
+                output.index.push_back(y.first);
+                output.value.push_back(y.second);
+            }
+            output.indptrs.push_back(output.value.size());
+            output.zeros.push_back(scaled.zero);
+        }
+
+    } else {
+        output.data.resize(profiles.size());
+        output.has_nonzero.resize(num_samples);
+        for (int s = 0; s < num_samples; ++s) {
+            const auto offset = static_cast<std::size_t>(num_markers) * s;
+            const auto ranked = rank_values(profiles.data() + offset, num_markers);
+            output.has_nonzero[s] = singlepp::scaled_ranks_dense(num_markers, ranked, output.data.data() + offset);
+        }
+    }
+
+    return output;
+}
+
+template<bool sparse_>
+static void BM_select_seeds(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const int num_samples = state.range(1);
+    const double density = (sparse_ ? state.range(2) / 100.0 : 1);
+    const auto original = create_unindexed<sparse_>(num_markers, num_samples, create_centers(num_markers, num_samples), density, 69);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto copy = original;
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(singlepp::select_seeds<sparse_, int, double>(num_markers, num_samples, copy));
+    }
+    state.SetItemsProcessed(state.iterations() * num_samples);
+}
+
+BENCHMARK(BM_select_seeds<false>)->ArgsProduct({ { 20, 100, 500 }, { 100, 1000, 10000 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_select_seeds<true>)->ArgsProduct({ { 100, 500 }, { 100, 1000, 10000 }, { 5, 20, 50 } })->Unit(benchmark::kMillisecond);
+
+// Searching for the number of neighbors that would be used to compute the default quantile in classify_single().
+// Queries are drawn from the same distribution as the reference, so that the pruning is realistic for a cell from the same label.
+template<bool query_sparse_, bool ref_sparse_>
+static void BM_find_closest_neighbors(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const int num_samples = state.range(1);
+    const double density = (query_sparse_ || ref_sparse_ ? state.range(2) / 100.0 : 1);
+
+    const auto centers = create_centers(num_markers, num_samples);
+    auto ref = create_unindexed<ref_sparse_>(num_markers, num_samples, centers, (ref_sparse_ ? density : 1), 69);
+    singlepp::select_seeds<ref_sparse_, int, double>(num_markers, num_samples, ref);
+    const int k = singlepp::precompute_quantile_details(num_samples, 0.8).right_index + 1;
+
+    constexpr int num_queries = 64;
+    typedef typename std::conditional<query_sparse_ && !ref_sparse_, singlepp::SparseScaled<int, double>, std::vector<double> >::type Query;
+    std::vector<Query> queries(num_queries);
+    std::vector<char> query_has_nonzero(num_queries);
+    {
+        const auto profiles = simulate_profiles(num_markers, num_queries, centers, (query_sparse_ ? density : 1), 1234);
+        for (int q = 0; q < num_queries; ++q) {
+            const auto ptr = profiles.data() + static_cast<std::size_t>(num_markers) * q;
+            if constexpr(query_sparse_ && !ref_sparse_) {
+                const auto ranked = rank_sparse_values(ptr, num_markers);
+                query_has_nonzero[q] = singlepp::scaled_ranks_sparse<int, double, double>(num_markers, ranked.first.begin(), ranked.first.end(), ranked.second.begin(), ranked.second.end(), queries[q]);
+            } else {
+                const auto ranked = rank_values(ptr, num_markers);
+                queries[q].resize(num_markers);
+                query_has_nonzero[q] = singlepp::scaled_ranks_dense(num_markers, ranked, queries[q].data());
+            }
+        }
+    }
+
+    singlepp::FindClosestNeighborsWorkspace<int, double> work(num_samples);
+    singlepp::NoopSearchCounters counters;
+    int q = 0;
+    for (auto _ : state) {
+        singlepp::find_closest_neighbors<query_sparse_, ref_sparse_>(num_markers, queries[q], query_has_nonzero[q], k, ref, work, counters);
+        benchmark::DoNotOptimize(work.closest_neighbors.data());
+        q = (q + 1) % num_queries;
+    }
+    state.SetItemsProcessed(state.iterations() * num_samples);
+}
+
+BENCHMARK(BM_find_closest_neighbors<false, false>)->ArgsProduct({ { 20, 100, 500 }, { 100, 1000, 10000 } })->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_find_closest_neighbors<true, false>)->ArgsProduct({ { 100, 500 }, { 100, 1000, 10000 }, { 5, 20, 50 } })->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_find_closest_neighbors<false, true>)->ArgsProduct({ { 100, 500 }, { 100, 1000, 10000 }, { 5, 20, 50 } })->Unit(benchmark::kMicrosecond);
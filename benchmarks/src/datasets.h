@@ -0,0 +1,63 @@
+#ifndef SINGLEPP_BENCHMARK_DATASETS_H
+#define SINGLEPP_BENCHMARK_DATASETS_H
+
+#include "singlepp/Markers.hpp"
+#include "tatami/tatami.hpp"
+
+#include "simulate_counts.h"
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+
+// Label-specific markers for train_integrated() are the union of the pairwise markers for each label.
+inline singlepp::PerLabelMarkers<int> pool_markers(const singlepp::PairwiseMarkers<int>& markers) {
+    singlepp::PerLabelMarkers<int> output(markers.size());
+    for (std::size_t l = 0; l < markers.size(); ++l) {
+        for (const auto& current : markers[l]) {
+            output[l].insert(output[l].end(), current.begin(), current.end());
+        }
+        std::sort(output[l].begin(), output[l].end());
+        output[l].erase(std::unique(output[l].begin(), output[l].end()), output[l].end());
+    }
+    return output;
+}
+
+struct Reference {
+    std::shared_ptr<const tatami::Matrix<double, int> > matrix;
+    std::vector<int> labels;
+};
+
+inline Reference create_reference(const SimulatedTruth& truth, bool bulk, int num_profiles, bool sparse, unsigned long long seed) {
+    auto sim = simulate_counts(truth, bulk ? bulk_shape(num_profiles, seed) : single_cell_shape(num_profiles, seed));
+    Reference output;
+    output.matrix = (sparse ? sim.sparse() : sim.dense());
+    output.labels = std::move(sim.labels);
+    return output;
+}
+
+// To avoid allocating a huge matrix, large test datasets are constructed by binding copies of a smaller block of cells.
+inline std::shared_ptr<const tatami::Matrix<double, int> > create_test(const SimulatedTruth& truth, double library_size, int block, bool sparse, int num_cells) {
+    const int block_size = std::min(block, num_cells);
+    auto create_block = [&](int n) -> std::shared_ptr<const tatami::Matrix<double, int> > {
+        auto sopt = single_cell_shape(n, 12345);
+        sopt.library_size = library_size;
+        auto sim = simulate_counts(truth, sopt);
+        return (sparse ? sim.sparse() : sim.dense());
+    };
+
+    auto first = create_block(block_size);
+    if (block_size == num_cells) {
+        return first;
+    }
+
+    std::vector<std::shared_ptr<const tatami::Matrix<double, int> > > components(num_cells / block_size, first);
+    const int leftover = num_cells % block_size;
+    if (leftover) {
+        components.push_back(create_block(leftover));
+    }
+    return tatami::make_DelayedBind(std::move(components), false);
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include <benchmark/benchmark.h>
+
+#include "singlepp/SubsetSanitizer.hpp"
+
+#include "simulate.h"
+
+#include <vector>
+#include <numeric>
+#include <random>
+#include <algorithm>
+
+// Choosing the markers from a typical number of genes in a single-cell dataset.
+static constexpr int num_genes = 20000;
+
+static std::vector<int> simulate_subset(int num_markers, bool sorted) {
+    std::vector<int> all(num_genes);
+    std::iota(all.begin(), all.end(), 0);
+    std::mt19937_64 rng(num_markers);
+    std::shuffle(all.begin(), all.end(), rng);
+    all.resize(num_markers);
+    if (sorted) {
+        std::sort(all.begin(), all.end());
+    }
+    return all;
+}
+
+static void BM_fill_ranks_dense_noop(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const auto subset = simulate_subset(num_markers, true);
+    singlepp::SubsetNoop<false, int> sub(subset);
+    const auto vals = simulate_values(num_markers, 1, 42);
+    singlepp::RankedVector<double, int> output;
+    for (auto _ : state) {
+        sub.fill_ranks(vals.data(), output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_fill_ranks_dense_noop)->ArgsProduct({ marker_sweep });
+
+static void BM_fill_ranks_dense_sanitized(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const auto subset = simulate_subset(num_markers, false);
+    singlepp::SubsetSanitizer<false, int> sub(subset);
+    const auto vals = simulate_values(num_markers, 1, 42);
+    singlepp::RankedVector<double, int> output;
+    for (auto _ : state) {
+        sub.fill_ranks(vals.data(), output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_fill_ranks_dense_sanitized)->ArgsProduct({ marker_sweep });
+
+static void BM_fill_ranks_sparse_sanitized(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const double density = state.range(1) / 100.0;
+    const auto subset = simulate_subset(num_markers, false);
+    singlepp::SubsetSanitizer<true, int> sub(subset);
+
+    // Mimicking the output of a sparse extractor on the sorted subset.
+    const auto& extracted = sub.extraction_subset();
+    const auto vals = simulate_values(num_markers, density, 42);
+    std::vector<double> nzvals;
+    std::vector<int> nzidx;
+    for (int m = 0; m < num_markers; ++m) {
+        if (vals[m]) {
+            nzvals.push_back(vals[m]);
+            nzidx.push_back(extracted[m]);
+        }
+    }
+    const tatami::SparseRange<double, int> range(nzvals.size(), nzvals.data(), nzidx.data());
+
+    singlepp::RankedVector<double, int> output;
+    for (auto _ : state) {
+        sub.fill_ranks(range, output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_fill_ranks_sparse_sanitized)->ArgsProduct({ marker_sweep, density_sweep });
@@ -0,0 +1,108 @@
+#include <benchmark/benchmark.h>
+
+#include "singlepp/l2.hpp"
+
+#include "simulate.h"
+
+#include <vector>
+
+static std::vector<double> scale_values(const std::vector<double>& values) {
+    const int num_markers = values.size();
+    auto ranked = rank_values(values.data(), num_markers);
+    std::vector<double> output(num_markers);
+    singlepp::scaled_ranks_dense(num_markers, ranked, output.data());
+    return output;
+}
+
+static singlepp::SparseScaled<int, double> scale_sparse_values(const std::vector<double>& values) {
+    const int num_markers = values.size();
+    auto ranked = rank_sparse_values(values.data(), num_markers);
+    singlepp::SparseScaled<int, double> output;
+    singlepp::scaled_ranks_sparse<int, double, double>(num_markers, ranked.first.begin(), ranked.first.end(), ranked.second.begin(), ranked.second.end(), output);
+    return output;
+}
+
+static void BM_dense_l2(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const auto query = scale_values(simulate_values(num_markers, 1, 42));
+    const auto ref = scale_values(simulate_values(num_markers, 1, 69));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(singlepp::dense_l2(num_markers, query.data(), ref.data()));
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_dense_l2)->ArgsProduct({ marker_sweep });
+
+static void BM_sparse_l2(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const double density = state.range(1) / 100.0;
+    const auto query = scale_values(simulate_values(num_markers, 1, 42));
+    const auto ref = scale_sparse_values(simulate_values(num_markers, density, 69));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(singlepp::sparse_l2(num_markers, query.data(), true, ref));
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_sparse_l2)->ArgsProduct({ marker_sweep, density_sweep });
+
+static void BM_scaled_ranks_dense_l2(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const auto query = scale_values(simulate_values(num_markers, 1, 42));
+    const auto vals = simulate_values(num_markers, 1, 69);
+    const auto ref = rank_values(vals.data(), num_markers);
+    std::vector<double> buffer(num_markers);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(singlepp::scaled_ranks_dense_l2(num_markers, query.data(), ref, buffer.data()));
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_scaled_ranks_dense_l2)->ArgsProduct({ marker_sweep });
+
+// The bound is set to a percentage of the full distance, to see how much is saved by abandoning the calculation early.
+static void BM_scaled_ranks_dense_l2_bounded(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const auto query = scale_values(simulate_values(num_markers, 1, 42));
+    const auto vals = simulate_values(num_markers, 1, 69);
+    const auto ref = rank_values(vals.data(), num_markers);
+    std::vector<double> buffer(num_markers);
+    const double bound = singlepp::scaled_ranks_dense_l2(num_markers, query.data(), ref, buffer.data()) * state.range(1) / 100.0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(singlepp::scaled_ranks_dense_l2(num_markers, query.data(), ref, buffer.data(), bound));
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_scaled_ranks_dense_l2_bounded)->ArgsProduct({ marker_sweep, { 10, 50, 100 } });
+
+static void BM_scaled_ranks_sparse_l2(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const double density = state.range(1) / 100.0;
+    const auto query = scale_values(simulate_values(num_markers, 1, 42));
+    const auto vals = simulate_values(num_markers, density, 69);
+    const auto ref = rank_sparse_values(vals.data(), num_markers);
+    std::vector<std::pair<int, double> > workspace;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(singlepp::scaled_ranks_sparse_l2(num_markers, query.data(), true, ref.first, ref.second, workspace));
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_scaled_ranks_sparse_l2)->ArgsProduct({ marker_sweep, density_sweep });
+
+static void BM_scaled_ranks_sparse_l2_sparse_query(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const double density = state.range(1) / 100.0;
+    const auto query = scale_sparse_values(simulate_values(num_markers, density, 42));
+    const auto vals = simulate_values(num_markers, 1, 69);
+    const auto ref = rank_values(vals.data(), num_markers);
+    std::vector<double> buffer(num_markers);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(singlepp::scaled_ranks_sparse_l2(num_markers, query, ref, buffer.data()));
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_scaled_ranks_sparse_l2_sparse_query)->ArgsProduct({ marker_sweep, density_sweep });
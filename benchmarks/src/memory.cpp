@@ -0,0 +1,283 @@
+// Benchmark of the peak memory usage of train_single(), train_integrated(), classify_single() and classify_integrated().
+// Results are printed to stdout as JSON, while progress messages are printed to stderr.
+//
+// Usage: singlepp_memory [--profiles=1000,10000,100000] [--cells=10000,100000,1000000] [--threads=1] [--genes=2000]
+//            [--labels=10] [--reference=single-cell] [--markers=20] [--library-size=5000] [--block=10000]
+//
+// --profiles is the total number of reference profiles, while --cells is the number of test cells.
+// Classification is performed with a reference containing the smallest number of profiles in --profiles.
+// All other options have the same meaning as in singlepp_scaling.
+//
+// Memory usage is measured by replacing the global allocator with one that counts the number of bytes that are currently allocated.
+// For each step, we report the peak number of bytes allocated during the step, relative to the number of bytes that were allocated before the step;
+// as well as the number of bytes that are still allocated after the step, i.e., the size of the returned object.
+// Input matrices are created before each step and are not included in these counts.
+
+#include "singlepp/singlepp.hpp"
+#include "tatami/tatami.hpp"
+
+#include "simulate_counts.h"
+#include "datasets.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/*** Counting allocator ***/
+
+// GCC complains about the free() in our replacement operator delete when it is inlined into a delete-expression.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<std::size_t> current_bytes(0);
+static std::atomic<std::size_t> peak_bytes(0);
+
+// Each allocation is prefixed with a header that stores its size, so that it can be subtracted upon deallocation.
+// The header is at least as large as the alignment so that the returned pointer has the same alignment as the underlying allocation.
+static void* counted_allocate(std::size_t size, std::size_t alignment) {
+    const std::size_t header = std::max(alignment, alignof(std::max_align_t));
+    void* raw;
+    if (alignment > alignof(std::max_align_t)) {
+        const std::size_t total = (size + header + alignment - 1) / alignment * alignment; // aligned_alloc() requires a multiple of the alignment.
+        raw = std::aligned_alloc(alignment, total);
+    } else {
+        raw = std::malloc(size + header);
+    }
+    if (raw == NULL) {
+        throw std::bad_alloc();
+    }
+
+    const auto now = current_bytes.fetch_add(size) + size;
+    auto old_peak = peak_bytes.load();
+    while (now > old_peak && !peak_bytes.compare_exchange_weak(old_peak, now)) {}
+
+    auto ptr = static_cast<unsigned char*>(raw) + header;
+    *reinterpret_cast<std::size_t*>(ptr - sizeof(std::size_t)) = size;
+    return ptr;
+}
+
+static void counted_deallocate(void* ptr, std::size_t alignment) {
+    if (ptr == NULL) {
+        return;
+    }
+    const std::size_t header = std::max(alignment, alignof(std::max_align_t));
+    auto cptr = static_cast<unsigned char*>(ptr);
+    current_bytes.fetch_sub(*reinterpret_cast<std::size_t*>(cptr - sizeof(std::size_t)));
+    std::free(cptr - header);
+}
+
+void* operator new(std::size_t size) { return counted_allocate(size, alignof(std::max_align_t)); }
+void* operator new[](std::size_t size) { return counted_allocate(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, std::align_val_t al) { return counted_allocate(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al) { return counted_allocate(size, static_cast<std::size_t>(al)); }
+
+void operator delete(void* ptr) noexcept { counted_deallocate(ptr, alignof(std::max_align_t)); }
+void operator delete[](void* ptr) noexcept { counted_deallocate(ptr, alignof(std::max_align_t)); }
+void operator delete(void* ptr, std::size_t) noexcept { counted_deallocate(ptr, alignof(std::max_align_t)); }
+void operator delete[](void* ptr, std::size_t) noexcept { counted_deallocate(ptr, alignof(std::max_align_t)); }
+void operator delete(void* ptr, std::align_val_t al) noexcept { counted_deallocate(ptr, static_cast<std::size_t>(al)); }
+void operator delete[](void* ptr, std::align_val_t al) noexcept { counted_deallocate(ptr, static_cast<std::size_t>(al)); }
+void operator delete(void* ptr, std::size_t, std::align_val_t al) noexcept { counted_deallocate(ptr, static_cast<std::size_t>(al)); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t al) noexcept { counted_deallocate(ptr, static_cast<std::size_t>(al)); }
+
+struct MemoryUsed {
+    std::size_t peak = 0;
+    std::size_t retained = 0;
+};
+
+// Returns the memory used by 'fun', as well as whatever object was returned by 'fun' so that it can be used in later steps.
+template<class Function_>
+auto measure(MemoryUsed& used, Function_ fun) {
+    const auto baseline = current_bytes.load();
+    peak_bytes.store(baseline);
+    auto output = fun();
+    used.peak = peak_bytes.load() - baseline;
+    used.retained = current_bytes.load() - baseline;
+    return output;
+}
+
+/*** Benchmark ***/
+
+struct MemoryOptions {
+    std::vector<int> profiles { 1000, 10000, 100000 };
+    std::vector<int> cells { 10000, 100000, 1000000 };
+    int threads = 1;
+    int genes = 2000;
+    int labels = 10;
+    bool bulk_reference = false;
+    int markers = 20;
+    double library_size = 5000;
+    int block = 10000;
+};
+
+static std::vector<int> parse_list(const std::string& value) {
+    std::vector<int> output;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        output.push_back(std::stoi(item));
+    }
+    return output;
+}
+
+static MemoryOptions parse_options(int argc, char** argv) {
+    MemoryOptions opt;
+    for (int a = 1; a < argc; ++a) {
+        const std::string arg(argv[a]);
+        const auto eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            throw std::runtime_error("expected arguments of the form '--name=value', got '" + arg + "'");
+        }
+        const auto name = arg.substr(2, eq - 2);
+        const auto value = arg.substr(eq + 1);
+
+        if (name == "profiles") {
+            opt.profiles = parse_list(value);
+        } else if (name == "cells") {
+            opt.cells = parse_list(value);
+        } else if (name == "threads") {
+            opt.threads = std::stoi(value);
+        } else if (name == "genes") {
+            opt.genes = std::stoi(value);
+        } else if (name == "labels") {
+            opt.labels = std::stoi(value);
+        } else if (name == "reference") {
+            if (value != "bulk" && value != "single-cell") {
+                throw std::runtime_error("reference should be 'bulk' or 'single-cell'");
+            }
+            opt.bulk_reference = (value == "bulk");
+        } else if (name == "markers") {
+            opt.markers = std::stoi(value);
+        } else if (name == "library-size") {
+            opt.library_size = std::stod(value);
+        } else if (name == "block") {
+            opt.block = std::stoi(value);
+        } else {
+            throw std::runtime_error("unknown argument '" + name + "'");
+        }
+    }
+
+    if (opt.profiles.empty()) {
+        throw std::runtime_error("at least one value should be supplied in 'profiles'");
+    }
+    return opt;
+}
+
+struct Measurement {
+    std::string step;
+    bool ref_sparse;
+    bool test_sparse;
+    int profiles;
+    int cells;
+    MemoryUsed used;
+};
+
+int main(int argc, char** argv) {
+    const auto opt = parse_options(argc, argv);
+
+    SimulateTruthOptions truth_opt;
+    truth_opt.num_genes = opt.genes;
+    truth_opt.num_labels = opt.labels;
+    const auto truth = simulate_truth(truth_opt);
+    const auto markers = simulate_pairwise_markers(truth, opt.markers);
+    const auto pooled = pool_markers(markers);
+    const int smallest = *std::min_element(opt.profiles.begin(), opt.profiles.end());
+
+    std::vector<Measurement> measurements;
+    for (bool ref_sparse : { false, true }) {
+        singlepp::TrainSingleOptions topt;
+        topt.num_threads = opt.threads;
+        singlepp::TrainIntegratedOptions tiopt;
+        tiopt.num_threads = opt.threads;
+
+        for (auto num_profiles : opt.profiles) {
+            std::cerr << "training with " << num_profiles << " " << (ref_sparse ? "sparse" : "dense") << " profiles" << std::endl;
+            const auto ref1 = create_reference(truth, opt.bulk_reference, num_profiles, ref_sparse, 100);
+            const auto ref2 = create_reference(truth, opt.bulk_reference, num_profiles, ref_sparse, 200);
+
+            MemoryUsed single_used;
+            measure(single_used, [&]() { return singlepp::train_single(*(ref1.matrix), ref1.labels.data(), markers, topt); });
+            measurements.push_back(Measurement{ "train_single", ref_sparse, false, num_profiles, 0, single_used });
+
+            std::vector<singlepp::TrainIntegratedInput<double, int, int> > inputs;
+            inputs.push_back(singlepp::prepare_integrated_input(ref1.matrix, ref1.labels.data(), pooled));
+            inputs.push_back(singlepp::prepare_integrated_input(ref2.matrix, ref2.labels.data(), pooled));
+            MemoryUsed integrated_used;
+            measure(integrated_used, [&]() { return singlepp::train_integrated(inputs, tiopt); });
+            measurements.push_back(Measurement{ "train_integrated", ref_sparse, false, num_profiles * 2, 0, integrated_used });
+        }
+
+        // Using the smallest reference for classification, so that the memory usage is dominated by the number of cells.
+        const auto ref1 = create_reference(truth, opt.bulk_reference, smallest, ref_sparse, 100);
+        const auto ref2 = create_reference(truth, opt.bulk_reference, smallest, ref_sparse, 200);
+        const auto trained1 = singlepp::train_single(*(ref1.matrix), ref1.labels.data(), markers, topt);
+        const auto trained2 = singlepp::train_single(*(ref2.matrix), ref2.labels.data(), markers, topt);
+        std::vector<singlepp::TrainIntegratedInput<double, int, int> > inputs;
+        inputs.push_back(singlepp::prepare_integrated_input(ref1.matrix, ref1.labels.data(), pooled));
+        inputs.push_back(singlepp::prepare_integrated_input(ref2.matrix, ref2.labels.data(), pooled));
+        const auto trained_integrated = singlepp::train_integrated(inputs, tiopt);
+
+        for (bool test_sparse : { false, true }) {
+            for (auto num_cells : opt.cells) {
+                std::cerr << "classifying " << num_cells << " " << (test_sparse ? "sparse" : "dense") << " cells" << std::endl;
+                const auto test = create_test(truth, opt.library_size, opt.block, test_sparse, num_cells);
+
+                singlepp::ClassifySingleOptions<double> copt;
+                copt.num_threads = opt.threads;
+                MemoryUsed single_used;
+                const auto assigned1 = measure(single_used, [&]() { return singlepp::classify_single(*test, trained1, copt); }).best;
+                measurements.push_back(Measurement{ "classify_single", ref_sparse, test_sparse, smallest, num_cells, single_used });
+
+                const auto assigned2 = singlepp::classify_single(*test, trained2, copt).best;
+                const std::vector<const int*> assigned { assigned1.data(), assigned2.data() };
+                singlepp::ClassifyIntegratedOptions<double> ciopt;
+                ciopt.num_threads = opt.threads;
+                MemoryUsed integrated_used;
+                measure(integrated_used, [&]() { return singlepp::classify_integrated(*test, assigned, trained_integrated, ciopt); });
+                measurements.push_back(Measurement{ "classify_integrated", ref_sparse, test_sparse, smallest * 2, num_cells, integrated_used });
+            }
+        }
+    }
+
+    std::cout << "{\n";
+    std::cout << "  \"genes\": " << opt.genes << ",\n";
+    std::cout << "  \"labels\": " << opt.labels << ",\n";
+    std::cout << "  \"reference_shape\": \"" << (opt.bulk_reference ? "bulk" : "single-cell") << "\",\n";
+    std::cout << "  \"markers_per_pair\": " << opt.markers << ",\n";
+    std::cout << "  \"library_size\": " << opt.library_size << ",\n";
+    std::cout << "  \"threads\": " << opt.threads << ",\n";
+    std::cout << "  \"results\": [";
+
+    // Training is reported per reference profile, while classification is reported per test cell.
+    const auto num_measurements = measurements.size();
+    for (std::size_t i = 0; i < num_measurements; ++i) {
+        const auto& current = measurements[i];
+        const bool training = (current.cells == 0);
+        const double denom = (training ? current.profiles : current.cells);
+        std::cout << (i ? "," : "") << "\n    {"
+            << "\"step\": \"" << current.step << "\", "
+            << "\"reference\": \"" << (current.ref_sparse ? "sparse" : "dense") << "\", ";
+        if (!training) {
+            std::cout << "\"test\": \"" << (current.test_sparse ? "sparse" : "dense") << "\", ";
+        }
+        std::cout << "\"profiles\": " << current.profiles << ", "
+            << "\"cells\": " << current.cells << ", "
+            << "\"peak_bytes\": " << current.used.peak << ", "
+            << "\"retained_bytes\": " << current.used.retained << ", "
+            << (training ? "\"peak_bytes_per_profile\": " : "\"peak_bytes_per_cell\": ") << current.used.peak / denom << ", "
+            << (training ? "\"retained_bytes_per_profile\": " : "\"retained_bytes_per_cell\": ") << current.used.retained / denom
+            << "}";
+    }
+
+    std::cout << "\n  ]\n}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <benchmark/benchmark.h>
+
+#include "singlepp/scaled_ranks.hpp"
+
+#include "simulate.h"
+
+#include <vector>
+#include <cmath>
+
+static void BM_scaled_ranks_dense(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const auto vals = simulate_values(num_markers, 1, 42);
+    const auto ranked = rank_values(vals.data(), num_markers);
+    std::vector<double> output(num_markers);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(singlepp::scaled_ranks_dense(num_markers, ranked, output.data()));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_scaled_ranks_dense)->ArgsProduct({ marker_sweep });
+
+// Rounding the values to integers, to mimic the many ties in low-coverage count data.
+static void BM_scaled_ranks_dense_ties(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    auto vals = simulate_values(num_markers, 1, 42);
+    for (auto& v : vals) {
+        v = std::round(v * 2);
+    }
+    const auto ranked = rank_values(vals.data(), num_markers);
+    std::vector<double> output(num_markers);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(singlepp::scaled_ranks_dense(num_markers, ranked, output.data()));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_scaled_ranks_dense_ties)->ArgsProduct({ marker_sweep });
+
+static void BM_scaled_ranks_sparse_to_dense(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const double density = state.range(1) / 100.0;
+    const auto vals = simulate_values(num_markers, density, 42);
+    const auto ranked = rank_sparse_values(vals.data(), num_markers);
+    std::vector<std::pair<int, double> > workspace;
+    std::vector<double> output(num_markers);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(singlepp::scaled_ranks_sparse<int, double, double>(
+            num_markers,
+            ranked.first.begin(),
+            ranked.first.end(),
+            ranked.second.begin(),
+            ranked.second.end(),
+            workspace,
+            output.data()
+        ));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_scaled_ranks_sparse_to_dense)->ArgsProduct({ marker_sweep, density_sweep });
+
+static void BM_scaled_ranks_sparse(benchmark::State& state) {
+    const int num_markers = state.range(0);
+    const double density = state.range(1) / 100.0;
+    const auto vals = simulate_values(num_markers, density, 42);
+    const auto ranked = rank_sparse_values(vals.data(), num_markers);
+    singlepp::SparseScaled<int, double> output;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(singlepp::scaled_ranks_sparse<int, double, double>(
+            num_markers,
+            ranked.first.begin(),
+            ranked.first.end(),
+            ranked.second.begin(),
+            ranked.second.end(),
+            output
+        ));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * num_markers);
+}
+
+BENCHMARK(BM_scaled_ranks_sparse)->ArgsProduct({ marker_sweep, density_sweep });
@@ -0,0 +1,312 @@
+// End-to-end benchmark of the thread scaling of classify_single() and classify_integrated().
+// Results are printed to stdout as JSON, while progress messages are printed to stderr.
+//
+// Usage: singlepp_scaling [--cells=10000,100000,1000000] [--threads=N] [--genes=2000] [--labels=10]
+//            [--reference=bulk] [--profiles=20] [--markers=20] [--library-size=5000] [--block=10000] [--repeats=1]
+//
+// --threads is the maximum number of threads, defaulting to the number of hardware threads.
+// Each configuration is run with 1, 2, 4, ... threads up to this maximum.
+// The references are simulated as bulk or single-cell datasets (depending on --reference) with --profiles profiles per label,
+// and --markers is the number of markers for each pairwise comparison.
+// The test datasets are simulated as single-cell data, where --library-size controls the sparsity.
+// The dense and sparse matrices contain the same values so that only the representation differs between them.
+// To avoid allocating a 1M-cell matrix, each test matrix is constructed by binding copies of a block of --block cells.
+// Entries with fine-tuning also report a summary of the fine-tuning statistics, which are collected in a separate untimed run with the maximum number of threads.
+
+#include "singlepp/singlepp.hpp"
+#include "tatami/tatami.hpp"
+
+#include "simulate_counts.h"
+#include "datasets.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <optional>
+
+struct ScalingOptions {
+    std::vector<int> cells { 10000, 100000, 1000000 };
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int genes = 2000;
+    int labels = 10;
+    bool bulk_reference = true;
+    int profiles = 20;
+    int markers = 20;
+    double library_size = 5000;
+    int block = 10000;
+    int repeats = 1;
+};
+
+static ScalingOptions parse_options(int argc, char** argv) {
+    ScalingOptions opt;
+    for (int a = 1; a < argc; ++a) {
+        const std::string arg(argv[a]);
+        const auto eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            throw std::runtime_error("expected arguments of the form '--name=value', got '" + arg + "'");
+        }
+        const auto name = arg.substr(2, eq - 2);
+        const auto value = arg.substr(eq + 1);
+
+        if (name == "cells") {
+            opt.cells.clear();
+            std::stringstream ss(value);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                opt.cells.push_back(std::stoi(item));
+            }
+        } else if (name == "threads") {
+            opt.threads = std::stoi(value);
+        } else if (name == "genes") {
+            opt.genes = std::stoi(value);
+        } else if (name == "labels") {
+            opt.labels = std::stoi(value);
+        } else if (name == "reference") {
+            if (value != "bulk" && value != "single-cell") {
+                throw std::runtime_error("reference should be 'bulk' or 'single-cell'");
+            }
+            opt.bulk_reference = (value == "bulk");
+        } else if (name == "profiles") {
+            opt.profiles = std::stoi(value);
+        } else if (name == "markers") {
+            opt.markers = std::stoi(value);
+        } else if (name == "library-size") {
+            opt.library_size = std::stod(value);
+        } else if (name == "block") {
+            opt.block = std::stoi(value);
+        } else if (name == "repeats") {
+            opt.repeats = std::stoi(value);
+        } else {
+            throw std::runtime_error("unknown argument '" + name + "'");
+        }
+    }
+    return opt;
+}
+
+// Thread counts of 1, 2, 4, ..., up to and including the maximum.
+static std::vector<int> choose_threads(int max_threads) {
+    std::vector<int> output;
+    for (int t = 1; t < max_threads; t *= 2) {
+        output.push_back(t);
+    }
+    output.push_back(max_threads);
+    return output;
+}
+
+template<class Function_>
+double time_best(int repeats, Function_ fun) {
+    double best = std::numeric_limits<double>::infinity();
+    for (int r = 0; r < repeats; ++r) {
+        const auto start = std::chrono::steady_clock::now();
+        fun();
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+struct Timing {
+    std::string method;
+    bool ref_sparse;
+    bool test_sparse;
+    bool fine_tune;
+    int cells;
+    int threads;
+    double seconds;
+    std::optional<singlepp::FineTuneSummary> fine_tune_summary;
+};
+
+// Using the same outputs as the allocating overloads, so that the amount of work is the same as in the timed runs.
+static singlepp::FineTuneSummary summarize_single(
+    const tatami::Matrix<double, int>& test,
+    const singlepp::TrainedSingle<int, double>& trained,
+    singlepp::ClassifySingleOptions<double> options,
+    int num_threads
+) {
+    const auto num_cells = test.ncol();
+    std::vector<int> best(num_cells);
+    std::vector<double> delta(num_cells);
+    std::vector<std::vector<double> > scores(trained.num_labels(), std::vector<double>(num_cells));
+    singlepp::FineTuneStatistics stats;
+
+    singlepp::ClassifySingleBuffers<int, double> buffers;
+    buffers.best = best.data();
+    buffers.delta = delta.data();
+    for (auto& s : scores) {
+        buffers.scores.push_back(s.data());
+    }
+    buffers.fine_tune_statistics = &stats;
+
+    options.num_threads = num_threads;
+    singlepp::classify_single(test, trained, buffers, options);
+    return singlepp::summarize_fine_tune_statistics(stats);
+}
+
+static singlepp::FineTuneSummary summarize_integrated(
+    const tatami::Matrix<double, int>& test,
+    const std::vector<const int*>& assigned,
+    const singlepp::TrainedIntegrated<int>& trained,
+    singlepp::ClassifyIntegratedOptions<double> options,
+    int num_threads
+) {
+    const auto num_cells = test.ncol();
+    std::vector<singlepp::DefaultRefLabel> best(num_cells);
+    std::vector<double> delta(num_cells);
+    std::vector<std::vector<double> > scores(trained.num_references(), std::vector<double>(num_cells));
+    singlepp::FineTuneStatistics stats;
+
+    singlepp::ClassifyIntegratedBuffers<singlepp::DefaultRefLabel, double> buffers;
+    buffers.best = best.data();
+    buffers.delta = delta.data();
+    for (auto& s : scores) {
+        buffers.scores.push_back(s.data());
+    }
+    buffers.fine_tune_statistics = &stats;
+
+    options.num_threads = num_threads;
+    singlepp::classify_integrated(test, assigned, trained, buffers, options);
+    return singlepp::summarize_fine_tune_statistics(stats);
+}
+
+int main(int argc, char** argv) {
+    const auto opt = parse_options(argc, argv);
+    const auto thread_choices = choose_threads(opt.threads);
+
+    SimulateTruthOptions truth_opt;
+    truth_opt.num_genes = opt.genes;
+    truth_opt.num_labels = opt.labels;
+    const auto truth = simulate_truth(truth_opt);
+    const auto markers = simulate_pairwise_markers(truth, opt.markers);
+    const auto pooled = pool_markers(markers);
+
+    std::vector<Timing> timings;
+    for (bool ref_sparse : { false, true }) {
+        std::cerr << "training the " << (ref_sparse ? "sparse" : "dense") << " references" << std::endl;
+
+        // The second reference is only used for integrated classification.
+        const auto ref1 = create_reference(truth, opt.bulk_reference, opt.labels * opt.profiles, ref_sparse, 100);
+        const auto ref2 = create_reference(truth, opt.bulk_reference, opt.labels * opt.profiles, ref_sparse, 200);
+
+        singlepp::TrainSingleOptions topt;
+        topt.num_threads = opt.threads;
+        const auto trained1 = singlepp::train_single(*(ref1.matrix), ref1.labels.data(), markers, topt);
+        const auto trained2 = singlepp::train_single(*(ref2.matrix), ref2.labels.data(), markers, topt);
+
+        std::vector<singlepp::TrainIntegratedInput<double, int, int> > inputs;
+        inputs.push_back(singlepp::prepare_integrated_input(ref1.matrix, ref1.labels.data(), pooled));
+        inputs.push_back(singlepp::prepare_integrated_input(ref2.matrix, ref2.labels.data(), pooled));
+        singlepp::TrainIntegratedOptions tiopt;
+        tiopt.num_threads = opt.threads;
+        const auto trained_integrated = singlepp::train_integrated(inputs, tiopt);
+
+        for (bool test_sparse : { false, true }) {
+            for (auto num_cells : opt.cells) {
+                std::cerr << "classifying " << num_cells << " " << (test_sparse ? "sparse" : "dense") << " cells" << std::endl;
+                const auto test = create_test(truth, opt.library_size, opt.block, test_sparse, num_cells);
+
+                // Assignments for each reference are computed once, as classify_single() is benchmarked separately.
+                singlepp::ClassifySingleOptions<double> aopt;
+                aopt.num_threads = opt.threads;
+                const auto assigned1 = singlepp::classify_single(*test, trained1, aopt).best;
+                const auto assigned2 = singlepp::classify_single(*test, trained2, aopt).best;
+                const std::vector<const int*> assigned { assigned1.data(), assigned2.data() };
+
+                for (bool fine_tune : { false, true }) {
+                    singlepp::ClassifySingleOptions<double> copt;
+                    copt.fine_tune = fine_tune;
+                    singlepp::ClassifyIntegratedOptions<double> ciopt;
+                    ciopt.fine_tune = fine_tune;
+
+                    std::optional<singlepp::FineTuneSummary> single_summary, integrated_summary;
+                    if (fine_tune) {
+                        single_summary = summarize_single(*test, trained1, copt, opt.threads);
+                        integrated_summary = summarize_integrated(*test, assigned, trained_integrated, ciopt, opt.threads);
+                    }
+
+                    for (auto nthreads : thread_choices) {
+                        copt.num_threads = nthreads;
+                        const double single_time = time_best(opt.repeats, [&]() -> void {
+                            singlepp::classify_single(*test, trained1, copt);
+                        });
+                        timings.push_back(Timing{ "single", ref_sparse, test_sparse, fine_tune, num_cells, nthreads, single_time, single_summary });
+
+                        ciopt.num_threads = nthreads;
+                        const double integrated_time = time_best(opt.repeats, [&]() -> void {
+                            singlepp::classify_integrated(*test, assigned, trained_integrated, ciopt);
+                        });
+                        timings.push_back(Timing{ "integrated", ref_sparse, test_sparse, fine_tune, num_cells, nthreads, integrated_time, integrated_summary });
+                    }
+                }
+            }
+        }
+    }
+
+    // Reporting the speed-up and parallel efficiency relative to the single-threaded run of the same configuration.
+    std::cout << "{\n";
+    std::cout << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    std::cout << "  \"genes\": " << opt.genes << ",\n";
+    std::cout << "  \"labels\": " << opt.labels << ",\n";
+    std::cout << "  \"reference_shape\": \"" << (opt.bulk_reference ? "bulk" : "single-cell") << "\",\n";
+    std::cout << "  \"profiles_per_label\": " << opt.profiles << ",\n";
+    std::cout << "  \"markers_per_pair\": " << opt.markers << ",\n";
+    std::cout << "  \"library_size\": " << opt.library_size << ",\n";
+    std::cout << "  \"repeats\": " << opt.repeats << ",\n";
+    std::cout << "  \"results\": [";
+
+    const auto num_timings = timings.size();
+    for (std::size_t i = 0; i < num_timings; ++i) {
+        const auto& current = timings[i];
+        double baseline = current.seconds;
+        for (const auto& other : timings) {
+            if (
+                other.threads == 1 &&
+                other.method == current.method &&
+                other.ref_sparse == current.ref_sparse &&
+                other.test_sparse == current.test_sparse &&
+                other.fine_tune == current.fine_tune &&
+                other.cells == current.cells
+            ) {
+                baseline = other.seconds;
+                break;
+            }
+        }
+
+        const double speedup = baseline / current.seconds;
+        std::cout << (i ? "," : "") << "\n    {"
+            << "\"method\": \"" << current.method << "\", "
+            << "\"reference\": \"" << (current.ref_sparse ? "sparse" : "dense") << "\", "
+            << "\"test\": \"" << (current.test_sparse ? "sparse" : "dense") << "\", "
+            << "\"fine_tune\": " << (current.fine_tune ? "true" : "false") << ", "
+            << "\"cells\": " << current.cells << ", "
+            << "\"threads\": " << current.threads << ", "
+            << "\"seconds\": " << current.seconds << ", "
+            << "\"cells_per_second\": " << current.cells / current.seconds << ", "
+            << "\"speedup\": " << speedup << ", "
+            << "\"efficiency\": " << speedup / current.threads;
+
+        if (current.fine_tune_summary.has_value()) {
+            const auto& summary = *(current.fine_tune_summary);
+            std::cout << ", \"fine_tune_statistics\": {"
+                << "\"total_iterations\": " << summary.total_iterations << ", "
+                << "\"mean_iterations\": " << (summary.num_cells ? static_cast<double>(summary.total_iterations) / summary.num_cells : 0.0) << ", "
+                << "\"max_iterations\": " << summary.max_iterations << ", "
+                << "\"mean_labels\": " << summary.mean_labels << ", "
+                << "\"mean_markers\": " << summary.mean_markers << ", "
+                << "\"profiles_scanned\": " << summary.num_profiles << ", "
+                << "\"seconds\": " << summary.seconds
+                << "}";
+        }
+        std::cout << "}";
+    }
+
+    std::cout << "\n  ]\n}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,91 @@
+#ifndef SINGLEPP_BENCHMARK_SIMULATE_H
+#define SINGLEPP_BENCHMARK_SIMULATE_H
+
+#include "singlepp/scaled_ranks.hpp"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <cstdint>
+
+// Standard normal values where each entry is zero with probability '1 - density'.
+inline std::vector<double> simulate_values(std::size_t n, double density, unsigned long long seed) {
+    std::vector<double> output(n);
+    std::mt19937_64 rng(seed);
+    std::normal_distribution<> ndist;
+    std::uniform_real_distribution<> udist;
+    for (auto& x : output) {
+        if (udist(rng) <= density) {
+            x = ndist(rng);
+        }
+    }
+    return output;
+}
+
+// Centers (in column-major order) for 'num_groups' groups of profiles.
+inline std::vector<double> simulate_centers(int num_genes, int num_groups, unsigned long long seed) {
+    return simulate_values(static_cast<std::size_t>(num_genes) * num_groups, 1, seed);
+}
+
+// Profiles (in column-major order) that are scattered around the 'centers'.
+// This provides some cluster structure for the KMKNN index, which would otherwise be searching uniform noise.
+// If 'groups' is supplied, it is filled with the group of each profile.
+inline std::vector<double> simulate_profiles(int num_genes, int num_samples, const std::vector<double>& centers, double density, unsigned long long seed, std::vector<int>* groups = NULL) {
+    const std::size_t ng = num_genes;
+    const int num_groups = centers.size() / ng;
+    auto output = simulate_values(ng * static_cast<std::size_t>(num_samples), density, seed);
+    if (groups) {
+        groups->resize(num_samples);
+    }
+
+    std::mt19937_64 rng(seed + 1);
+    for (int s = 0; s < num_samples; ++s) {
+        const int chosen = (groups ? s % num_groups : rng() % num_groups); // ensure that all groups are present if they're used as labels.
+        if (groups) {
+            (*groups)[s] = chosen;
+        }
+        const auto cptr = centers.data() + ng * static_cast<std::size_t>(chosen);
+        const auto optr = output.data() + ng * static_cast<std::size_t>(s);
+        for (std::size_t g = 0; g < ng; ++g) {
+            if (optr[g]) { // preserving the sparsity.
+                optr[g] = cptr[g] * 2 + optr[g];
+            }
+        }
+    }
+    return output;
+}
+
+// Ranked vector of all values, as produced by fill_ranks() for a dense input.
+inline singlepp::RankedVector<double, int> rank_values(const double* values, int n) {
+    singlepp::RankedVector<double, int> output;
+    output.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        output.emplace_back(values[i], i);
+    }
+    std::sort(output.begin(), output.end());
+    return output;
+}
+
+// Ranked vectors of the negative and positive values, as stored for sparse references.
+inline std::pair<singlepp::RankedVector<double, int>, singlepp::RankedVector<double, int> > rank_sparse_values(const double* values, int n) {
+    std::pair<singlepp::RankedVector<double, int>, singlepp::RankedVector<double, int> > output;
+    for (int i = 0; i < n; ++i) {
+        if (values[i] < 0) {
+            output.first.emplace_back(values[i], i);
+        } else if (values[i] > 0) {
+            output.second.emplace_back(values[i], i);
+        }
+    }
+    std::sort(output.first.begin(), output.first.end());
+    std::sort(output.second.begin(), output.second.end());
+    return output;
+}
+
+// Sweeps that are shared across all kernels.
+// Densities are reported as percentages as Google Benchmark only accepts integer arguments.
+inline const std::vector<std::int64_t> marker_sweep { 20, 100, 500, 2000, 10000 };
+inline const std::vector<std::int64_t> density_sweep { 1, 5, 20, 50 };
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef SINGLEPP_CLASSIFY_SINGLE_OPTIONS_HPP
+#define SINGLEPP_CLASSIFY_SINGLE_OPTIONS_HPP
+
+#include "defs.hpp"
+
+#include "FineTuneStatistics.hpp"
+#include "Tracer.hpp"
+#include "SearchCounters.hpp"
+#include "fixed_point_scores.hpp"
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @file ClassifySingleOptions.hpp
+ * @brief Options and output buffers for `classify_single()`.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Options for `classify_single()` and friends.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ */
+template<typename Float_ = DefaultFloat>
+struct ClassifySingleOptions {
+    /**
+     * Quantile probability in [0, 1].
+     * This is used to define a per-label score for each test cell,
+     * by applying it to the distribution of correlations between the test cell and that label's reference profiles.
+     * A value closer to 0.5 focuses on the behavior of the majority of a label's reference profiles.
+     * A smaller value will be more sensitive to the presence of a subset of profiles that are more similar to the test cell,
+     * which can be useful when the reference profiles themselves are heterogeneous.
+     */
+    Float_ quantile = 0.8;
+
+    /**
+     * Score threshold to use to select the top-scoring subset of labels during fine-tuning.
+     * Larger values increase the chance of recovering the correct label at the cost of computational time.
+     *
+     * This threshold should not be set to to a value that is too large.
+     * Otherwise, the first fine-tuning iteration would just contain all labels and there would be no reduction of the marker space.
+     */
+    Float_ fine_tune_threshold = 0.05;
+
+    /**
+     * Whether to perform fine-tuning.
+     * This can be disabled to improve speed at the cost of accuracy.
+     */
+    bool fine_tune = true;
+
+    /**
+     * Maximum size of the per-thread cache for fine-tuning, in bytes.
+     * In each fine-tuning iteration, the reference ranks for the remaining labels are cached after filtering to the current set of markers.
+     * The next iteration can then filter the smaller cache instead of the full set of reference ranks.
+     * If the cache would exceed this size, fine-tuning falls back to the cache from an earlier iteration or the full reference ranks.
+     * Setting this to zero will disable caching altogether; this has no effect on the results.
+     * Only relevant if `ClassifySingleOptions::fine_tune = true`.
+     */
+    std::size_t fine_tune_cache_size = 16777216;
+
+    /**
+     * Maximum size of the marker bitsets for fine-tuning, in bytes.
+     * Each pair of labels is associated with a bitset of their markers, and the markers for the labels in each fine-tuning iteration are obtained by OR-ing the relevant bitsets.
+     * This is faster than collecting the markers from each pair of labels, especially for references with many labels.
+     * If the bitsets would exceed this size, we fall back to collecting the markers directly.
+     * This has no effect on the results.
+     * Only relevant if `ClassifySingleOptions::fine_tune = true`.
+     */
+    std::size_t fine_tune_bitset_limit = 67108864;
+
+    /**
+     * Whether to prune labels during the initial search when no per-label scores are requested,
+     * i.e., all pointers in `ClassifySingleBuffers::scores` are `NULL`, no top labels are requested in `ClassifySingleBuffers::top_k`,
+     * and both `ClassifySingleBuffers::cell_major_scores` and `ClassifySingleBuffers::cell_major_fixed_scores` are `NULL`.
+     * In such cases, we only need to compute the exact scores for labels that could affect the assigned label and its delta.
+     * We compute an upper bound on each label's score from the distances between the test cell and the seeds of that label's neighbor search index,
+     * and we skip the neighbor search for labels whose upper bound is below the second-highest score (or outside the range of the fine-tuning threshold, if fine-tuning is performed).
+     * This can greatly reduce the computational time for references with many labels, and has no effect on the results.
+     */
+    bool prune_labels = true;
+
+    /**
+     * Pointer to a `Tracer` in which to record the time spent in each phase of classification.
+     * Each thread reports a `classify_single` event with the total time spent in extraction, ranking, neighbor search and fine-tuning for its cells.
+     * This may be `NULL` in which case no timings are recorded.
+     */
+    Tracer* tracer = NULL;
+
+    /**
+     * Number of threads to use.
+     * The parallelization scheme is determined by `tatami::parallelize()`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @brief Output buffers for `classify_single()`.
+ * @tparam Label_ Integer type for the reference labels.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ */
+template<typename Label_ = DefaultLabel, typename Float_ = DefaultFloat>
+struct ClassifySingleBuffers {
+    /** 
+     * Pointer to an array of length equal to the number of test cells.
+     * On output, this is filled with the index of the assigned label for each cell.
+     */
+    Label_* best;
+
+    /** 
+     * Vector of length equal to the number of labels.
+     * Each entry contains a pointer to an array of length equal to the number of test cells.
+     * On output, this is filled with the (non-fine-tuned) score for each label for each cell.
+     * Any pointer may be `NULL` in which case the scores for that label will not be reported.
+     */
+    std::vector<Float_*> scores;
+
+    /**
+     * Pointer to an array of length equal to the number of test cells.
+     * On output, this is filled with the difference between the highest and second-highest scores, possibly after fine-tuning.
+     * This may also be `NULL` in which case the deltas are not reported.
+     */
+    Float_* delta;
+
+    /**
+     * Number of top-scoring labels to report for each cell in `ClassifySingleBuffers::top_labels` and `ClassifySingleBuffers::top_scores`.
+     * This provides a compact alternative to `ClassifySingleBuffers::scores` when only the best few labels are of interest,
+     * as the memory usage does not depend on the number of labels.
+     * If this is greater than the number of labels, only the first `num_labels` entries for each cell are filled.
+     */
+    std::size_t top_k = 0;
+
+    /**
+     * Pointer to an array of length equal to the product of `ClassifySingleBuffers::top_k` and the number of test cells.
+     * On output, the `top_k` entries starting at `c * top_k` contain the indices of the top-scoring labels for cell `c`, in decreasing order of their (non-fine-tuned) scores.
+     * Ties are broken by choosing the label with the lower index.
+     * This may be `NULL` in which case the top labels are not reported.
+     */
+    Label_* top_labels = NULL;
+
+    /**
+     * Pointer to an array of length equal to the product of `ClassifySingleBuffers::top_k` and the number of test cells.
+     * On output, the `top_k` entries starting at `c * top_k` contain the (non-fine-tuned) scores for the corresponding labels in `ClassifySingleBuffers::top_labels`.
+     * This may be `NULL` in which case the top scores are not reported.
+     */
+    Float_* top_scores = NULL;
+
+    /**
+     * Pointer to a cell-major array of length equal to the product of the number of test cells and the number of labels.
+     * On output, the `num_labels` entries starting at `c * num_labels` contain the (non-fine-tuned) scores for all labels in cell `c`.
+     * This is an alternative to `ClassifySingleBuffers::scores` that writes a single contiguous row per cell, which is more cache-friendly and easier to pass to downstream tools.
+     * Single-precision output also halves the memory usage when `Float_` is `double`.
+     * This may be `NULL` in which case the cell-major scores are not reported.
+     */
+    float* cell_major_scores = NULL;
+
+    /**
+     * Pointer to a cell-major array of length equal to the product of the number of test cells and the number of labels.
+     * This is the same as `ClassifySingleBuffers::cell_major_scores` except that each score is stored in a 16-bit fixed-point encoding, see `encode_fixed_point_score()` for details.
+     * This may be `NULL` in which case the fixed-point scores are not reported.
+     */
+    FixedPointScore* cell_major_fixed_scores = NULL;
+
+    /**
+     * Pointer to a `FineTuneStatistics` object.
+     * On output, this is filled with statistics for the fine-tuning iterations of each cell.
+     * If `ClassifySingleOptions::fine_tune = false`, the number of iterations is reported as zero for all cells.
+     * This may also be `NULL` in which case no statistics are collected, avoiding any overhead.
+     */
+    FineTuneStatistics* fine_tune_statistics = NULL;
+
+    /**
+     * Pointer to a vector of `SearchCounters`.
+     * On output, this is resized to the number of labels and each entry is filled with the counters for the neighbor search of that label, summed across all test cells.
+     * This may also be `NULL` in which case no counters are collected, avoiding any overhead.
+     */
+    std::vector<SearchCounters>* search_counters = NULL;
+};
+
+}
+
+#endif
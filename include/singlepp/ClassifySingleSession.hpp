@@ -0,0 +1,127 @@
+#ifndef SINGLEPP_CLASSIFY_SINGLE_SESSION_HPP
+#define SINGLEPP_CLASSIFY_SINGLE_SESSION_HPP
+
+#include "defs.hpp"
+
+#include "tatami/tatami.hpp"
+
+#include "classify_single.hpp"
+#include "SingleClassifier.hpp"
+#include "WorkerPool.hpp"
+#include "train_single.hpp"
+
+#include <vector>
+
+/**
+ * @file ClassifySingleSession.hpp
+ * @brief Repeated classification against a single reference.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Session for repeated classification against a single reference.
+ *
+ * This owns a persistent `WorkerPool` and a `SingleClassifier` that uses it.
+ * All per-call setup in `classify_single()` - computing the quantile details, building the marker bitsets, spawning threads,
+ * and allocating the per-thread workspaces for the neighbor search and fine-tuning - is performed once and re-used in every call.
+ * This is most useful for services that classify many small batches of cells against the same reference,
+ * where the setup would otherwise be a substantial fraction of the runtime.
+ * The results are identical to those from `classify_single()` with the same options.
+ *
+ * The session holds a reference to the `TrainedSingle` object, which should outlive the session.
+ * A single session should not be used concurrently from multiple threads.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the reference labels.
+ */
+template<typename Value_ = DefaultValue, typename Index_ = DefaultIndex, typename Float_ = DefaultFloat, typename Label_ = DefaultLabel>
+class ClassifySingleSession {
+public:
+    /**
+     * @param trained Classifier returned by `train_single()`.
+     * @param options Further options.
+     * `ClassifySingleOptions::num_threads` is used to define the number of threads in the pool.
+     * If `ClassifySingleOptions::tracer` is supplied, events are recorded for each call to `classify()`.
+     */
+    ClassifySingleSession(const TrainedSingle<Index_, Float_>& trained, const ClassifySingleOptions<Float_>& options) :
+        my_num_labels(trained.num_labels()),
+        my_pool(options.num_threads),
+        my_classifier(trained, options, &my_pool)
+    {}
+
+private:
+    std::size_t my_num_labels;
+    WorkerPool my_pool;
+    SingleClassifier<Value_, Index_, Float_, Label_> my_classifier;
+
+public:
+    /**
+     * Classify all cells in a test matrix, see `classify_single()` for details.
+     *
+     * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+     * This should have the same order and identity of genes as the reference matrix used to create `trained`.
+     * @param[out] buffers Buffers in which to store the classification output.
+     * Each non-`NULL` pointer should refer to an array of length equal to the number of columns in `test`.
+     */
+    void classify(const tatami::Matrix<Value_, Index_>& test, const ClassifySingleBuffers<Label_, Float_>& buffers) {
+        my_classifier.classify(test, buffers);
+    }
+
+    /**
+     * Overload of `classify()` that allocates space for the output statistics.
+     *
+     * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+     * This should have the same order and identity of genes as the reference matrix used to create `trained`.
+     * @return Results of the classification for each cell in the test dataset.
+     */
+    ClassifySingleResults<Label_, Float_> classify(const tatami::Matrix<Value_, Index_>& test) {
+        ClassifySingleResults<Label_, Float_> output(test.ncol(), my_num_labels);
+
+        ClassifySingleBuffers<Label_, Float_> buffers;
+        buffers.best = output.best.data();
+        buffers.delta = output.delta.data();
+        buffers.scores.reserve(output.scores.size());
+        for (auto& s : output.scores) {
+            buffers.scores.emplace_back(s.data());
+        }
+
+        classify(test, buffers);
+        return output;
+    }
+
+    /**
+     * Classify cells from a dense column-major array, see `SingleClassifier::classify_dense()` for details.
+     *
+     * @param num_cells Number of cells.
+     * @param[in] values Pointer to a column-major array of expression values, with number of rows equal to `TrainedSingle::test_nrow()` and number of columns equal to `num_cells`.
+     * @param[out] buffers Buffers in which to store the classification output.
+     * Each non-`NULL` pointer should refer to an array of length equal to `num_cells`.
+     */
+    void classify_dense(const Index_ num_cells, const Value_* values, const ClassifySingleBuffers<Label_, Float_>& buffers) {
+        my_classifier.classify_dense(num_cells, values, buffers);
+    }
+
+    /**
+     * Classify cells from compressed sparse column buffers, see `SingleClassifier::classify_sparse()` for details.
+     *
+     * @tparam Pointer_ Integer type for the column pointers.
+     *
+     * @param num_cells Number of cells.
+     * @param[in] indptrs Pointer to an array of length `num_cells + 1`, containing the column pointers.
+     * @param[in] indices Pointer to an array of row indices for the structural non-zero elements.
+     * @param[in] values Pointer to an array of expression values for the structural non-zero elements.
+     * @param[out] buffers Buffers in which to store the classification output.
+     * Each non-`NULL` pointer should refer to an array of length equal to `num_cells`.
+     */
+    template<typename Pointer_>
+    void classify_sparse(const Index_ num_cells, const Pointer_* indptrs, const Index_* indices, const Value_* values, const ClassifySingleBuffers<Label_, Float_>& buffers) {
+        my_classifier.classify_sparse(num_cells, indptrs, indices, values, buffers);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef SINGLEPP_FINE_TUNE_STATISTICS_HPP
+#define SINGLEPP_FINE_TUNE_STATISTICS_HPP
+
+#include "utils.hpp"
+
+#include "sanisizer/sanisizer.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <chrono>
+#include <algorithm>
+#include <optional>
+
+/**
+ * @file FineTuneStatistics.hpp
+ * @brief Statistics for the fine-tuning iterations.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Statistics for the fine-tuning iterations.
+ *
+ * This is used to diagnose the computational cost of fine-tuning in `classify_single()` and `classify_integrated()`.
+ * Most of the classification time is usually spent in fine-tuning, especially for test cells with many similarly-scoring labels.
+ */
+struct FineTuneStatistics {
+    /**
+     * Vector of length equal to the number of test cells, containing the number of fine-tuning iterations for each cell.
+     * This is zero for cells where fine-tuning terminated immediately, e.g., because only one label was above the threshold.
+     */
+    std::vector<std::size_t> num_iterations;
+
+    /**
+     * Vector of length equal to the total number of iterations across all cells.
+     * Each entry contains the number of labels (or references, for `classify_integrated()`) that were considered in an iteration.
+     * The iterations for the first cell are stored first, followed by the iterations for the second cell, and so on.
+     */
+    std::vector<std::size_t> num_labels;
+
+    /**
+     * Vector of length equal to the total number of iterations across all cells.
+     * Each entry contains the number of marker genes that were used to compute correlations in an iteration.
+     * Entries are ordered in the same manner as `num_labels`.
+     */
+    std::vector<std::size_t> num_markers;
+
+    /**
+     * Total number of reference profiles that were compared to test cells in all fine-tuning iterations.
+     */
+    std::size_t num_profiles = 0;
+
+    /**
+     * Total time spent in fine-tuning, in seconds.
+     * This is summed across all threads and so may be greater than the wall-clock time.
+     */
+    double seconds = 0;
+};
+
+/**
+ * @brief Summary of the fine-tuning statistics.
+ */
+struct FineTuneSummary {
+    /**
+     * Number of test cells.
+     */
+    std::size_t num_cells = 0;
+
+    /**
+     * Total number of fine-tuning iterations across all cells.
+     */
+    std::size_t total_iterations = 0;
+
+    /**
+     * Maximum number of iterations for any cell.
+     */
+    std::size_t max_iterations = 0;
+
+    /**
+     * Mean number of labels per iteration.
+     */
+    double mean_labels = 0;
+
+    /**
+     * Mean number of marker genes per iteration.
+     */
+    double mean_markers = 0;
+
+    /**
+     * Total number of reference profiles compared in all iterations, see `FineTuneStatistics::num_profiles`.
+     */
+    std::size_t num_profiles = 0;
+
+    /**
+     * Total time spent in fine-tuning, see `FineTuneStatistics::seconds`.
+     */
+    double seconds = 0;
+};
+
+/**
+ * @param stats Statistics from fine-tuning.
+ * @return Summary of the statistics across all cells and iterations.
+ */
+inline FineTuneSummary summarize_fine_tune_statistics(const FineTuneStatistics& stats) {
+    FineTuneSummary output;
+    output.num_cells = stats.num_iterations.size();
+    for (auto n : stats.num_iterations) {
+        output.total_iterations += n;
+        output.max_iterations = std::max(output.max_iterations, n);
+    }
+
+    const auto num_total = stats.num_labels.size();
+    if (num_total) {
+        double total_labels = 0, total_markers = 0;
+        for (I<decltype(num_total)> i = 0; i < num_total; ++i) {
+            total_labels += stats.num_labels[i];
+            total_markers += stats.num_markers[i];
+        }
+        output.mean_labels = total_labels / num_total;
+        output.mean_markers = total_markers / num_total;
+    }
+
+    output.num_profiles = stats.num_profiles;
+    output.seconds = stats.seconds;
+    return output;
+}
+
+/**
+ * @cond
+ */
+// Records the statistics for the cells processed by a single thread.
+class FineTuneRecorder {
+public:
+    static constexpr bool enabled = true;
+
+    void start_cell() {
+        num_iterations.push_back(0);
+        my_start = std::chrono::steady_clock::now();
+    }
+
+    void add_iteration(const std::size_t labels, const std::size_t markers, const std::size_t profiles) {
+        ++(num_iterations.back());
+        num_labels.push_back(labels);
+        num_markers.push_back(markers);
+        num_profiles += profiles;
+    }
+
+    void finish_cell() {
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - my_start).count();
+    }
+
+    // Resets the statistics while retaining the allocated buffers, so that the recorder can be re-used.
+    void clear() {
+        num_iterations.clear();
+        num_labels.clear();
+        num_markers.clear();
+        num_profiles = 0;
+        seconds = 0;
+    }
+
+public:
+    std::vector<std::size_t> num_iterations;
+    std::vector<std::size_t> num_labels;
+    std::vector<std::size_t> num_markers;
+    std::size_t num_profiles = 0;
+    double seconds = 0;
+
+private:
+    std::chrono::steady_clock::time_point my_start;
+};
+
+// Used when statistics are not requested, so that all recording calls compile to nothing.
+class NoopFineTuneRecorder {
+public:
+    static constexpr bool enabled = false;
+    void start_cell() {}
+    void add_iteration(std::size_t, std::size_t, std::size_t) {}
+    void finish_cell() {}
+};
+
+// Combine the per-thread recorders into the final statistics.
+// 'starts' should contain the first cell processed by each thread, while 'recorders' should contain the corresponding recorders.
+template<typename Index_>
+void merge_fine_tune_recorders(const std::vector<Index_>& starts, std::vector<std::optional<FineTuneRecorder> >& recorders, FineTuneStatistics& output) {
+    const auto num_threads = recorders.size();
+    std::vector<std::pair<Index_, I<decltype(num_threads)> > > order;
+    order.reserve(num_threads);
+    for (I<decltype(num_threads)> t = 0; t < num_threads; ++t) {
+        if (recorders[t].has_value()) {
+            order.emplace_back(starts[t], t);
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    output.num_iterations.clear();
+    output.num_labels.clear();
+    output.num_markers.clear();
+    output.num_profiles = 0;
+    output.seconds = 0;
+
+    for (const auto& o : order) {
+        const auto& rec = *(recorders[o.second]);
+        output.num_iterations.insert(output.num_iterations.end(), rec.num_iterations.begin(), rec.num_iterations.end());
+        output.num_labels.insert(output.num_labels.end(), rec.num_labels.begin(), rec.num_labels.end());
+        output.num_markers.insert(output.num_markers.end(), rec.num_markers.begin(), rec.num_markers.end());
+        output.num_profiles += rec.num_profiles;
+        output.seconds += rec.seconds;
+    }
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef SINGLEPP_MARKER_BITSETS_HPP
+#define SINGLEPP_MARKER_BITSETS_HPP
+
+#include "Markers.hpp"
+#include "utils.hpp"
+
+#include "sanisizer/sanisizer.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cassert>
+
+namespace singlepp {
+
+/*
+ * This class stores the markers for each pair of labels as a bitset over the (subsetted) marker genes.
+ * For a pair of labels (l, l2), the bitset contains the union of the markers for l over l2 and for l2 over l.
+ * The union of markers for a set of labels can then be obtained by OR-ing the bitsets for all pairs of labels in that set,
+ * which is faster than looping over each pair and adding each marker to the SubsetRemapper.
+ * Only the pairs with l <= l2 are stored, in a lower triangular layout.
+ */
+template<typename Index_>
+class MarkerBitsets {
+private:
+    std::size_t my_num_words;
+    std::vector<std::uint64_t> my_words;
+
+    static std::size_t pair_offset(const std::size_t l, const std::size_t l2) {
+        assert(l <= l2);
+        return l2 * (l2 + 1) / 2 + l;
+    }
+
+public:
+    static std::size_t compute_num_words(const Index_ num_markers) {
+        return sanisizer::sum<std::size_t>(num_markers, 63) / 64;
+    }
+
+    // Check whether the bitsets would fit within 'limit' bytes, without overflowing.
+    static bool fits(const std::size_t num_labels, const Index_ num_markers, const std::size_t limit) {
+        const auto num_words = compute_num_words(num_markers);
+        if (num_words == 0) {
+            return true;
+        }
+        const auto max_pairs = limit / sizeof(std::uint64_t) / num_words;
+        if (num_labels > max_pairs) { // protect the multiplication below.
+            return false;
+        }
+        return num_labels * (num_labels + 1) / 2 <= max_pairs;
+    }
+
+    MarkerBitsets(const Index_ num_markers, const FlatPairwiseMarkers<Index_>& markers) : my_num_words(compute_num_words(num_markers)) {
+        const auto num_labels = markers.num_labels();
+        const auto num_pairs = sanisizer::product<std::size_t>(num_labels, sanisizer::sum<std::size_t>(num_labels, 1)) / 2;
+        my_words.resize(sanisizer::product<I<decltype(my_words.size())> >(num_pairs, my_num_words));
+
+        for (I<decltype(num_labels)> l = 0; l < num_labels; ++l) {
+            for (I<decltype(num_labels)> l2 = 0; l2 < num_labels; ++l2) {
+                const auto start = my_words.data() + pair_offset(std::min(l, l2), std::max(l, l2)) * my_num_words;
+                for (auto mIt = markers.begin(l, l2), mEnd = markers.end(l, l2); mIt != mEnd; ++mIt) {
+                    const auto m = *mIt;
+                    assert(m < num_markers);
+                    start[m / 64] |= static_cast<std::uint64_t>(1) << (m % 64);
+                }
+            }
+        }
+    }
+
+    std::size_t num_words() const {
+        return my_num_words;
+    }
+
+    // Fill 'output' with the union of markers for all pairs of labels in 'in_use', including the diagonal.
+    template<typename Label_>
+    void fill(const std::vector<Label_>& in_use, std::vector<std::uint64_t>& output) const {
+        output.clear();
+        output.resize(my_num_words);
+        const auto num_used = in_use.size();
+        for (I<decltype(num_used)> i = 0; i < num_used; ++i) {
+            const std::size_t l = in_use[i];
+            for (I<decltype(num_used)> j = 0; j <= i; ++j) {
+                const std::size_t l2 = in_use[j];
+                const auto start = my_words.data() + pair_offset(std::min(l, l2), std::max(l, l2)) * my_num_words;
+                for (I<decltype(my_num_words)> w = 0; w < my_num_words; ++w) {
+                    output[w] |= start[w];
+                }
+            }
+        }
+    }
+};
+
+}
+
+#endif
@@ -3,12 +3,16 @@
 
 #include "defs.hpp"
 
+#include "sanisizer/sanisizer.hpp"
+
 #include <vector>
+#include <cstddef>
+#include <stdexcept>
 
 /**
  * @file Markers.hpp
  *
- * @brief Define type aliases for marker lists.
+ * @brief Define types for marker lists.
  */
 
 namespace singlepp {
@@ -38,6 +42,164 @@ namespace singlepp {
 template<typename Index_ = DefaultIndex>
 using PairwiseMarkers = std::vector<std::vector<std::vector<Index_> > >;
 
+/**
+ * @brief Flattened representation of the pairwise marker lists.
+ *
+ * This contains the same information as a `PairwiseMarkers` object, but stores all marker lists in a single array of indices.
+ * The markers for label `i` compared to label `j` are stored in `indices()[offsets()[i * L + j]]` to `indices()[offsets()[i * L + j + 1] - 1]`,
+ * where $L$ is the number of labels.
+ * This avoids allocating a separate vector for each pair of labels, which is more efficient for references with many labels.
+ * See `PairwiseMarkers` for the interpretation of each marker list.
+ *
+ * @tparam Index_ Integer type for the gene (row) indices.
+ */
+template<typename Index_ = DefaultIndex>
+class FlatPairwiseMarkers {
+public:
+    /**
+     * Default constructor, for a marker set with no labels.
+     */
+    FlatPairwiseMarkers() : my_offsets(1) {}
+
+    /**
+     * @param num_labels Number of labels $L$.
+     * @param indices Vector containing the concatenated marker lists for all pairs of labels.
+     * @param offsets Vector of length $L^2 + 1$, containing the offsets for each pair of labels as described above.
+     * The first entry should be zero, entries should be non-decreasing, and the last entry should be equal to the length of `indices`.
+     */
+    FlatPairwiseMarkers(const std::size_t num_labels, std::vector<Index_> indices, std::vector<std::size_t> offsets) :
+        my_num_labels(num_labels),
+        my_indices(std::move(indices)),
+        my_offsets(std::move(offsets))
+    {
+        const auto num_pairs = sanisizer::product<std::size_t>(num_labels, num_labels);
+        if (!sanisizer::is_equal(my_offsets.size(), sanisizer::sum<std::size_t>(num_pairs, 1))) {
+            throw std::runtime_error("length of 'offsets' should be equal to the square of the number of labels plus 1");
+        }
+        if (my_offsets.front() != 0 || !sanisizer::is_equal(my_offsets.back(), my_indices.size())) {
+            throw std::runtime_error("first and last entries of 'offsets' should be equal to zero and the length of 'indices', respectively");
+        }
+        for (std::size_t p = 0; p < num_pairs; ++p) {
+            if (my_offsets[p] > my_offsets[p + 1]) {
+                throw std::runtime_error("entries of 'offsets' should be non-decreasing");
+            }
+        }
+    }
+
+    /**
+     * @param markers Nested vectors of marker lists for each pair of labels.
+     * The length of each `markers[i]` should be equal to the length of `markers`.
+     */
+    explicit FlatPairwiseMarkers(const PairwiseMarkers<Index_>& markers) : my_num_labels(markers.size()) {
+        const auto num_pairs = sanisizer::product<std::size_t>(my_num_labels, my_num_labels);
+        sanisizer::reserve(my_offsets, sanisizer::sum<std::size_t>(num_pairs, 1));
+        my_offsets.push_back(0);
+
+        std::size_t total = 0;
+        for (const auto& mrk : markers) {
+            if (!sanisizer::is_equal(mrk.size(), my_num_labels)) {
+                throw std::runtime_error("length of each entry of 'markers' should be equal to the number of unique labels");
+            }
+            for (const auto& mm : mrk) {
+                total = sanisizer::sum<std::size_t>(total, mm.size());
+                my_offsets.push_back(total);
+            }
+        }
+
+        sanisizer::reserve(my_indices, total);
+        for (const auto& mrk : markers) {
+            for (const auto& mm : mrk) {
+                my_indices.insert(my_indices.end(), mm.begin(), mm.end());
+            }
+        }
+    }
+
+private:
+    std::size_t my_num_labels = 0;
+    std::vector<Index_> my_indices;
+    std::vector<std::size_t> my_offsets;
+
+public:
+    /**
+     * @return Number of labels.
+     */
+    std::size_t num_labels() const {
+        return my_num_labels;
+    }
+
+    /**
+     * @return Concatenated marker lists for all pairs of labels.
+     */
+    const std::vector<Index_>& indices() const {
+        return my_indices;
+    }
+
+    /**
+     * @return Offsets of the marker list for each pair of labels in `indices()`.
+     */
+    const std::vector<std::size_t>& offsets() const {
+        return my_offsets;
+    }
+
+    /**
+     * @param i Index of the first label.
+     * @param j Index of the second label.
+     * @return Pointer to the start of the marker list for label `i` compared to label `j`.
+     */
+    const Index_* begin(const std::size_t i, const std::size_t j) const {
+        return my_indices.data() + my_offsets[i * my_num_labels + j];
+    }
+
+    /**
+     * @param i Index of the first label.
+     * @param j Index of the second label.
+     * @return Pointer to the end of the marker list for label `i` compared to label `j`.
+     */
+    const Index_* end(const std::size_t i, const std::size_t j) const {
+        return my_indices.data() + my_offsets[i * my_num_labels + j + 1];
+    }
+
+    /**
+     * @param i Index of the first label.
+     * @param j Index of the second label.
+     * @return Number of markers for label `i` compared to label `j`.
+     */
+    std::size_t size(const std::size_t i, const std::size_t j) const {
+        const auto p = i * my_num_labels + j;
+        return my_offsets[p + 1] - my_offsets[p];
+    }
+
+    /**
+     * @return The marker lists in the nested `PairwiseMarkers` representation.
+     */
+    PairwiseMarkers<Index_> to_nested() const {
+        auto output = sanisizer::create<PairwiseMarkers<Index_> >(my_num_labels);
+        for (std::size_t i = 0; i < my_num_labels; ++i) {
+            auto& current = output[i];
+            sanisizer::resize(current, my_num_labels);
+            for (std::size_t j = 0; j < my_num_labels; ++j) {
+                current[j].insert(current[j].end(), begin(i, j), end(i, j));
+            }
+        }
+        return output;
+    }
+
+    /**
+     * @cond
+     */
+    // For internal use only, when the indices need to be remapped or filtered in place.
+    std::vector<Index_>& mutable_indices() {
+        return my_indices;
+    }
+
+    std::vector<std::size_t>& mutable_offsets() {
+        return my_offsets;
+    }
+    /**
+     * @endcond
+     */
+};
+
 /**
  * Vector of marker lists, with one list for each label in the reference dataset.
  * This is used to determine which genes should be used to compute correlations in `train_integrated()`. 
@@ -0,0 +1,148 @@
+#ifndef SINGLEPP_MEMORY_USAGE_HPP
+#define SINGLEPP_MEMORY_USAGE_HPP
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @file MemoryUsage.hpp
+ * @brief Memory usage of trained classifiers.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Memory usage of the data structures for a single label.
+ *
+ * All values are reported in bytes, based on the capacity of each allocation.
+ * This does not include any overhead from the allocator itself.
+ * Fields that are not relevant to a particular classifier (e.g., `value` and `index` for a dense reference) are set to zero.
+ */
+struct LabelMemoryUsage {
+    /**
+     * Scaled ranks for the reference profiles in a dense reference, including the flags for non-zero profiles.
+     */
+    std::size_t data = 0;
+
+    /**
+     * Values of the scaled ranks for the reference profiles in a sparse reference, including the values for the zeros.
+     */
+    std::size_t value = 0;
+
+    /**
+     * Row indices of the non-zero scaled ranks in a sparse reference.
+     */
+    std::size_t index = 0;
+
+    /**
+     * Pointers to the start of each profile in `value` and `index` for a sparse reference.
+     */
+    std::size_t indptrs = 0;
+
+    /**
+     * Ranked expression values for each reference profile, used for fine-tuning.
+     * For sparse references, this includes the separate rankings of negative and positive values and their pointers.
+     */
+    std::size_t ranked = 0;
+
+    /**
+     * Distances from each profile to its seed in the neighbor search index.
+     */
+    std::size_t distances = 0;
+
+    /**
+     * Ranges of profiles assigned to each seed in the neighbor search index.
+     */
+    std::size_t seed_ranges = 0;
+
+    /**
+     * Marker genes for this label.
+     * Only used by `TrainedIntegrated`, see `MemoryUsage::markers` for `TrainedSingle`.
+     */
+    std::size_t markers = 0;
+
+    /**
+     * @return Total memory usage for this label.
+     */
+    std::size_t total() const {
+        return data + value + index + indptrs + ranked + distances + seed_ranges + markers;
+    }
+};
+
+/**
+ * @brief Memory usage of a trained classifier.
+ *
+ * All values are reported in bytes, based on the capacity of each allocation.
+ * This does not include any overhead from the allocator itself, or the size of the classifier object.
+ */
+struct MemoryUsage {
+    /**
+     * Vector of length equal to the number of labels, containing the memory usage for each label.
+     */
+    std::vector<LabelMemoryUsage> labels;
+
+    /**
+     * Pairwise marker genes across all labels.
+     */
+    std::size_t markers = 0;
+
+    /**
+     * Subset of genes used for classification.
+     */
+    std::size_t subset = 0;
+
+    /**
+     * @return Total memory usage across all labels, markers and the subset.
+     */
+    std::size_t total() const {
+        std::size_t output = markers + subset;
+        for (const auto& lab : labels) {
+            output += lab.total();
+        }
+        return output;
+    }
+};
+
+/**
+ * @brief Memory usage of a classifier for multiple references.
+ *
+ * All values are reported in bytes, as described for `MemoryUsage`.
+ */
+struct IntegratedMemoryUsage {
+    /**
+     * Vector of length equal to the number of references, containing the memory usage of each reference.
+     * For each reference, `MemoryUsage::markers` and `MemoryUsage::subset` are always zero as the markers are stored per label and the subset is shared across references.
+     */
+    std::vector<MemoryUsage> references;
+
+    /**
+     * Subset of genes used for classification, i.e., the union of markers across references.
+     */
+    std::size_t subset = 0;
+
+    /**
+     * @return Total memory usage across all references and the subset.
+     */
+    std::size_t total() const {
+        std::size_t output = subset;
+        for (const auto& ref : references) {
+            output += ref.total();
+        }
+        return output;
+    }
+};
+
+/**
+ * @cond
+ */
+template<class Vector_>
+std::size_t vector_bytes(const Vector_& x) {
+    return x.capacity() * sizeof(typename Vector_::value_type);
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
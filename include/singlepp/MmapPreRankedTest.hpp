@@ -0,0 +1,110 @@
+#ifndef SINGLEPP_MMAP_PRE_RANKED_TEST_HPP
+#define SINGLEPP_MMAP_PRE_RANKED_TEST_HPP
+
+#include "defs.hpp"
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "PreRankedTest.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @file MmapPreRankedTest.hpp
+ * @brief Memory-map a file containing cached ranks of the test dataset.
+ *
+ * This requires POSIX memory mapping and is not included in the `singlepp.hpp` umbrella header.
+ */
+
+namespace singlepp {
+
+/**
+ * Memory-map a file created by `save_pre_ranked_test()`.
+ * Unlike `read_pre_ranked_test()`, the values and indices are not loaded into memory;
+ * rather, the pages of the file are loaded on demand by the kernel during classification and can be evicted as needed.
+ * This allows the same file to be shared by multiple processes without duplicating its contents in memory.
+ * The file is validated upon loading, which involves a pass over the pointers and indices.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * This should be the same as that used to save the file.
+ * @tparam Index_ Integer type for the row indices.
+ * This should be the same as that used to save the file.
+ *
+ * @param path Path to the file.
+ *
+ * @return Ranked vectors for the test dataset.
+ * The file remains mapped until the returned object is destroyed.
+ */
+template<typename Value_ = DefaultValue, typename Index_ = DefaultIndex>
+PreRankedTest<Value_, Index_> load_pre_ranked_test(const std::string& path) {
+    const auto throw_errno = [&](const std::string& msg, const int err) -> void {
+        throw std::runtime_error(msg + " '" + path + "' (" + std::strerror(err) + ")");
+    };
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw_errno("failed to open", errno);
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) < 0) {
+        const int err = errno;
+        ::close(fd);
+        throw_errno("failed to inspect", err);
+    }
+    const auto file_size = sanisizer::cast<std::size_t>(info.st_size);
+    if (file_size < PreRankedTestHeader::size) {
+        ::close(fd);
+        throw std::runtime_error("failed to read '" + path + "' (not a pre-ranked test file)");
+    }
+
+    void* mapped = ::mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    const int err = errno;
+    ::close(fd); // the mapping remains valid after the file descriptor is closed.
+    if (mapped == MAP_FAILED) {
+        throw_errno("failed to map", err);
+    }
+    std::shared_ptr<const void> owner(mapped, [file_size](const void* ptr) -> void { ::munmap(const_cast<void*>(ptr), file_size); });
+
+    const auto buffer = static_cast<const unsigned char*>(mapped);
+    const auto header = parse_pre_ranked_test_header<Value_, Index_>(buffer, file_size, path);
+
+    // The subset is small and is needed as a vector, so we just copy it.
+    std::vector<Index_> subset;
+    sanisizer::resize(subset, header.num_subset);
+    std::memcpy(subset.data(), buffer + header.subset_offset, header.num_subset * sizeof(Index_)); // no overflow as this fits in the file.
+
+    // Arrays start at multiples of 64 bytes from the page-aligned start of the mapping, so they are suitably aligned for direct access.
+    const auto pointers = reinterpret_cast<const std::uint64_t*>(buffer + header.pointers_offset);
+    if (pointers[header.num_cells] != header.num_entries) {
+        throw std::runtime_error("failed to read '" + path + "' (last pointer should be equal to the number of entries)");
+    }
+
+    PreRankedTest<Value_, Index_> output(
+        header.test_nrow,
+        header.sparse,
+        std::move(subset),
+        header.num_cells,
+        pointers,
+        reinterpret_cast<const Value_*>(buffer + header.values_offset),
+        reinterpret_cast<const Index_*>(buffer + header.indices_offset),
+        std::move(owner)
+    );
+    validate_pre_ranked_test(output, path);
+    return output;
+}
+
+}
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef SINGLEPP_MMAP_RESULT_SINK_HPP
+#define SINGLEPP_MMAP_RESULT_SINK_HPP
+
+#include "defs.hpp"
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "ResultSink.hpp"
+#include "utils.hpp"
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <stdexcept>
+#include <type_traits>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @file MmapResultSink.hpp
+ * @brief Write classification results to a memory-mapped file.
+ *
+ * This requires POSIX memory mapping and is not included in the `singlepp.hpp` umbrella header.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Options for `MmapResultSink`.
+ */
+struct MmapResultSinkOptions {
+    /**
+     * Number of cells in each chunk, see `ResultSink::chunk_size()`.
+     * Larger values reduce the overhead of each chunk (e.g., spawning threads) at the cost of more dirty pages between synchronizations.
+     */
+    std::size_t chunk_size = 65536;
+
+    /**
+     * Whether to store the delta for each cell.
+     */
+    bool store_delta = true;
+
+    /**
+     * Whether to store the scores for each label in each cell.
+     */
+    bool store_scores = true;
+};
+
+/**
+ * @brief Write classification results to a memory-mapped file.
+ *
+ * This writes the results of `classify_single()` or `classify_integrated()` directly into a memory-mapped file,
+ * so that the size of the output is limited by the available disk space rather than memory.
+ * After each chunk is finished, its pages are scheduled for asynchronous write-back so that the kernel can reclaim them as needed.
+ *
+ * The file has the following layout, using the native byte order:
+ *
+ * - Bytes 0-7 contain the magic string `SGLPPRES`.
+ * - Bytes 8-11 contain the format version as a `uint32_t`, currently 1.
+ * - Bytes 12-15 contain the size of `Label_` in bytes as a `uint32_t`.
+ * - Bytes 16-19 contain the size of `Float_` in bytes as a `uint32_t`.
+ * - Bytes 20-23 contain flags as a `uint32_t`, where bit 0 is set if the deltas are stored and bit 1 is set if the scores are stored.
+ * - Bytes 24-31 contain the number of cells as a `uint64_t`.
+ * - Bytes 32-39 contain the number of labels (or references, for `classify_integrated()`) as a `uint64_t`.
+ * - Bytes 40-47 contain the byte offset of the assigned labels as a `uint64_t`.
+ *   This is followed by an array of `Label_` of length equal to the number of cells.
+ * - Bytes 48-55 contain the byte offset of the deltas as a `uint64_t`, or zero if the deltas are not stored.
+ *   This is followed by an array of `Float_` of length equal to the number of cells.
+ * - Bytes 56-63 contain the byte offset of the scores as a `uint64_t`, or zero if the scores are not stored.
+ *   This is followed by a label-major array of `Float_`, i.e., all scores for the first label across all cells, then all scores for the second label, etc.
+ *
+ * Each array starts at a multiple of 64 bytes.
+ *
+ * @tparam Label_ Integer type for the labels.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ */
+template<typename Label_ = DefaultLabel, typename Float_ = DefaultFloat>
+class MmapResultSink final : public ResultSink<Label_, Float_> {
+public:
+    /**
+     * @param path Path to the output file.
+     * This is created if it does not exist, and truncated otherwise.
+     * @param num_cells Number of cells in the test dataset.
+     * @param num_labels Number of labels in the reference (or number of references, for `classify_integrated()`).
+     * @param options Further options.
+     */
+    MmapResultSink(const std::string& path, const std::size_t num_cells, const std::size_t num_labels, const MmapResultSinkOptions& options) :
+        my_num_cells(num_cells),
+        my_num_labels(num_labels),
+        my_chunk_size(options.chunk_size)
+    {
+        // Computing the offsets of each array, padded to a multiple of 64 bytes.
+        std::size_t current = header_size;
+        const auto next = [&](std::size_t bytes) -> std::size_t {
+            const auto output = current;
+            current = sanisizer::sum<std::size_t>(current, bytes);
+            const auto remainder = current % alignment;
+            if (remainder) {
+                current = sanisizer::sum<std::size_t>(current, alignment - remainder);
+            }
+            return output;
+        };
+
+        my_best_offset = next(sanisizer::product<std::size_t>(num_cells, sizeof(Label_)));
+        if (options.store_delta) {
+            my_delta_offset = next(sanisizer::product<std::size_t>(num_cells, sizeof(Float_)));
+        }
+        if (options.store_scores) {
+            my_scores_offset = next(sanisizer::product<std::size_t>(num_cells, num_labels, sizeof(Float_)));
+        }
+        my_size = current;
+
+        my_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (my_fd < 0) {
+            throw_errno("failed to open '" + path + "'", errno);
+        }
+
+        if (::ftruncate(my_fd, sanisizer::cast<off_t>(my_size)) != 0) {
+            const int err = errno;
+            ::close(my_fd);
+            throw_errno("failed to resize '" + path + "'", err);
+        }
+
+        void* mapped = ::mmap(NULL, my_size, PROT_READ | PROT_WRITE, MAP_SHARED, my_fd, 0);
+        if (mapped == MAP_FAILED) {
+            const int err = errno;
+            ::close(my_fd);
+            throw_errno("failed to map '" + path + "'", err);
+        }
+        my_data = static_cast<unsigned char*>(mapped);
+
+        // Filling the header.
+        std::memcpy(my_data, "SGLPPRES", 8);
+        write_header<std::uint32_t>(8, 1);
+        write_header<std::uint32_t>(12, sizeof(Label_));
+        write_header<std::uint32_t>(16, sizeof(Float_));
+        write_header<std::uint32_t>(20, static_cast<std::uint32_t>(options.store_delta) | (static_cast<std::uint32_t>(options.store_scores) << 1));
+        write_header<std::uint64_t>(24, num_cells);
+        write_header<std::uint64_t>(32, num_labels);
+        write_header<std::uint64_t>(40, my_best_offset);
+        write_header<std::uint64_t>(48, my_delta_offset);
+        write_header<std::uint64_t>(56, my_scores_offset);
+
+        my_page_size = ::sysconf(_SC_PAGESIZE);
+    }
+
+    /**
+     * @cond
+     */
+    MmapResultSink(const MmapResultSink&) = delete;
+    MmapResultSink& operator=(const MmapResultSink&) = delete;
+
+    ~MmapResultSink() {
+        ::munmap(my_data, my_size);
+        ::close(my_fd);
+    }
+    /**
+     * @endcond
+     */
+
+private:
+    static constexpr std::size_t header_size = 64;
+    static constexpr std::size_t alignment = 64;
+
+    std::size_t my_num_cells, my_num_labels, my_chunk_size;
+    std::size_t my_best_offset = 0, my_delta_offset = 0, my_scores_offset = 0, my_size = 0;
+    int my_fd = -1;
+    unsigned char* my_data = NULL;
+    long my_page_size = 4096;
+
+    [[noreturn]] static void throw_errno(const std::string& msg, const int err) {
+        throw std::runtime_error(msg + " (" + std::strerror(err) + ")");
+    }
+
+    template<typename Type_>
+    void write_header(const std::size_t offset, const Type_ value) {
+        std::memcpy(my_data + offset, &value, sizeof(Type_));
+    }
+
+    template<typename Type_>
+    Type_* get_array(const std::size_t offset, const std::size_t start) const {
+        return reinterpret_cast<Type_*>(my_data + offset) + start;
+    }
+
+    // msync() requires a page-aligned address, so we expand the range to the enclosing pages.
+    void sync_range(const std::size_t offset, const std::size_t bytes, const int flags) {
+        if (bytes == 0) {
+            return;
+        }
+        const std::size_t page = my_page_size;
+        const std::size_t aligned = offset - offset % page;
+        if (::msync(my_data + aligned, offset + bytes - aligned, flags) != 0) {
+            throw_errno("failed to synchronize the memory-mapped results", errno);
+        }
+    }
+
+public:
+    /**
+     * @return Number of cells in each chunk, from `MmapResultSinkOptions::chunk_size`.
+     */
+    std::size_t chunk_size() const override {
+        return my_chunk_size;
+    }
+
+    /**
+     * An error is raised if the chunk extends past the number of cells, or if the number of scores does not match the number of labels.
+     *
+     * @param start Index of the first cell in the chunk.
+     * @param length Number of cells in the chunk.
+     * @param[out] chunk Output buffers for the chunk, pointing into the memory-mapped file.
+     */
+    void prepare(const std::size_t start, const std::size_t length, ResultSinkChunk<Label_, Float_>& chunk) override {
+        if (start > my_num_cells || length > my_num_cells - start) {
+            throw std::runtime_error("chunk should lie within the number of cells in the result sink");
+        }
+        if (my_scores_offset && !sanisizer::is_equal(chunk.scores.size(), my_num_labels)) {
+            throw std::runtime_error("number of scores should be equal to the number of labels in the result sink");
+        }
+
+        chunk.best = get_array<Label_>(my_best_offset, start);
+        if (my_delta_offset) {
+            chunk.delta = get_array<Float_>(my_delta_offset, start);
+        }
+        if (my_scores_offset) {
+            for (I<decltype(my_num_labels)> l = 0; l < my_num_labels; ++l) {
+                chunk.scores[l] = get_array<Float_>(my_scores_offset, start + l * my_num_cells); // no overflow as this is within the file.
+            }
+        }
+    }
+
+    /**
+     * Schedule the pages for the chunk for asynchronous write-back.
+     *
+     * @param start Index of the first cell in the chunk.
+     * @param length Number of cells in the chunk.
+     */
+    void finish(const std::size_t start, const std::size_t length) override {
+        sync_range(my_best_offset + start * sizeof(Label_), length * sizeof(Label_), MS_ASYNC);
+        if (my_delta_offset) {
+            sync_range(my_delta_offset + start * sizeof(Float_), length * sizeof(Float_), MS_ASYNC);
+        }
+        if (my_scores_offset) {
+            for (I<decltype(my_num_labels)> l = 0; l < my_num_labels; ++l) {
+                sync_range(my_scores_offset + (start + l * my_num_cells) * sizeof(Float_), length * sizeof(Float_), MS_ASYNC);
+            }
+        }
+    }
+
+    /**
+     * Synchronously flush all results to the file.
+     * This is not necessary for correctness as the kernel will eventually write all changes to the file, even after the sink is destroyed;
+     * but it can be used to ensure that the file is complete before it is read by another process.
+     */
+    void flush() {
+        sync_range(0, my_size, MS_SYNC);
+    }
+
+    /**
+     * @return Size of the file in bytes.
+     */
+    std::size_t size() const {
+        return my_size;
+    }
+};
+
+}
+
+#endif
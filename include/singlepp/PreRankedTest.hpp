@@ -0,0 +1,673 @@
+#ifndef SINGLEPP_PRE_RANKED_TEST_HPP
+#define SINGLEPP_PRE_RANKED_TEST_HPP
+
+#include "defs.hpp"
+
+#include "tatami/tatami.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "scaled_ranks.hpp"
+#include "SubsetSanitizer.hpp"
+#include "utils.hpp"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+
+/**
+ * @file PreRankedTest.hpp
+ * @brief Cached ranks of the marker expression values in each test cell.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Cached ranks of the marker expression values in each test cell.
+ *
+ * For each cell in the test dataset, this stores the expression values for a subset of rows in increasing order, along with their positions in the subset.
+ * This is the same ranked vector that is computed for each cell by `classify_single()` and `classify_integrated()` after extracting it from a `tatami::Matrix`.
+ * By computing it once, we can skip the extraction and sorting when the same test dataset is classified multiple times,
+ * e.g., with different parameters or with different references that use a subset of the same rows.
+ *
+ * The ranked vectors are stored in a compressed sparse format where the entries for cell `c` are in `[pointers()[c], pointers()[c + 1])` of `values()` and `indices()`.
+ * If the test matrix was sparse, only the structural non-zero entries are stored for each cell; otherwise, all entries in the subset are stored.
+ *
+ * Instances of this class should be created by `build_pre_ranked_test()`, `read_pre_ranked_test()` or `load_pre_ranked_test()`.
+ * Copying is not supported as the arrays may be views into memory that is owned by this object, but instances can be moved.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * @tparam Index_ Integer type for the row indices.
+ */
+template<typename Value_ = DefaultValue, typename Index_ = DefaultIndex>
+class PreRankedTest {
+public:
+    /**
+     * @cond
+     */
+    PreRankedTest(
+        const Index_ test_nrow,
+        const bool sparse,
+        std::vector<Index_> subset,
+        std::vector<std::uint64_t> pointers,
+        std::vector<Value_> values,
+        std::vector<Index_> indices
+    ) :
+        my_test_nrow(test_nrow),
+        my_sparse(sparse),
+        my_subset(std::move(subset)),
+        my_num_cells(pointers.size() - 1), // cast is safe as the number of cells is taken from an Index_.
+        my_owned_pointers(std::move(pointers)),
+        my_owned_values(std::move(values)),
+        my_owned_indices(std::move(indices)),
+        my_pointers(my_owned_pointers.data()),
+        my_values(my_owned_values.data()),
+        my_indices(my_owned_indices.data())
+    {}
+
+    PreRankedTest(
+        const Index_ test_nrow,
+        const bool sparse,
+        std::vector<Index_> subset,
+        const Index_ num_cells,
+        const std::uint64_t* pointers,
+        const Value_* values,
+        const Index_* indices,
+        std::shared_ptr<const void> owner
+    ) :
+        my_test_nrow(test_nrow),
+        my_sparse(sparse),
+        my_subset(std::move(subset)),
+        my_num_cells(num_cells),
+        my_pointers(pointers),
+        my_values(values),
+        my_indices(indices),
+        my_owner(std::move(owner))
+    {}
+
+    PreRankedTest(const PreRankedTest&) = delete;
+    PreRankedTest& operator=(const PreRankedTest&) = delete;
+    PreRankedTest(PreRankedTest&&) = default; // moving a std::vector preserves its data pointer, so the views remain valid.
+    PreRankedTest& operator=(PreRankedTest&&) = default;
+    /**
+     * @endcond
+     */
+
+private:
+    Index_ my_test_nrow;
+    bool my_sparse;
+    std::vector<Index_> my_subset;
+    Index_ my_num_cells;
+
+    std::vector<std::uint64_t> my_owned_pointers;
+    std::vector<Value_> my_owned_values;
+    std::vector<Index_> my_owned_indices;
+
+    const std::uint64_t* my_pointers;
+    const Value_* my_values;
+    const Index_* my_indices;
+    std::shared_ptr<const void> my_owner;
+
+public:
+    /**
+     * @return Number of rows in the test matrix.
+     */
+    Index_ test_nrow() const {
+        return my_test_nrow;
+    }
+
+    /**
+     * @return Number of cells, i.e., columns in the test matrix.
+     */
+    Index_ num_cells() const {
+        return my_num_cells;
+    }
+
+    /**
+     * @return Whether the test matrix was sparse, in which case only the structural non-zero entries are stored for each cell.
+     */
+    bool is_sparse() const {
+        return my_sparse;
+    }
+
+    /**
+     * @return Sorted and unique row indices of the test matrix that were used to compute the ranked vectors.
+     * Entries of `indices()` refer to positions in this vector.
+     */
+    const std::vector<Index_>& subset() const {
+        return my_subset;
+    }
+
+    /**
+     * @return Pointer to an array of length equal to `num_cells() + 1`, containing the offsets of each cell's entries in `values()` and `indices()`.
+     */
+    const std::uint64_t* pointers() const {
+        return my_pointers;
+    }
+
+    /**
+     * @return Pointer to an array of expression values, sorted in increasing order within each cell.
+     */
+    const Value_* values() const {
+        return my_values;
+    }
+
+    /**
+     * @return Pointer to an array of positions in `subset()` for the corresponding entries of `values()`.
+     * Within each cell, ties in the expression values are ordered by increasing position.
+     */
+    const Index_* indices() const {
+        return my_indices;
+    }
+
+    /**
+     * @return Total number of entries across all cells.
+     */
+    std::uint64_t num_entries() const {
+        return my_pointers[my_num_cells];
+    }
+};
+
+/**
+ * @brief Options for `build_pre_ranked_test()`.
+ */
+struct BuildPreRankedTestOptions {
+    /**
+     * Number of threads to use.
+     * The parallelization scheme is determined by `tatami::parallelize()`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * Compute the ranked vector for each cell in the test dataset, for later use in `classify_single()` or `classify_integrated()`.
+ *
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices.
+ *
+ * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+ * @param subset Vector of row indices of interest.
+ * This should contain at least the rows used by each classifier, e.g., `TrainedSingle::subset()` or `TrainedIntegrated::subset()`;
+ * if multiple classifiers are to be used, this should contain the union of their subsets.
+ * Indices need not be sorted or unique.
+ * @param options Further options.
+ *
+ * @return Ranked vectors for all cells in `test`.
+ */
+template<typename Value_, typename Index_>
+PreRankedTest<Value_, Index_> build_pre_ranked_test(const tatami::Matrix<Value_, Index_>& test, std::vector<Index_> subset, const BuildPreRankedTestOptions& options) {
+    const Index_ NR = test.nrow();
+    for (const auto s : subset) {
+        bool okay = s < NR;
+        if constexpr(std::is_signed<Index_>::value) {
+            okay = okay && s >= 0;
+        }
+        if (!okay) {
+            throw std::runtime_error("subset indices should be non-negative and less than the number of rows in 'test'");
+        }
+    }
+    std::sort(subset.begin(), subset.end());
+    subset.erase(std::unique(subset.begin(), subset.end()), subset.end());
+    const Index_ num_subset = subset.size(); // cast is safe as 'subset' is a unique subset of the rows.
+
+    const Index_ NC = test.ncol();
+    const bool sparse = test.is_sparse();
+    const int num_threads = options.num_threads;
+
+    // Each thread stores the ranked vectors for its own cells, which are concatenated at the end.
+    struct ThreadOutput {
+        Index_ start = 0;
+        std::vector<Index_> counts;
+        std::vector<Value_> values;
+        std::vector<Index_> indices;
+    };
+    auto thread_outputs = sanisizer::create<std::vector<ThreadOutput> >(num_threads);
+
+    const auto run = [&](auto query_sparse) -> void {
+        constexpr bool query_sparse_ = decltype(query_sparse)::value;
+        SubsetNoop<query_sparse_, Index_> subsorted(subset);
+
+        tatami::parallelize([&](int t, Index_ start, Index_ length) -> void {
+            auto& output = thread_outputs[t];
+            output.start = start;
+            sanisizer::reserve(output.counts, length);
+
+            tatami::VectorPtr<Index_> subset_ptr(tatami::VectorPtr<Index_>{}, &subset);
+            auto ext = tatami::consecutive_extractor<query_sparse_>(&test, false, start, length, std::move(subset_ptr));
+            auto vbuffer = sanisizer::create<std::vector<Value_> >(num_subset);
+            auto ibuffer = [&](){
+                if constexpr(query_sparse_) {
+                    return sanisizer::create<std::vector<Index_> >(num_subset);
+                } else {
+                    return false;
+                }
+            }();
+
+            RankedVector<Value_, Index_> ranked;
+            ranked.reserve(num_subset);
+            for (Index_ c = 0; c < length; ++c) {
+                if constexpr(query_sparse_) {
+                    const auto info = ext->fetch(vbuffer.data(), ibuffer.data());
+                    subsorted.fill_ranks(info, ranked);
+                } else {
+                    const auto info = ext->fetch(vbuffer.data());
+                    subsorted.fill_ranks(info, ranked);
+                }
+
+                output.counts.push_back(ranked.size());
+                for (const auto& r : ranked) {
+                    output.values.push_back(r.first);
+                    output.indices.push_back(r.second);
+                }
+            }
+        }, NC, num_threads);
+    };
+
+    if (sparse) {
+        run(std::true_type());
+    } else {
+        run(std::false_type());
+    }
+
+    // Threads may not be in order of their starting cells, so we sort them before concatenating.
+    std::vector<ThreadOutput*> order;
+    order.reserve(thread_outputs.size());
+    for (auto& output : thread_outputs) {
+        if (!output.counts.empty()) {
+            order.push_back(&output);
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const ThreadOutput* left, const ThreadOutput* right) -> bool { return left->start < right->start; });
+
+    std::vector<std::uint64_t> pointers;
+    pointers.reserve(sanisizer::sum<std::size_t>(NC, 1));
+    pointers.push_back(0);
+    std::vector<Value_> values;
+    std::vector<Index_> indices;
+    for (auto output : order) {
+        for (const auto count : output->counts) {
+            pointers.push_back(pointers.back() + count);
+        }
+        values.insert(values.end(), output->values.begin(), output->values.end());
+        indices.insert(indices.end(), output->indices.begin(), output->indices.end());
+
+        // Releasing memory as we go, to reduce the peak memory usage.
+        output->values = std::vector<Value_>();
+        output->indices = std::vector<Index_>();
+    }
+
+    return PreRankedTest<Value_, Index_>(NR, sparse, std::move(subset), std::move(pointers), std::move(values), std::move(indices));
+}
+
+/**
+ * @cond
+ */
+// Layout of the file header for a PreRankedTest.
+// All integers are stored in the native byte order.
+struct PreRankedTestHeader {
+    static constexpr std::size_t size = 128;
+    static constexpr std::size_t alignment = 64;
+    static constexpr std::uint32_t version = 1;
+
+    std::uint32_t value_size = 0;
+    std::uint32_t index_size = 0;
+    bool sparse = false;
+    std::uint64_t test_nrow = 0;
+    std::uint64_t num_cells = 0;
+    std::uint64_t num_subset = 0;
+    std::uint64_t num_entries = 0;
+    std::uint64_t subset_offset = 0;
+    std::uint64_t pointers_offset = 0;
+    std::uint64_t values_offset = 0;
+    std::uint64_t indices_offset = 0;
+    std::uint64_t file_size = 0;
+};
+
+template<typename Type_>
+void write_pre_ranked_test_field(unsigned char* buffer, const std::size_t offset, const Type_ value) {
+    std::memcpy(buffer + offset, &value, sizeof(Type_));
+}
+
+template<typename Type_>
+Type_ read_pre_ranked_test_field(const unsigned char* buffer, const std::size_t offset) {
+    Type_ value;
+    std::memcpy(&value, buffer + offset, sizeof(Type_));
+    return value;
+}
+
+// Computes the offset of each array from the sizes in the header, padded to a multiple of the alignment.
+inline void fill_pre_ranked_test_offsets(PreRankedTestHeader& header) {
+    std::uint64_t current = PreRankedTestHeader::size;
+    const auto next = [&](const std::uint64_t bytes) -> std::uint64_t {
+        const auto output = current;
+        current = sanisizer::sum<std::uint64_t>(current, bytes);
+        const auto remainder = current % PreRankedTestHeader::alignment;
+        if (remainder) {
+            current = sanisizer::sum<std::uint64_t>(current, PreRankedTestHeader::alignment - remainder);
+        }
+        return output;
+    };
+    header.subset_offset = next(sanisizer::product<std::uint64_t>(header.num_subset, header.index_size));
+    header.pointers_offset = next(sanisizer::product<std::uint64_t>(sanisizer::sum<std::uint64_t>(header.num_cells, 1), sizeof(std::uint64_t)));
+    header.values_offset = next(sanisizer::product<std::uint64_t>(header.num_entries, header.value_size));
+    header.indices_offset = next(sanisizer::product<std::uint64_t>(header.num_entries, header.index_size));
+    header.file_size = current;
+}
+
+template<typename Value_, typename Index_>
+PreRankedTestHeader create_pre_ranked_test_header(const PreRankedTest<Value_, Index_>& test) {
+    PreRankedTestHeader header;
+    header.value_size = sizeof(Value_);
+    header.index_size = sizeof(Index_);
+    header.sparse = test.is_sparse();
+    header.test_nrow = test.test_nrow();
+    header.num_cells = test.num_cells();
+    header.num_subset = test.subset().size();
+    header.num_entries = test.num_entries();
+
+    fill_pre_ranked_test_offsets(header);
+    return header;
+}
+
+inline void serialize_pre_ranked_test_header(const PreRankedTestHeader& header, unsigned char* buffer) {
+    std::fill_n(buffer, PreRankedTestHeader::size, 0);
+    std::memcpy(buffer, "SGLPPRNK", 8);
+    write_pre_ranked_test_field<std::uint32_t>(buffer, 8, PreRankedTestHeader::version);
+    write_pre_ranked_test_field<std::uint32_t>(buffer, 12, header.value_size);
+    write_pre_ranked_test_field<std::uint32_t>(buffer, 16, header.index_size);
+    write_pre_ranked_test_field<std::uint32_t>(buffer, 20, header.sparse);
+    write_pre_ranked_test_field<std::uint64_t>(buffer, 24, header.test_nrow);
+    write_pre_ranked_test_field<std::uint64_t>(buffer, 32, header.num_cells);
+    write_pre_ranked_test_field<std::uint64_t>(buffer, 40, header.num_subset);
+    write_pre_ranked_test_field<std::uint64_t>(buffer, 48, header.num_entries);
+    write_pre_ranked_test_field<std::uint64_t>(buffer, 56, header.subset_offset);
+    write_pre_ranked_test_field<std::uint64_t>(buffer, 64, header.pointers_offset);
+    write_pre_ranked_test_field<std::uint64_t>(buffer, 72, header.values_offset);
+    write_pre_ranked_test_field<std::uint64_t>(buffer, 80, header.indices_offset);
+}
+
+// Parses the header and checks that it is consistent with the expected types and the size of the file.
+template<typename Value_, typename Index_>
+PreRankedTestHeader parse_pre_ranked_test_header(const unsigned char* buffer, const std::uint64_t file_size, const std::string& path) {
+    const auto fail = [&](const std::string& msg) -> void {
+        throw std::runtime_error("failed to read '" + path + "' (" + msg + ")");
+    };
+    if (file_size < PreRankedTestHeader::size || std::memcmp(buffer, "SGLPPRNK", 8) != 0) {
+        fail("not a pre-ranked test file");
+    }
+    if (read_pre_ranked_test_field<std::uint32_t>(buffer, 8) != PreRankedTestHeader::version) {
+        fail("unsupported format version");
+    }
+
+    PreRankedTestHeader header;
+    header.value_size = read_pre_ranked_test_field<std::uint32_t>(buffer, 12);
+    header.index_size = read_pre_ranked_test_field<std::uint32_t>(buffer, 16);
+    if (header.value_size != sizeof(Value_) || header.index_size != sizeof(Index_)) {
+        fail("inconsistent sizes of the value or index types");
+    }
+
+    header.sparse = read_pre_ranked_test_field<std::uint32_t>(buffer, 20);
+    header.test_nrow = read_pre_ranked_test_field<std::uint64_t>(buffer, 24);
+    header.num_cells = read_pre_ranked_test_field<std::uint64_t>(buffer, 32);
+    header.num_subset = read_pre_ranked_test_field<std::uint64_t>(buffer, 40);
+    header.num_entries = read_pre_ranked_test_field<std::uint64_t>(buffer, 48);
+    if (!sanisizer::is_less_than_or_equal(header.test_nrow, std::numeric_limits<Index_>::max()) || !sanisizer::is_less_than_or_equal(header.num_cells, std::numeric_limits<Index_>::max())) {
+        fail("dimensions cannot be represented by the index type");
+    }
+
+    // Checking that the offsets are the same as those we would have computed ourselves, which guarantees that the arrays are aligned and non-overlapping.
+    auto expected = header;
+    fill_pre_ranked_test_offsets(expected);
+
+    header.subset_offset = read_pre_ranked_test_field<std::uint64_t>(buffer, 56);
+    header.pointers_offset = read_pre_ranked_test_field<std::uint64_t>(buffer, 64);
+    header.values_offset = read_pre_ranked_test_field<std::uint64_t>(buffer, 72);
+    header.indices_offset = read_pre_ranked_test_field<std::uint64_t>(buffer, 80);
+    header.file_size = file_size;
+    if (
+        header.subset_offset != expected.subset_offset ||
+        header.pointers_offset != expected.pointers_offset ||
+        header.values_offset != expected.values_offset ||
+        header.indices_offset != expected.indices_offset ||
+        file_size < expected.file_size
+    ) {
+        fail("inconsistent array offsets");
+    }
+
+    return header;
+}
+
+// Checks that the contents of a PreRankedTest are valid, so that they can be safely used for classification.
+template<typename Value_, typename Index_>
+void validate_pre_ranked_test(const PreRankedTest<Value_, Index_>& test, const std::string& path) {
+    const auto fail = [&](const std::string& msg) -> void {
+        throw std::runtime_error("failed to read '" + path + "' (" + msg + ")");
+    };
+
+    const auto& subset = test.subset();
+    const auto num_subset = subset.size();
+    if (!is_sorted_unique(num_subset, subset.data()) || (num_subset && !sanisizer::is_less_than(subset.back(), test.test_nrow()))) {
+        fail("subset should be sorted, unique and less than the number of rows");
+    }
+    if constexpr(std::is_signed<Index_>::value) {
+        if (num_subset && subset.front() < 0) {
+            fail("subset should be sorted, unique and less than the number of rows");
+        }
+    }
+
+    const auto pointers = test.pointers();
+    const auto indices = test.indices();
+    const auto num_cells = test.num_cells();
+    if (pointers[0] != 0) {
+        fail("first pointer should be zero");
+    }
+    for (Index_ c = 0; c < num_cells; ++c) {
+        const auto start = pointers[c], end = pointers[c + 1];
+        if (end < start || !sanisizer::is_less_than_or_equal(end - start, num_subset)) {
+            fail("pointers should be non-decreasing and each cell should have no more entries than the subset");
+        }
+        for (auto i = start; i < end; ++i) {
+            bool okay = sanisizer::is_less_than(indices[i], num_subset);
+            if constexpr(std::is_signed<Index_>::value) {
+                okay = okay && indices[i] >= 0;
+            }
+            if (!okay) {
+                fail("indices should be non-negative and less than the length of the subset");
+            }
+        }
+    }
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Save a `PreRankedTest` to a file, for later use with `read_pre_ranked_test()` or `load_pre_ranked_test()`.
+ *
+ * The file has the following layout, using the native byte order:
+ *
+ * - Bytes 0-7 contain the magic string `SGLPPRNK`.
+ * - Bytes 8-11 contain the format version as a `uint32_t`, currently 1.
+ * - Bytes 12-15 contain the size of `Value_` in bytes as a `uint32_t`.
+ * - Bytes 16-19 contain the size of `Index_` in bytes as a `uint32_t`.
+ * - Bytes 20-23 contain a `uint32_t` that is 1 if the test matrix was sparse and 0 otherwise.
+ * - Bytes 24-31 contain the number of rows in the test matrix as a `uint64_t`.
+ * - Bytes 32-39 contain the number of cells as a `uint64_t`.
+ * - Bytes 40-47 contain the length of the subset as a `uint64_t`.
+ * - Bytes 48-55 contain the total number of entries across all cells as a `uint64_t`.
+ * - Bytes 56-63, 64-71, 72-79 and 80-87 contain the byte offsets of the subset, pointers, values and indices, respectively, as `uint64_t`s.
+ *   These refer to arrays of `Index_`, `uint64_t`, `Value_` and `Index_`, respectively.
+ *
+ * The header occupies the first 128 bytes and each array starts at a multiple of 64 bytes.
+ * As the file uses the native byte order and type sizes, it should only be read on the same platform with the same `Value_` and `Index_` types.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * @tparam Index_ Integer type for the row indices.
+ *
+ * @param test Ranked vectors for the test dataset, typically from `build_pre_ranked_test()`.
+ * @param path Path to the output file.
+ * This is created if it does not exist, and truncated otherwise.
+ */
+template<typename Value_, typename Index_>
+void save_pre_ranked_test(const PreRankedTest<Value_, Index_>& test, const std::string& path) {
+    const auto header = create_pre_ranked_test_header(test);
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (!output) {
+        throw std::runtime_error("failed to open '" + path + "'");
+    }
+
+    unsigned char buffer[PreRankedTestHeader::size];
+    serialize_pre_ranked_test_header(header, buffer);
+    output.write(reinterpret_cast<const char*>(buffer), PreRankedTestHeader::size);
+
+    std::uint64_t position = PreRankedTestHeader::size;
+    const auto write_array = [&](const std::uint64_t offset, const void* data, const std::uint64_t bytes) -> void {
+        static constexpr char padding[PreRankedTestHeader::alignment] = {};
+        output.write(padding, offset - position); // offsets are at most one alignment unit past the previous array.
+        output.write(static_cast<const char*>(data), bytes);
+        position = offset + bytes;
+    };
+    write_array(header.subset_offset, test.subset().data(), header.num_subset * sizeof(Index_));
+    write_array(header.pointers_offset, test.pointers(), (header.num_cells + 1) * sizeof(std::uint64_t));
+    write_array(header.values_offset, test.values(), header.num_entries * sizeof(Value_));
+    write_array(header.indices_offset, test.indices(), header.num_entries * sizeof(Index_));
+    write_array(header.file_size, NULL, 0);
+
+    if (!output) {
+        throw std::runtime_error("failed to write '" + path + "'");
+    }
+}
+
+/**
+ * Read a `PreRankedTest` from a file created by `save_pre_ranked_test()`.
+ * All arrays are loaded into memory, see `load_pre_ranked_test()` for a memory-mapped alternative.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * This should be the same as that used to save the file.
+ * @tparam Index_ Integer type for the row indices.
+ * This should be the same as that used to save the file.
+ *
+ * @param path Path to the file.
+ *
+ * @return Ranked vectors for the test dataset.
+ */
+template<typename Value_ = DefaultValue, typename Index_ = DefaultIndex>
+PreRankedTest<Value_, Index_> read_pre_ranked_test(const std::string& path) {
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    if (!input) {
+        throw std::runtime_error("failed to open '" + path + "'");
+    }
+    const auto file_size = sanisizer::cast<std::uint64_t>(static_cast<std::streamoff>(input.tellg()));
+    input.seekg(0);
+
+    unsigned char buffer[PreRankedTestHeader::size] = {};
+    input.read(reinterpret_cast<char*>(buffer), std::min<std::uint64_t>(file_size, PreRankedTestHeader::size));
+    const auto header = parse_pre_ranked_test_header<Value_, Index_>(buffer, file_size, path);
+
+    const auto read_array = [&](const std::uint64_t offset, auto& vec, const std::uint64_t length) -> void {
+        sanisizer::resize(vec, length);
+        input.seekg(sanisizer::cast<std::streamoff>(offset));
+        input.read(reinterpret_cast<char*>(vec.data()), length * sizeof(typename I<decltype(vec)>::value_type)); // no overflow as this fits in the file.
+    };
+    std::vector<Index_> subset;
+    read_array(header.subset_offset, subset, header.num_subset);
+    std::vector<std::uint64_t> pointers;
+    read_array(header.pointers_offset, pointers, header.num_cells + 1);
+    std::vector<Value_> values;
+    read_array(header.values_offset, values, header.num_entries);
+    std::vector<Index_> indices;
+    read_array(header.indices_offset, indices, header.num_entries);
+    if (!input) {
+        throw std::runtime_error("failed to read '" + path + "'");
+    }
+    if (pointers.back() != header.num_entries) {
+        throw std::runtime_error("failed to read '" + path + "' (last pointer should be equal to the number of entries)");
+    }
+
+    PreRankedTest<Value_, Index_> output(header.test_nrow, header.sparse, std::move(subset), std::move(pointers), std::move(values), std::move(indices));
+    validate_pre_ranked_test(output, path);
+    return output;
+}
+
+/**
+ * @cond
+ */
+// Fills the ranked vector for each cell from a PreRankedTest, projected onto a subset of its rows.
+template<typename Value_, typename Index_>
+class PreRankedQueryRanker {
+private:
+    const PreRankedTest<Value_, Index_>& my_test;
+    bool my_identity;
+    Index_ my_num_target;
+
+    // Position of each entry of the test's subset in the target subset, or 'my_num_target' if it is absent.
+    std::vector<Index_> my_mapping;
+
+public:
+    // 'target' should be sorted and unique.
+    PreRankedQueryRanker(const PreRankedTest<Value_, Index_>& test, const std::vector<Index_>& target) :
+        my_test(test),
+        my_identity(test.subset() == target),
+        my_num_target(target.size()) // cast is safe as 'target' is a unique subset of the rows.
+    {
+        assert(is_sorted_unique(target.size(), target.data()));
+        if (my_identity) {
+            return;
+        }
+
+        const auto& source = test.subset();
+        const auto num_source = source.size();
+        sanisizer::resize(my_mapping, num_source, my_num_target);
+        I<decltype(num_source)> s = 0;
+        for (Index_ t = 0; t < my_num_target; ++t) {
+            while (s < num_source && source[s] < target[t]) {
+                ++s;
+            }
+            if (s == num_source || source[s] != target[t]) {
+                throw std::runtime_error("rows used by the classifier should be a subset of the rows in the pre-ranked test dataset");
+            }
+            my_mapping[s] = t;
+        }
+    }
+
+public:
+    // As both subsets are sorted, filtering preserves the order of ties and the output is the same as that of SubsetNoop::fill_ranks().
+    void fill(const Index_ c, RankedVector<Value_, Index_>& ranked) const {
+        ranked.clear();
+        const auto pointers = my_test.pointers();
+        const auto values = my_test.values();
+        const auto indices = my_test.indices();
+        for (auto i = pointers[c], end = pointers[c + 1]; i < end; ++i) {
+            if (my_identity) {
+                ranked.emplace_back(values[i], indices[i]);
+            } else {
+                const auto pos = my_mapping[indices[i]];
+                if (pos < my_num_target) {
+                    ranked.emplace_back(values[i], pos);
+                }
+            }
+        }
+    }
+
+    // Mimics the rankers from create_matrix_ranker(), for use in the annotate_cells_*_raw() functions.
+    auto create() const {
+        return [this](const Index_ c, RankedVector<Value_, Index_>& ranked, const auto& after_fetch) -> void {
+            after_fetch();
+            fill(c, ranked);
+        };
+    }
+};
+/**
+ * @endcond
+ */
+
+}
+
+#endif
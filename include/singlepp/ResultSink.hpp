@@ -0,0 +1,95 @@
+#ifndef SINGLEPP_RESULT_SINK_HPP
+#define SINGLEPP_RESULT_SINK_HPP
+
+#include "defs.hpp"
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @file ResultSink.hpp
+ * @brief Destination for classification results, filled in chunks of cells.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Output buffers for a chunk of cells in a `ResultSink`.
+ * @tparam Label_ Integer type for the labels.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ */
+template<typename Label_ = DefaultLabel, typename Float_ = DefaultFloat>
+struct ResultSinkChunk {
+    /**
+     * Pointer to an array of length equal to the number of cells in the chunk, to be filled with the assigned label for each cell.
+     * This should not be `NULL`.
+     */
+    Label_* best = NULL;
+
+    /**
+     * Pointer to an array of length equal to the number of cells in the chunk, to be filled with the delta for each cell.
+     * This may be `NULL` in which case the deltas are not reported.
+     */
+    Float_* delta = NULL;
+
+    /**
+     * Vector of length equal to the number of labels.
+     * Each entry contains a pointer to an array of length equal to the number of cells in the chunk, to be filled with the score for each label.
+     * Any pointer may be `NULL` in which case the scores for that label are not reported.
+     */
+    std::vector<Float_*> scores;
+};
+
+/**
+ * @brief Destination for classification results, filled in chunks of cells.
+ *
+ * The overloads of `classify_single()` and `classify_integrated()` that accept a `ResultSink` process the test matrix in consecutive chunks of cells.
+ * For each chunk, `prepare()` is called to obtain the output buffers, classification is performed (possibly in parallel) for all cells in the chunk, and then `finish()` is called.
+ * Each thread writes to a disjoint range of cells within the chunk's buffers.
+ * This allows subclasses to avoid holding the results for all cells in memory at once, e.g., by writing them to disk in `finish()` or by mapping the buffers to a file, see `MmapResultSink`.
+ *
+ * @tparam Label_ Integer type for the labels.
+ * For `classify_integrated()`, this is the integer type for the label representing each reference.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ */
+template<typename Label_ = DefaultLabel, typename Float_ = DefaultFloat>
+class ResultSink {
+public:
+    /**
+     * @cond
+     */
+    virtual ~ResultSink() = default;
+    /**
+     * @endcond
+     */
+
+    /**
+     * @return Maximum number of cells in each chunk.
+     * This should be positive.
+     */
+    virtual std::size_t chunk_size() const = 0;
+
+    /**
+     * @param start Index of the first cell in the chunk.
+     * @param length Number of cells in the chunk.
+     * @param[out] chunk Output buffers for the chunk.
+     * On input, `ResultSinkChunk::scores` is a vector of `NULL` pointers of length equal to the number of labels (or references, for `classify_integrated()`).
+     * All pointers should remain valid until the subsequent call to `finish()`.
+     *
+     * Subclasses should throw an exception if the chunk does not match their dimensions,
+     * e.g., if `start + length` exceeds the number of cells or the length of `ResultSinkChunk::scores` differs from the number of labels.
+     */
+    virtual void prepare(std::size_t start, std::size_t length, ResultSinkChunk<Label_, Float_>& chunk) = 0;
+
+    /**
+     * Called once all cells in the chunk have been classified.
+     *
+     * @param start Index of the first cell in the chunk.
+     * @param length Number of cells in the chunk.
+     */
+    virtual void finish(std::size_t start, std::size_t length) = 0;
+};
+
+}
+
+#endif
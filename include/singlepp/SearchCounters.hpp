@@ -0,0 +1,97 @@
+#ifndef SINGLEPP_SEARCH_COUNTERS_HPP
+#define SINGLEPP_SEARCH_COUNTERS_HPP
+
+#include "utils.hpp"
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @file SearchCounters.hpp
+ * @brief Counters for the neighbor search.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Counters for the neighbor search for a single label.
+ *
+ * Each label's reference profiles are indexed with the k-means for k-nearest neighbors (KMKNN) algorithm,
+ * where profiles are assigned to clusters around a "seed" profile and the triangle inequality is used to skip clusters that cannot contain a neighbor.
+ * These counters are summed across all test cells in `classify_single()` and can be used to diagnose labels that are poorly indexed.
+ * For example, a high ratio of `candidate_distances` to the number of profiles in the label indicates that few profiles are being skipped.
+ */
+struct SearchCounters {
+    /**
+     * Number of distances computed between the test cell and each seed.
+     */
+    std::size_t seed_distances = 0;
+
+    /**
+     * Number of clusters that were skipped entirely because the lower bound on the distance exceeded the current threshold.
+     */
+    std::size_t skipped_clusters = 0;
+
+    /**
+     * Number of clusters where the range of candidate profiles was truncated by the upper bound on the distance.
+     */
+    std::size_t truncated_clusters = 0;
+
+    /**
+     * Number of distances computed between the test cell and each candidate profile within the clusters.
+     */
+    std::size_t candidate_distances = 0;
+
+    /**
+     * Number of candidate profiles that were inserted into the heap of nearest neighbors.
+     */
+    std::size_t heap_insertions = 0;
+};
+
+/**
+ * @cond
+ */
+// Used when counters are not requested, so that all counting calls compile to nothing.
+struct NoopSearchCounters {};
+
+inline void count_seed_distances(SearchCounters& counters, const std::size_t n) { counters.seed_distances += n; }
+inline void count_seed_distances(NoopSearchCounters&, std::size_t) {}
+
+inline void count_skipped_cluster(SearchCounters& counters) { ++(counters.skipped_clusters); }
+inline void count_skipped_cluster(NoopSearchCounters&) {}
+
+inline void count_truncated_cluster(SearchCounters& counters) { ++(counters.truncated_clusters); }
+inline void count_truncated_cluster(NoopSearchCounters&) {}
+
+inline void count_candidate_distances(SearchCounters& counters, const std::size_t n) { counters.candidate_distances += n; }
+inline void count_candidate_distances(NoopSearchCounters&, std::size_t) {}
+
+inline void count_heap_insertion(SearchCounters& counters) { ++(counters.heap_insertions); }
+inline void count_heap_insertion(NoopSearchCounters&) {}
+
+// Sum the per-thread counters for each label into 'output'.
+inline void merge_search_counters(const std::vector<std::vector<SearchCounters> >& per_thread, std::vector<SearchCounters>& output) {
+    for (auto& out : output) {
+        out = SearchCounters();
+    }
+
+    for (const auto& current : per_thread) {
+        const auto num_labels = current.size(); // empty if the thread was not used.
+        for (I<decltype(num_labels)> l = 0; l < num_labels; ++l) {
+            auto& out = output[l];
+            const auto& cur = current[l];
+            out.seed_distances += cur.seed_distances;
+            out.skipped_clusters += cur.skipped_clusters;
+            out.truncated_clusters += cur.truncated_clusters;
+            out.candidate_distances += cur.candidate_distances;
+            out.heap_insertions += cur.heap_insertions;
+        }
+    }
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
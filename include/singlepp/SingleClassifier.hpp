@@ -0,0 +1,357 @@
+#ifndef SINGLEPP_SINGLE_CLASSIFIER_HPP
+#define SINGLEPP_SINGLE_CLASSIFIER_HPP
+
+#include "defs.hpp"
+
+#include "tatami/tatami.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "FineTuneStatistics.hpp"
+#include "SearchCounters.hpp"
+#include "SubsetSanitizer.hpp"
+#include "annotate_cells_single.hpp"
+#include "ClassifySingleOptions.hpp"
+#include "train_single.hpp"
+#include "Tracer.hpp"
+#include "WorkerPool.hpp"
+#include "utils.hpp"
+
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstddef>
+
+/**
+ * @file SingleClassifier.hpp
+ * @brief Classify streaming batches of cells based on a single reference.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Stateful classifier for streaming batches of test cells.
+ *
+ * This applies the same algorithm as `classify_single()` but accepts test cells in chunks from raw dense or compressed sparse column buffers.
+ * It is intended for pipelines where the test dataset is never available as a complete `tatami::Matrix`, e.g., when cells are read from a stream.
+ * All setup (e.g., quantile details, marker bitsets) is performed once in the constructor,
+ * and the per-thread workspaces are created on first use and retained across chunks.
+ * This means that memory usage is constant regardless of the number of chunks, and the workspaces are not reallocated after the first chunk of each representation.
+ * If `ClassifySingleBuffers::fine_tune_statistics` is requested, the per-thread statistics are also retained and only grow when a chunk requires more fine-tuning iterations than any previous chunk.
+ * The results for each cell are identical to those from `classify_single()` with the same options.
+ *
+ * Cells can also be supplied as a `tatami::Matrix` (or a consecutive range of its columns) via `classify()`, in which case only the extractors and their buffers are created in each call.
+ *
+ * The `SingleClassifier` holds a reference to the `TrainedSingle` object, which should outlive the classifier.
+ * A single instance should not be used concurrently from multiple threads; use `ClassifySingleOptions::num_threads` to parallelize within each chunk instead.
+ * Threads are spawned by `tatami::parallelize()` in each call unless a persistent `WorkerPool` is supplied, see also `ClassifySingleSession`.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * @tparam Index_ Integer type for the row indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the reference labels.
+ */
+template<typename Value_ = DefaultValue, typename Index_ = DefaultIndex, typename Float_ = DefaultFloat, typename Label_ = DefaultLabel>
+class SingleClassifier {
+public:
+    /**
+     * @param trained Classifier returned by `train_single()`.
+     * @param options Further options.
+     * If `ClassifySingleOptions::tracer` is supplied, events are recorded for each call to `classify_dense()`, `classify_sparse()` or `classify()`.
+     */
+    SingleClassifier(const TrainedSingle<Index_, Float_>& trained, const ClassifySingleOptions<Float_>& options) :
+        SingleClassifier(trained, options, NULL)
+    {}
+
+    /**
+     * @param trained Classifier returned by `train_single()`.
+     * @param options Further options.
+     * If `ClassifySingleOptions::tracer` is supplied, events are recorded for each call to `classify_dense()`, `classify_sparse()` or `classify()`.
+     * `ClassifySingleOptions::num_threads` is ignored if `pool` is not `NULL`.
+     * @param pool Pointer to a persistent pool of worker threads, to be used for parallelization within each chunk instead of `tatami::parallelize()`.
+     * This may be shared between multiple `SingleClassifier` instances as long as they are not used concurrently, and should outlive all of them.
+     * If `NULL`, `tatami::parallelize()` is used instead.
+     */
+    SingleClassifier(const TrainedSingle<Index_, Float_>& trained, const ClassifySingleOptions<Float_>& options, WorkerPool* pool) :
+        my_trained(trained),
+        my_options(options),
+        my_ref_sparse(trained.built().sparse.has_value()),
+        my_pool(pool),
+        my_ranker(trained.subset(), trained.test_nrow()),
+        my_dense_subsorted(trained.subset()),
+        my_sparse_subsorted(trained.subset())
+    {
+        if (my_ref_sparse) {
+            my_shared = prepare_classify_single<true>(trained, options.quantile, options.fine_tune, options.fine_tune_bitset_limit);
+        } else {
+            my_shared = prepare_classify_single<false>(trained, options.quantile, options.fine_tune, options.fine_tune_bitset_limit);
+        }
+
+        const auto num_threads = sanisizer::cast<std::size_t>(pool ? pool->num_threads() : std::max(options.num_threads, 1));
+        my_dense_dense.resize(num_threads);
+        my_dense_sparse.resize(num_threads);
+        my_sparse_dense.resize(num_threads);
+        my_sparse_sparse.resize(num_threads);
+        my_search_counters.resize(num_threads);
+        my_recorders.resize(num_threads);
+        my_recorder_starts.resize(num_threads);
+    }
+
+private:
+    const TrainedSingle<Index_, Float_>& my_trained;
+    ClassifySingleOptions<Float_> my_options;
+    bool my_ref_sparse;
+    WorkerPool* my_pool;
+    ClassifySingleShared<Index_, Float_> my_shared;
+    RawQueryRanker<Index_> my_ranker;
+    SubsetNoop<false, Index_> my_dense_subsorted;
+    SubsetNoop<true, Index_> my_sparse_subsorted;
+
+    template<bool query_sparse_, bool ref_sparse_>
+    using Workspace = ClassifySingleWorkspace<query_sparse_, ref_sparse_, Label_, Index_, Float_, Value_>;
+    std::vector<std::optional<Workspace<false, false> > > my_dense_dense;
+    std::vector<std::optional<Workspace<false, true> > > my_dense_sparse;
+    std::vector<std::optional<Workspace<true, false> > > my_sparse_dense;
+    std::vector<std::optional<Workspace<true, true> > > my_sparse_sparse;
+
+    std::vector<std::optional<FineTuneRecorder> > my_recorders;
+    std::vector<Index_> my_recorder_starts;
+    std::vector<std::vector<SearchCounters> > my_search_counters;
+
+    template<bool query_sparse_, bool ref_sparse_>
+    auto& get_workspaces() {
+        if constexpr(query_sparse_) {
+            if constexpr(ref_sparse_) {
+                return my_sparse_sparse;
+            } else {
+                return my_sparse_dense;
+            }
+        } else {
+            if constexpr(ref_sparse_) {
+                return my_dense_sparse;
+            } else {
+                return my_dense_dense;
+            }
+        }
+    }
+
+    template<class Function_>
+    void parallelize(Function_ fun, const Index_ num_cells) {
+        if (my_pool) {
+            my_pool->run(std::move(fun), num_cells);
+        } else {
+            tatami::parallelize(std::move(fun), num_cells, static_cast<int>(my_dense_dense.size()));
+        }
+    }
+
+    // 'prepare' should accept the thread index and the start and length of the block of cells for that thread,
+    // and return a ranker that fills the ranks for each cell in that block, see annotate_cells_single_raw() for details.
+    template<bool query_sparse_, bool ref_sparse_, class Prepare_>
+    void run(const Index_ num_cells, Prepare_& prepare, const ClassifySingleBuffers<Label_, Float_>& buffers) {
+        const Index_ num_markers = my_trained.subset().size();
+        const auto& ref = get_per_label_references<ref_sparse_>(my_trained.built());
+        const auto num_labels = ref.size();
+        auto& workspaces = get_workspaces<query_sparse_, ref_sparse_>();
+
+        // Statistics are only requested for some chunks, so we need to reset them for each chunk that does ask for them.
+        // The recorders are cleared rather than recreated so that their buffers can be re-used across chunks.
+        const auto fine_tune_stats = buffers.fine_tune_statistics;
+        if (fine_tune_stats) {
+            for (auto& rec : my_recorders) {
+                if (rec.has_value()) {
+                    rec->clear();
+                } else {
+                    rec.emplace();
+                }
+            }
+        }
+        const auto search_counters = buffers.search_counters;
+        if (search_counters) {
+            for (auto& counters : my_search_counters) {
+                counters.clear();
+            }
+        }
+
+        const bool prune = use_pruned_scoring(buffers, my_options);
+
+        parallelize([&](int t, Index_ start, Index_ length) -> void {
+            ThreadTracer tracer(my_options.tracer, t);
+            tracer.begin("classify_single");
+            const auto extract_phase = tracer.add_phase("extract_us");
+            const auto fill_phase = tracer.add_phase("fill_ranks_us");
+            const auto scaled_phase = tracer.add_phase("scaled_ranks_us");
+            const auto search_phase = tracer.add_phase("search_us");
+            const auto fine_tune_phase = tracer.add_phase("fine_tune_us");
+            tracer.begin("setup");
+
+            auto ranker = prepare(t, start, length);
+            auto& work_opt = workspaces[t];
+            if (!work_opt.has_value()) {
+                work_opt.emplace(my_trained, my_shared, my_options.fine_tune, my_options.fine_tune_cache_size);
+            }
+            auto& work = *work_opt;
+
+            std::vector<SearchCounters>* thread_counters = NULL;
+            if (search_counters) {
+                thread_counters = &(my_search_counters[t]);
+                sanisizer::resize(*thread_counters, num_labels);
+            }
+            tracer.end();
+
+            auto process = [&](auto& recorder) -> void {
+                for (Index_ c = start, end = start + length; c < end; ++c) {
+                    ranker(c, work.query_ranked, [&]() -> void { tracer.lap(extract_phase); });
+                    tracer.lap(fill_phase);
+                    const bool query_has_nonzero = scale_query_ranks(num_markers, work.query_ranked, work.query_buffers);
+                    tracer.lap(scaled_phase);
+                    score_and_choose_label(c, query_has_nonzero, my_trained, my_shared, my_options, prune, work, thread_counters, buffers, recorder, [&]() -> void { tracer.lap(search_phase); });
+                    tracer.lap(fine_tune_phase);
+                }
+            };
+
+            tracer.lap_start();
+            if (fine_tune_stats) {
+                my_recorder_starts[t] = start;
+                process(*(my_recorders[t]));
+            } else {
+                NoopFineTuneRecorder rec;
+                process(rec);
+            }
+
+            tracer.count("cells", length);
+            tracer.count_phases();
+            tracer.end();
+        }, num_cells);
+
+        if (fine_tune_stats) {
+            merge_fine_tune_recorders(my_recorder_starts, my_recorders, *fine_tune_stats);
+        }
+        if (search_counters) {
+            sanisizer::resize(*search_counters, num_labels);
+            merge_search_counters(my_search_counters, *search_counters);
+        }
+    }
+
+    template<bool query_sparse_, class Prepare_>
+    void dispatch(const Index_ num_cells, Prepare_ prepare, const ClassifySingleBuffers<Label_, Float_>& buffers) {
+        if (!sanisizer::is_equal(buffers.scores.size(), my_trained.num_labels())) {
+            throw std::runtime_error("length of 'buffers.scores' should be equal to the number of labels");
+        }
+        if (my_ref_sparse) {
+            run<query_sparse_, true>(num_cells, prepare, buffers);
+        } else {
+            run<query_sparse_, false>(num_cells, prepare, buffers);
+        }
+    }
+
+
+public:
+    /**
+     * Classify a chunk of cells from a dense column-major array.
+     *
+     * @param num_cells Number of cells in this chunk.
+     * @param[in] values Pointer to a column-major array of expression values, with number of rows equal to `TrainedSingle::test_nrow()` and number of columns equal to `num_cells`.
+     * Rows should have the same order and identity of genes as the test matrix expected by `trained`.
+     * @param[out] buffers Buffers in which to store the classification output for this chunk.
+     * Each non-`NULL` pointer should refer to an array of length equal to `num_cells`.
+     */
+    void classify_dense(const Index_ num_cells, const Value_* values, const ClassifySingleBuffers<Label_, Float_>& buffers) {
+        const auto test_nrow = my_trained.test_nrow();
+        dispatch<false>(
+            num_cells,
+            [&](int, Index_, Index_) {
+                return [&](Index_ c, RankedVector<Value_, Index_>& ranked, const auto& after_fetch) -> void {
+                    after_fetch();
+                    my_ranker.fill_dense(values + sanisizer::product_unsafe<std::size_t>(test_nrow, c), ranked);
+                };
+            },
+            buffers
+        );
+    }
+
+    /**
+     * Classify a chunk of cells from compressed sparse column buffers.
+     *
+     * @tparam Pointer_ Integer type for the column pointers.
+     *
+     * @param num_cells Number of cells in this chunk.
+     * @param[in] indptrs Pointer to an array of length `num_cells + 1`, containing the column pointers.
+     * Column `c` occupies the interval `[indptrs[c], indptrs[c + 1])` of `indices` and `values`.
+     * @param[in] indices Pointer to an array of row indices for the structural non-zero elements.
+     * Each index should be less than `TrainedSingle::test_nrow()` and indices should be unique within each column.
+     * Rows should have the same order and identity of genes as the test matrix expected by `trained`.
+     * @param[in] values Pointer to an array of expression values for the structural non-zero elements.
+     * @param[out] buffers Buffers in which to store the classification output for this chunk.
+     * Each non-`NULL` pointer should refer to an array of length equal to `num_cells`.
+     */
+    template<typename Pointer_>
+    void classify_sparse(const Index_ num_cells, const Pointer_* indptrs, const Index_* indices, const Value_* values, const ClassifySingleBuffers<Label_, Float_>& buffers) {
+        dispatch<true>(
+            num_cells,
+            [&](int, Index_, Index_) {
+                return [&](Index_ c, RankedVector<Value_, Index_>& ranked, const auto& after_fetch) -> void {
+                    after_fetch();
+                    const auto offset = indptrs[c];
+                    my_ranker.fill_sparse(indptrs[c + 1] - offset, values + offset, indices + offset, ranked);
+                };
+            },
+            buffers
+        );
+    }
+
+    /**
+     * Classify a consecutive range of columns in a `tatami::Matrix`.
+     * This is equivalent to calling `classify_single_subset()` on the columns in `[start, start + length)`, but re-uses the setup and workspaces from previous calls.
+     * Only the extractors for `test` need to be created in each call, and the columns are extracted consecutively without an oracle.
+     *
+     * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+     * This should have the same order and identity of genes as the reference matrix used to create `trained`.
+     * @param start Index of the first column to classify.
+     * @param length Number of columns to classify.
+     * `start + length` should be no greater than the number of columns in `test`.
+     * @param[out] buffers Buffers in which to store the classification output.
+     * Each non-`NULL` pointer should refer to an array of length equal to `length`, where the `i`-th entry contains the result for column `start + i`.
+     */
+    void classify(const tatami::Matrix<Value_, Index_>& test, const Index_ start, const Index_ length, const ClassifySingleBuffers<Label_, Float_>& buffers) {
+        if (!sanisizer::is_equal(my_trained.test_nrow(), test.nrow())) {
+            throw std::runtime_error("number of rows in 'test' is not the same as that expected by 'trained'");
+        }
+        if (start > test.ncol() || length > test.ncol() - start) {
+            throw std::runtime_error("requested range of columns should lie within 'test'");
+        }
+
+        // Using the same rankers as classify_single(), so that the extraction and ranking is identical.
+        // Thread blocks are defined relative to 'start', so we need to shift them back to the matrix's columns.
+        if (test.is_sparse()) {
+            dispatch<true>(
+                length,
+                [&](int, Index_ sub_start, Index_ sub_length) { return create_matrix_ranker(test, static_cast<const Index_*>(NULL), my_sparse_subsorted, static_cast<Index_>(start + sub_start), sub_length); },
+                buffers
+            );
+        } else {
+            dispatch<false>(
+                length,
+                [&](int, Index_ sub_start, Index_ sub_length) { return create_matrix_ranker(test, static_cast<const Index_*>(NULL), my_dense_subsorted, static_cast<Index_>(start + sub_start), sub_length); },
+                buffers
+            );
+        }
+    }
+
+    /**
+     * Classify all cells in a `tatami::Matrix`.
+     * This is equivalent to calling `classify_single()` but re-uses the setup and workspaces from previous calls.
+     * Only the extractors for `test` need to be created in each call.
+     *
+     * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+     * This should have the same order and identity of genes as the reference matrix used to create `trained`.
+     * @param[out] buffers Buffers in which to store the classification output.
+     * Each non-`NULL` pointer should refer to an array of length equal to the number of columns in `test`.
+     */
+    void classify(const tatami::Matrix<Value_, Index_>& test, const ClassifySingleBuffers<Label_, Float_>& buffers) {
+        classify(test, 0, test.ncol(), buffers);
+    }
+};
+
+}
+
+#endif
@@ -2,12 +2,14 @@
 #define SINGLEPP_SUBSET_REMAPPER_HPP
 
 #include "scaled_ranks.hpp"
+#include "utils.hpp"
 
 #include <vector>
 #include <limits>
 #include <cstddef>
 #include <type_traits>
 #include <cassert>
+#include <cstdint>
 
 namespace singlepp {
 
@@ -66,6 +68,25 @@ public:
         my_used.clear();
     }
 
+    // Replace the current subset with the indices of the set bits in 'words', where bit 'b' of word 'w' represents index 'w * 64 + b'.
+    // Unlike add(), the indices are always mapped to the subset in increasing order.
+    void set(const std::vector<std::uint64_t>& words) {
+        clear();
+        const auto num_words = words.size();
+        assert(sanisizer::is_less_than_or_equal(num_words, (static_cast<std::size_t>(my_capacity) + 63) / 64));
+        for (I<decltype(num_words)> w = 0; w < num_words; ++w) {
+            auto current = words[w];
+            const Index_ offset = w * 64; // no overflow as all set bits should be less than 'my_capacity'.
+            while (current) {
+                const Index_ i = offset + count_trailing_zeros(current);
+                assert(i < my_capacity);
+                my_mapping[i] = my_used.size();
+                my_used.push_back(i);
+                current &= current - 1; // unset the lowest bit.
+            }
+        }
+    }
+
     Index_ size() const {
         return my_used.size();
     }
@@ -91,6 +112,26 @@ public:
     void remap(const RankedVector<Stat_, Index_>& input, RankedVector<Stat_, Index_>& output) const {
         remap(input.begin(), input.end(), output);
     }
+
+    // Same as remap(), but each retained entry is also appended to 'retained' with its original index.
+    // This allows callers to cache the filtered rank vector for later remapping with a subset of the currently added indices.
+    template<typename Stat_>
+    void remap(
+        typename RankedVector<Stat_, Index_>::const_iterator begin,
+        typename RankedVector<Stat_, Index_>::const_iterator end,
+        RankedVector<Stat_, Index_>& output,
+        RankedVector<Stat_, Index_>& retained
+    ) const {
+        output.clear();
+        for (; begin != end; ++begin) {
+            assert(sanisizer::is_less_than(begin->second, my_capacity));
+            const auto& target = my_mapping[begin->second];
+            if (target != my_capacity) {
+                output.emplace_back(begin->first, target);
+                retained.push_back(*begin);
+            }
+        }
+    }
 };
 
 }
@@ -11,6 +11,7 @@
 #include <vector>
 #include <type_traits>
 #include <cassert>
+#include <memory>
 
 namespace singlepp {
 
@@ -64,6 +65,55 @@ public:
     }
 };
 
+/*
+ * Creates a ranker that extracts each cell in '[start, start + length)' from
+ * 'test' and fills its ranked vector with 'subsorted'. If 'columns' is
+ * provided, cells refer to positions in 'columns' rather than column indices.
+ * Calls to the ranker should be made in order of the cells.
+ */
+template<bool sparse_, typename Value_, typename Index_>
+auto create_matrix_ranker(const tatami::Matrix<Value_, Index_>& test, const Index_* columns, const SubsetNoop<sparse_, Index_>& subsorted, const Index_ start, const Index_ length) {
+    const auto& subset = subsorted.extraction_subset();
+    const Index_ num_subset = subset.size(); // cast is safe as 'subset' is a unique subset of the rows.
+
+    // If only some columns are requested, we use an oracle to only extract those columns.
+    tatami::VectorPtr<Index_> subset_ptr(tatami::VectorPtr<Index_>{}, &subset);
+    auto ext = [&]() {
+        if (columns) {
+            auto oracle = std::make_shared<tatami::FixedViewOracle<Index_> >(columns + start, length);
+            return tatami::new_extractor<sparse_, true>(&test, false, std::move(oracle), std::move(subset_ptr));
+        } else {
+            return tatami::consecutive_extractor<sparse_>(&test, false, start, length, std::move(subset_ptr));
+        }
+    }();
+
+    auto vbuffer = sanisizer::create<std::vector<Value_> >(num_subset);
+    auto ibuffer = [&](){
+        if constexpr(sparse_) {
+            return sanisizer::create<std::vector<Index_> >(num_subset);
+        } else {
+            return false;
+        }
+    }();
+
+    return [
+        &subsorted,
+        ext = std::move(ext),
+        vbuffer = std::move(vbuffer),
+        ibuffer = std::move(ibuffer)
+    ](const Index_, RankedVector<Value_, Index_>& ranked, const auto& after_fetch) mutable -> void {
+        if constexpr(sparse_) {
+            const auto info = ext->fetch(vbuffer.data(), ibuffer.data());
+            after_fetch();
+            subsorted.fill_ranks(info, ranked);
+        } else {
+            const auto info = ext->fetch(vbuffer.data());
+            after_fetch();
+            subsorted.fill_ranks(info, ranked);
+        }
+    };
+}
+
 /*
  * This class sanitizes any user-provided subsets so that we can provide a
  * sorted subset to the tatami extractor. We then undo the sorting to use the
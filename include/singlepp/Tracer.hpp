@@ -0,0 +1,268 @@
+#ifndef SINGLEPP_TRACER_HPP
+#define SINGLEPP_TRACER_HPP
+
+#include "utils.hpp"
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstddef>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <ios>
+
+/**
+ * @file Tracer.hpp
+ * @brief Record the time spent in each phase of training and classification.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Timed event in a `Tracer`.
+ */
+struct TraceEvent {
+    /**
+     * Name of the event, e.g., the phase of the computation.
+     */
+    std::string name;
+
+    /**
+     * Identifier for the thread in which the event occurred, as reported by `tatami::parallelize()`.
+     */
+    int thread = 0;
+
+    /**
+     * Start time of the event, in microseconds since the construction of the `Tracer`.
+     */
+    double start = 0;
+
+    /**
+     * Duration of the event, in microseconds.
+     */
+    double duration = 0;
+
+    /**
+     * Additional counters for this event, as pairs of names and values.
+     * For events that cover many cells, this usually contains the total time spent in each sub-phase across all cells.
+     */
+    std::vector<std::pair<std::string, double> > counters;
+};
+
+/**
+ * @brief Collect timings from training and classification.
+ *
+ * A pointer to an instance of this class can be supplied in the options for `train_single()` and `classify_single()`.
+ * Each thread will then record events for the major phases of the computation, e.g., each thread's block of cells, or the index construction for each label.
+ * Phases that are repeated for each cell (extraction, ranking, neighbor search, fine-tuning) are too short to record as individual events,
+ * so their total times are reported as counters of the enclosing event instead.
+ *
+ * The events can be written in the Chrome trace event format with `write_chrome_trace()`, for inspection in a trace viewer like Perfetto.
+ * This is useful for identifying load imbalances and stalls in each thread.
+ */
+class Tracer {
+public:
+    /**
+     * Start time for all events is defined as the time of construction.
+     */
+    Tracer() : my_origin(std::chrono::steady_clock::now()) {}
+
+    /**
+     * @return All events that have been recorded so far.
+     * Events are ordered by the time at which their threads submitted them, which may not be the same as their start times.
+     */
+    const std::vector<TraceEvent>& events() const {
+        return my_events;
+    }
+
+    /**
+     * Remove all recorded events.
+     */
+    void clear() {
+        my_events.clear();
+    }
+
+    /**
+     * Write all events in the [Chrome trace event format](https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU).
+     * Each event is reported as a complete event (`"ph": "X"`) with its counters stored in `"args"`.
+     *
+     * @param output Output stream to write to.
+     */
+    void write_chrome_trace(std::ostream& output) const {
+        // Using a fixed precision to avoid scientific notation for long runs.
+        const auto old_flags = output.flags();
+        const auto old_precision = output.precision(3);
+        output.setf(std::ios::fixed, std::ios::floatfield);
+
+        output << "{\"traceEvents\":[";
+        bool first = true;
+        for (const auto& ev : my_events) {
+            if (!first) {
+                output << ",";
+            }
+            first = false;
+
+            output << "\n{\"name\":";
+            write_json_string(output, ev.name);
+            output << ",\"cat\":\"singlepp\",\"ph\":\"X\",\"pid\":0,\"tid\":" << ev.thread << ",\"ts\":" << ev.start << ",\"dur\":" << ev.duration;
+
+            if (!ev.counters.empty()) {
+                output << ",\"args\":{";
+                bool first_counter = true;
+                for (const auto& counter : ev.counters) {
+                    if (!first_counter) {
+                        output << ",";
+                    }
+                    first_counter = false;
+                    write_json_string(output, counter.first);
+                    output << ":" << counter.second;
+                }
+                output << "}";
+            }
+
+            output << "}";
+        }
+        output << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+        output.flags(old_flags);
+        output.precision(old_precision);
+    }
+
+private:
+    std::chrono::steady_clock::time_point my_origin;
+    std::vector<TraceEvent> my_events;
+    std::mutex my_mutex;
+
+    static void write_json_string(std::ostream& output, const std::string& x) {
+        output << "\"";
+        for (auto c : x) {
+            if (c == '"' || c == '\\') {
+                output << "\\" << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                output << " ";
+            } else {
+                output << c;
+            }
+        }
+        output << "\"";
+    }
+
+public:
+    /**
+     * @cond
+     */
+    double since_origin(const std::chrono::steady_clock::time_point& time) const {
+        return std::chrono::duration<double, std::micro>(time - my_origin).count();
+    }
+
+    void submit(std::vector<TraceEvent>& events) {
+        std::lock_guard<std::mutex> lock(my_mutex);
+        for (auto& ev : events) {
+            my_events.push_back(std::move(ev));
+        }
+        events.clear();
+    }
+    /**
+     * @endcond
+     */
+};
+
+/**
+ * @cond
+ */
+// Per-thread recorder that submits its events to the Tracer upon destruction.
+// All methods are no-ops if no Tracer is supplied, so callers don't need to check.
+class ThreadTracer {
+public:
+    ThreadTracer(Tracer* tracer, int thread) : my_tracer(tracer), my_thread(thread) {}
+
+    ~ThreadTracer() {
+        if (my_tracer) {
+            my_tracer->submit(my_events);
+        }
+    }
+
+    ThreadTracer(const ThreadTracer&) = delete;
+    ThreadTracer& operator=(const ThreadTracer&) = delete;
+
+    bool enabled() const {
+        return my_tracer != NULL;
+    }
+
+public:
+    // Scoped events, which may be nested. Each begin() should be matched by an end().
+    void begin(const char* name) {
+        if (my_tracer) {
+            my_open.emplace_back(my_events.size(), std::chrono::steady_clock::now());
+            my_events.emplace_back();
+            auto& ev = my_events.back();
+            ev.name = name;
+            ev.thread = my_thread;
+            ev.start = my_tracer->since_origin(my_open.back().second);
+        }
+    }
+
+    void end() {
+        if (my_tracer) {
+            auto& ev = my_events[my_open.back().first];
+            ev.duration = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - my_open.back().second).count();
+            my_open.pop_back();
+        }
+    }
+
+    // Counters are added to the innermost open event.
+    void count(const char* name, const double value) {
+        if (my_tracer) {
+            my_events[my_open.back().first].counters.emplace_back(name, value);
+        }
+    }
+
+public:
+    // Accumulated phases for the per-cell loop. After calling lap_start(), each call to lap() adds the time elapsed since the previous call to the specified phase.
+    std::size_t add_phase(const char* name) {
+        my_phase_names.push_back(name);
+        my_phase_times.push_back(0);
+        return my_phase_names.size() - 1;
+    }
+
+    void lap_start() {
+        if (my_tracer) {
+            my_last = std::chrono::steady_clock::now();
+        }
+    }
+
+    void lap(const std::size_t phase) {
+        if (my_tracer) {
+            auto now = std::chrono::steady_clock::now();
+            my_phase_times[phase] += std::chrono::duration<double, std::micro>(now - my_last).count();
+            my_last = now;
+        }
+    }
+
+    // Reports the accumulated phase times as counters of the innermost open event, and resets them.
+    void count_phases() {
+        const auto num_phases = my_phase_names.size();
+        for (I<decltype(num_phases)> p = 0; p < num_phases; ++p) {
+            count(my_phase_names[p], my_phase_times[p]);
+            my_phase_times[p] = 0;
+        }
+    }
+
+private:
+    Tracer* my_tracer;
+    int my_thread;
+    std::vector<TraceEvent> my_events;
+    std::vector<std::pair<std::size_t, std::chrono::steady_clock::time_point> > my_open;
+
+    std::vector<const char*> my_phase_names;
+    std::vector<double> my_phase_times;
+    std::chrono::steady_clock::time_point my_last;
+};
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef SINGLEPP_WORKER_POOL_HPP
+#define SINGLEPP_WORKER_POOL_HPP
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "utils.hpp"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * @file WorkerPool.hpp
+ * @brief Persistent pool of worker threads.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Persistent pool of worker threads.
+ *
+ * This keeps a fixed set of threads alive across multiple parallel jobs, avoiding the cost of spawning threads for each job.
+ * It is intended for applications that repeatedly classify small batches of cells, where thread creation is a substantial fraction of the runtime.
+ * The calling thread participates as the first worker, so a pool with `n` threads only spawns `n - 1` additional threads.
+ *
+ * Unlike `tatami::parallelize()`, this always uses `std::thread` and ignores any custom parallelization scheme.
+ * A single pool should not be used to run multiple jobs concurrently, i.e., `run()` should not be called from multiple threads at once.
+ */
+class WorkerPool {
+public:
+    /**
+     * @param num_threads Number of threads in the pool.
+     * Values less than 1 are treated as 1.
+     */
+    WorkerPool(int num_threads) : my_num_threads(std::max(num_threads, 1)) {
+        const auto num_workers = sanisizer::cast<std::size_t>(my_num_threads - 1);
+        sanisizer::resize(my_errors, my_num_threads);
+        my_workers.reserve(num_workers);
+        for (I<decltype(num_workers)> w = 0; w < num_workers; ++w) {
+            my_workers.emplace_back([this, w]() -> void { loop(static_cast<int>(w) + 1); });
+        }
+    }
+
+    /**
+     * @cond
+     */
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lck(my_mutex);
+            my_shutdown = true;
+        }
+        my_start_cv.notify_all();
+        for (auto& w : my_workers) {
+            w.join();
+        }
+    }
+    /**
+     * @endcond
+     */
+
+private:
+    int my_num_threads;
+    std::vector<std::thread> my_workers;
+
+    std::mutex my_mutex;
+    std::condition_variable my_start_cv, my_finish_cv;
+    std::size_t my_generation = 0;
+    int my_remaining = 0;
+    bool my_shutdown = false;
+
+    // Type-erased job, so that run() does not need to allocate (e.g., for a std::function).
+    void* my_job = NULL;
+    void (*my_invoke)(void*, int) = NULL;
+    std::vector<std::exception_ptr> my_errors;
+
+    template<class Job_>
+    static void invoke(void* job, int t) {
+        (*static_cast<Job_*>(job))(t);
+    }
+
+    void execute(int t) {
+        try {
+            my_invoke(my_job, t);
+        } catch (...) {
+            my_errors[t] = std::current_exception();
+        }
+    }
+
+    void loop(int t) {
+        std::size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lck(my_mutex);
+                my_start_cv.wait(lck, [&]() -> bool { return my_shutdown || my_generation != seen; });
+                if (my_shutdown) {
+                    return;
+                }
+                seen = my_generation;
+            }
+
+            execute(t);
+
+            {
+                std::lock_guard<std::mutex> lck(my_mutex);
+                --my_remaining;
+                if (my_remaining == 0) {
+                    my_finish_cv.notify_one();
+                }
+            }
+        }
+    }
+
+public:
+    /**
+     * @return Number of threads in the pool, including the calling thread.
+     */
+    int num_threads() const {
+        return my_num_threads;
+    }
+
+    /**
+     * Split a range of tasks into contiguous blocks and process each block on a separate thread, analogous to `tatami::parallelize()`.
+     * This blocks until all threads have finished.
+     * If any thread throws an exception, it is rethrown in the calling thread after all threads have finished.
+     *
+     * @tparam Index_ Integer type for the number of tasks.
+     * @tparam Function_ Function to be executed by each thread.
+     *
+     * @param fun Function that accepts three arguments - the thread index, the start of the block of tasks, and the number of tasks in the block.
+     * The thread index is guaranteed to be less than `num_threads()`.
+     * This is only called for non-empty blocks.
+     * @param num_tasks Number of tasks.
+     */
+    template<typename Index_, class Function_>
+    void run(Function_ fun, const Index_ num_tasks) {
+        if (num_tasks <= 0) {
+            return;
+        }
+
+        const Index_ per_thread = num_tasks / my_num_threads + (num_tasks % my_num_threads > 0);
+        auto job = [&](int t) -> void {
+            if (sanisizer::is_greater_than(t, (num_tasks - 1) / per_thread)) { // trailing threads may not have any tasks.
+                return;
+            }
+            const Index_ start = per_thread * t; // no overflow as this is less than num_tasks.
+            fun(t, start, std::min<Index_>(per_thread, num_tasks - start));
+        };
+
+        for (auto& e : my_errors) {
+            e = nullptr;
+        }
+
+        if (my_workers.empty()) {
+            job(0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(my_mutex);
+            my_job = static_cast<void*>(&job);
+            my_invoke = &invoke<I<decltype(job)> >;
+            my_remaining = my_workers.size();
+            ++my_generation;
+        }
+        my_start_cv.notify_all();
+
+        execute(0);
+
+        {
+            std::unique_lock<std::mutex> lck(my_mutex);
+            my_finish_cv.wait(lck, [&]() -> bool { return my_remaining == 0; });
+            my_job = NULL;
+            my_invoke = NULL;
+        }
+
+        for (const auto& e : my_errors) {
+            if (e) {
+                std::rethrow_exception(e);
+            }
+        }
+    }
+};
+
+}
+
+#endif
@@ -9,10 +9,12 @@
 #include "l2.hpp"
 #include "SubsetRemapper.hpp"
 #include "SubsetSanitizer.hpp"
+#include "PreRankedTest.hpp"
 #include "train_integrated.hpp"
 #include "find_best_and_delta.hpp"
 #include "fill_labels_in_use.hpp"
 #include "correlations_to_score.hpp"
+#include "FineTuneStatistics.hpp"
 
 #include <vector>
 #include <algorithm>
@@ -20,6 +22,7 @@
 #include <cmath>
 #include <cstddef>
 #include <optional>
+#include <stdexcept>
 
 namespace singlepp {
 
@@ -33,6 +36,10 @@ struct PrecomputedIntegratedDetails {
 
 template<typename Index_, typename Float_>
 PrecomputedIntegratedDetails<Index_, Float_> precompute_integrated_details(const TrainedIntegrated<Index_>& trained, const Float_ quantile) {
+    if (quantile < 0 || quantile > 1) {
+        throw std::runtime_error("'quantile' should be in [0, 1]");
+    }
+
     PrecomputedIntegratedDetails<Index_, Float_> output;
     output.num_universe = trained.subset().size(); // safety of cast is implicit as universe is a subset of all rows in the various tatami::Matrix objects.
 
@@ -80,7 +87,7 @@ private:
     typename std::conditional<query_sparse_, SparseScaled<Index_, Float_>, bool>::type my_scaled_query_sparse;
     std::optional<std::vector<Float_> > my_scaled_query_dense;
 
-    std::vector<Float_> my_all_l2;
+    SmallestL2<Index_, Float_> my_smallest_l2;
 
 public:
     AnnotateIntegrated(const PrecomputedIntegratedDetails<Index_, Float_>& details) : my_num_universe(details.num_universe), my_remapper(my_num_universe) {
@@ -107,7 +114,7 @@ public:
             my_scaled_query_dense.emplace(sanisizer::cast<I<decltype(my_scaled_query_dense->size())> >(my_num_universe));
         }
 
-        sanisizer::reserve(my_all_l2, details.max_num_samples);
+        my_smallest_l2.reserve(details.max_num_samples);
     }
 
 private:
@@ -200,7 +207,8 @@ private:
 
             const auto& curref = references[ref_index];
             const auto curassigned = assigned[ref_index][query_index];
-            my_all_l2.clear();
+            const auto& curdeets = quantile_details[ref_index][curassigned];
+            my_smallest_l2.reset(curdeets);
 
             if (curref.sparse.has_value()) {
                 const auto& curlab = (*(curref.sparse))[curassigned];
@@ -222,7 +230,7 @@ private:
                         *my_scaled_ref_sparse
                     );
 
-                    my_all_l2.push_back(l2);
+                    my_smallest_l2.add(l2);
                 }
 
             } else {
@@ -246,15 +254,16 @@ private:
                             num_markers,
                             my_scaled_query_dense->data(),
                             my_subset_ref,
-                            my_scaled_ref_dense->data()
+                            my_scaled_ref_dense->data(),
+                            my_smallest_l2.bound()
                         );
                     }
 
-                    my_all_l2.push_back(l2);
+                    my_smallest_l2.add(l2);
                 }
             }
 
-            const auto score = l2_to_score(my_all_l2, quantile_details[ref_index][curassigned]);
+            const auto score = my_smallest_l2.score(curdeets);
             scores.push_back(score);
         }
     }
@@ -272,7 +281,7 @@ public:
         run_internal<true>(query_index, query_ranked, trained, assigned, false, quantile_details, scores);
     }
 
-    template<typename Label_, typename RefLabel_>
+    template<typename Label_, typename RefLabel_, class Recorder_>
     std::pair<RefLabel_, Float_> run_fine(
         const Index_ query_index,
         const RankedVector<Value_, Index_>& query_ranked, 
@@ -281,56 +290,81 @@ public:
         const std::vector<std::vector<PrecomputedQuantileDetails<Index_, Float_> > >& quantile_details,
         const Float_ threshold,
         std::vector<Float_>& scores,
-        std::vector<RefLabel_>& reflabels_in_use
+        std::vector<RefLabel_>& reflabels_in_use,
+        Recorder_& recorder
     ) {
         auto candidate = fill_labels_in_use(scores, threshold, reflabels_in_use);
         while (reflabels_in_use.size() > 1 && reflabels_in_use.size() < scores.size()) {
             run_internal<false>(query_index, query_ranked, trained, assigned, reflabels_in_use, quantile_details, scores);
+
+            if constexpr(Recorder_::enabled) {
+                const auto& references = trained.references();
+                std::size_t num_profiles = 0;
+                for (auto r : reflabels_in_use) {
+                    const auto curassigned = assigned[r][query_index];
+                    const auto& curref = references[r];
+                    num_profiles += (curref.sparse.has_value() ? (*(curref.sparse))[curassigned].num_samples : (*(curref.dense))[curassigned].num_samples);
+                }
+                recorder.add_iteration(reflabels_in_use.size(), my_remapper.size(), num_profiles);
+            }
+
             candidate = update_labels_in_use(scores, threshold, reflabels_in_use);
         }
         return candidate;
     }
+
+    template<typename Label_, typename RefLabel_>
+    std::pair<RefLabel_, Float_> run_fine(
+        const Index_ query_index,
+        const RankedVector<Value_, Index_>& query_ranked, 
+        const TrainedIntegrated<Index_>& trained,
+        const std::vector<const Label_*>& assigned,
+        const std::vector<std::vector<PrecomputedQuantileDetails<Index_, Float_> > >& quantile_details,
+        const Float_ threshold,
+        std::vector<Float_>& scores,
+        std::vector<RefLabel_>& reflabels_in_use
+    ) {
+        NoopFineTuneRecorder recorder;
+        return run_fine(query_index, query_ranked, trained, assigned, quantile_details, threshold, scores, reflabels_in_use, recorder);
+    }
 };
 
-template<bool query_sparse_, typename Value_, typename Index_, typename Label_, typename Float_, typename RefLabel_>
+// 'create_ranker(start, length)' should return a ranker for the columns in '[start, start + length)', see annotate_cells_single_raw() for details.
+// 'precomputed' should be created by precompute_integrated_details(), and can be re-used across calls that process different chunks of the same test matrix.
+template<bool query_sparse_, typename Value_, typename Index_, typename Label_, typename Float_, typename RefLabel_, class CreateRanker_>
 void annotate_cells_integrated_raw(
-    const tatami::Matrix<Value_, Index_>& test,
+    CreateRanker_ create_ranker,
+    const Index_ first_column,
+    const Index_ num_cells,
     const TrainedIntegrated<Index_>& trained,
     const std::vector<const Label_*>& assigned,
-    Float_ quantile,
+    const PrecomputedIntegratedDetails<Index_, Float_>& precomputed,
     bool fine_tune,
     Float_ threshold,
     RefLabel_* best, 
     const std::vector<Float_*>& scores,
     Float_* delta,
+    FineTuneStatistics* fine_tune_stats,
     int num_threads
 ) {
-    const auto& subset = trained.subset();
-    SubsetNoop<query_sparse_, Index_> subsorted(subset);
-
-    if (quantile < 0 || quantile > 1) {
-        throw std::runtime_error("'quantile' should be in [0, 1]");
-    }
-    const auto precomputed = precompute_integrated_details(trained, quantile);
     const auto num_universe = precomputed.num_universe;
 
     const auto nref = trained.references().size();
     sanisizer::cast<RefLabel_>(nref); // checking that it'll fit in the output.
 
-    tatami::parallelize([&](int, Index_ start, Index_ len) {
+    // Each thread records its own statistics, which are combined at the end.
+    std::vector<std::optional<FineTuneRecorder> > recorders;
+    std::vector<Index_> recorder_starts;
+    if (fine_tune_stats) {
+        recorders.resize(sanisizer::cast<I<decltype(recorders.size())> >(num_threads));
+        recorder_starts.resize(recorders.size());
+    }
+
+    tatami::parallelize([&](int t, Index_ start, Index_ len) {
         AnnotateIntegrated<query_sparse_, Index_, Value_, Float_> ft(precomputed);
         RankedVector<Value_, Index_> test_ranked_full;
         test_ranked_full.reserve(num_universe);
 
-        auto vbuffer = sanisizer::create<std::vector<Value_> >(num_universe);
-        auto ibuffer = [&](){
-            if constexpr(query_sparse_) {
-                return sanisizer::create<std::vector<Index_> >(num_universe);
-            } else {
-                return false;
-            }
-        }();
-
         std::vector<Float_> all_scores;
         sanisizer::reserve(all_scores, nref);
         std::optional<std::vector<RefLabel_> > reflabels_in_use;
@@ -339,62 +373,114 @@ void annotate_cells_integrated_raw(
             sanisizer::reserve(*reflabels_in_use, nref);
         }
 
-        // We perform an indexed extraction, so all subsequent indices
-        // will refer to indices into this subset (i.e., 'universe').
-        tatami::VectorPtr<Index_> universe_ptr(tatami::VectorPtr<Index_>{}, &subset);
-        auto mat_work = tatami::consecutive_extractor<query_sparse_>(&test, false, start, len, std::move(universe_ptr));
+        // All indices in the ranked vector refer to positions in the subset (i.e., 'universe').
+        // Output buffers are indexed relative to 'first_column', to allow callers to process the test matrix in chunks of columns.
+        auto ranker = create_ranker(static_cast<Index_>(first_column + start), len);
 
-        for (Index_ i = start, end = start + len; i < end; ++i) {
-            const auto info = [&](){
-                if constexpr(query_sparse_) {
-                    return mat_work->fetch(vbuffer.data(), ibuffer.data());
-                } else {
-                    return mat_work->fetch(vbuffer.data());
+        // Using a generic lambda so that the recording calls can be compiled away if no statistics are requested.
+        auto process = [&](auto& recorder) -> void {
+            for (Index_ i = start, end = start + len; i < end; ++i) {
+                const Index_ column = first_column + i;
+                ranker(column, test_ranked_full, []() -> void {});
+
+                ft.run_first(column, test_ranked_full, trained, assigned, precomputed.quantile_details, all_scores);
+                for (I<decltype(nref)> r = 0; r < nref; ++r) {
+                    if (scores[r]) {
+                        scores[r][i] = all_scores[r];
+                    }
                 }
-            }();
-            subsorted.fill_ranks(info, test_ranked_full);
 
-            ft.run_first(i, test_ranked_full, trained, assigned, precomputed.quantile_details, all_scores);
-            for (I<decltype(nref)> r = 0; r < nref; ++r) {
-                scores[r][i] = all_scores[r];
-            }
+                std::pair<RefLabel_, Float_> candidate;
+                recorder.start_cell();
+                if (fine_tune) {
+                    candidate = ft.run_fine(column, test_ranked_full, trained, assigned, precomputed.quantile_details, threshold, all_scores, *reflabels_in_use, recorder);
+                } else {
+                    candidate = find_best_and_delta<RefLabel_>(all_scores);
+                }
+                recorder.finish_cell();
 
-            std::pair<RefLabel_, Float_> candidate;
-            if (fine_tune) {
-                candidate = ft.run_fine(i, test_ranked_full, trained, assigned, precomputed.quantile_details, threshold, all_scores, *reflabels_in_use);
-            } else {
-                candidate = find_best_and_delta<RefLabel_>(all_scores);
+                best[i] = candidate.first;
+                if (delta) {
+                    delta[i] = candidate.second;
+                }
             }
+        };
 
-            best[i] = candidate.first;
-            if (delta) {
-                delta[i] = candidate.second;
-            }
+        if (fine_tune_stats) {
+            auto& rec = recorders[t];
+            rec.emplace();
+            recorder_starts[t] = start;
+            process(*rec);
+        } else {
+            NoopFineTuneRecorder rec;
+            process(rec);
         }
-    }, test.ncol(), num_threads);
+    }, num_cells, num_threads);
+
+    if (fine_tune_stats) {
+        merge_fine_tune_recorders(recorder_starts, recorders, *fine_tune_stats);
+    }
 }
 
 template<typename Value_, typename Index_, typename Label_, typename Float_, typename RefLabel_>
 void annotate_cells_integrated(
     const tatami::Matrix<Value_, Index_>& test,
+    const Index_ first_column,
+    const Index_ num_cells,
     const TrainedIntegrated<Index_>& trained,
     const std::vector<const Label_*>& assigned,
-    Float_ quantile,
+    const PrecomputedIntegratedDetails<Index_, Float_>& precomputed,
     bool fine_tune,
     Float_ threshold,
     RefLabel_* best, 
     const std::vector<Float_*>& scores,
     Float_* delta,
+    FineTuneStatistics* fine_tune_stats,
     int num_threads
 ) {
     if (!sanisizer::is_equal(test.nrow(), trained.test_nrow())) {
         throw std::runtime_error("number of rows in 'test' do not match up with those expected by 'trained'");
     }
 
+    const auto& subset = trained.subset();
+    if (test.is_sparse()) {
+        SubsetNoop<true, Index_> subsorted(subset);
+        const auto create_ranker = [&](const Index_ start, const Index_ length) { return create_matrix_ranker(test, static_cast<const Index_*>(NULL), subsorted, start, length); };
+        annotate_cells_integrated_raw<true, Value_>(create_ranker, first_column, num_cells, trained, assigned, precomputed, fine_tune, threshold, best, scores, delta, fine_tune_stats, num_threads);
+    } else {
+        SubsetNoop<false, Index_> subsorted(subset);
+        const auto create_ranker = [&](const Index_ start, const Index_ length) { return create_matrix_ranker(test, static_cast<const Index_*>(NULL), subsorted, start, length); };
+        annotate_cells_integrated_raw<false, Value_>(create_ranker, first_column, num_cells, trained, assigned, precomputed, fine_tune, threshold, best, scores, delta, fine_tune_stats, num_threads);
+    }
+}
+
+template<typename Value_, typename Index_, typename Label_, typename Float_, typename RefLabel_>
+void annotate_cells_integrated(
+    const PreRankedTest<Value_, Index_>& test,
+    const TrainedIntegrated<Index_>& trained,
+    const std::vector<const Label_*>& assigned,
+    const PrecomputedIntegratedDetails<Index_, Float_>& precomputed,
+    bool fine_tune,
+    Float_ threshold,
+    RefLabel_* best, 
+    const std::vector<Float_*>& scores,
+    Float_* delta,
+    FineTuneStatistics* fine_tune_stats,
+    int num_threads
+) {
+    if (!sanisizer::is_equal(test.test_nrow(), trained.test_nrow())) {
+        throw std::runtime_error("number of rows in 'test' do not match up with those expected by 'trained'");
+    }
+
+    // Skipping extraction and sorting by projecting each cell's cached ranked vector onto the universe.
+    const PreRankedQueryRanker<Value_, Index_> ranker(test, trained.subset());
+    const auto create_ranker = [&](const Index_, const Index_) { return ranker.create(); };
+    const Index_ first_column = 0;
+    const auto num_cells = test.num_cells();
     if (test.is_sparse()) {
-        annotate_cells_integrated_raw<true>(test, trained, assigned, quantile, fine_tune, threshold, best, scores, delta, num_threads);
+        annotate_cells_integrated_raw<true, Value_>(create_ranker, first_column, num_cells, trained, assigned, precomputed, fine_tune, threshold, best, scores, delta, fine_tune_stats, num_threads);
     } else {
-        annotate_cells_integrated_raw<false>(test, trained, assigned, quantile, fine_tune, threshold, best, scores, delta, num_threads);
+        annotate_cells_integrated_raw<false, Value_>(create_ranker, first_column, num_cells, trained, assigned, precomputed, fine_tune, threshold, best, scores, delta, fine_tune_stats, num_threads);
     }
 }
 
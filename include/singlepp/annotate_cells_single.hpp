@@ -9,7 +9,14 @@
 #include "train_single.hpp"
 #include "SubsetSanitizer.hpp"
 #include "SubsetRemapper.hpp"
+#include "PreRankedTest.hpp"
+#include "MarkerBitsets.hpp"
+#include "FineTuneStatistics.hpp"
+#include "Tracer.hpp"
+#include "SearchCounters.hpp"
+#include "WorkerPool.hpp"
 #include "find_best_and_delta.hpp"
+#include "fixed_point_scores.hpp"
 #include "scaled_ranks.hpp"
 #include "l2.hpp"
 #include "correlations_to_score.hpp"
@@ -22,6 +29,9 @@
 #include <cassert>
 #include <type_traits>
 #include <optional>
+#include <cstddef>
+#include <limits>
+#include <utility>
 
 namespace singlepp {
 
@@ -79,64 +89,242 @@ private:
     std::vector<Label_> my_labels_in_use;
     SubsetRemapper<Index_> my_gene_subset;
     RankedVector<Value_, Index_> my_subset_query; // don't fold this into QueryBuffers, as it mutates in each iteration.
-    RankedVector<Index_, Index_> my_subset_ref;
-    typename std::conditional<ref_sparse_, RankedVector<Index_, Index_>, bool>::type my_subset_ref_alt;
-    typename std::conditional<ref_sparse_, std::vector<std::pair<Index_, Float_> >, std::vector<Float_> >::type my_scaled_ref;
-    std::vector<Float_> my_all_l2;
+
+    // Buffers for computing the score of a single label, so that each thread needs its own copy when parallelizing across labels.
+    struct LabelScratch {
+        RankedVector<Index_, Index_> subset_ref;
+        typename std::conditional<ref_sparse_, RankedVector<Index_, Index_>, bool>::type subset_ref_alt;
+        typename std::conditional<ref_sparse_, std::vector<std::pair<Index_, Float_> >, std::vector<Float_> >::type scaled_ref;
+        SmallestL2<Index_, Float_> smallest_l2;
+    };
+    LabelScratch my_scratch;
+    Index_ my_max_num_samples = 0;
+
+    // Optional parallelization across labels within each fine-tuning iteration, see set_label_parallelism().
+    WorkerPool* my_pool = NULL;
+    std::vector<LabelScratch> my_pool_scratch;
+
+    // Cache of the reference ranks from the previous fine-tuning iteration, restricted to that iteration's labels and markers.
+    // As the labels in use (and thus the markers) can only shrink across iterations, we can filter the cache instead of the full 'all_ranked'.
+    // Indices are still relative to the full set of markers so that the cache can be directly used in SubsetRemapper::remap().
+    struct Cache {
+        RankedVector<Index_, Index_> ranked;
+
+        // For dense references, profile 'c' of label 'l' occupies '[indptrs[offsets[l] + c], indptrs[offsets[l] + c + 1])' of 'ranked'.
+        // For sparse references, each profile has two consecutive ranges in 'indptrs', containing the negative and positive ranks respectively.
+        std::vector<std::size_t> indptrs;
+        std::vector<std::size_t> offsets;
+    };
+    Cache my_cache, my_next_cache;
+    bool my_cache_filled = false;
+    std::size_t my_cache_limit;
+
+    // If available, the markers for the labels in use are obtained by OR-ing the bitsets instead of adding each marker to 'my_gene_subset'.
+    const MarkerBitsets<Index_>* my_bitsets;
+    std::vector<std::uint64_t> my_marker_words;
 
 public:
     typedef typename std::conditional<ref_sparse_, SparsePerLabel<Index_, Float_>, DensePerLabel<Index_, Float_> >::type PerLabel;
 
-    FineTuneSingle(const Index_ full_num_markers, const std::vector<PerLabel>& ref) : my_gene_subset(full_num_markers) {
+    // 'cache_size' is the maximum memory usage of the cache in bytes, split between the current and previous iterations.
+    // 'bitsets' may be NULL, in which case the markers for the labels in use are collected from the FlatPairwiseMarkers directly.
+    FineTuneSingle(const Index_ full_num_markers, const std::vector<PerLabel>& ref, const std::size_t cache_size, const MarkerBitsets<Index_>* bitsets) :
+        my_gene_subset(full_num_markers),
+        my_cache_limit(cache_size / (2 * sizeof(typename RankedVector<Index_, Index_>::value_type))),
+        my_bitsets(bitsets)
+    {
         sanisizer::reserve(my_labels_in_use, ref.size());
-
-        sanisizer::reserve(my_subset_ref, full_num_markers); 
-        if constexpr(ref_sparse_) {
-            sanisizer::reserve(my_subset_ref_alt, full_num_markers); 
+        if (my_cache_limit) {
+            sanisizer::resize(my_cache.offsets, ref.size());
+            sanisizer::resize(my_next_cache.offsets, ref.size());
         }
 
-        sanisizer::reserve(my_scaled_ref, full_num_markers);
-
-        I<decltype(get_num_samples(ref.front()))> max_labels = 0;
         for (const auto& curref : ref) {
-            max_labels = std::max(max_labels, get_num_samples(curref));
+            my_max_num_samples = std::max(my_max_num_samples, get_num_samples(curref));
         }
-        sanisizer::reserve(my_all_l2, max_labels);
+        reserve_scratch(my_scratch);
     }
 
+private:
+    void reserve_scratch(LabelScratch& scratch) const {
+        const auto full_num_markers = my_gene_subset.capacity();
+        sanisizer::reserve(scratch.subset_ref, full_num_markers); 
+        if constexpr(ref_sparse_) {
+            sanisizer::reserve(scratch.subset_ref_alt, full_num_markers); 
+        }
+        sanisizer::reserve(scratch.scaled_ref, full_num_markers);
+        scratch.smallest_l2.reserve(my_max_num_samples);
+    }
+
+public:
     // For testing only.
-    FineTuneSingle(const TrainedSingle<Index_, Float_>& trained) : 
-        FineTuneSingle(trained.subset().size(), get_per_label_references<ref_sparse_>(trained.built()))
+    FineTuneSingle(const TrainedSingle<Index_, Float_>& trained, const std::size_t cache_size = 0, const MarkerBitsets<Index_>* bitsets = NULL) : 
+        FineTuneSingle(trained.subset().size(), get_per_label_references<ref_sparse_>(trained.built()), cache_size, bitsets)
     {}
 
+    // Parallelize the score calculations across labels in each fine-tuning iteration, using the threads in 'pool'.
+    // This disables the cache as it is filled sequentially; this has no effect on the results.
+    // 'pool' may be NULL to restore serial execution.
+    void set_label_parallelism(WorkerPool* pool) {
+        my_pool = pool;
+        if (pool) {
+            my_pool_scratch.resize(sanisizer::cast<I<decltype(my_pool_scratch.size())> >(pool->num_threads()));
+            for (auto& scratch : my_pool_scratch) {
+                reserve_scratch(scratch);
+            }
+        }
+    }
+
+private:
+    // Computes the score for label 'curlab' from the scaled ranks of the query in 'query_buffers', using the current subset of markers.
+    // If 'fill_cache = true', the filtered reference ranks for this label are also appended to the next cache.
+    Float_ score_label(
+        const PerLabel& curref,
+        const PrecomputedQuantileDetails<Index_, Float_>& curdeets,
+        const Label_ curlab,
+        const Index_ current_num_markers,
+        const QueryBuffers<query_sparse_, ref_sparse_, Index_, Float_>& query_buffers,
+        const bool query_has_nonzero,
+        const bool fill_cache,
+        LabelScratch& scratch
+    ) {
+        if constexpr(!ref_sparse_) {
+            scratch.scaled_ref.resize(current_num_markers);
+        }
+
+        scratch.smallest_l2.reset(curdeets);
+        const auto NC = get_num_samples(curref);
+
+        const auto cache_offset = (my_cache_filled ? my_cache.offsets[curlab] : 0);
+        if (fill_cache) {
+            my_next_cache.offsets[curlab] = my_next_cache.indptrs.size() - 1;
+        }
+
+        for (I<decltype(NC)> c = 0; c < NC; ++c) {
+            Float_ l2 = 0;
+            if constexpr(ref_sparse_) {
+                auto nStart = curref.negative_ranked.begin() + curref.negative_indptrs[c];
+                auto nEnd = curref.negative_ranked.begin() + curref.negative_indptrs[c + 1];
+                auto pStart = curref.positive_ranked.begin() + curref.positive_indptrs[c];
+                auto pEnd = curref.positive_ranked.begin() + curref.positive_indptrs[c + 1];
+                if (my_cache_filled) {
+                    const auto cStart = my_cache.ranked.begin(), cIndptrs = my_cache.indptrs.begin() + cache_offset + 2 * static_cast<std::size_t>(c);
+                    nStart = cStart + cIndptrs[0];
+                    nEnd = cStart + cIndptrs[1];
+                    pStart = nEnd;
+                    pEnd = cStart + cIndptrs[2];
+                }
+
+                if (fill_cache) {
+                    my_gene_subset.remap(nStart, nEnd, scratch.subset_ref, my_next_cache.ranked);
+                    my_next_cache.indptrs.push_back(my_next_cache.ranked.size());
+                    my_gene_subset.remap(pStart, pEnd, scratch.subset_ref_alt, my_next_cache.ranked);
+                    my_next_cache.indptrs.push_back(my_next_cache.ranked.size());
+                } else {
+                    my_gene_subset.remap(nStart, nEnd, scratch.subset_ref);
+                    my_gene_subset.remap(pStart, pEnd, scratch.subset_ref_alt);
+                }
+
+                l2 = scaled_ranks_sparse_l2(
+                    current_num_markers,
+                    query_buffers.dense_scaled.data(),
+                    query_has_nonzero,
+                    scratch.subset_ref,
+                    scratch.subset_ref_alt,
+                    scratch.scaled_ref
+                );
+
+            } else {
+                auto refstart = curref.all_ranked.begin();
+                auto refend = refstart;
+                if (my_cache_filled) {
+                    const auto cIndptrs = my_cache.indptrs.begin() + cache_offset + static_cast<std::size_t>(c);
+                    refstart = my_cache.ranked.begin() + cIndptrs[0];
+                    refend = my_cache.ranked.begin() + cIndptrs[1];
+                } else {
+                    const auto full_num_markers = my_gene_subset.capacity();
+                    refstart += sanisizer::product_unsafe<std::size_t>(full_num_markers, c);
+                    refend = refstart + full_num_markers;
+                }
+
+                if (fill_cache) {
+                    my_gene_subset.remap(refstart, refend, scratch.subset_ref, my_next_cache.ranked);
+                    my_next_cache.indptrs.push_back(my_next_cache.ranked.size());
+                } else {
+                    my_gene_subset.remap(refstart, refend, scratch.subset_ref);
+                }
+
+                if constexpr(query_sparse_) {
+                    l2 = scaled_ranks_sparse_l2(
+                        current_num_markers,
+                        query_buffers.sparse_scaled,
+                        scratch.subset_ref,
+                        scratch.scaled_ref.data()
+                    );
+                } else {
+                    l2 = scaled_ranks_dense_l2(
+                        current_num_markers,
+                        query_buffers.dense_scaled.data(),
+                        scratch.subset_ref,
+                        scratch.scaled_ref.data(),
+                        scratch.smallest_l2.bound()
+                    );
+                }
+            }
+
+            scratch.smallest_l2.add(l2);
+        }
+
+        return scratch.smallest_l2.score(curdeets);
+    }
+
 public:
+    template<class Recorder_>
     std::pair<Label_, Float_> run(
         const RankedVector<Value_, Index_>& input, 
         const TrainedSingle<Index_, Float_>& trained,
         const std::vector<PrecomputedQuantileDetails<Index_, Float_> >& quantile_details,
         const Float_ threshold,
         QueryBuffers<query_sparse_, ref_sparse_, Index_, Float_>& query_buffers,
-        std::vector<Float_>& scores
+        std::vector<Float_>& scores,
+        Recorder_& recorder
     ) {
         auto candidate = fill_labels_in_use(scores, threshold, my_labels_in_use);
         const auto& ref = get_per_label_references<ref_sparse_>(trained.built());
-        const auto& markers = trained.markers();
+        const auto& markers = trained.flat_markers();
+        my_cache_filled = false;
 
         // If there's only one top label, we don't need to do anything else.
         // We also give up if every label is in range, because any subsequent
         // calculations would use all markers and just give the same result.
         while (my_labels_in_use.size() > 1 && my_labels_in_use.size() < scores.size()) {
-            my_gene_subset.clear();
-            for (auto l : my_labels_in_use) {
-                for (auto l2 : my_labels_in_use){ 
-                    for (auto c : markers[l][l2]) {
-                        my_gene_subset.add(c);
+            if (my_bitsets) {
+                my_bitsets->fill(my_labels_in_use, my_marker_words);
+            } else {
+                // Setting the bits directly so that the markers are in the same (increasing) order as when the bitsets are available.
+                my_marker_words.clear();
+                my_marker_words.resize(MarkerBitsets<Index_>::compute_num_words(my_gene_subset.capacity()));
+                for (auto l : my_labels_in_use) {
+                    for (auto l2 : my_labels_in_use){ 
+                        for (auto mIt = markers.begin(l, l2), mEnd = markers.end(l, l2); mIt != mEnd; ++mIt) {
+                            const auto m = *mIt;
+                            my_marker_words[m / 64] |= static_cast<std::uint64_t>(1) << (m % 64);
+                        }
                     }
                 }
             }
+            my_gene_subset.set(my_marker_words);
             my_gene_subset.remap(input, my_subset_query);
             const auto current_num_markers = my_gene_subset.size();
 
+            if constexpr(Recorder_::enabled) {
+                std::size_t num_profiles = 0;
+                for (auto l : my_labels_in_use) {
+                    num_profiles += get_num_samples(ref[l]);
+                }
+                recorder.add_iteration(my_labels_in_use.size(), current_num_markers, num_profiles);
+            }
+
             bool query_has_nonzero = false;
             if constexpr(query_sparse_) {
                 const auto substart = my_subset_query.begin();
@@ -175,69 +363,48 @@ public:
                 );
             }
 
-            if constexpr(!ref_sparse_) {
-                my_scaled_ref.resize(current_num_markers);
+            // We only fill the cache if it can hold all profiles for the labels in use.
+            // For sparse references, this is an upper bound as the zeros are not stored.
+            // If the cache is too small, we just fall back to the previous cache (if any) or the full reference ranks.
+            bool fill_cache = false;
+            if (my_cache_limit && !my_pool) {
+                std::size_t cache_request = 0;
+                for (auto l : my_labels_in_use) {
+                    cache_request += sanisizer::product_unsafe<std::size_t>(get_num_samples(ref[l]), current_num_markers);
+                    if (cache_request > my_cache_limit) {
+                        break;
+                    }
+                }
+
+                if (cache_request <= my_cache_limit) {
+                    fill_cache = true;
+                    my_next_cache.ranked.clear();
+                    my_next_cache.ranked.reserve(cache_request);
+                    my_next_cache.indptrs.clear();
+                    my_next_cache.indptrs.push_back(0);
+                }
             }
 
-            scores.clear();
-            auto nlabels_used = my_labels_in_use.size();
-            for (I<decltype(nlabels_used)> i = 0; i < nlabels_used; ++i) {
-                auto curlab = my_labels_in_use[i];
-
-                my_all_l2.clear();
-                const auto& curref = ref[curlab];
-                const auto NC = get_num_samples(curref);
-
-                for (I<decltype(NC)> c = 0; c < NC; ++c) {
-                    // Technically we could be faster if we remembered the
-                    // subset from the previous fine-tuning iteration, but this
-                    // requires us to (possibly) make a copy of the entire
-                    // reference set; we can't afford to do this in each thread.
-
-                    Float_ l2 = 0;
-                    if constexpr(ref_sparse_) {
-                        const auto nStart = curref.negative_ranked.begin();
-                        my_gene_subset.remap(nStart + curref.negative_indptrs[c], nStart + curref.negative_indptrs[c + 1], my_subset_ref);
-                        const auto pStart = curref.positive_ranked.begin();
-                        my_gene_subset.remap(pStart + curref.positive_indptrs[c], pStart + curref.positive_indptrs[c + 1], my_subset_ref_alt);
-
-                        l2 = scaled_ranks_sparse_l2(
-                            current_num_markers,
-                            query_buffers.dense_scaled.data(),
-                            query_has_nonzero,
-                            my_subset_ref,
-                            my_subset_ref_alt,
-                            my_scaled_ref
-                        );
-
-                    } else {
-                        const auto full_num_markers = my_gene_subset.capacity();
-                        const auto refstart = curref.all_ranked.begin() + sanisizer::product_unsafe<std::size_t>(full_num_markers, c);
-                        const auto refend = refstart + full_num_markers;
-                        my_gene_subset.remap(refstart, refend, my_subset_ref);
-
-                        if constexpr(query_sparse_) {
-                            l2 = scaled_ranks_sparse_l2(
-                                current_num_markers,
-                                query_buffers.sparse_scaled,
-                                my_subset_ref,
-                                my_scaled_ref.data()
-                            );
-                        } else {
-                            l2 = scaled_ranks_dense_l2(
-                                current_num_markers,
-                                query_buffers.dense_scaled.data(),
-                                my_subset_ref,
-                                my_scaled_ref.data()
-                            );
-                        }
+            const auto nlabels_used = my_labels_in_use.size();
+            scores.resize(nlabels_used); // no need to use sanisizer as this is no greater than the number of labels.
+            if (my_pool && nlabels_used > 1) {
+                my_pool->run([&](int t, I<decltype(nlabels_used)> start, I<decltype(nlabels_used)> length) -> void {
+                    auto& scratch = my_pool_scratch[t];
+                    for (auto i = start, end = start + length; i < end; ++i) {
+                        const auto curlab = my_labels_in_use[i];
+                        scores[i] = score_label(ref[curlab], quantile_details[curlab], curlab, current_num_markers, query_buffers, query_has_nonzero, false, scratch);
                     }
-
-                    my_all_l2.push_back(l2);
+                }, nlabels_used);
+            } else {
+                for (I<decltype(nlabels_used)> i = 0; i < nlabels_used; ++i) {
+                    const auto curlab = my_labels_in_use[i];
+                    scores[i] = score_label(ref[curlab], quantile_details[curlab], curlab, current_num_markers, query_buffers, query_has_nonzero, fill_cache, my_scratch);
                 }
+            }
 
-                const Float_ score = l2_to_score(my_all_l2, quantile_details[curlab]);
-                scores.push_back(score);
+            if (fill_cache) {
+                std::swap(my_cache, my_next_cache);
+                my_cache_filled = true;
             }
 
             candidate = update_labels_in_use(scores, threshold, my_labels_in_use); 
@@ -245,176 +412,586 @@ public:
 
         return candidate;
     }
+
+    std::pair<Label_, Float_> run(
+        const RankedVector<Value_, Index_>& input, 
+        const TrainedSingle<Index_, Float_>& trained,
+        const std::vector<PrecomputedQuantileDetails<Index_, Float_> >& quantile_details,
+        const Float_ threshold,
+        QueryBuffers<query_sparse_, ref_sparse_, Index_, Float_>& query_buffers,
+        std::vector<Float_>& scores
+    ) {
+        NoopFineTuneRecorder recorder;
+        return run(input, trained, quantile_details, threshold, query_buffers, scores, recorder);
+    }
 };
 
-template<bool query_sparse_, bool ref_sparse_, typename Value_, typename Index_, typename Float_, typename Label_>
-void annotate_cells_single_raw(
-    const tatami::Matrix<Value_, Index_>& test,
+// Fills the ranks of the markers from a raw test vector, i.e., without going through a tatami extractor.
+template<typename Index_>
+class RawQueryRanker {
+private:
+    const std::vector<Index_>& my_subset;
+
+    // Position of each row of the test matrix in the subset, or the number of markers if it is not a marker.
+    std::vector<Index_> my_row_to_marker;
+
+public:
+    RawQueryRanker(const std::vector<Index_>& subset, const std::size_t test_nrow) : my_subset(subset) {
+        const Index_ num_markers = subset.size(); // cast is safe as 'subset' is a unique subset of the rows of the reference matrix.
+        my_row_to_marker.resize(sanisizer::cast<I<decltype(my_row_to_marker.size())> >(test_nrow), num_markers);
+        for (Index_ i = 0; i < num_markers; ++i) {
+            my_row_to_marker[subset[i]] = i;
+        }
+    }
+
+    // 'values' should contain the expression values for all rows of the test matrix.
+    template<typename Value_>
+    void fill_dense(const Value_* values, RankedVector<Value_, Index_>& ranked) const {
+        ranked.clear();
+        const Index_ num_markers = my_subset.size();
+        for (Index_ s = 0; s < num_markers; ++s) {
+            ranked.emplace_back(values[my_subset[s]], s);
+        }
+        std::sort(ranked.begin(), ranked.end());
+    }
+
+    // 'indices' should contain unique row indices of the test matrix, not necessarily sorted.
+    template<typename Number_, typename Value_>
+    void fill_sparse(const Number_ number, const Value_* values, const Index_* indices, RankedVector<Value_, Index_>& ranked) const {
+        const Index_ num_markers = my_subset.size();
+        ranked.clear();
+        for (Number_ j = 0; j < number; ++j) {
+            const auto pos = my_row_to_marker[indices[j]];
+            if (pos < num_markers) {
+                ranked.emplace_back(values[j], pos);
+            }
+        }
+        std::sort(ranked.begin(), ranked.end());
+    }
+};
+
+// Read-only state that is computed once from the trained reference and shared across all threads.
+template<typename Index_, typename Float_>
+struct ClassifySingleShared {
+    std::vector<PrecomputedQuantileDetails<Index_, Float_> > quantile_details;
+    Index_ max_num_samples = 0;
+    std::optional<MarkerBitsets<Index_> > bitsets;
+};
+
+template<bool ref_sparse_, typename Index_, typename Float_>
+ClassifySingleShared<Index_, Float_> prepare_classify_single(
     const TrainedSingle<Index_, Float_>& trained,
     Float_ quantile,
     bool fine_tune,
-    Float_ threshold,
-    Label_* best, 
-    const std::vector<Float_*>& scores,
-    Float_* delta,
-    int num_threads
+    std::size_t fine_tune_bitset_limit
 ) {
-    const auto& subset = trained.subset();
-    const Index_ num_markers = subset.size(); // cast is safe as 'subset' is a unique subset of the rows of the reference matrix.
-    SubsetNoop<query_sparse_, Index_> subsorted(subset);
-
-    const auto& built = trained.built();
-    const auto& ref = get_per_label_references<ref_sparse_>(built);
+    const Index_ num_markers = trained.subset().size(); // cast is safe as 'subset' is a unique subset of the rows of the reference matrix.
+    const auto& ref = get_per_label_references<ref_sparse_>(trained.built());
     const auto num_labels = ref.size();
 
     if (quantile < 0 || quantile > 1) {
         throw std::runtime_error("'quantile' should be in [0, 1]");
     }
-    auto quantile_details = std::vector<PrecomputedQuantileDetails<Index_, Float_> >(num_labels);
-    Index_ max_num_samples = 0;
+
+    ClassifySingleShared<Index_, Float_> output;
+    output.quantile_details.resize(num_labels);
     for (I<decltype(num_labels)> r = 0; r < num_labels; ++r) {
         const auto num_samples = get_num_samples(ref[r]);
-        quantile_details[r] = precompute_quantile_details(num_samples, quantile);
-        max_num_samples = std::max(max_num_samples, num_samples);
+        output.quantile_details[r] = precompute_quantile_details(num_samples, quantile);
+        output.max_num_samples = std::max(output.max_num_samples, num_samples);
     }
 
-    tatami::parallelize([&](int, Index_ start, Index_ length) {
-        tatami::VectorPtr<Index_> subset_ptr(tatami::VectorPtr<Index_>{}, &subset);
-        auto ext = tatami::consecutive_extractor<query_sparse_>(&test, false, start, length, std::move(subset_ptr));
+    // Bitsets are shared across threads, so we only need to build them once.
+    if (fine_tune && MarkerBitsets<Index_>::fits(num_labels, num_markers, fine_tune_bitset_limit)) {
+        output.bitsets.emplace(num_markers, trained.flat_markers());
+    }
 
-        auto vbuffer = sanisizer::create<std::vector<Value_> >(num_markers);
-        auto ibuffer = [&](){
-            if constexpr(query_sparse_) {
-                return sanisizer::create<std::vector<Index_> >(num_markers);
-            } else {
-                return false;
-            }
-        }();
+    return output;
+}
+
+// Per-thread workspace for classifying one cell at a time.
+// This can be re-used across any number of cells, e.g., across different calls in a streaming context.
+template<typename Label_, typename Index_, typename Float_>
+struct LabelPruningWorkspace {
+    std::vector<std::pair<Float_, Index_> > seed_distances;
+    std::vector<std::size_t> seed_offsets;
+    std::vector<std::pair<Float_, Index_> > bound_buffer;
+    std::vector<std::pair<Float_, Label_> > order;
+};
 
-        RankedVector<Value_, Index_> query_ranked;
+template<bool query_sparse_, bool ref_sparse_, typename Label_, typename Index_, typename Float_, typename Value_>
+struct ClassifySingleWorkspace {
+    ClassifySingleWorkspace(
+        const TrainedSingle<Index_, Float_>& trained,
+        const ClassifySingleShared<Index_, Float_>& shared,
+        bool fine_tune,
+        std::size_t fine_tune_cache_size
+    ) :
+        query_buffers(trained.subset().size()),
+        find_work(shared.max_num_samples)
+    {
+        const Index_ num_markers = trained.subset().size();
         query_ranked.reserve(num_markers);
+        const auto& ref = get_per_label_references<ref_sparse_>(trained.built());
+        if (fine_tune) {
+            fine_tuner.emplace(num_markers, ref, fine_tune_cache_size, (shared.bitsets.has_value() ? &(*(shared.bitsets)) : NULL));
+        }
+        sanisizer::resize(scores, ref.size());
+    }
 
-        QueryBuffers<query_sparse_, ref_sparse_, Index_, Float_> query_buffers(num_markers);
-        FindClosestNeighborsWorkspace<Index_, Float_> find_work(max_num_samples);
+    RankedVector<Value_, Index_> query_ranked;
+    QueryBuffers<query_sparse_, ref_sparse_, Index_, Float_> query_buffers;
+    FindClosestNeighborsWorkspace<Index_, Float_> find_work;
+    std::optional<FineTuneSingle<query_sparse_, ref_sparse_, Label_, Index_, Float_, Value_> > fine_tuner;
+    std::vector<Float_> scores;
+    std::vector<Label_> top_order; // only used when reporting the top labels.
+    LabelPruningWorkspace<Label_, Index_, Float_> prune_work; // only used when pruning labels.
+};
 
-        std::optional<FineTuneSingle<query_sparse_, ref_sparse_, Label_, Index_, Float_, Value_> > ft;
-        if (fine_tune) {
-            ft.emplace(num_markers, ref);
+// Computes the scaled ranks of the query from its ranked marker expression values.
+// Returns whether any of the scaled ranks are non-zero.
+template<bool query_sparse_, bool ref_sparse_, typename Value_, typename Index_, typename Float_>
+bool scale_query_ranks(
+    const Index_ num_markers,
+    const RankedVector<Value_, Index_>& query_ranked,
+    QueryBuffers<query_sparse_, ref_sparse_, Index_, Float_>& query_buffers
+) {
+    if constexpr(query_sparse_) {
+        const auto qStart = query_ranked.begin(), qEnd = query_ranked.end();
+        const auto zero_ranges = find_zero_ranges<Value_, Index_>(qStart, qEnd);
+
+        if constexpr(ref_sparse_) {
+            return scaled_ranks_sparse<Index_, Value_, Float_>(
+                num_markers,
+                qStart,
+                zero_ranges.first,
+                zero_ranges.second,
+                qEnd,
+                query_buffers.sparse_scaled,
+                query_buffers.dense_scaled.data()
+            );
+        } else {
+            const bool query_has_nonzero = scaled_ranks_sparse<Index_, Value_, Float_>(
+                num_markers,
+                qStart,
+                zero_ranges.first,
+                zero_ranges.second,
+                qEnd,
+                query_buffers.sparse_scaled
+            );
+            std::sort(query_buffers.sparse_scaled.nonzero.begin(), query_buffers.sparse_scaled.nonzero.end()); // improve cache locality in sparse_l2().
+            return query_has_nonzero;
         }
-        auto curscores = sanisizer::create<std::vector<Float_> >(num_labels);
 
-        for (Index_ c = start, end = start + length; c < end; ++c) {
-            bool query_has_nonzero = false;
-            if constexpr(query_sparse_) {
-                const auto info = ext->fetch(vbuffer.data(), ibuffer.data());
-                subsorted.fill_ranks(info, query_ranked);
-                const auto qStart = query_ranked.begin(), qEnd = query_ranked.end();
-                const auto zero_ranges = find_zero_ranges<Value_, Index_>(qStart, qEnd);
+    } else {
+        return scaled_ranks_dense(
+            num_markers,
+            query_ranked,
+            query_buffers.dense_scaled.data()
+        );
+    }
+}
 
-                if constexpr(ref_sparse_) {
-                    query_has_nonzero = scaled_ranks_sparse<Index_, Value_, Float_>(
-                        num_markers,
-                        qStart,
-                        zero_ranges.first,
-                        zero_ranges.second,
-                        qEnd,
-                        query_buffers.sparse_scaled,
-                        query_buffers.dense_scaled.data()
-                    );
-                } else {
-                    query_has_nonzero = scaled_ranks_sparse<Index_, Value_, Float_>(
-                        num_markers,
-                        qStart,
-                        zero_ranges.first,
-                        zero_ranges.second,
-                        qEnd,
-                        query_buffers.sparse_scaled
-                    );
-                    std::sort(query_buffers.sparse_scaled.nonzero.begin(), query_buffers.sparse_scaled.nonzero.end()); // improve cache locality in sparse_l2().
-                }
+// Computes the score from the closest neighbors of the query in 'find_work'.
+template<typename Index_, typename Float_>
+Float_ neighbors_to_score(FindClosestNeighborsWorkspace<Index_, Float_>& find_work, const PrecomputedQuantileDetails<Index_, Float_>& qdeets) {
+    const Float_ right_l2 = get_furthest_neighbor(find_work).first;
+    const Float_ right_cor = l2_to_correlation(right_l2);
+    if (!qdeets.find_left) {
+        return right_cor;
+    } else {
+        pop_furthest_neighbor(find_work);
+        const Float_ left_l2 = get_furthest_neighbor(find_work).first;
+        const Float_ left_cor = l2_to_correlation(left_l2);
+        return left_cor + (right_cor - left_cor) * qdeets.right_prop; // see l2_to_score() for more details.
+    }
+}
 
+// Computes the score for each label in '[label_start, label_end)' from the scaled ranks of the query, storing them in 'scores'.
+// 'search_counters' may be NULL, otherwise it should have one entry per label.
+template<bool query_sparse_, bool ref_sparse_, typename Index_, typename Float_, class PerLabel_, typename Label_>
+void score_labels(
+    const Index_ num_markers,
+    const std::vector<PerLabel_>& ref,
+    const std::vector<PrecomputedQuantileDetails<Index_, Float_> >& quantile_details,
+    const QueryBuffers<query_sparse_, ref_sparse_, Index_, Float_>& query_buffers,
+    const bool query_has_nonzero,
+    const Label_ label_start,
+    const Label_ label_end,
+    FindClosestNeighborsWorkspace<Index_, Float_>& find_work,
+    Float_* scores,
+    std::vector<SearchCounters>* search_counters
+) {
+    for (Label_ r = label_start; r < label_end; ++r) {
+        const auto& qdeets = quantile_details[r];
+        const Index_ k = qdeets.right_index + 1; // cast is safe as k <= num_samples.
+        const auto search = [&](auto& counters) -> void {
+            if constexpr(query_sparse_ && !ref_sparse_) {
+                find_closest_neighbors<query_sparse_, ref_sparse_>(num_markers, query_buffers.sparse_scaled, query_has_nonzero, k, ref[r], find_work, counters);
             } else {
-                auto info = ext->fetch(vbuffer.data());
-                subsorted.fill_ranks(info, query_ranked);
-                query_has_nonzero = scaled_ranks_dense(
-                    num_markers,
-                    query_ranked,
-                    query_buffers.dense_scaled.data()
-                );
+                find_closest_neighbors<query_sparse_, ref_sparse_>(num_markers, query_buffers.dense_scaled, query_has_nonzero, k, ref[r], find_work, counters);
             }
+        };
+        if (search_counters) {
+            search((*search_counters)[r]);
+        } else {
+            NoopSearchCounters counters;
+            search(counters);
+        }
 
-            curscores.resize(num_labels); // no need to use sanisizer as we already checked during the initial allocation.
-            for (I<decltype(num_labels)> r = 0; r < num_labels; ++r) {
-                const auto& qdeets = quantile_details[r];
-                const Index_ k = qdeets.right_index + 1; // cast is safe as k <= num_samples.
-                if constexpr(query_sparse_ && !ref_sparse_) {
-                    find_closest_neighbors<query_sparse_, ref_sparse_>(num_markers, query_buffers.sparse_scaled, query_has_nonzero, k, ref[r], find_work);
-                } else {
-                    find_closest_neighbors<query_sparse_, ref_sparse_>(num_markers, query_buffers.dense_scaled, query_has_nonzero, k, ref[r], find_work);
-                }
+        scores[r] = neighbors_to_score(find_work, qdeets);
+    }
+}
 
-                const Float_ right_l2 = get_furthest_neighbor(find_work).first;
-                const Float_ right_cor = l2_to_correlation(right_l2);
-                if (!qdeets.find_left) {
-                    curscores[r] = right_cor;
-                } else {
-                    pop_furthest_neighbor(find_work);
-                    const Float_ left_l2 = get_furthest_neighbor(find_work).first;
-                    const Float_ left_cor = l2_to_correlation(left_l2);
-                    curscores[r] = left_cor + (right_cor - left_cor) * qdeets.right_prop; // see l2_to_score() for more details.
-                }
+// Computes the score for each label like score_labels(), but skips the exact calculation for labels that cannot affect the assigned label or its delta.
+// Specifically, labels are processed in decreasing order of an upper bound on their scores, computed from the query-to-seed distances and the cluster radii.
+// Once the upper bound for the next label is below the second-highest score so far (or the fine-tuning bound, if lower), all remaining labels are skipped.
+// Skipped labels are assigned a score of -Inf so that they are never chosen by find_best_and_delta() or included in the first round of fine-tuning.
+// This means that the best label and delta are the same as if score_labels() was used.
+template<bool query_sparse_, bool ref_sparse_, typename Index_, typename Float_, class PerLabel_, typename Label_>
+void score_labels_pruned(
+    const Index_ num_markers,
+    const std::vector<PerLabel_>& ref,
+    const std::vector<PrecomputedQuantileDetails<Index_, Float_> >& quantile_details,
+    const QueryBuffers<query_sparse_, ref_sparse_, Index_, Float_>& query_buffers,
+    const bool query_has_nonzero,
+    const bool fine_tune,
+    const Float_ threshold,
+    FindClosestNeighborsWorkspace<Index_, Float_>& find_work,
+    LabelPruningWorkspace<Label_, Index_, Float_>& prune_work,
+    Float_* scores,
+    std::vector<SearchCounters>* search_counters
+) {
+    const Label_ num_labels = ref.size(); // cast is safe as the labels must be representable in Label_.
+    const auto& query = [&]() -> const auto& {
+        if constexpr(query_sparse_ && !ref_sparse_) {
+            return query_buffers.sparse_scaled;
+        } else {
+            return query_buffers.dense_scaled;
+        }
+    }();
+
+    // Each distance is a sum over all markers, so the rounding error scales with the number of markers.
+    // We use a conservative slack to ensure that the bounds are never tighter than the exact distances.
+    constexpr Float_ eps = std::numeric_limits<Float_>::epsilon();
+    const Float_ distance_slack = 3 * std::sqrt(static_cast<Float_>(num_markers + 1) * eps);
+    const Float_ score_slack = 8 * eps;
+
+    // First pass computes the seed distances for all labels, which are cached for use in the neighbor search.
+    auto& all_seeds = prune_work.seed_distances;
+    auto& offsets = prune_work.seed_offsets;
+    auto& order = prune_work.order;
+    all_seeds.clear();
+    offsets.clear();
+    offsets.push_back(0);
+    order.clear();
+
+    for (Label_ r = 0; r < num_labels; ++r) {
+        const auto compute = [&](auto& counters) -> void {
+            compute_seed_distances<query_sparse_, ref_sparse_>(num_markers, query, query_has_nonzero, ref[r], find_work.seed_distances, counters);
+        };
+        if (search_counters) {
+            compute((*search_counters)[r]);
+        } else {
+            NoopSearchCounters counters;
+            compute(counters);
+        }
 
-                if (scores[r]) {
-                    scores[r][c] = curscores[r];
-                }
+        all_seeds.insert(all_seeds.end(), find_work.seed_distances.begin(), find_work.seed_distances.end());
+        offsets.push_back(all_seeds.size());
+
+        // The score is no greater than the correlation to the closer of the two neighbors flanking the quantile.
+        const auto& qdeets = quantile_details[r];
+        const Index_ rank = qdeets.right_index + !qdeets.find_left; // cast is safe as rank <= num_samples.
+        const Float_ lower = lower_bound_neighbor_distance(ref[r], find_work.seed_distances.data(), find_work.seed_distances.size(), rank, distance_slack, prune_work.bound_buffer);
+        order.emplace_back(l2_to_correlation(lower * lower), r);
+    }
+
+    std::sort(order.begin(), order.end(), [](const std::pair<Float_, Label_>& left, const std::pair<Float_, Label_>& right) -> bool {
+        return left.first > right.first || (left.first == right.first && left.second < right.second);
+    });
+
+    // Second pass computes the exact scores in order of decreasing upper bound.
+    constexpr Float_ inf = std::numeric_limits<Float_>::infinity();
+    Float_ first = -inf, second = -inf;
+    for (I<decltype(order.size())> i = 0, end = order.size(); i < end; ++i) {
+        const Float_ cutoff = (fine_tune ? std::min(second, first - threshold) : second);
+        if (order[i].first + score_slack < cutoff) {
+            for (; i < end; ++i) {
+                scores[order[i].second] = -inf;
             }
+            break;
+        }
 
-            std::pair<Label_, Float_> chosen;
-            if (!fine_tune) {
-                chosen = find_best_and_delta<Label_>(curscores);
-            } else {
-                chosen = ft->run(query_ranked, trained, quantile_details, threshold, query_buffers, curscores);
+        const auto r = order[i].second;
+        find_work.seed_distances.clear();
+        find_work.seed_distances.insert(find_work.seed_distances.end(), all_seeds.begin() + offsets[r], all_seeds.begin() + offsets[r + 1]);
+
+        const auto& qdeets = quantile_details[r];
+        const Index_ k = qdeets.right_index + 1; // cast is safe as k <= num_samples.
+        const auto search = [&](auto& counters) -> void {
+            find_closest_neighbors_from_seeds<query_sparse_, ref_sparse_>(num_markers, query, query_has_nonzero, k, ref[r], find_work, counters);
+        };
+        if (search_counters) {
+            search((*search_counters)[r]);
+        } else {
+            NoopSearchCounters counters;
+            search(counters);
+        }
+
+        const Float_ current = neighbors_to_score(find_work, qdeets);
+        scores[r] = current;
+        if (current > first) {
+            second = first;
+            first = current;
+        } else if (current > second) {
+            second = current;
+        }
+    }
+}
+
+// Chooses the best label (and its delta) from the per-label scores in 'work', possibly after fine-tuning.
+template<bool query_sparse_, bool ref_sparse_, typename Label_, typename Index_, typename Float_, typename Value_, class Recorder_>
+std::pair<Label_, Float_> choose_label(
+    const TrainedSingle<Index_, Float_>& trained,
+    const ClassifySingleShared<Index_, Float_>& shared,
+    const Float_ threshold,
+    ClassifySingleWorkspace<query_sparse_, ref_sparse_, Label_, Index_, Float_, Value_>& work,
+    Recorder_& recorder
+) {
+    if (!work.fine_tuner.has_value()) {
+        return find_best_and_delta<Label_>(work.scores);
+    } else {
+        return work.fine_tuner->run(work.query_ranked, trained, shared.quantile_details, threshold, work.query_buffers, work.scores, recorder);
+    }
+}
+
+// Scores cell 'c' from its scaled ranks in 'work', stores the results in 'buffers' and chooses its label, possibly after fine-tuning.
+// 'prune' should only be true if no per-label scores are requested in 'buffers', see use_pruned_scoring().
+// 'after_score()' is called once the initial scores are computed, e.g., to record the time spent before fine-tuning.
+template<bool query_sparse_, bool ref_sparse_, typename Label_, typename Index_, typename Float_, typename Value_, class Buffers_, class Options_, class Recorder_, class AfterScore_>
+void score_and_choose_label(
+    const Index_ c,
+    const bool query_has_nonzero,
+    const TrainedSingle<Index_, Float_>& trained,
+    const ClassifySingleShared<Index_, Float_>& shared,
+    const Options_& options,
+    const bool prune,
+    ClassifySingleWorkspace<query_sparse_, ref_sparse_, Label_, Index_, Float_, Value_>& work,
+    std::vector<SearchCounters>* counters,
+    const Buffers_& buffers,
+    Recorder_& recorder,
+    const AfterScore_& after_score
+) {
+    const Index_ num_markers = trained.subset().size(); // cast is safe as 'subset' is a unique subset of the rows of the reference matrix.
+    const auto& ref = get_per_label_references<ref_sparse_>(trained.built());
+    const auto num_labels = ref.size();
+
+    work.scores.resize(num_labels); // no need to use sanisizer as we already checked during the initial allocation.
+    if (prune) {
+        score_labels_pruned(num_markers, ref, shared.quantile_details, work.query_buffers, query_has_nonzero, options.fine_tune, options.fine_tune_threshold, work.find_work, work.prune_work, work.scores.data(), counters);
+    } else {
+        score_labels(num_markers, ref, shared.quantile_details, work.query_buffers, query_has_nonzero, static_cast<Label_>(0), static_cast<Label_>(num_labels), work.find_work, work.scores.data(), counters);
+        for (I<decltype(num_labels)> r = 0; r < num_labels; ++r) {
+            if (buffers.scores[r]) {
+                buffers.scores[r][c] = work.scores[r];
             }
+        }
+    }
+    if (buffers.cell_major_scores || buffers.cell_major_fixed_scores) {
+        const auto offset = sanisizer::product_unsafe<std::size_t>(c, num_labels);
+        fill_cell_major_scores(work.scores, (buffers.cell_major_scores ? buffers.cell_major_scores + offset : NULL), (buffers.cell_major_fixed_scores ? buffers.cell_major_fixed_scores + offset : NULL));
+    }
+    if (buffers.top_k && (buffers.top_labels || buffers.top_scores)) {
+        const auto offset = sanisizer::product_unsafe<std::size_t>(c, buffers.top_k);
+        find_top_labels(work.scores, buffers.top_k, work.top_order, (buffers.top_labels ? buffers.top_labels + offset : NULL), (buffers.top_scores ? buffers.top_scores + offset : NULL));
+    }
+    after_score();
+
+    recorder.start_cell();
+    const auto chosen = choose_label(trained, shared, options.fine_tune_threshold, work, recorder);
+    recorder.finish_cell();
+
+    buffers.best[c] = chosen.first;
+    if (buffers.delta) {
+        buffers.delta[c] = chosen.second;
+    }
+}
+
+// Pruned scoring skips the exact scores for labels that cannot be chosen, so it can only be used if none of the per-label scores are reported.
+template<class Buffers_, class Options_>
+bool use_pruned_scoring(const Buffers_& buffers, const Options_& options) {
+    const bool report_top = buffers.top_k && (buffers.top_labels || buffers.top_scores);
+    const bool report_cell_major = buffers.cell_major_scores || buffers.cell_major_fixed_scores;
+    return options.prune_labels && !report_top && !report_cell_major && std::all_of(buffers.scores.begin(), buffers.scores.end(), [](const auto ptr) -> bool { return ptr == NULL; });
+}
+
+// 'create_ranker(start, length)' should return a ranker for the cells in '[start, start + length)'.
+// Each call to 'ranker(c, ranked, after_fetch)' should fill 'ranked' for cell 'c' in order, calling 'after_fetch()' once the cell's data is available.
+// 'Buffers_' and 'Options_' should be ClassifySingleBuffers and ClassifySingleOptions, or any types with the same members.
+template<bool query_sparse_, bool ref_sparse_, typename Value_, typename Index_, typename Float_, class Buffers_, class Options_, class CreateRanker_>
+void annotate_cells_single_raw(
+    CreateRanker_ create_ranker,
+    const Index_ num_cells,
+    const TrainedSingle<Index_, Float_>& trained,
+    const Buffers_& buffers,
+    const Options_& options
+) {
+    typedef I<decltype(*(buffers.best))> Label_;
+    const Index_ num_markers = trained.subset().size(); // cast is safe as 'subset' is a unique subset of the rows of the reference matrix.
+
+    const auto& built = trained.built();
+    const auto& ref = get_per_label_references<ref_sparse_>(built);
+    const auto num_labels = ref.size();
+    const auto shared = prepare_classify_single<ref_sparse_>(trained, options.quantile, options.fine_tune, options.fine_tune_bitset_limit);
+    const auto num_threads = options.num_threads;
+
+    // Each thread records its own statistics, which are combined at the end.
+    std::vector<std::optional<FineTuneRecorder> > recorders;
+    std::vector<Index_> recorder_starts;
+    const auto fine_tune_stats = buffers.fine_tune_statistics;
+    if (fine_tune_stats) {
+        recorders.resize(sanisizer::cast<I<decltype(recorders.size())> >(num_threads));
+        recorder_starts.resize(recorders.size());
+    }
 
-            best[c] = chosen.first;
-            if (delta) {
-                delta[c] = chosen.second;
+    // Each thread has its own search counters to avoid contention, which are summed at the end.
+    std::vector<std::vector<SearchCounters> > all_search_counters;
+    const auto search_counters = buffers.search_counters;
+    if (search_counters) {
+        sanisizer::resize(all_search_counters, num_threads);
+    }
+
+    tatami::parallelize([&](int t, Index_ start, Index_ length) {
+        ThreadTracer tracer(options.tracer, t);
+        tracer.begin("classify_single");
+        const auto extract_phase = tracer.add_phase("extract_us");
+        const auto fill_phase = tracer.add_phase("fill_ranks_us");
+        const auto scaled_phase = tracer.add_phase("scaled_ranks_us");
+        const auto search_phase = tracer.add_phase("search_us");
+        const auto fine_tune_phase = tracer.add_phase("fine_tune_us");
+        tracer.begin("setup");
+
+        auto ranker = create_ranker(start, length);
+
+        ClassifySingleWorkspace<query_sparse_, ref_sparse_, Label_, Index_, Float_, Value_> work(trained, shared, options.fine_tune, options.fine_tune_cache_size);
+        std::vector<SearchCounters>* thread_counters = NULL;
+        if (search_counters) {
+            thread_counters = &(all_search_counters[t]);
+            sanisizer::resize(*thread_counters, num_labels);
+        }
+
+        const bool prune = use_pruned_scoring(buffers, options);
+        tracer.end();
+
+        // Using a generic lambda so that the recording calls can be compiled away if no statistics are requested.
+        auto process = [&](auto& recorder) -> void {
+            for (Index_ c = start, end = start + length; c < end; ++c) {
+                ranker(c, work.query_ranked, [&]() -> void { tracer.lap(extract_phase); });
+                tracer.lap(fill_phase);
+                const bool query_has_nonzero = scale_query_ranks(num_markers, work.query_ranked, work.query_buffers);
+                tracer.lap(scaled_phase);
+                score_and_choose_label(c, query_has_nonzero, trained, shared, options, prune, work, thread_counters, buffers, recorder, [&]() -> void { tracer.lap(search_phase); });
+                tracer.lap(fine_tune_phase);
             }
+        };
+
+        tracer.lap_start();
+        if (fine_tune_stats) {
+            auto& rec = recorders[t];
+            rec.emplace();
+            recorder_starts[t] = start;
+            process(*rec);
+        } else {
+            NoopFineTuneRecorder rec;
+            process(rec);
         }
-    }, test.ncol(), num_threads);
 
-    return;
+        tracer.count("cells", length);
+        tracer.count_phases();
+        tracer.end();
+    }, num_cells, num_threads);
+
+    if (fine_tune_stats) {
+        merge_fine_tune_recorders(recorder_starts, recorders, *fine_tune_stats);
+    }
+    if (search_counters) {
+        sanisizer::resize(*search_counters, num_labels);
+        merge_search_counters(all_search_counters, *search_counters);
+    }
+}
+
+// Dispatches to annotate_cells_single_raw() for the combination of query and reference representations.
+template<bool query_sparse_, typename Value_, typename Index_, typename Float_, class Buffers_, class Options_, class CreateRanker_>
+void annotate_cells_single_dispatch(
+    CreateRanker_ create_ranker,
+    const Index_ num_cells,
+    const TrainedSingle<Index_, Float_>& trained,
+    const Buffers_& buffers,
+    const Options_& options
+) {
+    if (trained.built().sparse.has_value()) {
+        annotate_cells_single_raw<query_sparse_, true, Value_>(std::move(create_ranker), num_cells, trained, buffers, options);
+    } else {
+        annotate_cells_single_raw<query_sparse_, false, Value_>(std::move(create_ranker), num_cells, trained, buffers, options);
+    }
 }
 
-template<typename Value_, typename Index_, typename Float_, typename Label_>
+template<typename Value_, typename Index_, typename Float_, class Buffers_, class Options_>
 void annotate_cells_single(
     const tatami::Matrix<Value_, Index_>& test,
+    const Index_* columns,
+    const Index_ num_cells,
     const TrainedSingle<Index_, Float_>& trained,
-    Float_ quantile,
-    bool fine_tune,
-    Float_ threshold,
-    Label_* best, 
-    const std::vector<Float_*>& scores,
-    Float_* delta,
-    int num_threads
+    const Buffers_& buffers,
+    const Options_& options
 ) {
     if (!sanisizer::is_equal(trained.test_nrow(), test.nrow())) {
         throw std::runtime_error("number of rows in 'test' is not the same as that expected by 'trained'");
     }
+    if (columns) {
+        const auto NC = test.ncol();
+        for (Index_ i = 0; i < num_cells; ++i) {
+            bool okay = columns[i] < NC;
+            if constexpr(std::is_signed<Index_>::value) {
+                okay = okay && columns[i] >= 0;
+            }
+            if (!okay) {
+                throw std::runtime_error("column indices should be non-negative and less than the number of columns in 'test'");
+            }
+        }
+    }
 
-    const auto ref_sparse = trained.built().sparse.has_value();
+    const auto& subset = trained.subset();
     if (test.is_sparse()) {
-        if (ref_sparse) {
-            annotate_cells_single_raw<true, true>(test, trained, quantile, fine_tune, threshold, best, scores, delta, num_threads);
-        } else {
-            annotate_cells_single_raw<true, false>(test, trained, quantile, fine_tune, threshold, best, scores, delta, num_threads);
-        }
+        SubsetNoop<true, Index_> subsorted(subset);
+        const auto create_ranker = [&](const Index_ start, const Index_ length) { return create_matrix_ranker(test, columns, subsorted, start, length); };
+        annotate_cells_single_dispatch<true, Value_>(create_ranker, num_cells, trained, buffers, options);
     } else {
-        if (ref_sparse) {
-            annotate_cells_single_raw<false, true>(test, trained, quantile, fine_tune, threshold, best, scores, delta, num_threads);
-        } else {
-            annotate_cells_single_raw<false, false>(test, trained, quantile, fine_tune, threshold, best, scores, delta, num_threads);
-        }
+        SubsetNoop<false, Index_> subsorted(subset);
+        const auto create_ranker = [&](const Index_ start, const Index_ length) { return create_matrix_ranker(test, columns, subsorted, start, length); };
+        annotate_cells_single_dispatch<false, Value_>(create_ranker, num_cells, trained, buffers, options);
+    }
+}
+
+template<typename Value_, typename Index_, typename Float_, class Buffers_, class Options_>
+void annotate_cells_single(
+    const PreRankedTest<Value_, Index_>& test,
+    const TrainedSingle<Index_, Float_>& trained,
+    const Buffers_& buffers,
+    const Options_& options
+) {
+    if (!sanisizer::is_equal(trained.test_nrow(), test.test_nrow())) {
+        throw std::runtime_error("number of rows in 'test' is not the same as that expected by 'trained'");
+    }
+
+    // Skipping extraction and sorting by projecting each cell's cached ranked vector onto the classifier's subset.
+    const PreRankedQueryRanker<Value_, Index_> ranker(test, trained.subset());
+    const auto create_ranker = [&](const Index_, const Index_) { return ranker.create(); };
+    if (test.is_sparse()) {
+        annotate_cells_single_dispatch<true, Value_>(create_ranker, test.num_cells(), trained, buffers, options);
+    } else {
+        annotate_cells_single_dispatch<false, Value_>(create_ranker, test.num_cells(), trained, buffers, options);
     }
 }
 
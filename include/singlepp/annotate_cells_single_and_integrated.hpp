@@ -0,0 +1,169 @@
+#ifndef SINGLEPP_ANNOTATE_CELLS_SINGLE_AND_INTEGRATED_HPP
+#define SINGLEPP_ANNOTATE_CELLS_SINGLE_AND_INTEGRATED_HPP
+
+#include "defs.hpp"
+
+#include "tatami/tatami.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "annotate_cells_single_multiple.hpp"
+#include "annotate_cells_integrated.hpp"
+#include "FineTuneStatistics.hpp"
+#include "Tracer.hpp"
+#include "train_single.hpp"
+#include "train_integrated.hpp"
+#include "utils.hpp"
+
+#include <vector>
+#include <optional>
+#include <stdexcept>
+#include <cstddef>
+
+namespace singlepp {
+
+// 'Buffers_' and 'Options_' should be ClassifySingleBuffers and ClassifySingleOptions, see annotate_cells_single_raw().
+// Similarly, 'IntegratedBuffers_' and 'IntegratedOptions_' should be ClassifyIntegratedBuffers and ClassifyIntegratedOptions.
+template<typename Value_, typename Index_, typename Float_, class Buffers_, class IntegratedBuffers_, class Options_, class IntegratedOptions_>
+void annotate_cells_single_and_integrated(
+    const tatami::Matrix<Value_, Index_>& test,
+    const std::vector<const TrainedSingle<Index_, Float_>*>& trained_single,
+    const TrainedIntegrated<Index_>& trained_integrated,
+    const std::vector<Buffers_>& buffers,
+    const IntegratedBuffers_& integrated_buffers,
+    const Options_& options,
+    const IntegratedOptions_& integrated_options
+) {
+    typedef I<decltype(*(integrated_buffers.best))> RefLabel_;
+    const auto integrated_best = integrated_buffers.best;
+    const auto& integrated_scores = integrated_buffers.scores;
+    const auto integrated_delta = integrated_buffers.delta;
+    const auto integrated_fine_tune_stats = integrated_buffers.fine_tune_statistics;
+    const auto integrated_fine_tune = integrated_options.fine_tune;
+    const auto integrated_threshold = integrated_options.fine_tune_threshold;
+    const auto num_threads = options.num_threads;
+
+    check_multiple_inputs(test, trained_single, buffers);
+    if (!sanisizer::is_equal(test.nrow(), trained_integrated.test_nrow())) {
+        throw std::runtime_error("number of rows in 'test' do not match up with those expected by 'trained_integrated'");
+    }
+
+    const auto nref = trained_single.size();
+    if (nref != trained_integrated.num_references()) {
+        throw std::runtime_error("number of entries in 'trained_single' should be equal to the number of references in 'trained_integrated'");
+    }
+    sanisizer::cast<RefLabel_>(nref); // checking that it'll fit in the output.
+
+    // The labels assigned by each reference are immediately used by the integrated classifier, so they must be stored somewhere.
+    // Conveniently, the integrated classifier can then read them from the buffers as if they were the 'assigned' arrays.
+    using Label_ = I<decltype(*(buffers.front().best))>;
+    std::vector<const Label_*> assigned;
+    assigned.reserve(nref);
+    for (I<decltype(nref)> r = 0; r < nref; ++r) {
+        if (trained_single[r]->num_labels() != trained_integrated.num_labels(r)) {
+            throw std::runtime_error("number of labels in each entry of 'trained_single' should be equal to that of the corresponding reference in 'trained_integrated'");
+        }
+        if (buffers[r].best == NULL) {
+            throw std::runtime_error("'best' should be non-NULL in each entry of 'buffers'");
+        }
+        assigned.push_back(buffers[r].best);
+    }
+
+    const auto precomputed = precompute_integrated_details(trained_integrated, integrated_options.quantile);
+    const auto num_universe = precomputed.num_universe;
+
+    // The integrated classifier's universe is included in the union of subsets, so that each cell is only extracted and ranked once.
+    const auto subsets = prepare_multiple_subsets(trained_single, &(trained_integrated.subset()));
+    const auto& universe_remapper = subsets.remappers.back();
+
+    std::vector<std::optional<FineTuneRecorder> > recorders;
+    std::vector<Index_> recorder_starts;
+    if (integrated_fine_tune_stats) {
+        sanisizer::resize(recorders, num_threads);
+        sanisizer::resize(recorder_starts, num_threads);
+    }
+
+    const auto run = [&](auto query_sparse) -> void {
+        constexpr bool query_sparse_ = decltype(query_sparse)::value;
+
+        const auto create_hook = [&](int t) {
+            std::optional<std::vector<RefLabel_> > reflabels_in_use;
+            if (integrated_fine_tune) {
+                reflabels_in_use.emplace();
+                sanisizer::reserve(*reflabels_in_use, nref);
+            }
+            RankedVector<Value_, Index_> universe_ranked;
+            universe_ranked.reserve(num_universe);
+
+            FineTuneRecorder* recorder = NULL;
+            if (integrated_fine_tune_stats) {
+                recorders[t].emplace();
+                recorder = &(*(recorders[t]));
+            }
+            bool first = true;
+
+            return [
+                &,
+                t,
+                recorder,
+                first,
+                ft = AnnotateIntegrated<query_sparse_, Index_, Value_, Float_>(precomputed),
+                all_scores = sanisizer::create<std::vector<Float_> >(nref),
+                reflabels_in_use = std::move(reflabels_in_use),
+                universe_ranked = std::move(universe_ranked)
+            ](const Index_ c, const RankedVector<Value_, Index_>& combined_ranked) mutable -> void {
+                universe_remapper.remap(combined_ranked, universe_ranked);
+                ft.run_first(c, universe_ranked, trained_integrated, assigned, precomputed.quantile_details, all_scores);
+                for (I<decltype(nref)> r = 0; r < nref; ++r) {
+                    if (integrated_scores[r]) {
+                        integrated_scores[r][c] = all_scores[r];
+                    }
+                }
+
+                const auto process = [&](auto& rec) -> std::pair<RefLabel_, Float_> {
+                    rec.start_cell();
+                    std::pair<RefLabel_, Float_> candidate;
+                    if (integrated_fine_tune) {
+                        candidate = ft.run_fine(c, universe_ranked, trained_integrated, assigned, precomputed.quantile_details, integrated_threshold, all_scores, *reflabels_in_use, rec);
+                    } else {
+                        candidate = find_best_and_delta<RefLabel_>(all_scores);
+                    }
+                    rec.finish_cell();
+                    return candidate;
+                };
+
+                std::pair<RefLabel_, Float_> candidate;
+                if (recorder) {
+                    if (first) {
+                        recorder_starts[t] = c;
+                        first = false;
+                    }
+                    candidate = process(*recorder);
+                } else {
+                    NoopFineTuneRecorder rec;
+                    candidate = process(rec);
+                }
+
+                integrated_best[c] = candidate.first;
+                if (integrated_delta) {
+                    integrated_delta[c] = candidate.second;
+                }
+            };
+        };
+
+        annotate_cells_single_multiple_raw<query_sparse_>(test, trained_single, subsets, buffers, options, create_hook);
+    };
+
+    if (test.is_sparse()) {
+        run(std::true_type());
+    } else {
+        run(std::false_type());
+    }
+
+    if (integrated_fine_tune_stats) {
+        merge_fine_tune_recorders(recorder_starts, recorders, *integrated_fine_tune_stats);
+    }
+}
+
+}
+
+#endif
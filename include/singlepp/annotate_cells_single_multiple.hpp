@@ -0,0 +1,263 @@
+#ifndef SINGLEPP_ANNOTATE_CELLS_SINGLE_MULTIPLE_HPP
+#define SINGLEPP_ANNOTATE_CELLS_SINGLE_MULTIPLE_HPP
+
+#include "defs.hpp"
+
+#include "tatami/tatami.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "annotate_cells_single.hpp"
+#include "SubsetSanitizer.hpp"
+#include "SubsetRemapper.hpp"
+#include "FineTuneStatistics.hpp"
+#include "SearchCounters.hpp"
+#include "Tracer.hpp"
+#include "fixed_point_scores.hpp"
+#include "find_best_and_delta.hpp"
+#include "train_single.hpp"
+#include "utils.hpp"
+
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <type_traits>
+#include <stdexcept>
+#include <cstddef>
+
+namespace singlepp {
+
+// Union of the marker subsets of multiple references, along with the projection from the union to each reference's subset.
+template<typename Index_>
+struct MultipleSubsets {
+    std::vector<Index_> combined;
+    std::vector<SubsetRemapper<Index_> > remappers;
+};
+
+// If 'extra' is supplied, it is also included in the union and its projection is added as the last entry of 'remappers'.
+// This is used to obtain the ranked vector for other classifiers that are applied after the single-reference classification, e.g., the integrated classifier.
+template<typename Index_, typename Float_>
+MultipleSubsets<Index_> prepare_multiple_subsets(const std::vector<const TrainedSingle<Index_, Float_>*>& trained, const std::vector<Index_>* extra) {
+    MultipleSubsets<Index_> output;
+    for (const auto tr : trained) {
+        const auto& subset = tr->subset();
+        output.combined.insert(output.combined.end(), subset.begin(), subset.end());
+    }
+    if (extra) {
+        output.combined.insert(output.combined.end(), extra->begin(), extra->end());
+    }
+    std::sort(output.combined.begin(), output.combined.end());
+    output.combined.erase(std::unique(output.combined.begin(), output.combined.end()), output.combined.end());
+
+    // Each subset is sorted, so the projection preserves the relative order of the rows in the union.
+    // This means that ties in the union-ranked vector are broken in the same manner as if each reference's subset was ranked separately.
+    const Index_ num_combined = output.combined.size(); // cast is safe as 'combined' is a unique subset of the rows of the test matrix.
+    output.remappers.reserve(trained.size() + (extra != NULL));
+    const auto add_remapper = [&](const std::vector<Index_>& subset) -> void {
+        output.remappers.emplace_back(num_combined);
+        auto& remapper = output.remappers.back();
+        for (const auto s : subset) {
+            remapper.add(std::lower_bound(output.combined.begin(), output.combined.end(), s) - output.combined.begin());
+        }
+    };
+    for (const auto tr : trained) {
+        add_remapper(tr->subset());
+    }
+    if (extra) {
+        add_remapper(*extra);
+    }
+
+    return output;
+}
+
+// No-op hook for annotate_cells_single_multiple_raw(), when there is nothing else to do after classifying each cell against all references.
+struct NoopMultipleCellHook {
+    template<typename Index_, typename Value_>
+    void operator()(Index_, const RankedVector<Value_, Index_>&) {}
+};
+
+// 'create_hook' is called in each thread with the thread index, and should return a function that accepts the cell index and the union-ranked vector.
+// This function is called for each cell after it has been classified against all references, i.e., after the assigned labels have been stored in the buffers.
+// 'Buffers_' and 'Options_' should be ClassifySingleBuffers and ClassifySingleOptions, see annotate_cells_single_raw().
+template<bool query_sparse_, typename Value_, typename Index_, typename Float_, class Buffers_, class Options_, class CreateHook_>
+void annotate_cells_single_multiple_raw(
+    const tatami::Matrix<Value_, Index_>& test,
+    const std::vector<const TrainedSingle<Index_, Float_>*>& trained,
+    const MultipleSubsets<Index_>& subsets,
+    const std::vector<Buffers_>& buffers,
+    const Options_& options,
+    CreateHook_ create_hook
+) {
+    typedef I<decltype(*(buffers.front().best))> Label_;
+    const auto fine_tune = options.fine_tune;
+    const auto num_threads = options.num_threads;
+    const auto num_refs = trained.size();
+    const Index_ num_combined = subsets.combined.size();
+    SubsetNoop<query_sparse_, Index_> subsorted(subsets.combined);
+
+    std::vector<ClassifySingleShared<Index_, Float_> > shared;
+    shared.reserve(num_refs);
+    for (const auto tr : trained) {
+        if (tr->built().sparse.has_value()) {
+            shared.push_back(prepare_classify_single<true>(*tr, options.quantile, fine_tune, options.fine_tune_bitset_limit));
+        } else {
+            shared.push_back(prepare_classify_single<false>(*tr, options.quantile, fine_tune, options.fine_tune_bitset_limit));
+        }
+    }
+
+    // Each thread records its own statistics for each reference, which are combined at the end.
+    auto recorders = sanisizer::create<std::vector<std::vector<std::optional<FineTuneRecorder> > > >(num_refs);
+    auto all_search_counters = sanisizer::create<std::vector<std::vector<std::vector<SearchCounters> > > >(num_refs);
+    for (I<decltype(num_refs)> r = 0; r < num_refs; ++r) {
+        if (buffers[r].fine_tune_statistics) {
+            sanisizer::resize(recorders[r], num_threads);
+        }
+        if (buffers[r].search_counters) {
+            sanisizer::resize(all_search_counters[r], num_threads);
+        }
+    }
+    auto recorder_starts = sanisizer::create<std::vector<Index_> >(num_threads);
+
+    tatami::parallelize([&](int t, Index_ start, Index_ length) {
+        ThreadTracer tracer(options.tracer, t);
+        tracer.begin("classify_single_multiple");
+        const auto extract_phase = tracer.add_phase("extract_us");
+        const auto fill_phase = tracer.add_phase("fill_ranks_us");
+        const auto classify_phase = tracer.add_phase("classify_us");
+        tracer.begin("setup");
+
+        // Extracting the union of all subsets, so that each column is only extracted (and ranked) once.
+        tatami::VectorPtr<Index_> subset_ptr(tatami::VectorPtr<Index_>{}, &(subsets.combined));
+        auto ext = tatami::consecutive_extractor<query_sparse_>(&test, false, start, length, std::move(subset_ptr));
+        auto vbuffer = sanisizer::create<std::vector<Value_> >(num_combined);
+        auto ibuffer = [&](){
+            if constexpr(query_sparse_) {
+                return sanisizer::create<std::vector<Index_> >(num_combined);
+            } else {
+                return false;
+            }
+        }();
+        RankedVector<Value_, Index_> combined_ranked;
+        combined_ranked.reserve(num_combined);
+
+        // Only one of the dense or sparse workspaces is used for each reference, depending on the representation of its built index.
+        std::vector<std::optional<ClassifySingleWorkspace<query_sparse_, false, Label_, Index_, Float_, Value_> > > dense_work(num_refs);
+        std::vector<std::optional<ClassifySingleWorkspace<query_sparse_, true, Label_, Index_, Float_, Value_> > > sparse_work(num_refs);
+        std::vector<unsigned char> prune(num_refs);
+
+        for (I<decltype(num_refs)> r = 0; r < num_refs; ++r) {
+            const auto& tr = *(trained[r]);
+            if (tr.built().sparse.has_value()) {
+                sparse_work[r].emplace(tr, shared[r], fine_tune, options.fine_tune_cache_size);
+            } else {
+                dense_work[r].emplace(tr, shared[r], fine_tune, options.fine_tune_cache_size);
+            }
+
+            const auto& buf = buffers[r];
+            if (buf.search_counters) {
+                sanisizer::resize(all_search_counters[r][t], tr.num_labels());
+            }
+            if (buf.fine_tune_statistics) {
+                recorders[r][t].emplace();
+            }
+
+            prune[r] = use_pruned_scoring(buf, options);
+        }
+        recorder_starts[t] = start;
+        auto hook = create_hook(t);
+        tracer.end();
+
+        // Classifies cell 'c' against reference 'r', using the projection of the union-ranked vector onto that reference's subset.
+        auto classify = [&](const I<decltype(num_refs)> r, const Index_ c, auto& work, auto& recorder) -> void {
+            const auto& tr = *(trained[r]);
+            const Index_ num_markers = tr.subset().size(); // cast is safe as 'subset' is a unique subset of the rows of the reference matrix.
+            subsets.remappers[r].remap(combined_ranked, work.query_ranked);
+            const bool query_has_nonzero = scale_query_ranks(num_markers, work.query_ranked, work.query_buffers);
+            std::vector<SearchCounters>* thread_counters = (buffers[r].search_counters ? &(all_search_counters[r][t]) : NULL);
+            score_and_choose_label(c, query_has_nonzero, tr, shared[r], options, static_cast<bool>(prune[r]), work, thread_counters, buffers[r], recorder, []() -> void {});
+        };
+
+        tracer.lap_start();
+        for (Index_ c = start, end = start + length; c < end; ++c) {
+            if constexpr(query_sparse_) {
+                const auto info = ext->fetch(vbuffer.data(), ibuffer.data());
+                tracer.lap(extract_phase);
+                subsorted.fill_ranks(info, combined_ranked);
+            } else {
+                auto info = ext->fetch(vbuffer.data());
+                tracer.lap(extract_phase);
+                subsorted.fill_ranks(info, combined_ranked);
+            }
+            tracer.lap(fill_phase);
+
+            for (I<decltype(num_refs)> r = 0; r < num_refs; ++r) {
+                const auto dispatch = [&](auto& recorder) -> void {
+                    if (sparse_work[r].has_value()) {
+                        classify(r, c, *(sparse_work[r]), recorder);
+                    } else {
+                        classify(r, c, *(dense_work[r]), recorder);
+                    }
+                };
+                if (buffers[r].fine_tune_statistics) {
+                    dispatch(*(recorders[r][t]));
+                } else {
+                    NoopFineTuneRecorder rec;
+                    dispatch(rec);
+                }
+            }
+            hook(c, combined_ranked);
+            tracer.lap(classify_phase);
+        }
+
+        tracer.count("cells", length);
+        tracer.count_phases();
+        tracer.end();
+    }, test.ncol(), num_threads);
+
+    for (I<decltype(num_refs)> r = 0; r < num_refs; ++r) {
+        const auto& buf = buffers[r];
+        if (buf.fine_tune_statistics) {
+            merge_fine_tune_recorders(recorder_starts, recorders[r], *(buf.fine_tune_statistics));
+        }
+        if (buf.search_counters) {
+            sanisizer::resize(*(buf.search_counters), trained[r]->num_labels());
+            merge_search_counters(all_search_counters[r], *(buf.search_counters));
+        }
+    }
+}
+
+template<typename Value_, typename Index_, typename Float_, class Buffers_>
+void check_multiple_inputs(const tatami::Matrix<Value_, Index_>& test, const std::vector<const TrainedSingle<Index_, Float_>*>& trained, const std::vector<Buffers_>& buffers) {
+    if (trained.size() != buffers.size()) {
+        throw std::runtime_error("'trained' and 'buffers' should have the same length");
+    }
+    for (const auto tr : trained) {
+        if (!sanisizer::is_equal(tr->test_nrow(), test.nrow())) {
+            throw std::runtime_error("number of rows in 'test' is not the same as that expected by each entry of 'trained'");
+        }
+    }
+}
+
+template<typename Value_, typename Index_, typename Float_, class Buffers_, class Options_>
+void annotate_cells_single_multiple(
+    const tatami::Matrix<Value_, Index_>& test,
+    const std::vector<const TrainedSingle<Index_, Float_>*>& trained,
+    const std::vector<Buffers_>& buffers,
+    const Options_& options
+) {
+    check_multiple_inputs(test, trained, buffers);
+    if (trained.empty()) {
+        return;
+    }
+
+    const auto subsets = prepare_multiple_subsets(trained, static_cast<const std::vector<Index_>*>(NULL));
+    const auto create_hook = [](int) -> NoopMultipleCellHook { return NoopMultipleCellHook(); };
+    if (test.is_sparse()) {
+        annotate_cells_single_multiple_raw<true>(test, trained, subsets, buffers, options, create_hook);
+    } else {
+        annotate_cells_single_multiple_raw<false>(test, trained, subsets, buffers, options, create_hook);
+    }
+}
+
+}
+
+#endif
@@ -11,6 +11,9 @@
 #include "scaled_ranks.hpp"
 #include "SubsetSanitizer.hpp"
 #include "l2.hpp"
+#include "Tracer.hpp"
+#include "SearchCounters.hpp"
+#include "MemoryUsage.hpp"
 
 #include <vector>
 #include <memory>
@@ -96,6 +99,28 @@ Float_ get_sparse_zero(const CompressedSparseVector<Index_, Float_>& x) { return
 template<typename Index_, typename Float_>
 void check_sparse_index_sorted_and_unique(const CompressedSparseVector<Index_, Float_>& x) { assert(is_sorted_unique(x.number, x.index)); }
 
+template<typename Index_, typename Float_>
+LabelMemoryUsage compute_memory_usage(const DensePerLabel<Index_, Float_>& ref) {
+    LabelMemoryUsage output;
+    output.data = vector_bytes(ref.data) + vector_bytes(ref.has_nonzero);
+    output.ranked = vector_bytes(ref.all_ranked);
+    output.distances = vector_bytes(ref.distances);
+    output.seed_ranges = vector_bytes(ref.seed_ranges);
+    return output;
+}
+
+template<typename Index_, typename Float_>
+LabelMemoryUsage compute_memory_usage(const SparsePerLabel<Index_, Float_>& ref) {
+    LabelMemoryUsage output;
+    output.value = vector_bytes(ref.value) + vector_bytes(ref.zeros);
+    output.index = vector_bytes(ref.index);
+    output.indptrs = vector_bytes(ref.indptrs);
+    output.ranked = vector_bytes(ref.negative_ranked) + vector_bytes(ref.positive_ranked) + vector_bytes(ref.negative_indptrs) + vector_bytes(ref.positive_indptrs);
+    output.distances = vector_bytes(ref.distances);
+    output.seed_ranges = vector_bytes(ref.seed_ranges);
+    return output;
+}
+
 /*** KMKNN building ***/ 
 
 template<typename Index_, typename Float_>
@@ -218,7 +243,8 @@ std::vector<Index_> select_seeds(
             for (const auto& x : curgroup) {
                 const auto curid = x.second;
                 if (curid != seed) {
-                    ref.distances.push_back(std::sqrt(x.first));
+                    // Sparse distances can be slightly negative due to numerical imprecision for duplicate profiles.
+                    ref.distances.push_back(std::sqrt(std::max(x.first, static_cast<Float_>(0))));
                     identities.push_back(curid);
                 }
             }
@@ -298,35 +324,96 @@ struct FindClosestNeighborsWorkspace {
 };
 
 template<bool query_sparse_, bool ref_sparse_, typename Index_, typename Float_>
-void find_closest_neighbors(
+Float_ compute_query_l2(
+    const Index_ num_markers,
+    const typename std::conditional<query_sparse_ && !ref_sparse_, SparseScaled<Index_, Float_>, std::vector<Float_> >::type& query,
+    const bool query_has_nonzero,
+    const typename std::conditional<ref_sparse_, SparsePerLabel<Index_, Float_>, DensePerLabel<Index_, Float_> >::type& ref,
+    const Index_ col
+) {
+    const auto refinfo = retrieve_vector(num_markers, ref, col);
+    if constexpr(ref_sparse_) {
+        return sparse_l2(num_markers, query.data(), query_has_nonzero, refinfo);
+    } else if constexpr(query_sparse_) {
+        return sparse_l2(num_markers, refinfo.first, refinfo.second, query);
+    } else {
+        return dense_l2(num_markers, query.data(), refinfo.first);
+    }
+}
+
+// Computes the distance from the query to each seed and sorts in increasing order.
+template<bool query_sparse_, bool ref_sparse_, typename Index_, typename Float_, class Counters_>
+void compute_seed_distances(
     const Index_ num_markers,
     const typename std::conditional<query_sparse_ && !ref_sparse_, SparseScaled<Index_, Float_>, std::vector<Float_> >::type& query,
     const bool query_has_nonzero,
-    const Index_ k,
     const typename std::conditional<ref_sparse_, SparsePerLabel<Index_, Float_>, DensePerLabel<Index_, Float_> >::type& ref,
-    FindClosestNeighborsWorkspace<Index_, Float_>& work
+    std::vector<std::pair<Float_, Index_> >& seed_distances,
+    Counters_& counters
 ) {
     const auto num_seeds = ref.seed_ranges.size();
-    const auto num_neighbors = sanisizer::cast<I<decltype(work.closest_neighbors.size())> >(k);
+    seed_distances.clear();
+    for (I<decltype(num_seeds)> se = 0; se < num_seeds; ++se) {
+        const auto dist_raw = compute_query_l2<query_sparse_, ref_sparse_, Index_, Float_>(num_markers, query, query_has_nonzero, ref, static_cast<Index_>(se));
+        seed_distances.emplace_back(dist_raw, se);
+    }
+    std::sort(seed_distances.begin(), seed_distances.end());
+    count_seed_distances(counters, num_seeds);
+}
 
-    const auto compute_distance = [&](const Index_ se) -> Float_ {
-        const auto refinfo = retrieve_vector(num_markers, ref, se);
-        if constexpr(ref_sparse_) {
-            return sparse_l2(num_markers, query.data(), query_has_nonzero, refinfo);
-        } else if constexpr(query_sparse_) {
-            return sparse_l2(num_markers, refinfo.first, refinfo.second, query);
-        } else {
-            return dense_l2(num_markers, query.data(), refinfo.first);
+// Lower bound on the distance from the query to its 'rank'-th closest profile (1-based) in 'ref', given the query-to-seed distances from compute_seed_distances().
+// Every non-seed profile in a cluster must be at least 'max(query-to-seed - max subject-to-seed, min subject-to-seed - query-to-seed)' away from the query,
+// so the 'rank'-th smallest of these per-profile bounds is a lower bound on the 'rank'-th smallest distance.
+// 'slack' is subtracted to protect against numerical imprecision in the distance calculations.
+template<typename Index_, typename Float_, class PerLabel_>
+Float_ lower_bound_neighbor_distance(
+    const PerLabel_& ref,
+    const std::pair<Float_, Index_>* seed_distances,
+    const std::size_t num_seeds,
+    const Index_ rank,
+    const Float_ slack,
+    std::vector<std::pair<Float_, Index_> >& buffer
+) {
+    buffer.clear();
+    for (std::size_t i = 0; i < num_seeds; ++i) {
+        const auto& curseed = seed_distances[i];
+        const Float_ query2seed = std::sqrt(std::max(curseed.first, static_cast<Float_>(0)));
+        buffer.emplace_back(query2seed, 1);
+
+        const auto& ranges = ref.seed_ranges[curseed.second];
+        if (ranges.second) {
+            const Float_ min_subj2seed = ref.distances[ranges.first];
+            const Float_ max_subj2seed = ref.distances[ranges.first + ranges.second - 1];
+            buffer.emplace_back(std::max(query2seed - max_subj2seed, min_subj2seed - query2seed), ranges.second);
         }
-    };
+    }
+    std::sort(buffer.begin(), buffer.end());
 
-    // First compute the distance from the query to each seed and sort in increasing order.
-    work.seed_distances.clear();
-    for (I<decltype(num_seeds)> se = 0; se < num_seeds; ++se) {
-        const auto dist_raw = compute_distance(se);
-        work.seed_distances.emplace_back(dist_raw, se);
+    Index_ covered = 0; // no overflow as this is no greater than the number of samples.
+    for (const auto& b : buffer) {
+        covered += b.second;
+        if (covered >= rank) {
+            return std::max(b.first - slack, static_cast<Float_>(0));
+        }
     }
-    std::sort(work.seed_distances.begin(), work.seed_distances.end());
+    return 0;
+}
+
+// Finds the closest neighbors after the seed distances in 'work' have been filled by compute_seed_distances().
+template<bool query_sparse_, bool ref_sparse_, typename Index_, typename Float_, class Counters_>
+void find_closest_neighbors_from_seeds(
+    const Index_ num_markers,
+    const typename std::conditional<query_sparse_ && !ref_sparse_, SparseScaled<Index_, Float_>, std::vector<Float_> >::type& query,
+    const bool query_has_nonzero,
+    const Index_ k,
+    const typename std::conditional<ref_sparse_, SparsePerLabel<Index_, Float_>, DensePerLabel<Index_, Float_> >::type& ref,
+    FindClosestNeighborsWorkspace<Index_, Float_>& work,
+    Counters_& counters
+) {
+    const auto num_neighbors = sanisizer::cast<I<decltype(work.closest_neighbors.size())> >(k);
+    const auto compute_distance = [&](const Index_ se) -> Float_ {
+        return compute_query_l2<query_sparse_, ref_sparse_, Index_, Float_>(num_markers, query, query_has_nonzero, ref, se);
+    };
 
     work.closest_neighbors.clear();
     const auto to_add = sanisizer::min(num_neighbors, work.seed_distances.size()); // adding the smallest distances preferentially.
@@ -357,6 +444,7 @@ void find_closest_neighbors(
              */
             const Float_ lower_bd = query2seed - threshold;
             if (max_subj2seed < lower_bd) {
+                count_skipped_cluster(counters);
                 continue;
             }
             firstsubj = std::lower_bound(ref.distances.data() + firstsubj, ref.distances.data() + lastsubj, lower_bd) - ref.distances.data();
@@ -374,14 +462,18 @@ void find_closest_neighbors(
             const Float_ upper_bd = query2seed + threshold;
             if (max_subj2seed > upper_bd) {
                 lastsubj = std::upper_bound(ref.distances.data() + firstsubj, ref.distances.data() + lastsubj, upper_bd) - ref.distances.data();
+                count_truncated_cluster(counters);
             }
         }
 
+        count_candidate_distances(counters, lastsubj - firstsubj);
+
         for (auto s = firstsubj; s < lastsubj; ++s) {
             const auto dist2subj_raw = compute_distance(s);
             if (dist2subj_raw <= threshold_raw) {
                 work.closest_neighbors.emplace_back(dist2subj_raw, s);
                 std::push_heap(work.closest_neighbors.begin(), work.closest_neighbors.end());
+                count_heap_insertion(counters);
 
                 if (work.closest_neighbors.size() >= num_neighbors) {
                     if (work.closest_neighbors.size() > num_neighbors) {
@@ -412,6 +504,20 @@ void find_closest_neighbors(
     }
 }
 
+template<bool query_sparse_, bool ref_sparse_, typename Index_, typename Float_, class Counters_>
+void find_closest_neighbors(
+    const Index_ num_markers,
+    const typename std::conditional<query_sparse_ && !ref_sparse_, SparseScaled<Index_, Float_>, std::vector<Float_> >::type& query,
+    const bool query_has_nonzero,
+    const Index_ k,
+    const typename std::conditional<ref_sparse_, SparsePerLabel<Index_, Float_>, DensePerLabel<Index_, Float_> >::type& ref,
+    FindClosestNeighborsWorkspace<Index_, Float_>& work,
+    Counters_& counters
+) {
+    compute_seed_distances<query_sparse_, ref_sparse_>(num_markers, query, query_has_nonzero, ref, work.seed_distances, counters);
+    find_closest_neighbors_from_seeds<query_sparse_, ref_sparse_>(num_markers, query, query_has_nonzero, k, ref, work, counters);
+}
+
 template<typename Index_, typename Float_>
 const std::pair<Float_, Index_>& get_furthest_neighbor(const FindClosestNeighborsWorkspace<Index_, Float_>& work) {
     return work.closest_neighbors.front();
@@ -459,6 +565,7 @@ BuiltReference<Index_, Float_> build_reference_raw(
     const tatami::Matrix<Value_, Index_>& ref,
     const Label_* labels,
     const std::vector<Index_>& subset,
+    Tracer* trace,
     int num_threads
 ) {
     const auto num_markers = sanisizer::cast<Index_>(subset.size());
@@ -520,7 +627,13 @@ BuiltReference<Index_, Float_> build_reference_raw(
         subptr = &(subsorted->extraction_subset());
     }
 
-    tatami::parallelize([&](int, Index_ start, Index_ len) {
+    tatami::parallelize([&](int t, Index_ start, Index_ len) {
+        ThreadTracer tracer(trace, t);
+        tracer.begin("rank_reference");
+        const auto extract_phase = tracer.add_phase("extract_us");
+        const auto fill_phase = tracer.add_phase("fill_ranks_us");
+        const auto scaled_phase = tracer.add_phase("scaled_ranks_us");
+
         tatami::VectorPtr<Index_> subset_ptr(tatami::VectorPtr<Index_>{}, subptr);
         auto ext = tatami::consecutive_extractor<ref_sparse_>(ref, false, start, len, std::move(subset_ptr));
         auto vbuffer = sanisizer::create<std::vector<Value_> >(num_markers);
@@ -535,6 +648,7 @@ BuiltReference<Index_, Float_> build_reference_raw(
         RankedVector<Value_, Index_> query_ranked;
         sanisizer::reserve(query_ranked, num_markers);
 
+        tracer.lap_start();
         for (Index_ c = start, end = start + len; c < end; ++c) {
             const auto col = [&](){
                 if constexpr(ref_sparse_) {
@@ -543,12 +657,14 @@ BuiltReference<Index_, Float_> build_reference_raw(
                     return ext->fetch(vbuffer.data());
                 }
             }();
+            tracer.lap(extract_phase);
 
             if (subset_noop) {
                 subnoop->fill_ranks(col, query_ranked); 
             } else {
                 subsorted->fill_ranks(col, query_ranked); 
             }
+            tracer.lap(fill_phase);
 
             const auto curlab = labels[c];
             const auto curoff = label_offsets[c];
@@ -565,13 +681,22 @@ BuiltReference<Index_, Float_> build_reference_raw(
                 const auto has_nonzero = scaled_ranks_dense(num_markers, query_ranked, scaled);
                 nnrefs[curlab].has_nonzero[curoff] = has_nonzero; 
             }
+            tracer.lap(scaled_phase);
         }
+
+        tracer.count("samples", len);
+        tracer.count_phases();
+        tracer.end();
     }, num_samples, num_threads);
 
-    tatami::parallelize([&](int, std::size_t start, std::size_t len) {
+    tatami::parallelize([&](int t, std::size_t start, std::size_t len) {
+        ThreadTracer tracer(trace, t);
         for (std::size_t l = start, end = start + len; l < end; ++l) {
             auto& curlab = nnrefs[l]; 
             const auto labcount = label_count[l];
+            tracer.begin("build_index");
+            tracer.count("label", l);
+            tracer.count("samples", labcount);
 
             if constexpr(ref_sparse_) {
                 const auto& neg_ranked = negative_ref_ranked[l];
@@ -605,7 +730,9 @@ BuiltReference<Index_, Float_> build_reference_raw(
                     curlab.zeros.push_back(scaled.zero);
                 }
 
+                tracer.begin("select_seeds");
                 auto identities = select_seeds<ref_sparse_, Index_, Float_>(num_markers, labcount, curlab);
+                tracer.end();
 
                 sanisizer::reserve(curlab.negative_ranked, negative_nzeros);
                 curlab.negative_indptrs.reserve(sanisizer::sum<I<decltype(curlab.positive_indptrs.size())> >(labcount, 1));
@@ -622,13 +749,18 @@ BuiltReference<Index_, Float_> build_reference_raw(
                 }
 
             } else {
+                tracer.begin("select_seeds");
                 auto identities = select_seeds<ref_sparse_, Index_, Float_>(num_markers, labcount, curlab);
+                tracer.end();
+
                 sanisizer::reserve(curlab.all_ranked, curlab.data.size());
                 const auto& ref_ranked = tmp_ref_ranked[l];
                 for (auto sam : identities) {
                     curlab.all_ranked.insert(curlab.all_ranked.end(), ref_ranked[sam].begin(), ref_ranked[sam].end()); 
                 }
             }
+
+            tracer.end();
         }
     }, num_labels, num_threads);
 
@@ -640,12 +772,13 @@ BuiltReference<Index_, Float_> build_reference(
     const tatami::Matrix<Value_, Index_>& ref,
     const Label_* labels,
     const std::vector<Index_>& subset,
+    Tracer* trace,
     int num_threads
 ) {
     if (ref.is_sparse()) {
-        return build_reference_raw<true, Float_>(ref, labels, subset, num_threads); 
+        return build_reference_raw<true, Float_>(ref, labels, subset, trace, num_threads); 
     } else {
-        return build_reference_raw<false, Float_>(ref, labels, subset, num_threads); 
+        return build_reference_raw<false, Float_>(ref, labels, subset, trace, num_threads); 
     }
 }
 
@@ -5,12 +5,16 @@
 
 #include "tatami/tatami.hpp"
 
+#include "FineTuneStatistics.hpp"
 #include "annotate_cells_integrated.hpp"
+#include "ResultSink.hpp"
+#include "PreRankedTest.hpp"
 #include "train_integrated.hpp"
 
 #include <vector>
 #include <cstddef>
 #include <algorithm>
+#include <stdexcept>
 
 /**
  * @file classify_integrated.hpp
@@ -77,6 +81,14 @@ struct ClassifyIntegratedBuffers {
      * This may also be `NULL` in which case the deltas are not reported.
      */
     Float_* delta;
+
+    /**
+     * Pointer to a `FineTuneStatistics` object.
+     * On output, this is filled with statistics for the fine-tuning iterations of each cell.
+     * If `ClassifyIntegratedOptions::fine_tune = false`, the number of iterations is reported as zero for all cells.
+     * This may also be `NULL` in which case no statistics are collected, avoiding any overhead.
+     */
+    FineTuneStatistics* fine_tune_statistics = NULL;
 };
 
 /**
@@ -132,14 +144,17 @@ void classify_integrated(
 {
     annotate_cells_integrated(
         test,
+        static_cast<Index_>(0),
+        test.ncol(),
         trained,
         assigned,
-        options.quantile,
+        precompute_integrated_details(trained, options.quantile),
         options.fine_tune,
         options.fine_tune_threshold,
         buffers.best,
         buffers.scores,
         buffers.delta,
+        buffers.fine_tune_statistics,
         options.num_threads
     );
 }
@@ -220,6 +235,154 @@ ClassifyIntegratedResults<RefLabel_, Float_> classify_integrated(
     return results;
 }
 
+/**
+ * Overload of `classify_integrated()` that uses the cached ranks of the test dataset.
+ * This skips the extraction and sorting of each cell's expression values, see `classify_single()` for details.
+ * As in `classify_single()`, the scaled ranks are still computed for each cell in each call.
+ * Results are the same as those from calling `classify_integrated()` on the test matrix used to create `test`.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Label_ Integer type for the labels within each reference.
+ * @tparam RefLabel_ Integer type for the label to represent each reference.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * 
+ * @param test Ranked vectors for the test dataset, typically from `build_pre_ranked_test()`.
+ * `PreRankedTest::subset()` should contain all rows in `TrainedIntegrated::subset()`.
+ * @param[in] assigned Vector of pointers of length equal to the number of references.
+ * Each pointer should point to an array of length equal to `PreRankedTest::num_cells()`,
+ * containing the assigned label for each cell in each reference.
+ * @param trained The integrated classifier returned by `train_integrated()`.
+ * @param[out] buffers Buffers in which to store the classification output.
+ * @param options Further options.
+ */
+template<typename Value_, typename Index_, typename Label_, typename RefLabel_, typename Float_>
+void classify_integrated(
+    const PreRankedTest<Value_, Index_>& test,
+    const std::vector<const Label_*>& assigned,
+    const TrainedIntegrated<Index_>& trained,
+    ClassifyIntegratedBuffers<RefLabel_, Float_>& buffers,
+    const ClassifyIntegratedOptions<Float_>& options)
+{
+    annotate_cells_integrated(
+        test,
+        trained,
+        assigned,
+        precompute_integrated_details(trained, options.quantile),
+        options.fine_tune,
+        options.fine_tune_threshold,
+        buffers.best,
+        buffers.scores,
+        buffers.delta,
+        buffers.fine_tune_statistics,
+        options.num_threads
+    );
+}
+
+/**
+ * Overload of `classify_integrated()` that uses the cached ranks of the test dataset and allocates space for the results.
+ *
+ * @param test Ranked vectors for the test dataset, typically from `build_pre_ranked_test()`.
+ * `PreRankedTest::subset()` should contain all rows in `TrainedIntegrated::subset()`.
+ * @param[in] assigned Vector of pointers of length equal to the number of references.
+ * Each pointer should point to an array of length equal to `PreRankedTest::num_cells()`,
+ * containing the assigned label for each cell in each reference.
+ * @param trained A pre-built classifier produced by `train_integrated()`.
+ * @param options Further options.
+ *
+ * @return Object containing the best reference and associated scores for each cell in `test`.
+ */
+template<typename RefLabel_ = DefaultRefLabel, typename Value_, typename Index_, typename Label_, typename Float_>
+ClassifyIntegratedResults<RefLabel_, Float_> classify_integrated(
+    const PreRankedTest<Value_, Index_>& test,
+    const std::vector<const Label_*>& assigned,
+    const TrainedIntegrated<Index_>& trained,
+    const ClassifyIntegratedOptions<Float_>& options)
+{
+    ClassifyIntegratedResults<RefLabel_, Float_> results(test.num_cells(), trained.num_references());
+    ClassifyIntegratedBuffers<RefLabel_, Float_> buffers;
+    buffers.best = results.best.data();
+    buffers.delta = results.delta.data();
+    buffers.scores.reserve(results.scores.size());
+    for (auto& s : results.scores) {
+        buffers.scores.emplace_back(s.data());
+    }
+    classify_integrated(test, assigned, trained, buffers, options);
+    return results;
+}
+
+/**
+ * Overload of `classify_integrated()` that writes the results into a `ResultSink`.
+ * The test matrix is processed in consecutive chunks of `ResultSink::chunk_size()` columns, where the results for each chunk are written into the buffers provided by `ResultSink::prepare()`.
+ * This avoids holding the results for all cells in memory at once, which is useful for very large test datasets, see `MmapResultSink` for an example.
+ * The per-reference quantile details are computed once and shared across chunks.
+ * Results are the same as those from `classify_integrated()`, though fine-tuning statistics are not reported.
+ *
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Label_ Integer type for the labels within each reference.
+ * @tparam RefLabel_ Integer type for the label to represent each reference.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * 
+ * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+ * The identity of the rows should be consistent with the reference datasets used to construct `trained`,
+ * see `prepare_integrated_input()` for details.
+ * @param[in] assigned Vector of pointers of length equal to the number of references.
+ * Each pointer should point to an array of length equal to the number of columns in `test`,
+ * containing the assigned label for each column in each reference.
+ * @param trained The integrated classifier returned by `train_integrated()`.
+ * @param sink Destination for the classification results.
+ * `ResultSinkChunk::scores` will have length equal to the number of references in `trained`.
+ * @param options Further options.
+ */
+template<typename Value_, typename Index_, typename Label_, typename RefLabel_, typename Float_>
+void classify_integrated(
+    const tatami::Matrix<Value_, Index_>& test,
+    const std::vector<const Label_*>& assigned,
+    const TrainedIntegrated<Index_>& trained,
+    ResultSink<RefLabel_, Float_>& sink,
+    const ClassifyIntegratedOptions<Float_>& options)
+{
+    const Index_ num_cells = test.ncol();
+    const Index_ chunk_size = sanisizer::min(num_cells, sink.chunk_size()); // cast is safe as this is no greater than num_cells.
+    if (chunk_size == 0 && num_cells > 0) {
+        throw std::runtime_error("chunk size of the result sink should be positive");
+    }
+
+    // Quantile details are the same for all chunks, so we only compute them once.
+    const auto precomputed = precompute_integrated_details(trained, options.quantile);
+    ResultSinkChunk<RefLabel_, Float_> chunk;
+    Index_ start = 0;
+    while (start < num_cells) {
+        const Index_ length = std::min<Index_>(chunk_size, num_cells - start);
+
+        chunk.best = NULL;
+        chunk.delta = NULL;
+        chunk.scores.clear();
+        chunk.scores.resize(sanisizer::cast<I<decltype(chunk.scores.size())> >(trained.references().size()), NULL);
+        sink.prepare(start, length, chunk);
+
+        annotate_cells_integrated(
+            test,
+            start,
+            length,
+            trained,
+            assigned,
+            precomputed,
+            options.fine_tune,
+            options.fine_tune_threshold,
+            chunk.best,
+            chunk.scores,
+            chunk.delta,
+            static_cast<FineTuneStatistics*>(NULL),
+            options.num_threads
+        );
+
+        sink.finish(start, length);
+        start += length;
+    }
+}
+
 }
 
 #endif
@@ -5,12 +5,17 @@
 
 #include "tatami/tatami.hpp"
 
+#include "ClassifySingleOptions.hpp"
 #include "annotate_cells_single.hpp"
+#include "SingleClassifier.hpp"
+#include "ResultSink.hpp"
+#include "PreRankedTest.hpp"
 #include "train_single.hpp"
 
 #include <vector> 
 #include <cstddef>
 #include <stdexcept>
+#include <algorithm>
 
 /**
  * @file classify_single.hpp
@@ -19,73 +24,6 @@
 
 namespace singlepp {
 
-/**
- * @brief Options for `classify_single()` and friends.
- * @tparam Float_ Floating-point type for the correlations and scores.
- */
-template<typename Float_ = DefaultFloat>
-struct ClassifySingleOptions {
-    /**
-     * Quantile probability in [0, 1].
-     * This is used to define a per-label score for each test cell,
-     * by applying it to the distribution of correlations between the test cell and that label's reference profiles.
-     * A value closer to 0.5 focuses on the behavior of the majority of a label's reference profiles.
-     * A smaller value will be more sensitive to the presence of a subset of profiles that are more similar to the test cell,
-     * which can be useful when the reference profiles themselves are heterogeneous.
-     */
-    Float_ quantile = 0.8;
-
-    /**
-     * Score threshold to use to select the top-scoring subset of labels during fine-tuning.
-     * Larger values increase the chance of recovering the correct label at the cost of computational time.
-     *
-     * This threshold should not be set to to a value that is too large.
-     * Otherwise, the first fine-tuning iteration would just contain all labels and there would be no reduction of the marker space.
-     */
-    Float_ fine_tune_threshold = 0.05;
-
-    /**
-     * Whether to perform fine-tuning.
-     * This can be disabled to improve speed at the cost of accuracy.
-     */
-    bool fine_tune = true;
-
-    /**
-     * Number of threads to use.
-     * The parallelization scheme is determined by `tatami::parallelize()`.
-     */
-    int num_threads = 1;
-};
-
-/**
- * @brief Output buffers for `classify_single()`.
- * @tparam Label_ Integer type for the reference labels.
- * @tparam Float_ Floating-point type for the correlations and scores.
- */
-template<typename Label_ = DefaultLabel, typename Float_ = DefaultFloat>
-struct ClassifySingleBuffers {
-    /** 
-     * Pointer to an array of length equal to the number of test cells.
-     * On output, this is filled with the index of the assigned label for each cell.
-     */
-    Label_* best;
-
-    /** 
-     * Vector of length equal to the number of labels.
-     * Each entry contains a pointer to an array of length equal to the number of test cells.
-     * On output, this is filled with the (non-fine-tuned) score for each label for each cell.
-     * Any pointer may be `NULL` in which case the scores for that label will not be reported.
-     */
-    std::vector<Float_*> scores;
-
-    /**
-     * Pointer to an array of length equal to the number of test cells.
-     * On output, this is filled with the difference between the highest and second-highest scores, possibly after fine-tuning.
-     * This may also be `NULL` in which case the deltas are not reported.
-     */
-    Float_* delta;
-};
-
 /**
  * @brief Implements the [**SingleR**](https://bioconductor.org/packages/SingleR) algorithm for automated annotation of single-cell RNA-seq data.
  *
@@ -139,17 +77,41 @@ void classify_single(
     if (trained.test_nrow() != test.nrow()) {
         throw std::runtime_error("number of rows in 'test' is not the same as that used to build 'trained'");
     }
-    annotate_cells_single(
-        test, 
-        trained,
-        options.quantile, 
-        options.fine_tune, 
-        options.fine_tune_threshold, 
-        buffers.best, 
-        buffers.scores, 
-        buffers.delta,
-        options.num_threads
-    );
+    annotate_cells_single(test, static_cast<const Index_*>(NULL), test.ncol(), trained, buffers, options);
+}
+
+/**
+ * Variant of `classify_single()` that only classifies a subset of columns in the test matrix.
+ * Only the requested columns are extracted from `test`, so the cost is proportional to the number of requested columns rather than the size of `test`.
+ * This is useful for iterative workflows that revisit small subsets of cells, e.g., a single cluster or cells that previously failed quality control.
+ * Results are the same as calling `classify_single()` on a column-subsetted matrix.
+ *
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the reference labels.
+ *
+ * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+ * This should have the same order and identity of genes as the reference matrix used to create `trained`.
+ * @param num_columns Number of columns to classify.
+ * @param[in] columns Pointer to an array of length `num_columns`, containing the indices of the columns of `test` to classify.
+ * Indices need not be sorted or unique, though extraction is usually most efficient when the indices are sorted.
+ * @param trained Classifier returned by `train_single()`.
+ * @param[out] buffers Buffers in which to store the classification output.
+ * Each non-`NULL` pointer should refer to an array of length equal to `num_columns`,
+ * where the `i`-th entry contains the result for column `columns[i]`.
+ * @param options Further options.
+ */
+template<typename Value_, typename Index_, typename Float_, typename Label_>
+void classify_single_subset(
+    const tatami::Matrix<Value_, Index_>& test, 
+    const Index_ num_columns,
+    const Index_* columns,
+    const TrainedSingle<Index_, Float_>& trained,
+    const ClassifySingleBuffers<Label_, Float_>& buffers,
+    const ClassifySingleOptions<Float_>& options) 
+{
+    annotate_cells_single(test, columns, num_columns, trained, buffers, options);
 }
 
 /**
@@ -230,6 +192,261 @@ ClassifySingleResults<Label_, Float_> classify_single(
     return output;
 }
 
+/**
+ * Overload of `classify_single()` that uses the cached ranks of the test dataset.
+ * This skips the extraction and sorting of each cell's expression values, which is useful when the same test dataset is classified multiple times,
+ * e.g., with different options or against different references whose marker subsets are contained in `PreRankedTest::subset()`.
+ * Only the ranks are cached, so the scaled ranks for the correlations are still computed for each cell in each call.
+ * (The scaled ranks depend on the representation of the reference and would double the size of the cache, while their computation is linear in the number of markers, unlike the sorting that is skipped.)
+ * Results are the same as those from calling `classify_single()` on the test matrix used to create `test`.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the reference labels.
+ *
+ * @param test Ranked vectors for the test dataset, typically from `build_pre_ranked_test()`.
+ * `PreRankedTest::subset()` should contain all rows in `TrainedSingle::subset()`.
+ * @param trained Classifier returned by `train_single()`.
+ * @param[out] buffers Buffers in which to store the classification output.
+ * Each non-`NULL` pointer should refer to an array of length equal to `PreRankedTest::num_cells()`.
+ * @param options Further options.
+ */
+template<typename Value_, typename Index_, typename Float_, typename Label_>
+void classify_single(
+    const PreRankedTest<Value_, Index_>& test, 
+    const TrainedSingle<Index_, Float_>& trained,
+    const ClassifySingleBuffers<Label_, Float_>& buffers,
+    const ClassifySingleOptions<Float_>& options) 
+{
+    annotate_cells_single(test, trained, buffers, options);
+}
+
+/**
+ * Overload of `classify_single()` that uses the cached ranks of the test dataset and allocates space for the output statistics.
+ *
+ * @tparam Label_ Integer type for the reference labels.
+ * @tparam Value_ Numeric type for the expression values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ *
+ * @param test Ranked vectors for the test dataset, typically from `build_pre_ranked_test()`.
+ * `PreRankedTest::subset()` should contain all rows in `TrainedSingle::subset()`.
+ * @param trained Classifier returned by `train_single()`.
+ * @param options Further options.
+ *
+ * @return Results of the classification for each cell in the test dataset.
+ */
+template<typename Label_ = DefaultLabel, typename Value_, typename Index_, typename Float_>
+ClassifySingleResults<Label_, Float_> classify_single(
+    const PreRankedTest<Value_, Index_>& test,
+    const TrainedSingle<Index_, Float_>& trained,
+    const ClassifySingleOptions<Float_>& options) 
+{
+    ClassifySingleResults<Label_, Float_> output(test.num_cells(), trained.num_labels());
+
+    ClassifySingleBuffers<Label_, Float_> buffers;
+    buffers.best = output.best.data();
+    buffers.delta = output.delta.data();
+    buffers.scores.reserve(output.scores.size());
+    for (auto& s : output.scores) {
+        buffers.scores.emplace_back(s.data());
+    }
+
+    classify_single(test, trained, buffers, options);
+    return output;
+}
+
+/**
+ * @brief Compact results of `classify_single_top()`.
+ * @tparam Label_ Integer type for the reference labels.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ */
+template<typename Label_ = DefaultLabel, typename Float_ = DefaultFloat>
+struct ClassifySingleTopResults {
+    /**
+     * @cond
+     */
+    ClassifySingleTopResults(const std::size_t num_cells, const std::size_t num_top) :
+        top_k(num_top),
+        best(sanisizer::cast<I<decltype(best.size())> >(num_cells)),
+        delta(sanisizer::cast<I<decltype(delta.size())> >(num_cells)),
+        top_labels(sanisizer::product<I<decltype(top_labels.size())> >(num_cells, num_top)),
+        top_scores(sanisizer::product<I<decltype(top_scores.size())> >(num_cells, num_top))
+    {}
+    /**
+     * @endcond
+     */
+
+    /**
+     * Number of top labels reported for each cell.
+     * This is the smaller of the requested number and the number of labels in the reference.
+     */
+    std::size_t top_k;
+
+    /** 
+     * Vector of length equal to the number of cells in the test dataset,
+     * containing the index of the assigned label for each cell.
+     */
+    std::vector<Label_> best;
+
+    /** 
+     * Vector of length equal to the number of cells in the test dataset.
+     * This contains the difference between the highest and second-highest scores for each cell, possibly after fine-tuning.
+     */
+    std::vector<Float_> delta;
+
+    /**
+     * Vector of length equal to the product of `top_k` and the number of cells in the test dataset.
+     * The `top_k` entries starting at `c * top_k` contain the indices of the top-scoring labels for cell `c`, in decreasing order of their (non-fine-tuned) scores.
+     */
+    std::vector<Label_> top_labels;
+
+    /**
+     * Vector of length equal to the product of `top_k` and the number of cells in the test dataset.
+     * This contains the (non-fine-tuned) scores for the corresponding entries of `top_labels`.
+     */
+    std::vector<Float_> top_scores;
+};
+
+/**
+ * Overload of `classify_single()` that only reports the scores for the top-scoring labels in each cell.
+ * This avoids allocating the full matrix of scores in `ClassifySingleResults`, which can be very large for references with many labels and test datasets with many cells.
+ *
+ * @tparam Label_ Integer type for the reference labels.
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ *
+ * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+ * This should have the same order and identity of genes as the reference matrix used to create `trained`.
+ * @param trained Classifier returned by `train_single()`.
+ * @param top_k Number of top-scoring labels to report for each cell.
+ * @param options Further options.
+ *
+ * @return Results of the classification for each cell in the test dataset.
+ */
+template<typename Label_ = DefaultLabel, typename Value_, typename Index_, typename Float_>
+ClassifySingleTopResults<Label_, Float_> classify_single_top(
+    const tatami::Matrix<Value_, Index_>& test,
+    const TrainedSingle<Index_, Float_>& trained,
+    const std::size_t top_k,
+    const ClassifySingleOptions<Float_>& options) 
+{
+    const std::size_t num_top = std::min<std::size_t>(top_k, trained.num_labels());
+    ClassifySingleTopResults<Label_, Float_> output(test.ncol(), num_top);
+
+    ClassifySingleBuffers<Label_, Float_> buffers;
+    buffers.best = output.best.data();
+    buffers.delta = output.delta.data();
+    buffers.scores.resize(sanisizer::cast<I<decltype(buffers.scores.size())> >(trained.num_labels()), NULL);
+    buffers.top_k = num_top;
+    buffers.top_labels = output.top_labels.data();
+    buffers.top_scores = output.top_scores.data();
+
+    classify_single(test, trained, buffers, options);
+    return output;
+}
+
+/**
+ * Overload of `classify_single()` that writes the results into a `ResultSink`.
+ * The test matrix is processed in consecutive chunks of `ResultSink::chunk_size()` columns, where the results for each chunk are written into the buffers provided by `ResultSink::prepare()`.
+ * This avoids holding the results for all cells in memory at once, which is useful for very large test datasets, see `MmapResultSink` for an example.
+ * All chunks are classified by a single `SingleClassifier`, so the setup and per-thread workspaces are shared across chunks.
+ * Results are the same as those from `classify_single()`, though fine-tuning statistics and search counters are not reported.
+ *
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the reference labels.
+ *
+ * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+ * This should have the same order and identity of genes as the reference matrix used to create `trained`.
+ * @param trained Classifier returned by `train_single()`.
+ * @param sink Destination for the classification results.
+ * `ResultSinkChunk::scores` will have length equal to the number of labels in `trained`.
+ * @param options Further options.
+ * `ClassifySingleOptions::tracer` will record events for each chunk.
+ */
+template<typename Value_, typename Index_, typename Float_, typename Label_>
+void classify_single(
+    const tatami::Matrix<Value_, Index_>& test,
+    const TrainedSingle<Index_, Float_>& trained,
+    ResultSink<Label_, Float_>& sink,
+    const ClassifySingleOptions<Float_>& options) 
+{
+    if (trained.test_nrow() != test.nrow()) {
+        throw std::runtime_error("number of rows in 'test' is not the same as that used to build 'trained'");
+    }
+
+    const Index_ num_cells = test.ncol();
+    const Index_ chunk_size = sanisizer::min(num_cells, sink.chunk_size()); // cast is safe as this is no greater than num_cells.
+    if (chunk_size == 0 && num_cells > 0) {
+        throw std::runtime_error("chunk size of the result sink should be positive");
+    }
+
+    SingleClassifier<Value_, Index_, Float_, Label_> classifier(trained, options);
+    ResultSinkChunk<Label_, Float_> chunk;
+    ClassifySingleBuffers<Label_, Float_> buffers;
+
+    Index_ start = 0;
+    while (start < num_cells) {
+        const Index_ length = std::min<Index_>(chunk_size, num_cells - start);
+
+        chunk.best = NULL;
+        chunk.delta = NULL;
+        chunk.scores.clear();
+        chunk.scores.resize(sanisizer::cast<I<decltype(chunk.scores.size())> >(trained.num_labels()), NULL);
+        sink.prepare(start, length, chunk);
+
+        buffers.best = chunk.best;
+        buffers.delta = chunk.delta;
+        buffers.scores = chunk.scores;
+        classifier.classify(test, start, length, buffers);
+
+        sink.finish(start, length);
+        start += length;
+    }
+}
+
+/**
+ * Overload of `classify_single_subset()` that allocates space for the output statistics.
+ *
+ * @tparam Label_ Integer type for the reference labels.
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ *
+ * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+ * This should have the same order and identity of genes as the reference matrix used to create `trained`.
+ * @param columns Vector of indices of the columns of `test` to classify.
+ * @param trained Classifier returned by `train_single()`.
+ * @param options Further options.
+ *
+ * @return Results of the classification for each requested column, in the same order as `columns`.
+ */
+template<typename Label_ = DefaultLabel, typename Value_, typename Index_, typename Float_>
+ClassifySingleResults<Label_, Float_> classify_single_subset(
+    const tatami::Matrix<Value_, Index_>& test,
+    const std::vector<Index_>& columns,
+    const TrainedSingle<Index_, Float_>& trained,
+    const ClassifySingleOptions<Float_>& options) 
+{
+    const Index_ num_columns = sanisizer::cast<Index_>(columns.size());
+    ClassifySingleResults<Label_, Float_> output(num_columns, trained.num_labels());
+
+    ClassifySingleBuffers<Label_, Float_> buffers;
+    buffers.best = output.best.data();
+    buffers.delta = output.delta.data();
+    buffers.scores.reserve(output.scores.size());
+    for (auto& s : output.scores) {
+        buffers.scores.emplace_back(s.data());
+    }
+
+    classify_single_subset(test, num_columns, columns.data(), trained, buffers, options);
+    return output;
+}
+
 }
 
 #endif
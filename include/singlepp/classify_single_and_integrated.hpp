@@ -0,0 +1,150 @@
+#ifndef SINGLEPP_CLASSIFY_SINGLE_AND_INTEGRATED_HPP
+#define SINGLEPP_CLASSIFY_SINGLE_AND_INTEGRATED_HPP
+
+#include "defs.hpp"
+
+#include "tatami/tatami.hpp"
+
+#include "classify_single.hpp"
+#include "classify_integrated.hpp"
+#include "annotate_cells_single_and_integrated.hpp"
+#include "train_single.hpp"
+#include "train_integrated.hpp"
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @file classify_single_and_integrated.hpp
+ * @brief Classify cells against multiple references and integrate the results in a single pass.
+ */
+
+namespace singlepp {
+
+/**
+ * Classify cells in a test dataset against each of multiple references, and then integrate the classifications across references.
+ * This is equivalent to calling `classify_single()` for each reference followed by `classify_integrated()` on the assigned labels,
+ * but all steps are performed for each cell before moving onto the next cell.
+ * Each column of the test matrix is only extracted and ranked once, see `classify_single_multiple()` for details;
+ * and the assigned labels for each cell are immediately used for integration, so there is no need to hold any per-label scores in memory.
+ *
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the labels within each reference.
+ * @tparam RefLabel_ Integer type for the label to represent each reference.
+ *
+ * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+ * This should have the same order and identity of genes as expected by each entry of `trained_single` and by `trained_integrated`.
+ * @param trained_single Vector of pointers to classifiers returned by `train_single()`, one per reference.
+ * These should be in the same order as the references used to construct `trained_integrated`, with the same labels in each reference.
+ * @param trained_integrated The integrated classifier returned by `train_integrated()`.
+ * @param[out] single_buffers Vector of length equal to `trained_single`, containing the buffers in which to store the classification output for the corresponding reference.
+ * Each `ClassifySingleBuffers::best` should be non-`NULL` as the assigned labels are required for integration.
+ * Each non-`NULL` pointer should refer to an array of length equal to the number of columns in `test`.
+ * @param[out] integrated_buffers Buffers in which to store the integrated classification output.
+ * @param single_options Options for classification within each reference.
+ * `ClassifySingleOptions::num_threads` and `ClassifySingleOptions::tracer` are also used for integration.
+ * @param integrated_options Options for integration across references.
+ * `ClassifyIntegratedOptions::num_threads` is ignored.
+ */
+template<typename Value_, typename Index_, typename Float_, typename Label_, typename RefLabel_>
+void classify_single_and_integrated(
+    const tatami::Matrix<Value_, Index_>& test,
+    const std::vector<const TrainedSingle<Index_, Float_>*>& trained_single,
+    const TrainedIntegrated<Index_>& trained_integrated,
+    const std::vector<ClassifySingleBuffers<Label_, Float_> >& single_buffers,
+    ClassifyIntegratedBuffers<RefLabel_, Float_>& integrated_buffers,
+    const ClassifySingleOptions<Float_>& single_options,
+    const ClassifyIntegratedOptions<Float_>& integrated_options)
+{
+    annotate_cells_single_and_integrated(test, trained_single, trained_integrated, single_buffers, integrated_buffers, single_options, integrated_options);
+}
+
+/**
+ * @brief Results of `classify_single_and_integrated()`.
+ * @tparam Label_ Integer type for the labels within each reference.
+ * @tparam RefLabel_ Integer type for the label to represent each reference.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ */
+template<typename Label_ = DefaultLabel, typename RefLabel_ = DefaultRefLabel, typename Float_ = DefaultFloat>
+struct ClassifySingleAndIntegratedResults {
+    /**
+     * @cond
+     */
+    ClassifySingleAndIntegratedResults(const std::size_t ncells, const std::size_t nrefs) : integrated(ncells, nrefs) {
+        assigned.reserve(nrefs);
+        for (I<decltype(nrefs)> r = 0; r < nrefs; ++r) {
+            assigned.emplace_back(sanisizer::cast<I<decltype(assigned.front().size())> >(ncells));
+        }
+    }
+    /**
+     * @endcond
+     */
+
+    /**
+     * Vector of length equal to the number of references,
+     * containing vectors of length equal to the number of cells in the test dataset.
+     * Each vector contains the assigned label for each cell in the corresponding reference, equivalent to `ClassifySingleResults::best`.
+     */
+    std::vector<std::vector<Label_> > assigned;
+
+    /**
+     * Results of integrating the classifications across references, equivalent to the output of `classify_integrated()`.
+     */
+    ClassifyIntegratedResults<RefLabel_, Float_> integrated;
+};
+
+/**
+ * Overload of `classify_single_and_integrated()` that allocates space for the results.
+ * Only the assigned labels are reported for each reference, so that no per-label scores need to be computed or stored if `ClassifySingleOptions::prune_labels = true`.
+ *
+ * @tparam Label_ Integer type for the labels within each reference.
+ * @tparam RefLabel_ Integer type for the label to represent each reference.
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ *
+ * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+ * This should have the same order and identity of genes as expected by each entry of `trained_single` and by `trained_integrated`.
+ * @param trained_single Vector of pointers to classifiers returned by `train_single()`, one per reference.
+ * These should be in the same order as the references used to construct `trained_integrated`, with the same labels in each reference.
+ * @param trained_integrated The integrated classifier returned by `train_integrated()`.
+ * @param single_options Options for classification within each reference.
+ * @param integrated_options Options for integration across references.
+ *
+ * @return Assigned labels within each reference and the integrated results for each cell in `test`.
+ */
+template<typename Label_ = DefaultLabel, typename RefLabel_ = DefaultRefLabel, typename Value_, typename Index_, typename Float_>
+ClassifySingleAndIntegratedResults<Label_, RefLabel_, Float_> classify_single_and_integrated(
+    const tatami::Matrix<Value_, Index_>& test,
+    const std::vector<const TrainedSingle<Index_, Float_>*>& trained_single,
+    const TrainedIntegrated<Index_>& trained_integrated,
+    const ClassifySingleOptions<Float_>& single_options,
+    const ClassifyIntegratedOptions<Float_>& integrated_options)
+{
+    const auto nrefs = trained_single.size();
+    ClassifySingleAndIntegratedResults<Label_, RefLabel_, Float_> results(test.ncol(), nrefs);
+
+    std::vector<ClassifySingleBuffers<Label_, Float_> > single_buffers(nrefs);
+    for (I<decltype(nrefs)> r = 0; r < nrefs; ++r) {
+        single_buffers[r].best = results.assigned[r].data();
+        single_buffers[r].scores.resize(trained_single[r]->num_labels());
+    }
+
+    ClassifyIntegratedBuffers<RefLabel_, Float_> integrated_buffers;
+    auto& integrated = results.integrated;
+    integrated_buffers.best = integrated.best.data();
+    integrated_buffers.delta = integrated.delta.data();
+    integrated_buffers.scores.reserve(integrated.scores.size());
+    for (auto& s : integrated.scores) {
+        integrated_buffers.scores.emplace_back(s.data());
+    }
+
+    classify_single_and_integrated(test, trained_single, trained_integrated, single_buffers, integrated_buffers, single_options, integrated_options);
+    return results;
+}
+
+}
+
+#endif
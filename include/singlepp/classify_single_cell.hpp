@@ -0,0 +1,261 @@
+#ifndef SINGLEPP_CLASSIFY_SINGLE_CELL_HPP
+#define SINGLEPP_CLASSIFY_SINGLE_CELL_HPP
+
+#include "defs.hpp"
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "classify_single.hpp"
+#include "annotate_cells_single.hpp"
+#include "WorkerPool.hpp"
+#include "FineTuneStatistics.hpp"
+#include "train_single.hpp"
+#include "utils.hpp"
+
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * @file classify_single_cell.hpp
+ * @brief Classify a single cell with minimal latency.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Reusable workspace for `classify_single_cell_dense()` and `classify_single_cell_sparse()`.
+ *
+ * This contains all precomputed values and buffers that are required to classify a single cell against a trained reference.
+ * It should be constructed once and re-used for each cell, so that each call to `classify_single_cell_dense()` or `classify_single_cell_sparse()` does not need to perform any setup or allocation.
+ *
+ * If `ClassifySingleOptions::num_threads` is greater than 1, the workspace owns a persistent `WorkerPool` that is used to parallelize across labels within each cell.
+ * This applies to both the initial neighbor search for each label and the score calculations for each label in each fine-tuning iteration.
+ * Per-cell latency should then decrease with the number of threads, provided that there are enough labels (and reference profiles per label) to keep all threads busy.
+ * The results are identical regardless of the number of threads.
+ *
+ * The workspace holds a reference to the `TrainedSingle` object, which should outlive the workspace.
+ * A single workspace should not be used concurrently from multiple threads.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * @tparam Index_ Integer type for the row indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the reference labels.
+ */
+template<typename Value_ = DefaultValue, typename Index_ = DefaultIndex, typename Float_ = DefaultFloat, typename Label_ = DefaultLabel>
+class ClassifySingleCellWorkspace {
+public:
+    /**
+     * @param trained Classifier returned by `train_single()`.
+     * @param options Further options.
+     * `ClassifySingleOptions::num_threads` is the number of threads to use for parallelization across labels within each cell.
+     * `ClassifySingleOptions::tracer` is ignored.
+     */
+    ClassifySingleCellWorkspace(const TrainedSingle<Index_, Float_>& trained, const ClassifySingleOptions<Float_>& options) :
+        my_trained(trained),
+        my_options(options),
+        my_ref_sparse(trained.built().sparse.has_value()),
+        my_ranker(trained.subset(), trained.test_nrow())
+    {
+        if (my_ref_sparse) {
+            my_shared = prepare_classify_single<true>(trained, options.quantile, options.fine_tune, options.fine_tune_bitset_limit);
+        } else {
+            my_shared = prepare_classify_single<false>(trained, options.quantile, options.fine_tune, options.fine_tune_bitset_limit);
+        }
+
+        if (options.num_threads > 1) {
+            my_pool.emplace(options.num_threads);
+
+            // The first thread uses the FindClosestNeighborsWorkspace in the ClassifySingleWorkspace.
+            const auto num_extra = sanisizer::cast<I<decltype(my_find_work.size())> >(options.num_threads - 1);
+            my_find_work.reserve(num_extra);
+            for (I<decltype(num_extra)> t = 0; t < num_extra; ++t) {
+                my_find_work.emplace_back(my_shared.max_num_samples);
+            }
+        }
+    }
+
+private:
+    const TrainedSingle<Index_, Float_>& my_trained;
+    ClassifySingleOptions<Float_> my_options;
+    bool my_ref_sparse;
+    ClassifySingleShared<Index_, Float_> my_shared;
+    RawQueryRanker<Index_> my_ranker;
+
+    std::optional<WorkerPool> my_pool;
+    std::vector<FindClosestNeighborsWorkspace<Index_, Float_> > my_find_work;
+
+    template<bool query_sparse_, bool ref_sparse_>
+    using Workspace = ClassifySingleWorkspace<query_sparse_, ref_sparse_, Label_, Index_, Float_, Value_>;
+    std::optional<Workspace<false, false> > my_dense_dense;
+    std::optional<Workspace<false, true> > my_dense_sparse;
+    std::optional<Workspace<true, false> > my_sparse_dense;
+    std::optional<Workspace<true, true> > my_sparse_sparse;
+
+    template<bool query_sparse_, bool ref_sparse_>
+    auto& get_workspace() {
+        if constexpr(query_sparse_) {
+            if constexpr(ref_sparse_) {
+                return my_sparse_sparse;
+            } else {
+                return my_sparse_dense;
+            }
+        } else {
+            if constexpr(ref_sparse_) {
+                return my_dense_sparse;
+            } else {
+                return my_dense_dense;
+            }
+        }
+    }
+
+    template<bool query_sparse_, bool ref_sparse_, class FillRanks_>
+    std::pair<Label_, Float_> run(FillRanks_ fill_ranks, Float_* scores) {
+        const Index_ num_markers = my_trained.subset().size();
+        const auto& ref = get_per_label_references<ref_sparse_>(my_trained.built());
+        const Label_ num_labels = ref.size(); // cast is safe as the labels must be representable in Label_.
+
+        auto& work_opt = get_workspace<query_sparse_, ref_sparse_>();
+        if (!work_opt.has_value()) {
+            work_opt.emplace(my_trained, my_shared, my_options.fine_tune, my_options.fine_tune_cache_size);
+            if (my_pool.has_value() && work_opt->fine_tuner.has_value()) {
+                work_opt->fine_tuner->set_label_parallelism(&(*my_pool));
+            }
+        }
+        auto& work = *work_opt;
+
+        fill_ranks(work.query_ranked);
+        const bool query_has_nonzero = scale_query_ranks(num_markers, work.query_ranked, work.query_buffers);
+
+        work.scores.resize(num_labels); // no need to use sanisizer as we already checked during the initial allocation.
+        if (my_pool.has_value()) {
+            my_pool->run([&](int t, Label_ start, Label_ length) -> void {
+                auto& find_work = (t ? my_find_work[t - 1] : work.find_work);
+                score_labels(num_markers, ref, my_shared.quantile_details, work.query_buffers, query_has_nonzero, start, static_cast<Label_>(start + length), find_work, work.scores.data(), NULL);
+            }, num_labels);
+        } else {
+            score_labels(num_markers, ref, my_shared.quantile_details, work.query_buffers, query_has_nonzero, static_cast<Label_>(0), num_labels, work.find_work, work.scores.data(), NULL);
+        }
+
+        if (scores) {
+            std::copy(work.scores.begin(), work.scores.end(), scores);
+        }
+
+        NoopFineTuneRecorder recorder;
+        return choose_label(my_trained, my_shared, my_options.fine_tune_threshold, work, recorder);
+    }
+
+public:
+    /**
+     * @cond
+     */
+    template<bool query_sparse_, class FillRanks_>
+    std::pair<Label_, Float_> dispatch(FillRanks_ fill_ranks, Float_* scores) {
+        if (my_ref_sparse) {
+            return run<query_sparse_, true>(std::move(fill_ranks), scores);
+        } else {
+            return run<query_sparse_, false>(std::move(fill_ranks), scores);
+        }
+    }
+
+    const RawQueryRanker<Index_>& ranker() const {
+        return my_ranker;
+    }
+    /**
+     * @endcond
+     */
+};
+
+/**
+ * @brief Result of `classify_single_cell_dense()` and `classify_single_cell_sparse()`.
+ * @tparam Label_ Integer type for the reference labels.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ */
+template<typename Label_ = DefaultLabel, typename Float_ = DefaultFloat>
+struct ClassifySingleCellResults {
+    /**
+     * Index of the assigned label for the cell.
+     */
+    Label_ best;
+
+    /**
+     * Difference between the highest and second-highest scores, possibly after fine-tuning.
+     */
+    Float_ delta;
+};
+
+/**
+ * Classify a single cell from a dense expression vector.
+ * This is equivalent to calling `classify_single()` on a matrix with one column, but with lower latency as all setup is performed once in `workspace`.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * @tparam Index_ Integer type for the row indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the reference labels.
+ *
+ * @param[in] values Pointer to an array of length equal to `TrainedSingle::test_nrow()`, containing the expression values for the cell.
+ * Entries should have the same order and identity of genes as the test matrix expected by the `TrainedSingle` object used to construct `workspace`.
+ * @param workspace Workspace for classification.
+ * @param[out] scores Pointer to an array of length equal to the number of labels.
+ * On output, this is filled with the (non-fine-tuned) score for each label.
+ * This may also be `NULL` in which case the scores are not reported.
+ *
+ * @return Classification result for the cell.
+ */
+template<typename Value_, typename Index_, typename Float_, typename Label_>
+ClassifySingleCellResults<Label_, Float_> classify_single_cell_dense(
+    const Value_* values,
+    ClassifySingleCellWorkspace<Value_, Index_, Float_, Label_>& workspace,
+    Float_* scores = NULL)
+{
+    const auto chosen = workspace.template dispatch<false>(
+        [&](RankedVector<Value_, Index_>& ranked) -> void {
+            workspace.ranker().fill_dense(values, ranked);
+        },
+        scores
+    );
+    return ClassifySingleCellResults<Label_, Float_>{ chosen.first, chosen.second };
+}
+
+/**
+ * Classify a single cell from a sparse expression vector.
+ * This is equivalent to calling `classify_single()` on a sparse matrix with one column, but with lower latency as all setup is performed once in `workspace`.
+ *
+ * @tparam Value_ Numeric type for the expression values.
+ * @tparam Index_ Integer type for the row indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the reference labels.
+ *
+ * @param number Number of structural non-zero elements.
+ * @param[in] values Pointer to an array of length `number`, containing the expression values of the structural non-zero elements.
+ * @param[in] indices Pointer to an array of length `number`, containing the row indices of the structural non-zero elements.
+ * Each index should be less than `TrainedSingle::test_nrow()` and all indices should be unique.
+ * Rows should have the same order and identity of genes as the test matrix expected by the `TrainedSingle` object used to construct `workspace`.
+ * @param workspace Workspace for classification.
+ * @param[out] scores Pointer to an array of length equal to the number of labels.
+ * On output, this is filled with the (non-fine-tuned) score for each label.
+ * This may also be `NULL` in which case the scores are not reported.
+ *
+ * @return Classification result for the cell.
+ */
+template<typename Value_, typename Index_, typename Float_, typename Label_>
+ClassifySingleCellResults<Label_, Float_> classify_single_cell_sparse(
+    const Index_ number,
+    const Value_* values,
+    const Index_* indices,
+    ClassifySingleCellWorkspace<Value_, Index_, Float_, Label_>& workspace,
+    Float_* scores = NULL)
+{
+    const auto chosen = workspace.template dispatch<true>(
+        [&](RankedVector<Value_, Index_>& ranked) -> void {
+            workspace.ranker().fill_sparse(number, values, indices, ranked);
+        },
+        scores
+    );
+    return ClassifySingleCellResults<Label_, Float_>{ chosen.first, chosen.second };
+}
+
+}
+
+#endif
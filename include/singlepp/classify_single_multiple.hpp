@@ -0,0 +1,95 @@
+#ifndef SINGLEPP_CLASSIFY_SINGLE_MULTIPLE_HPP
+#define SINGLEPP_CLASSIFY_SINGLE_MULTIPLE_HPP
+
+#include "defs.hpp"
+
+#include "tatami/tatami.hpp"
+
+#include "classify_single.hpp"
+#include "annotate_cells_single_multiple.hpp"
+#include "train_single.hpp"
+
+#include <vector>
+
+/**
+ * @file classify_single_multiple.hpp
+ * @brief Classify cells in a test dataset against multiple references in a single pass.
+ */
+
+namespace singlepp {
+
+/**
+ * Classify cells in a test dataset against each of multiple references.
+ * This is equivalent to calling `classify_single()` separately for each reference,
+ * but each column of the test matrix is only extracted and ranked once across the union of all references' subsets.
+ * The ranked vector for each reference is then obtained by filtering the union's ranked vector to that reference's markers, without any further sorting.
+ * This reduces the cost of extraction and ranking when the same test dataset is classified against many references.
+ *
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the reference labels.
+ *
+ * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+ * This should have the same order and identity of genes as the reference matrices used to create each entry of `trained`.
+ * @param trained Vector of pointers to classifiers returned by `train_single()`, one per reference.
+ * All classifiers should expect the same number of rows in the test matrix, see `TrainedSingle::test_nrow()`.
+ * @param[out] buffers Vector of length equal to `trained`, containing the buffers in which to store the classification output for the corresponding reference.
+ * Each non-`NULL` pointer should refer to an array of length equal to the number of columns in `test`.
+ * @param options Further options, applied to all references.
+ * `ClassifySingleOptions::tracer` records a `classify_single_multiple` event for each thread, where the time spent in classification is summed across all references.
+ */
+template<typename Value_, typename Index_, typename Float_, typename Label_>
+void classify_single_multiple(
+    const tatami::Matrix<Value_, Index_>& test,
+    const std::vector<const TrainedSingle<Index_, Float_>*>& trained,
+    const std::vector<ClassifySingleBuffers<Label_, Float_> >& buffers,
+    const ClassifySingleOptions<Float_>& options)
+{
+    annotate_cells_single_multiple(test, trained, buffers, options);
+}
+
+/**
+ * Overload of `classify_single_multiple()` that allocates space for the output statistics.
+ *
+ * @tparam Label_ Integer type for the reference labels.
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ *
+ * @param test Expression matrix of the test dataset, where rows are genes and columns are cells.
+ * This should have the same order and identity of genes as the reference matrices used to create each entry of `trained`.
+ * @param trained Vector of pointers to classifiers returned by `train_single()`, one per reference.
+ * @param options Further options.
+ *
+ * @return Vector of length equal to `trained`, containing the results of the classification against each reference.
+ */
+template<typename Label_ = DefaultLabel, typename Value_, typename Index_, typename Float_>
+std::vector<ClassifySingleResults<Label_, Float_> > classify_single_multiple(
+    const tatami::Matrix<Value_, Index_>& test,
+    const std::vector<const TrainedSingle<Index_, Float_>*>& trained,
+    const ClassifySingleOptions<Float_>& options)
+{
+    std::vector<ClassifySingleResults<Label_, Float_> > output;
+    output.reserve(trained.size());
+    std::vector<ClassifySingleBuffers<Label_, Float_> > buffers(trained.size());
+
+    for (I<decltype(trained.size())> r = 0, end = trained.size(); r < end; ++r) {
+        output.emplace_back(test.ncol(), trained[r]->num_labels());
+        auto& current = output.back();
+        auto& buf = buffers[r];
+        buf.best = current.best.data();
+        buf.delta = current.delta.data();
+        buf.scores.reserve(current.scores.size());
+        for (auto& s : current.scores) {
+            buf.scores.emplace_back(s.data());
+        }
+    }
+
+    classify_single_multiple(test, trained, buffers, options);
+    return output;
+}
+
+}
+
+#endif
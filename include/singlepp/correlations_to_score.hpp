@@ -5,6 +5,9 @@
 #include <algorithm>
 #include <limits>
 #include <cmath>
+#include <cstddef>
+#include <cassert>
+#include <type_traits>
 
 #include "utils.hpp"
 
@@ -79,6 +82,65 @@ Float_ l2_to_score(std::vector<Float_>& l2, const PrecomputedQuantileDetails<Ind
     return left_val + (right_val - left_val) * deets.right_prop;
 }
 
+// Alternative to l2_to_score() that only retains the smallest 'right_index + 1' distances, as the others have no effect on the score.
+// This is implemented as a max-heap so that the largest retained distance can be used as a bound for early termination of the L2 calculations.
+template<typename Index_, typename Float_>
+class SmallestL2 {
+private:
+    std::vector<Float_> my_heap;
+    std::size_t my_limit = 0;
+
+public:
+    void reserve(const Index_ max_num_samples) {
+        sanisizer::reserve(my_heap, max_num_samples);
+    }
+
+    void reset(const PrecomputedQuantileDetails<Index_, Float_>& deets) {
+        my_heap.clear();
+        my_limit = sanisizer::sum<std::size_t>(deets.right_index, 1);
+    }
+
+    // Any L2 greater than the bound will not affect the score, so its calculation can be abandoned. 
+    Float_ bound() const {
+        if (my_heap.size() < my_limit) {
+            return std::numeric_limits<Float_>::infinity();
+        } else {
+            return my_heap.front();
+        }
+    }
+
+    void add(const Float_ l2) {
+        if (my_heap.size() < my_limit) {
+            my_heap.push_back(l2);
+            std::push_heap(my_heap.begin(), my_heap.end());
+        } else if (l2 < my_heap.front()) {
+            std::pop_heap(my_heap.begin(), my_heap.end());
+            my_heap.back() = l2;
+            std::push_heap(my_heap.begin(), my_heap.end());
+        }
+    }
+
+    // Same as l2_to_score() on all L2s that were passed to add().
+    Float_ score(const PrecomputedQuantileDetails<Index_, Float_>& deets) const {
+        static_assert(std::is_floating_point<Float_>::value);
+        assert(my_heap.size() == my_limit);
+
+        // The top of the heap is the largest retained L2, i.e., the distance at 'right_index'.
+        const Float_ right_val = l2_to_correlation(my_heap.front());
+        if (!deets.find_left) {
+            return right_val;
+        }
+
+        // The next-largest retained L2 must be one of the children of the root.
+        Float_ left_l2 = my_heap[1];
+        if (my_heap.size() > 2) {
+            left_l2 = std::max(left_l2, my_heap[2]);
+        }
+        const Float_ left_val = l2_to_correlation(left_l2);
+        return left_val + (right_val - left_val) * deets.right_prop;
+    }
+};
+
 }
 
 #endif
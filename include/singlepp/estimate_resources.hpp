@@ -0,0 +1,434 @@
+#ifndef SINGLEPP_ESTIMATE_RESOURCES_HPP
+#define SINGLEPP_ESTIMATE_RESOURCES_HPP
+
+#include "defs.hpp"
+
+#include "train_single.hpp"
+#include "train_integrated.hpp"
+#include "classify_single.hpp"
+#include "classify_integrated.hpp"
+#include "correlations_to_score.hpp"
+#include "MarkerBitsets.hpp"
+#include "utils.hpp"
+
+#include "sanisizer/sanisizer.hpp"
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+
+/**
+ * @file estimate_resources.hpp
+ * @brief Estimate the memory usage and runtime before training or classification.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Dimensions of a reference dataset.
+ */
+struct ReferenceDimensions {
+    /**
+     * Number of reference profiles, i.e., columns in the reference matrix.
+     */
+    std::size_t num_profiles = 0;
+
+    /**
+     * Number of labels.
+     */
+    std::size_t num_labels = 0;
+
+    /**
+     * Number of profiles in the largest label.
+     * If zero, the profiles are assumed to be evenly distributed across labels.
+     */
+    std::size_t largest_label = 0;
+
+    /**
+     * Number of unique marker genes across all labels.
+     * For `train_single()` and `classify_single()`, this is the length of `TrainedSingle::subset()`.
+     */
+    std::size_t num_markers = 0;
+
+    /**
+     * Total number of marker genes across all entries of the marker list, with duplicates.
+     * For `train_single()`, this is the sum of the lengths of all vectors in the `PairwiseMarkers`;
+     * for `train_integrated()`, this is the sum of the lengths of all vectors in `TrainIntegratedInput::markers`.
+     */
+    std::size_t num_marker_entries = 0;
+
+    /**
+     * Whether the reference matrix is sparse.
+     */
+    bool sparse = false;
+
+    /**
+     * Proportion of non-zero values among the marker genes in the reference matrix.
+     * Only used if `ReferenceDimensions::sparse = true`.
+     */
+    double density = 1;
+};
+
+/**
+ * @brief Dimensions of a test dataset.
+ */
+struct TestDimensions {
+    /**
+     * Number of test cells, i.e., columns in the test matrix.
+     */
+    std::size_t num_cells = 0;
+
+    /**
+     * Whether the test matrix is sparse.
+     */
+    bool sparse = false;
+};
+
+/**
+ * @brief Options for the resource estimators.
+ */
+struct EstimateResourcesOptions {
+    /**
+     * Number of elementary operations (e.g., a multiply-add in a distance calculation) per second for each thread.
+     * This should be calibrated against a real run on the target machine.
+     */
+    double operations_per_second = 1e9;
+
+    /**
+     * Proportion of each label's profiles that are visited by the neighbor search in classification.
+     * Smaller values reflect more effective pruning by the search index, see `IndexQuality::pruning_efficiency` in `report_index_quality()` for an empirical value.
+     */
+    double search_fraction = 0.5;
+
+    /**
+     * Expected number of labels (or references, for integrated classification) that are retained in each fine-tuning iteration.
+     * This is used to estimate the cost of fine-tuning.
+     */
+    double fine_tune_labels = 2;
+};
+
+/**
+ * @brief Estimated resource usage.
+ *
+ * Memory estimates are based on the allocations made by the library itself, including per-thread workspaces.
+ * This does not include the input matrices, allocator overhead or the temporary allocations made by **tatami** for data extraction.
+ * Runtime estimates are very rough and should only be used to compare different parameter settings or to set generous time limits.
+ */
+struct ResourceEstimate {
+    /**
+     * Peak memory usage during the call, in bytes.
+     * For classification, this does not include the trained classifier, see `output_memory` from the corresponding training estimate.
+     */
+    std::size_t peak_memory = 0;
+
+    /**
+     * Memory usage of the returned object, in bytes.
+     * For training, this is the trained classifier; for classification, this is the results.
+     */
+    std::size_t output_memory = 0;
+
+    /**
+     * Estimated number of elementary operations.
+     */
+    double operations = 0;
+
+    /**
+     * Estimated wall-clock time in seconds, assuming perfect scaling across threads.
+     */
+    double seconds = 0;
+};
+
+/**
+ * @cond
+ */
+inline std::size_t estimate_largest_label(const ReferenceDimensions& ref) {
+    if (ref.largest_label) {
+        return ref.largest_label;
+    } else if (ref.num_labels == 0) {
+        return 0;
+    } else {
+        return (ref.num_profiles + ref.num_labels - 1) / ref.num_labels;
+    }
+}
+
+inline std::size_t estimate_nonzeros(const ReferenceDimensions& ref, const std::size_t num_genes) {
+    if (ref.sparse) {
+        return std::ceil(ref.density * static_cast<double>(num_genes));
+    } else {
+        return num_genes;
+    }
+}
+
+inline double estimate_log2(const std::size_t n) {
+    return std::log2(static_cast<double>(std::max(n, static_cast<std::size_t>(2))));
+}
+
+inline double estimate_num_seeds(const std::size_t n) {
+    return std::round(std::sqrt(static_cast<double>(n)));
+}
+
+inline void finalize_estimate(ResourceEstimate& output, const int num_threads, const EstimateResourcesOptions& options) {
+    output.seconds = output.operations / (options.operations_per_second * std::max(num_threads, 1));
+}
+
+template<typename Value_, typename Index_, typename Float_>
+std::size_t estimate_ranking_workspace(const std::size_t num_genes, const bool sparse) {
+    std::size_t output = num_genes * (sizeof(Value_) + sizeof(std::pair<Value_, Index_>));
+    if (sparse) {
+        output += num_genes * sizeof(Index_);
+    }
+    return output;
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Estimate the resources required by `train_single()`.
+ *
+ * @tparam Value_ Numeric type of the matrix values.
+ * @tparam Index_ Integer type of the row/column indices of the matrix.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ *
+ * @param ref Dimensions of the reference dataset.
+ * @param train_options Options to be passed to `train_single()`.
+ * @param options Further options.
+ *
+ * @return Estimated resource usage.
+ */
+template<typename Value_ = DefaultValue, typename Index_ = DefaultIndex, typename Float_ = DefaultFloat>
+ResourceEstimate estimate_train_single(const ReferenceDimensions& ref, const TrainSingleOptions& train_options, const EstimateResourcesOptions& options) {
+    ResourceEstimate output;
+    const auto num_threads = static_cast<std::size_t>(std::max(train_options.num_threads, 1));
+    const auto P = ref.num_profiles, L = ref.num_labels, M = ref.num_markers;
+    const auto nz = estimate_nonzeros(ref, M);
+    const auto nmax = estimate_largest_label(ref);
+    typedef std::pair<Index_, Index_> RankedPair;
+
+    // Components of the trained classifier, see TrainedSingle::memory_usage().
+    std::size_t trained = ref.num_marker_entries * sizeof(Index_) + (L * L + 1) * sizeof(std::size_t) + M * sizeof(Index_);
+    trained += P * sizeof(Float_) + L * estimate_num_seeds(nmax) * sizeof(std::pair<Index_, Index_>); // KMKNN distances and seed ranges.
+    std::size_t ranked_size, transient;
+    if (ref.sparse) {
+        trained += P * (nz * (sizeof(Float_) + sizeof(Index_)) + sizeof(Float_) + sizeof(std::size_t)); // values, indices, zeros and pointers.
+        ranked_size = P * (nz * sizeof(RankedPair) + 2 * sizeof(std::size_t));
+
+        // Temporary ranked vectors for the negative and positive values, plus the per-thread copy of each label's data during re-sorting.
+        transient = P * (nz * sizeof(RankedPair) + 2 * sizeof(RankedVector<Index_, Index_>));
+        transient += num_threads * nmax * (nz * (sizeof(Float_) + sizeof(Index_)) + sizeof(Float_) + sizeof(std::size_t));
+    } else {
+        trained += P * (M * sizeof(Float_) + sizeof(char));
+        ranked_size = P * M * sizeof(RankedPair);
+        transient = P * (M * sizeof(RankedPair) + sizeof(RankedVector<Index_, Index_>)); // temporary ranked vectors.
+    }
+    trained += ranked_size;
+
+    // Label counts and offsets, plus the per-thread workspaces for ranking and select_seeds().
+    transient += (L + P) * sizeof(Index_);
+    transient += num_threads * estimate_ranking_workspace<Value_, Index_, Float_>(M, ref.sparse);
+    transient += num_threads * (nmax * (2 * sizeof(Index_) + 2 * sizeof(Float_) + sizeof(std::pair<Float_, Index_>) + sizeof(char)) + M * sizeof(Float_));
+
+    // Marker subsetting in train_single() creates a copy of the markers.
+    transient += ref.num_marker_entries * sizeof(Index_);
+
+    output.output_memory = trained;
+    output.peak_memory = trained + transient;
+
+    // Ranking each profile, and then the kmeans++ initialization in select_seeds().
+    output.operations = static_cast<double>(P) * M * estimate_log2(M);
+    output.operations += static_cast<double>(L) * estimate_num_seeds(nmax) * static_cast<double>(nmax) * nz;
+    finalize_estimate(output, train_options.num_threads, options);
+    return output;
+}
+
+/**
+ * Estimate the resources required by `classify_single()`.
+ *
+ * @tparam Value_ Numeric type of the matrix values.
+ * @tparam Index_ Integer type of the row/column indices of the matrix.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Label_ Integer type for the reference labels.
+ *
+ * @param ref Dimensions of the reference dataset.
+ * @param test Dimensions of the test dataset.
+ * @param classify_options Options to be passed to `classify_single()`.
+ * @param options Further options.
+ *
+ * @return Estimated resource usage.
+ */
+template<typename Value_ = DefaultValue, typename Index_ = DefaultIndex, typename Float_ = DefaultFloat, typename Label_ = DefaultLabel>
+ResourceEstimate estimate_classify_single(
+    const ReferenceDimensions& ref,
+    const TestDimensions& test,
+    const ClassifySingleOptions<Float_>& classify_options,
+    const EstimateResourcesOptions& options)
+{
+    ResourceEstimate output;
+    const auto num_threads = static_cast<std::size_t>(std::max(classify_options.num_threads, 1));
+    const auto L = ref.num_labels, M = ref.num_markers, N = test.num_cells;
+    const auto nmax = estimate_largest_label(ref);
+    typedef std::pair<Index_, Index_> RankedPair;
+
+    // Results from classify_single().
+    output.output_memory = N * (sizeof(Label_) + (L + 1) * sizeof(Float_));
+
+    // Shared across threads: quantile details and the marker bitsets.
+    std::size_t shared = L * sizeof(PrecomputedQuantileDetails<Index_, Float_>);
+    const auto num_words = (M + 63) / 64;
+    if (classify_options.fine_tune && MarkerBitsets<Index_>::fits(L, sanisizer::cast<Index_>(M), classify_options.fine_tune_bitset_limit)) {
+        shared += (L * (L + 1) / 2) * num_words * sizeof(std::uint64_t);
+    }
+
+    // Per-thread workspaces for extraction, ranking, QueryBuffers, FindClosestNeighborsWorkspace and the scores.
+    std::size_t per_thread = estimate_ranking_workspace<Value_, Index_, Float_>(M, test.sparse);
+    per_thread += M * sizeof(Float_);
+    if (test.sparse) {
+        per_thread += M * sizeof(std::pair<Index_, Float_>);
+    }
+    per_thread += 2 * nmax * sizeof(std::pair<Float_, Index_>);
+    per_thread += L * sizeof(Float_);
+
+    // Per-thread FineTuneSingle.
+    if (classify_options.fine_tune) {
+        per_thread += L * sizeof(Label_) + 2 * M * sizeof(Index_); // labels in use and the SubsetRemapper.
+        per_thread += M * (sizeof(std::pair<Value_, Index_>) + 2 * sizeof(RankedPair) + sizeof(std::pair<Index_, Float_>)); // subsetted query and reference.
+        per_thread += nmax * sizeof(Float_) + num_words * sizeof(std::uint64_t);
+
+        // The cache is bounded by its limit or by the size of the ranked vectors, whichever is smaller.
+        const std::size_t ranked_size = ref.num_profiles * estimate_nonzeros(ref, M) * sizeof(RankedPair);
+        if (classify_options.fine_tune_cache_size) {
+            per_thread += std::min(classify_options.fine_tune_cache_size, 2 * ranked_size);
+            per_thread += 2 * (L + 2 * ref.num_profiles) * sizeof(std::size_t);
+        }
+    }
+
+    output.peak_memory = output.output_memory + shared + num_threads * per_thread;
+
+    // Ranking each cell, the neighbor search across all labels and fine-tuning on the top labels.
+    const double num_distances = static_cast<double>(ref.num_profiles) * options.search_fraction;
+    double per_cell = M * estimate_log2(M) + num_distances * M;
+    if (classify_options.fine_tune && L > 1) {
+        const double fine_tune_profiles = std::min(static_cast<double>(L), options.fine_tune_labels) * nmax;
+        per_cell += fine_tune_profiles * M * estimate_log2(M);
+    }
+    output.operations = per_cell * N;
+    finalize_estimate(output, classify_options.num_threads, options);
+    return output;
+}
+
+/**
+ * Estimate the resources required by `train_integrated()`.
+ *
+ * @tparam Value_ Numeric type of the matrix values.
+ * @tparam Index_ Integer type of the row/column indices of the matrix.
+ *
+ * @param refs Dimensions of each reference dataset.
+ * For each reference, `ReferenceDimensions::num_markers` is ignored.
+ * @param num_universe Number of genes in the union of markers across all references, i.e., the length of `TrainedIntegrated::subset()`.
+ * @param train_options Options to be passed to `train_integrated()`.
+ * @param options Further options.
+ *
+ * @return Estimated resource usage.
+ */
+template<typename Value_ = DefaultValue, typename Index_ = DefaultIndex>
+ResourceEstimate estimate_train_integrated(
+    const std::vector<ReferenceDimensions>& refs,
+    const std::size_t num_universe,
+    const TrainIntegratedOptions& train_options,
+    const EstimateResourcesOptions& options)
+{
+    ResourceEstimate output;
+    const auto num_threads = static_cast<std::size_t>(std::max(train_options.num_threads, 1));
+    const auto U = num_universe;
+    typedef std::pair<Index_, Index_> RankedPair;
+
+    std::size_t trained = U * sizeof(Index_), largest_transient = 0;
+    for (const auto& ref : refs) {
+        const auto nz = estimate_nonzeros(ref, U);
+        std::size_t ranked_size = ref.num_profiles * nz * sizeof(RankedPair);
+        if (ref.sparse) {
+            ranked_size += 2 * (ref.num_profiles + ref.num_labels) * sizeof(std::size_t);
+        }
+        trained += ranked_size + ref.num_marker_entries * sizeof(Index_);
+
+        // Each reference's profiles are ranked into temporary vectors before being concatenated.
+        const std::size_t transient = ref.num_profiles * (nz * sizeof(RankedPair) + sizeof(RankedVector<Index_, Index_>)) + ref.num_profiles * sizeof(Index_);
+        largest_transient = std::max(largest_transient, transient);
+
+        output.operations += static_cast<double>(ref.num_profiles) * U * estimate_log2(U);
+    }
+
+    // Remapping vectors for the test rows are proportional to the universe, so we ignore them here.
+    largest_transient += num_threads * estimate_ranking_workspace<Value_, Index_, double>(U, true);
+
+    output.output_memory = trained;
+    output.peak_memory = trained + largest_transient;
+    finalize_estimate(output, train_options.num_threads, options);
+    return output;
+}
+
+/**
+ * Estimate the resources required by `classify_integrated()`.
+ *
+ * @tparam Value_ Numeric type of the matrix values.
+ * @tparam Index_ Integer type of the row/column indices of the matrix.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam RefLabel_ Integer type for the label to represent each reference.
+ *
+ * @param refs Dimensions of each reference dataset.
+ * For each reference, `ReferenceDimensions::num_markers` is ignored.
+ * @param num_universe Number of genes in the union of markers across all references, i.e., the length of `TrainedIntegrated::subset()`.
+ * @param test Dimensions of the test dataset.
+ * @param classify_options Options to be passed to `classify_integrated()`.
+ * @param options Further options.
+ *
+ * @return Estimated resource usage.
+ */
+template<typename Value_ = DefaultValue, typename Index_ = DefaultIndex, typename Float_ = DefaultFloat, typename RefLabel_ = DefaultRefLabel>
+ResourceEstimate estimate_classify_integrated(
+    const std::vector<ReferenceDimensions>& refs,
+    const std::size_t num_universe,
+    const TestDimensions& test,
+    const ClassifyIntegratedOptions<Float_>& classify_options,
+    const EstimateResourcesOptions& options)
+{
+    ResourceEstimate output;
+    const auto num_threads = static_cast<std::size_t>(std::max(classify_options.num_threads, 1));
+    const auto R = refs.size(), U = num_universe, N = test.num_cells;
+
+    output.output_memory = N * (sizeof(RefLabel_) + (R + 1) * sizeof(Float_));
+
+    std::size_t shared = 0, nmax = 0;
+    double assigned_profiles = 0;
+    for (const auto& ref : refs) {
+        shared += ref.num_labels * sizeof(PrecomputedQuantileDetails<Index_, Float_>);
+        const auto current = estimate_largest_label(ref);
+        nmax = std::max(nmax, current);
+        assigned_profiles += current;
+    }
+
+    // Per-thread workspaces for extraction, ranking and AnnotateIntegrated.
+    std::size_t per_thread = estimate_ranking_workspace<Value_, Index_, Float_>(U, test.sparse);
+    per_thread += U * (sizeof(std::pair<Value_, Index_>) + 2 * sizeof(std::pair<Index_, Index_>) + 2 * sizeof(Index_));
+    per_thread += U * (2 * sizeof(Float_) + sizeof(std::pair<Index_, Float_>));
+    per_thread += nmax * sizeof(Float_) + R * (sizeof(Float_) + sizeof(RefLabel_));
+
+    output.peak_memory = output.output_memory + shared + num_threads * per_thread;
+
+    // Computing the score for the assigned label in each reference, and then fine-tuning on the top references.
+    double per_cell = U * estimate_log2(U) + assigned_profiles * U * estimate_log2(U);
+    if (classify_options.fine_tune && R > 1) {
+        const double mean_profiles = assigned_profiles / R;
+        per_cell += std::min(static_cast<double>(R), options.fine_tune_labels) * mean_profiles * U * estimate_log2(U);
+    }
+    output.operations = per_cell * N;
+    finalize_estimate(output, classify_options.num_threads, options);
+    return output;
+}
+
+}
+
+#endif
@@ -4,6 +4,8 @@
 #include <algorithm>
 #include <limits>
 #include <vector>
+#include <numeric>
+#include <cstddef>
 
 #include "utils.hpp"
 
@@ -34,6 +36,32 @@ std::pair<Label_, Float_> find_best_and_delta(const std::vector<Float_>& scores)
     return std::pair<Label_, Float_>(best_idx, topscore - second);
 }
 
+// Reports the 'top_k' highest-scoring labels in decreasing order of their scores, breaking ties by the label index.
+// If 'top_k' is greater than the number of labels, only the first 'scores.size()' entries are filled.
+// Either of 'top_labels' or 'top_scores' may be NULL, in which case they are not filled.
+template<typename Label_, typename Float_>
+void find_top_labels(const std::vector<Float_>& scores, const std::size_t top_k, std::vector<Label_>& order, Label_* top_labels, Float_* top_scores) {
+    const auto num_labels = scores.size();
+    order.resize(num_labels); // no need to use sanisizer as the labels must be representable in Label_.
+    std::iota(order.begin(), order.end(), static_cast<Label_>(0));
+
+    const auto num_top = std::min<std::size_t>(top_k, num_labels);
+    std::partial_sort(order.begin(), order.begin() + num_top, order.end(), [&](Label_ left, Label_ right) -> bool {
+        const auto lscore = scores[left], rscore = scores[right];
+        return lscore > rscore || (lscore == rscore && left < right);
+    });
+
+    for (I<decltype(num_top)> i = 0; i < num_top; ++i) {
+        const auto curlab = order[i];
+        if (top_labels) {
+            top_labels[i] = curlab;
+        }
+        if (top_scores) {
+            top_scores[i] = scores[curlab];
+        }
+    }
+}
+
 }
 
 #endif
@@ -0,0 +1,72 @@
+#ifndef SINGLEPP_FIXED_POINT_SCORES_HPP
+#define SINGLEPP_FIXED_POINT_SCORES_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+/**
+ * @file fixed_point_scores.hpp
+ * @brief Fixed-point encoding of classification scores.
+ */
+
+namespace singlepp {
+
+/**
+ * Type of the 16-bit fixed-point encoding of each score, see `encode_fixed_point_score()`.
+ */
+typedef std::uint16_t FixedPointScore;
+
+/**
+ * Encode a score as a 16-bit fixed-point integer.
+ * Scores are correlations in [-1, 1], which are linearly mapped to [0, 65535] and rounded to the nearest integer.
+ * This has a resolution of about 3e-5, which is more than sufficient for most downstream applications,
+ * e.g., plotting or comparing scores between labels; it is much finer than any sensible `ClassifySingleOptions::fine_tune_threshold`.
+ * Values outside of [-1, 1] are clamped to the boundaries of the range.
+ *
+ * @tparam Float_ Floating-point type for the scores.
+ * @param score Score for a label in a test cell.
+ * @return Encoded score.
+ */
+template<typename Float_>
+FixedPointScore encode_fixed_point_score(const Float_ score) {
+    const Float_ scaled = (score + static_cast<Float_>(1)) * static_cast<Float_>(32767.5);
+    return static_cast<FixedPointScore>(std::round(std::max(static_cast<Float_>(0), std::min(static_cast<Float_>(65535), scaled))));
+}
+
+/**
+ * Decode a score from its 16-bit fixed-point encoding, i.e., the reverse of `encode_fixed_point_score()`.
+ *
+ * @tparam Float_ Floating-point type for the scores.
+ * @param encoded Encoded score.
+ * @return Decoded score, accurate to within 2e-5 of the original score (if it was in [-1, 1]).
+ */
+template<typename Float_ = double>
+Float_ decode_fixed_point_score(const FixedPointScore encoded) {
+    return static_cast<Float_>(encoded) / static_cast<Float_>(32767.5) - static_cast<Float_>(1);
+}
+
+/**
+ * @cond
+ */
+// Writes all scores for a single cell into its row of the cell-major output buffers, if they are non-NULL.
+template<typename Float_>
+void fill_cell_major_scores(const std::vector<Float_>& scores, float* cell_major_scores, FixedPointScore* cell_major_fixed_scores) {
+    if (cell_major_scores) {
+        std::copy(scores.begin(), scores.end(), cell_major_scores);
+    }
+    if (cell_major_fixed_scores) {
+        for (auto s : scores) {
+            *cell_major_fixed_scores = encode_fixed_point_score(s);
+            ++cell_major_fixed_scores;
+        }
+    }
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
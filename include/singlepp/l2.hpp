@@ -40,6 +40,27 @@ Float_ scaled_ranks_dense_l2(const Index_ num_markers, const Float_* query, cons
     return l2;
 }
 
+// Same as the above overload, but the calculation is abandoned once the partial L2 exceeds 'bound'.
+// This is possible as each term of the sum is non-negative. 
+// If the calculation is abandoned, the return value is guaranteed to be greater than 'bound' but is otherwise meaningless.
+template<typename Index_, typename Float_, typename Stat_>
+Float_ scaled_ranks_dense_l2(const Index_ num_markers, const Float_* query, const RankedVector<Stat_, Index_>& ref, Float_* buffer, const Float_ bound) {
+    // We can't abandon the calculation of the centered ranks as we need the sum of squares for scaling.
+    // Nonetheless, we can still skip the second pass through 'buffer'.
+    const auto sum_squares = centered_ranks_dense(num_markers, ref, buffer);
+    const Float_ mult = (sum_squares ? sum_squares_to_mult(sum_squares) : 0); // no-variance profiles are left as all-zero scaled ranks. 
+
+    Float_ l2 = 0;
+    for (Index_ i = 0; i < num_markers; ++i) {
+        const Float_ delta = buffer[i] * mult - query[i];
+        l2 += delta * delta;
+        if (l2 > bound) {
+            break;
+        }
+    }
+    return l2;
+}
+
 template<typename Index_, typename Float_>
 Index_ get_sparse_num(const SparseScaled<Index_, Float_>& x) { return x.nonzero.size(); }
 
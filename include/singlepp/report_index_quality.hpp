@@ -0,0 +1,287 @@
+#ifndef SINGLEPP_REPORT_INDEX_QUALITY_HPP
+#define SINGLEPP_REPORT_INDEX_QUALITY_HPP
+
+#include "defs.hpp"
+
+#include "tatami/tatami.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "build_reference.hpp"
+#include "correlations_to_score.hpp"
+#include "SearchCounters.hpp"
+#include "train_single.hpp"
+#include "utils.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+#include <limits>
+
+/**
+ * @file report_index_quality.hpp
+ * @brief Report the quality of the neighbor search indices in a trained classifier.
+ */
+
+namespace singlepp {
+
+/**
+ * @brief Options for `report_index_quality()`.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ */
+template<typename Float_ = DefaultFloat>
+struct ReportIndexQualityOptions {
+    /**
+     * Quantile probability in [0, 1], used to define the number of neighbors to search for in each label.
+     * This should be the same as `ClassifySingleOptions::quantile` for a realistic estimate of the pruning efficiency.
+     */
+    Float_ quantile = 0.8;
+
+    /**
+     * Maximum number of reference profiles to use as probes when estimating the pruning efficiency.
+     * Profiles are sampled evenly across all labels, so that the estimate accounts for queries that are far from a label as well as those that are close to it.
+     * Setting this to zero will skip the estimation altogether.
+     */
+    std::size_t num_probes = 100;
+
+    /**
+     * Number of threads to use.
+     * The parallelization scheme is determined by `tatami::parallelize()`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @brief Quality of the neighbor search index for a single label.
+ *
+ * Each label's reference profiles are indexed with the k-means for k-nearest neighbors (KMKNN) algorithm,
+ * where profiles are assigned to clusters around a "seed" profile and the triangle inequality is used to skip clusters that cannot contain a neighbor.
+ * The search is most efficient when there are many small, compact clusters.
+ *
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ */
+template<typename Float_ = DefaultFloat>
+struct IndexQuality {
+    /**
+     * Number of reference profiles for this label.
+     */
+    std::size_t num_profiles = 0;
+
+    /**
+     * Number of seeds, i.e., clusters.
+     * This may be less than the square root of `num_profiles` if duplicate profiles were present.
+     */
+    std::size_t num_seeds = 0;
+
+    /**
+     * Number of profiles that are identical to their seed (up to numerical precision) in terms of the scaled ranks of the markers.
+     */
+    std::size_t num_duplicates = 0;
+
+    /**
+     * Smallest number of profiles in any cluster, including the seed.
+     */
+    std::size_t min_cluster_size = 0;
+
+    /**
+     * Median number of profiles in each cluster, including the seed.
+     */
+    double median_cluster_size = 0;
+
+    /**
+     * Largest number of profiles in any cluster, including the seed.
+     */
+    std::size_t max_cluster_size = 0;
+
+    /**
+     * Median radius of the clusters, defined as the largest distance from the seed to any profile in the cluster.
+     * Distances are Euclidean distances between scaled rank vectors.
+     */
+    Float_ median_radius = 0;
+
+    /**
+     * Largest radius of any cluster.
+     */
+    Float_ max_radius = 0;
+
+    /**
+     * Estimated proportion of distance calculations that are avoided by the index when searching for neighbors, relative to a brute-force search.
+     * This is computed by searching the index with a sample of reference profiles, see `ReportIndexQualityOptions::num_probes`.
+     * Values close to zero indicate that the index provides little benefit.
+     */
+    double pruning_efficiency = 0;
+};
+
+/**
+ * @cond
+ */
+template<typename Input_>
+double compute_median(std::vector<Input_>& values) {
+    const auto n = values.size();
+    if (n == 0) {
+        return 0;
+    }
+    const auto half = n / 2;
+    std::nth_element(values.begin(), values.begin() + half, values.end());
+    const double right = values[half];
+    if (n % 2 == 1) {
+        return right;
+    }
+    const double left = *std::max_element(values.begin(), values.begin() + half);
+    return (left + right) / 2;
+}
+
+template<typename Index_, typename Float_, class PerLabel_>
+IndexQuality<Float_> summarize_index(const PerLabel_& ref) {
+    IndexQuality<Float_> output;
+    output.num_profiles = get_num_samples(ref);
+    output.num_seeds = ref.seed_ranges.size();
+
+    std::vector<std::size_t> sizes;
+    sizes.reserve(output.num_seeds);
+    std::vector<Float_> radii;
+    radii.reserve(output.num_seeds);
+
+    // Allowing for some numerical imprecision in the distances, e.g., from the densification of sparse vectors.
+    // The squared distances are compared to a small multiple of the machine epsilon, given that the scaled ranks have unit length.
+    const Float_ duplicate_threshold = std::sqrt(std::numeric_limits<Float_>::epsilon() * 10);
+
+    for (const auto& range : ref.seed_ranges) {
+        sizes.push_back(sanisizer::sum<std::size_t>(range.second, 1));
+
+        // Distances are sorted within each range, so the radius is the last entry.
+        const auto start = ref.distances.begin() + range.first, end = start + range.second;
+        radii.push_back(range.second ? *(end - 1) : 0);
+        output.num_duplicates += std::upper_bound(start, end, duplicate_threshold) - start;
+    }
+
+    if (output.num_seeds) {
+        output.min_cluster_size = *std::min_element(sizes.begin(), sizes.end());
+        output.max_cluster_size = *std::max_element(sizes.begin(), sizes.end());
+        output.max_radius = *std::max_element(radii.begin(), radii.end());
+    }
+    output.median_cluster_size = compute_median(sizes);
+    output.median_radius = compute_median(radii);
+    return output;
+}
+
+template<bool ref_sparse_, typename Index_, typename Float_>
+void estimate_pruning_efficiency(
+    const Index_ num_markers,
+    const std::vector<typename std::conditional<ref_sparse_, SparsePerLabel<Index_, Float_>, DensePerLabel<Index_, Float_> >::type>& references,
+    const Float_ quantile,
+    const std::size_t num_probes,
+    const int num_threads,
+    std::vector<IndexQuality<Float_> >& output
+) {
+    const auto num_labels = references.size();
+    std::size_t total_profiles = 0;
+    for (const auto& ref : references) {
+        total_profiles += get_num_samples(ref);
+    }
+
+    // Choosing evenly spaced profiles across all labels.
+    std::vector<std::pair<I<decltype(num_labels)>, Index_> > probes;
+    const auto actual_probes = std::min(num_probes, total_profiles);
+    if (actual_probes == 0) {
+        return;
+    }
+    probes.reserve(actual_probes);
+    {
+        const double step = static_cast<double>(total_profiles) / actual_probes;
+        I<decltype(num_labels)> label = 0;
+        std::size_t offset = 0;
+        for (std::size_t p = 0; p < actual_probes; ++p) {
+            const std::size_t target = p * step; // truncation is intended here.
+            while (target - offset >= static_cast<std::size_t>(get_num_samples(references[label]))) {
+                offset += get_num_samples(references[label]);
+                ++label;
+            }
+            probes.emplace_back(label, target - offset);
+        }
+    }
+
+    // Each thread has its own counters, which are summed at the end.
+    std::vector<std::vector<SearchCounters> > all_counters;
+    sanisizer::resize(all_counters, num_threads);
+    tatami::parallelize([&](int t, std::size_t start, std::size_t length) {
+        auto& counters = all_counters[t];
+        sanisizer::resize(counters, num_labels);
+        auto query = sanisizer::create<std::vector<Float_> >(num_markers);
+
+        Index_ max_num_samples = 0;
+        for (const auto& ref : references) {
+            max_num_samples = std::max(max_num_samples, get_num_samples(ref));
+        }
+        FindClosestNeighborsWorkspace<Index_, Float_> work(max_num_samples);
+
+        for (std::size_t p = start, end = start + length; p < end; ++p) {
+            const auto& probe = probes[p];
+            const auto info = retrieve_vector(num_markers, references[probe.first], probe.second);
+            bool has_nonzero;
+            if constexpr(ref_sparse_) {
+                has_nonzero = densify_sparse_vector(num_markers, info, query);
+            } else {
+                std::copy_n(info.first, num_markers, query.data());
+                has_nonzero = info.second;
+            }
+
+            for (I<decltype(num_labels)> l = 0; l < num_labels; ++l) {
+                const auto& ref = references[l];
+                const Index_ k = precompute_quantile_details(get_num_samples(ref), quantile).right_index + 1;
+                find_closest_neighbors<false, ref_sparse_>(num_markers, query, has_nonzero, k, ref, work, counters[l]);
+            }
+        }
+    }, actual_probes, num_threads);
+
+    auto merged = sanisizer::create<std::vector<SearchCounters> >(num_labels);
+    merge_search_counters(all_counters, merged);
+    for (I<decltype(num_labels)> l = 0; l < num_labels; ++l) {
+        const double brute = static_cast<double>(actual_probes) * get_num_samples(references[l]);
+        const double computed = merged[l].seed_distances + merged[l].candidate_distances;
+        output[l].pruning_efficiency = 1 - computed / brute;
+    }
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Report the quality of the neighbor search index for each label in a trained classifier.
+ * This can be used to identify labels with poorly-structured indices, e.g., a few large clusters with large radii, before classifying a large test dataset.
+ *
+ * @tparam Index_ Integer type for the row/column indices of the matrix.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ *
+ * @param trained Classifier returned by `train_single()`.
+ * @param options Further options.
+ *
+ * @return Vector of length equal to the number of labels, containing the index quality for each label.
+ */
+template<typename Index_, typename Float_>
+std::vector<IndexQuality<Float_> > report_index_quality(const TrainedSingle<Index_, Float_>& trained, const ReportIndexQualityOptions<Float_>& options) {
+    const auto& built = trained.built();
+    const auto num_markers = sanisizer::cast<Index_>(trained.subset().size());
+    std::vector<IndexQuality<Float_> > output;
+
+    auto process = [&](const auto& references) -> void {
+        output.reserve(references.size());
+        for (const auto& ref : references) {
+            output.push_back(summarize_index<Index_, Float_>(ref));
+        }
+    };
+
+    if (built.sparse.has_value()) {
+        process(*(built.sparse));
+        estimate_pruning_efficiency<true>(num_markers, *(built.sparse), options.quantile, options.num_probes, options.num_threads, output);
+    } else {
+        process(*(built.dense));
+        estimate_pruning_efficiency<false>(num_markers, *(built.dense), options.quantile, options.num_probes, options.num_threads, output);
+    }
+
+    return output;
+}
+
+}
+
+#endif
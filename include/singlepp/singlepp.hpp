@@ -10,9 +10,19 @@
 #include "Markers.hpp"
 #include "Intersection.hpp"
 #include "train_single.hpp"
+#include "report_index_quality.hpp"
 #include "train_integrated.hpp"
 #include "classify_single.hpp"
+#include "fixed_point_scores.hpp"
+#include "SingleClassifier.hpp"
+#include "ClassifySingleSession.hpp"
+#include "classify_single_cell.hpp"
+#include "classify_single_multiple.hpp"
 #include "classify_integrated.hpp"
+#include "PreRankedTest.hpp"
+#include "classify_single_and_integrated.hpp"
+#include "ResultSink.hpp"
+#include "estimate_resources.hpp"
 
 /**
  * @namespace singlepp
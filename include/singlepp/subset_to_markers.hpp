@@ -16,19 +16,17 @@ namespace singlepp {
 
 // Use this method when the feature spaces are already identical.
 template<typename Index_>
-std::vector<Index_> subset_to_markers(const Index_ ref_nrow, PairwiseMarkers<Index_>& markers) {
+std::vector<Index_> subset_to_markers(const Index_ ref_nrow, FlatPairwiseMarkers<Index_>& markers) {
+    auto& indices = markers.mutable_indices();
+
     // Using ref_nrow as a missing-value placeholder, as all indices should be less than it.
     auto available = sanisizer::create<std::vector<Index_> >(ref_nrow, ref_nrow);
     std::vector<Index_> subset;
-    for (const auto& mrk : markers) {
-        for (const auto& mm : mrk) {
-            for (const auto y : mm) {
-                auto& av = available[y];
-                if (av == ref_nrow) {
-                    av = 0; // any value != ref_nrow will do here, and ref_nrow > 0 at this point (otherwise we'd segfault).
-                    subset.emplace_back(y);
-                }
-            }
+    for (const auto y : indices) {
+        auto& av = available[y];
+        if (av == ref_nrow) {
+            av = 0; // any value != ref_nrow will do here, and ref_nrow > 0 at this point (otherwise we'd segfault).
+            subset.emplace_back(y);
         }
     }
 
@@ -39,12 +37,8 @@ std::vector<Index_> subset_to_markers(const Index_ ref_nrow, PairwiseMarkers<Ind
         available[subset[s]] = s;
     }
 
-    for (auto& mrk : markers) {
-        for (auto& mm : mrk) {
-            for (auto& y : mm) {
-                y = available[y];
-            }
-        }
+    for (auto& y : indices) {
+        y = available[y];
     }
 
     return subset;
@@ -55,7 +49,7 @@ std::pair<std::vector<Index_>, std::vector<Index_> > subset_to_markers(
     const Index_ test_nrow,
     const Intersection<Index_>& intersection,
     const Index_ ref_nrow,
-    PairwiseMarkers<Index_>& markers
+    FlatPairwiseMarkers<Index_>& markers
 ) {
     // Again, using ref_nrow and test_nrow as the respective missing-value placeholders.
     auto in_inter = sanisizer::create<std::vector<Index_> >(ref_nrow, test_nrow);
@@ -65,26 +59,31 @@ std::pair<std::vector<Index_>, std::vector<Index_> > subset_to_markers(
 
     auto available = sanisizer::create<std::vector<Index_> >(ref_nrow, ref_nrow);
     std::vector<std::pair<Index_, Index_> > subset;
-    for (auto& mrk : markers) {
-        for (auto& mm : mrk) {
-            const auto num_markers = mm.size();
-            I<decltype(num_markers)> used = 0;
-            for (I<decltype(num_markers)> m = 0; m < num_markers; ++m) {
-                const auto y = mm[m];
-                const auto t = in_inter[y];
-                if (t != test_nrow) {
-                    auto& av = available[y];
-                    if (av == ref_nrow) {
-                        av = 0; // any value != ref_nrow will do here.
-                        subset.emplace_back(t, y);
-                    }
-                    mm[used] = y;
-                    ++used;
+
+    // Filtering each marker list in place, shifting the retained markers to the front of the flattened array.
+    auto& indices = markers.mutable_indices();
+    auto& offsets = markers.mutable_offsets();
+    const auto num_pairs = offsets.size() - 1;
+    std::size_t used = 0, start = 0;
+    for (I<decltype(num_pairs)> p = 0; p < num_pairs; ++p) {
+        const auto end = offsets[p + 1];
+        for (auto m = start; m < end; ++m) {
+            const auto y = indices[m];
+            const auto t = in_inter[y];
+            if (t != test_nrow) {
+                auto& av = available[y];
+                if (av == ref_nrow) {
+                    av = 0; // any value != ref_nrow will do here.
+                    subset.emplace_back(t, y);
                 }
+                indices[used] = y;
+                ++used;
             }
-            mm.resize(used);
         }
+        offsets[p + 1] = used;
+        start = end; // need to hold onto the old value as 'offsets[p + 1]' was just overwritten.
     }
+    indices.resize(used);
 
     // Output is sorted by the test indices, to favor more efficient extraction
     // from the test matrix after the training is complete.
@@ -99,12 +98,8 @@ std::pair<std::vector<Index_>, std::vector<Index_> > subset_to_markers(
         available[subset[s].second] = s;
     }
 
-    for (auto& mrk : markers) {
-        for (auto& mm : mrk) {
-            for (auto& y : mm) {
-                y = available[y];
-            }
-        }
+    for (auto& y : indices) {
+        y = available[y];
     }
 
     return output;
@@ -6,6 +6,7 @@
 #include "tatami/tatami.hpp"
 
 #include "build_reference.hpp"
+#include "MemoryUsage.hpp"
 #include "Markers.hpp"
 #include "Intersection.hpp"
 #include "utils.hpp"
@@ -280,6 +281,41 @@ public:
         }
         return num_prof;
     }
+
+    /**
+     * @return Memory usage of this classifier, broken down by reference, label and data structure.
+     * This can be used to decide how many classifiers can be held in memory at once.
+     */
+    IntegratedMemoryUsage memory_usage() const {
+        IntegratedMemoryUsage output;
+        output.references.reserve(my_references.size());
+
+        for (const auto& ref : my_references) {
+            output.references.emplace_back();
+            auto& labels = output.references.back().labels;
+
+            if (ref.dense.has_value()) {
+                labels.reserve(ref.dense->size());
+                for (const auto& lab : *(ref.dense)) {
+                    labels.emplace_back();
+                    auto& current = labels.back();
+                    current.markers = vector_bytes(lab.markers);
+                    current.ranked = vector_bytes(lab.all_ranked);
+                }
+            } else {
+                labels.reserve(ref.sparse->size());
+                for (const auto& lab : *(ref.sparse)) {
+                    labels.emplace_back();
+                    auto& current = labels.back();
+                    current.markers = vector_bytes(lab.markers);
+                    current.ranked = vector_bytes(lab.negative_ranked) + vector_bytes(lab.positive_ranked) + vector_bytes(lab.negative_indptrs) + vector_bytes(lab.positive_indptrs);
+                }
+            }
+        }
+
+        output.subset = vector_bytes(my_universe);
+        return output;
+    }
 };
 
 /**
@@ -6,11 +6,15 @@
 #include "tatami/tatami.hpp"
 
 #include "build_reference.hpp"
+#include "Tracer.hpp"
+#include "MemoryUsage.hpp"
 #include "subset_to_markers.hpp"
 #include "utils.hpp"
 
 #include <vector>
 #include <memory>
+#include <optional>
+#include <mutex>
 #include <cstddef>
 #include <cassert>
 
@@ -25,6 +29,14 @@ namespace singlepp {
  * @brief Options for `train_single()` and friends.
  */
 struct TrainSingleOptions {
+    /**
+     * Pointer to a `Tracer` in which to record the time spent in each phase of training.
+     * Each thread reports a `rank_reference` event for the ranking of its reference profiles,
+     * and a `build_index` event (containing a nested `select_seeds` event) for each label that it processes.
+     * This may be `NULL` in which case no timings are recorded.
+     */
+    Tracer* tracer = NULL;
+
     /**
      * Number of threads to use.
      * The parallelization scheme is determined by `tatami::parallelize()`.
@@ -58,6 +70,38 @@ std::size_t get_num_profiles_from_built(const BuiltReference<Index_, Float_>& bu
     }
     return n;
 }
+
+// Lazily constructs the nested representation of the markers for the deprecated TrainedSingle::markers().
+// Copies start with an empty cache, as std::once_flag cannot be copied or reset.
+// Moves transfer the cache so that they remain noexcept; a moved-from instance should not be used.
+template<typename Index_>
+class NestedMarkersCache {
+public:
+    NestedMarkersCache() : my_state(std::make_unique<State>()) {}
+    NestedMarkersCache(const NestedMarkersCache&) : NestedMarkersCache() {}
+    NestedMarkersCache(NestedMarkersCache&&) = default;
+
+    NestedMarkersCache& operator=(const NestedMarkersCache&) {
+        my_state = std::make_unique<State>();
+        return *this;
+    }
+    NestedMarkersCache& operator=(NestedMarkersCache&&) = default;
+
+    const PairwiseMarkers<Index_>& get(const FlatPairwiseMarkers<Index_>& flat) const {
+        auto& state = *my_state;
+        std::call_once(state.flag, [&]() -> void {
+            state.nested = flat.to_nested();
+        });
+        return *(state.nested);
+    }
+
+private:
+    struct State {
+        std::once_flag flag;
+        std::optional<PairwiseMarkers<Index_> > nested;
+    };
+    std::unique_ptr<State> my_state;
+};
 /**
  * @endcond
  */
@@ -79,7 +123,7 @@ public:
      */
     TrainedSingle(
         Index_ test_nrow,
-        PairwiseMarkers<Index_> markers,
+        FlatPairwiseMarkers<Index_> markers,
         std::vector<Index_> subset,
         BuiltReference<Index_, Float_> built
     ) : 
@@ -91,14 +135,9 @@ public:
         assert(is_sorted_unique(subset.size(), subset.data()));
 
         const auto nlabels = my_built.dense.has_value() ? my_built.dense->size() : my_built.sparse->size();
-        if (!sanisizer::is_equal(my_markers.size(), nlabels)) {
+        if (!sanisizer::is_equal(my_markers.num_labels(), nlabels)) {
             throw std::runtime_error("'markers' length should be equal to the number of unique labels");
         }
-        for (const auto& mm : my_markers) {
-            if (!sanisizer::is_equal(mm.size(), nlabels)) {
-                throw std::runtime_error("length of each entry of 'markers' should be equal to the number of unique labels");
-            }
-        }
     }
     /**
      * @endcond
@@ -106,9 +145,10 @@ public:
 
 private:
     Index_ my_test_nrow;
-    PairwiseMarkers<Index_> my_markers;
+    FlatPairwiseMarkers<Index_> my_markers;
     std::vector<Index_> my_subset;
     BuiltReference<Index_, Float_> my_built;
+    NestedMarkersCache<Index_> my_nested_markers;
 
 public:
     /**
@@ -119,13 +159,27 @@ public:
     }
 
     /**
+     * @return Marker genes for each pairwise comparison to be used in the classification.
+     * Each marker is represented as an index into the subset vector (see `subset()`),
+     * e.g., `subset()[*(flat_markers().begin(2, 1))]` is the row index of the first marker of the third label over the first label.
+     * The set of marker genes is a subset of the input `markers` used in `train_single()`. 
+     */
+    const FlatPairwiseMarkers<Index_>& flat_markers() const {
+        return my_markers;
+    }
+
+    /**
+     * @deprecated Use `flat_markers()` instead.
+     * The nested representation is constructed from `flat_markers()` on the first call and cached for subsequent calls,
+     * so this roughly doubles the memory used by the markers.
+     * This function is thread-safe.
+     *
      * @return A vector of vectors of vectors of ranked marker genes to be used in the classification.
      * In the innermost vectors, each value is an index into the subset vector (see `subset()`),
      * e.g., `subset()[markers()[2][1].front()]` is the row index of the first marker of the third label over the first label.
-     * The set of marker genes is a subset of the input `markers` used in `train_single()`. 
      */
     const PairwiseMarkers<Index_>& markers() const {
-        return my_markers;
+        return my_nested_markers.get(my_markers);
     }
 
     /**
@@ -151,6 +205,29 @@ public:
         return get_num_profiles_from_built(my_built);
     }
 
+    /**
+     * @return Memory usage of this classifier, broken down by label and data structure.
+     * This can be used to decide how many classifiers can be held in memory at once.
+     */
+    MemoryUsage memory_usage() const {
+        MemoryUsage output;
+        auto fill = [&](const auto& references) -> void {
+            output.labels.reserve(references.size());
+            for (const auto& ref : references) {
+                output.labels.push_back(compute_memory_usage(ref));
+            }
+        };
+        if (my_built.sparse.has_value()) {
+            fill(*(my_built.sparse));
+        } else {
+            fill(*(my_built.dense));
+        }
+
+        output.markers = vector_bytes(my_markers.indices()) + vector_bytes(my_markers.offsets());
+        output.subset = vector_bytes(my_subset);
+        return output;
+    }
+
     /**
      * @cond
      */
@@ -181,9 +258,9 @@ public:
  * @param[in] labels An array of length equal to the number of columns of `ref`, containing the label for each reference profile.
  * Labels should be integers in \f$[0, L)\f$ where \f$L\f$ is the total number of unique labels.
  * Each label up to \f$L\f$ should occur at least once in `labels`.
- * @param markers Vector of vectors of ranked marker genes for each pairwise comparison between labels.
+ * @param markers Ranked marker genes for each pairwise comparison between labels.
  * The number of labels should be equal \f$L\f$, and each marker gene should be defined as a row index in `ref`.
- * See `singlepp::PairwiseMarkers` for more details.
+ * See `singlepp::FlatPairwiseMarkers` for more details.
  * @param options Further options.
  *
  * @return A pre-built classifier that can be used in `classify_single()` with a test dataset.
@@ -192,15 +269,42 @@ template<typename Float_ = double, typename Value_, typename Index_, typename La
 TrainedSingle<Index_, Float_> train_single(
     const tatami::Matrix<Value_, Index_>& ref,
     const Label_* labels,
-    PairwiseMarkers<Index_> markers,
+    FlatPairwiseMarkers<Index_> markers,
     const TrainSingleOptions& options
 ) {
     auto subset = subset_to_markers(ref.nrow(), markers);
-    auto subref = build_reference<Float_>(ref, labels, subset, options.num_threads);
+    auto subref = build_reference<Float_>(ref, labels, subset, options.tracer, options.num_threads);
     const Index_ test_nrow = ref.nrow(); // remember, test and ref are assumed to have the same features.
     return TrainedSingle<Index_, Float_>(test_nrow, std::move(markers), std::move(subset), std::move(subref));
 }
 
+/**
+ * Overload of `train_single()` that accepts nested marker lists.
+ * These are converted into a `FlatPairwiseMarkers` object before training.
+ *
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Index_ Integer type for the row/column indices of the matrix.
+ * @tparam Label_ Integer type for the reference labels.
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ *
+ * @param ref Matrix for the reference expression profiles.
+ * @param[in] labels An array of length equal to the number of columns of `ref`, containing the label for each reference profile.
+ * @param markers Vector of vectors of ranked marker genes for each pairwise comparison between labels.
+ * See `singlepp::PairwiseMarkers` for more details.
+ * @param options Further options.
+ *
+ * @return A pre-built classifier that can be used in `classify_single()` with a test dataset.
+ */
+template<typename Float_ = double, typename Value_, typename Index_, typename Label_>
+TrainedSingle<Index_, Float_> train_single(
+    const tatami::Matrix<Value_, Index_>& ref,
+    const Label_* labels,
+    const PairwiseMarkers<Index_>& markers,
+    const TrainSingleOptions& options
+) {
+    return train_single<Float_>(ref, labels, FlatPairwiseMarkers<Index_>(markers), options);
+}
+
 /**
  * Overload of `train_single()` that uses a pre-computed intersection of genes between the reference dataset and an as-yet-unspecified test dataset.
  * Most users will prefer to use the other `train_single()` overload that accepts `test_id` and `ref_id` and computes the intersection automatically.
@@ -223,9 +327,9 @@ TrainedSingle<Index_, Float_> train_single(
  * @param[in] labels An array of length equal to the number of columns of `ref`, containing the label for each reference profile.
  * Labels should be integers in \f$[0, L)\f$ where \f$L\f$ is the total number of unique labels.
  * Each label up to \f$L\f$ should occur at least once in `labels`.
- * @param markers A vector of vectors of ranked marker genes for each pairwise comparison between labels. 
+ * @param markers Ranked marker genes for each pairwise comparison between labels. 
  * The number of labels should be equal \f$L\f$, and each marker gene should be defined as a row index in `ref`.
- * See `singlepp::PairwiseMarkers` for more details.
+ * See `singlepp::FlatPairwiseMarkers` for more details.
  * @param[out] ref_subset Pointer to a vector in which to store the subset of rows of `ref` that contains the markers to be used for classification.
  * On output, the vector is filled with unique (but not necessarily sorted) row indices of length equal to `TrainedSingle::subset()`,
  * where each value contains the reference row that matches the test row indexed by the corresponding entry of `TrainedSingle::subset()`.
@@ -240,18 +344,51 @@ TrainedSingle<Index_, Float_> train_single(
     const Intersection<Index_>& intersection,
     const tatami::Matrix<Value_, Index_>& ref, 
     const Label_* labels,
-    PairwiseMarkers<Index_> markers,
+    FlatPairwiseMarkers<Index_> markers,
     std::vector<Index_>* ref_subset,
     const TrainSingleOptions& options
 ) {
     auto pairs = subset_to_markers(test_nrow, intersection, ref.nrow(), markers);
-    auto subref = build_reference<Float_>(ref, labels, pairs.second, options.num_threads);
+    auto subref = build_reference<Float_>(ref, labels, pairs.second, options.tracer, options.num_threads);
     if (ref_subset) {
         *ref_subset = std::move(pairs.second);
     }
     return TrainedSingle<Index_, Float_>(test_nrow, std::move(markers), std::move(pairs.first), std::move(subref));
 }
 
+/**
+ * Overload of `train_single()` that accepts a pre-computed intersection and nested marker lists.
+ * The latter are converted into a `FlatPairwiseMarkers` object before training.
+ *
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Index_ Integer type for the row/column indices of the matrix.
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Label_ Integer type for the reference labels.
+ *
+ * @param test_nrow Number of features in the test dataset.
+ * @param intersection Vector defining the intersection of genes between the test and reference datasets.
+ * @param ref An expression matrix for the reference expression profiles, where rows are genes and columns are cells.
+ * @param[in] labels An array of length equal to the number of columns of `ref`, containing the label for each reference profile.
+ * @param markers A vector of vectors of ranked marker genes for each pairwise comparison between labels. 
+ * See `singlepp::PairwiseMarkers` for more details.
+ * @param[out] ref_subset Pointer to a vector in which to store the subset of rows of `ref` that contains the markers to be used for classification.
+ * @param options Further options.
+ *
+ * @return A pre-built classifier that can be used in `classify_single()`. 
+ */
+template<typename Float_ = double, typename Index_, typename Value_, typename Label_>
+TrainedSingle<Index_, Float_> train_single(
+    Index_ test_nrow,
+    const Intersection<Index_>& intersection,
+    const tatami::Matrix<Value_, Index_>& ref, 
+    const Label_* labels,
+    const PairwiseMarkers<Index_>& markers,
+    std::vector<Index_>* ref_subset,
+    const TrainSingleOptions& options
+) {
+    return train_single<Float_>(test_nrow, intersection, ref, labels, FlatPairwiseMarkers<Index_>(markers), ref_subset, options);
+}
+
 /**
  * Overload of `train_single()` that uses the intersection of genes between the reference dataset and a (future) test dataset.
  * This is useful when the genes are not in the same order and number across the test and reference datasets.
@@ -276,9 +413,9 @@ TrainedSingle<Index_, Float_> train_single(
  * @param[in] labels An array of length equal to the number of columns of `ref`, containing the label for each reference profile.
  * Labels should be integers in \f$[0, L)\f$ where \f$L\f$ is the total number of unique labels.
  * Each label up to \f$L\f$ should occur at least once in `labels`.
- * @param markers Vector of vectors of ranked marker genes for each pairwise comparison between labels. 
+ * @param markers Ranked marker genes for each pairwise comparison between labels. 
  * The number of labels should be equal \f$L\f$, and each marker gene should be defined as a row index in `ref`.
- * See `singlepp::PairwiseMarkers` for more details.
+ * See `singlepp::FlatPairwiseMarkers` for more details.
  * @param[out] ref_subset Pointer to a vector in which to store the subset of rows of `ref` that contains the markers to be used for classification.
  * On output, the vector is filled with unique (but not necessarily sorted) row indices of length equal to `TrainedSingle::subset()`,
  * where each value contains the reference row that matches the test row indexed by the corresponding entry of `TrainedSingle::subset()`.
@@ -294,12 +431,48 @@ TrainedSingle<Index_, Float_> train_single(
     const tatami::Matrix<Value_, Index_>& ref, 
     const Id_* ref_id, 
     const Label_* labels,
-    PairwiseMarkers<Index_> markers,
+    FlatPairwiseMarkers<Index_> markers,
     std::vector<Index_>* ref_subset,
     const TrainSingleOptions& options
 ) {
     auto intersection = intersect_genes(test_nrow, test_id, ref.nrow(), ref_id);
-    return train_single(test_nrow, intersection, ref, labels, std::move(markers), ref_subset, options);
+    return train_single<Float_>(test_nrow, intersection, ref, labels, std::move(markers), ref_subset, options);
+}
+
+/**
+ * Overload of `train_single()` that computes the intersection of genes and accepts nested marker lists.
+ * The latter are converted into a `FlatPairwiseMarkers` object before training.
+ *
+ * @tparam Float_ Floating-point type for the correlations and scores.
+ * @tparam Index_ Integer type for the row/column indices of the matrix.
+ * @tparam Id_ Type of the gene identifier for each row, typically integer or string.
+ * @tparam Value_ Numeric type for the matrix values.
+ * @tparam Label_ Integer type for the reference labels.
+ *
+ * @param test_nrow Number of rows (genes) in the test dataset.
+ * @param[in] test_id Pointer to an array of length equal to `test_nrow`, containing a gene identifier for each row of the test dataset.
+ * @param ref An expression matrix for the reference expression profiles, where rows are genes and columns are cells.
+ * @param[in] ref_id Pointer to an array of length equal to the number of rows of `ref`, containing a gene identifier for each row of the reference dataset.
+ * @param[in] labels An array of length equal to the number of columns of `ref`, containing the label for each reference profile.
+ * @param markers Vector of vectors of ranked marker genes for each pairwise comparison between labels. 
+ * See `singlepp::PairwiseMarkers` for more details.
+ * @param[out] ref_subset Pointer to a vector in which to store the subset of rows of `ref` that contains the markers to be used for classification.
+ * @param options Further options.
+ *
+ * @return A pre-built classifier that can be used in `classify_single()`.
+ */
+template<typename Float_ = double, typename Index_, typename Id_, typename Value_, typename Label_>
+TrainedSingle<Index_, Float_> train_single(
+    Index_ test_nrow,
+    const Id_* test_id, 
+    const tatami::Matrix<Value_, Index_>& ref, 
+    const Id_* ref_id, 
+    const Label_* labels,
+    const PairwiseMarkers<Index_>& markers,
+    std::vector<Index_>* ref_subset,
+    const TrainSingleOptions& options
+) {
+    return train_single<Float_>(test_nrow, test_id, ref, ref_id, labels, FlatPairwiseMarkers<Index_>(markers), ref_subset, options);
 }
 
 }
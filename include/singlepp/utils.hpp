@@ -4,6 +4,8 @@
 #include <type_traits>
 #include <algorithm>
 #include <vector>
+#include <cstdint>
+#include <cassert>
 
 namespace singlepp {
 
@@ -31,6 +33,19 @@ bool is_sorted_unique(const Number_ n, const Value_* data) {
     return true;
 }
 
+inline int count_trailing_zeros(const std::uint64_t x) {
+    assert(x != 0);
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int count = 0;
+    for (auto y = x; (y & 1) == 0; y >>= 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
 }
 
 #endif
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/ClassifySingleSession.hpp"
+#include "singlepp/classify_single.hpp"
+#include "tatami/tatami.hpp"
+
+#include "spawn_matrix.h"
+#include "train_mock.h"
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <string>
+
+class ClassifySingleSessionTest : public ::testing::TestWithParam<std::tuple<bool, bool, int> > {};
+
+TEST_P(ClassifySingleSessionTest, Repeated) {
+    auto param = GetParam();
+    bool ref_sparse = std::get<0>(param);
+    bool fine_tune = std::get<1>(param);
+    int nthreads = std::get<2>(param);
+
+    std::size_t ngenes = 200, nlabels = 4, nrefs = 60;
+    auto trained = train_mock_single(ngenes, nlabels, nrefs, 10, /* seed = */ 400, /* ref_sparse = */ ref_sparse);
+
+    singlepp::ClassifySingleOptions<double> copt;
+    copt.fine_tune = fine_tune;
+    copt.num_threads = nthreads;
+    singlepp::ClassifySingleSession<double, int, double, int> session(trained, copt);
+
+    // Many small batches of different sizes, in both dense and sparse form.
+    for (int batch = 0; batch < 6; ++batch) {
+        const std::size_t ntest = 1 + batch * 5;
+        std::shared_ptr<tatami::Matrix<double, int> > test = spawn_sparse_matrix(ngenes, ntest, /* seed = */ 403 + batch, 0.3);
+        if (batch % 2) {
+            test = tatami::convert_to_compressed_sparse<double, int>(*test, true, {});
+        }
+
+        auto expected = singlepp::classify_single<int>(*test, trained, copt);
+        auto observed = session.classify(*test);
+        EXPECT_EQ(expected.best, observed.best);
+        EXPECT_EQ(expected.delta, observed.delta);
+        EXPECT_EQ(expected.scores, observed.scores);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ClassifySingleSession,
+    ClassifySingleSessionTest,
+    ::testing::Combine(
+        ::testing::Values(false, true), // whether the reference is sparse.
+        ::testing::Values(false, true), // whether to fine-tune.
+        ::testing::Values(1, 3) // number of threads.
+    )
+);
+
+TEST(ClassifySingleSession, Buffers) {
+    std::size_t ngenes = 150, nlabels = 3, nrefs = 30, ntest = 20;
+    auto trained = train_mock_single(ngenes, nlabels, nrefs, 10, /* seed = */ 500, /* ref_sparse = */ false);
+
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 503);
+    singlepp::ClassifySingleOptions<double> copt;
+    copt.num_threads = 2;
+    auto expected = singlepp::classify_single<int>(*test, trained, copt);
+
+    singlepp::ClassifySingleSession<double, int, double, int> session(trained, copt);
+    std::vector<int> best(ntest);
+    singlepp::ClassifySingleBuffers<int, double> buffers;
+    buffers.best = best.data();
+    buffers.delta = NULL;
+    buffers.scores.resize(nlabels, NULL);
+    session.classify(*test, buffers);
+    EXPECT_EQ(expected.best, best);
+
+    // Same results from a raw dense array.
+    auto ext = test->dense_column();
+    std::vector<double> values(ngenes * ntest);
+    for (std::size_t c = 0; c < ntest; ++c) {
+        auto ptr = ext->fetch(c, values.data() + c * ngenes);
+        tatami::copy_n(ptr, ngenes, values.data() + c * ngenes);
+    }
+    std::fill(best.begin(), best.end(), -1);
+    session.classify_dense(ntest, values.data(), buffers);
+    EXPECT_EQ(expected.best, best);
+
+    // Checking that the row check is still performed.
+    auto wrong = spawn_matrix(ngenes + 1, ntest, /* seed = */ 504);
+    std::string msg;
+    try {
+        session.classify(*wrong, buffers);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("number of rows") != std::string::npos);
+}
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/MarkerBitsets.hpp"
+
+#include "mock_markers.h"
+
+#include <vector>
+#include <cstdint>
+#include <set>
+
+static std::set<int> unpack_words(const std::vector<std::uint64_t>& words) {
+    std::set<int> output;
+    for (std::size_t w = 0; w < words.size(); ++w) {
+        for (int b = 0; b < 64; ++b) {
+            if (words[w] & (static_cast<std::uint64_t>(1) << b)) {
+                output.insert(w * 64 + b);
+            }
+        }
+    }
+    return output;
+}
+
+TEST(MarkerBitsets, Basic) {
+    const int nmarkers = 150;
+    const std::size_t nlabels = 5;
+    auto markers = mock_pairwise_markers<int>(nlabels, 10, nmarkers, /* seed = */ 69);
+    markers[2][2] = std::vector<int>{ 3, 149 }; // adding some diagonal markers.
+
+    singlepp::MarkerBitsets<int> bitsets(nmarkers, singlepp::FlatPairwiseMarkers<int>(markers));
+    EXPECT_EQ(bitsets.num_words(), 3);
+
+    std::vector<std::vector<int> > choices{ { 0 }, { 2 }, { 1, 3 }, { 4, 0, 2 }, { 3, 1, 0, 4 }, { 0, 1, 2, 3, 4 } };
+    std::vector<std::uint64_t> words;
+    for (const auto& in_use : choices) {
+        std::set<int> expected;
+        for (auto l : in_use) {
+            for (auto l2 : in_use) {
+                expected.insert(markers[l][l2].begin(), markers[l][l2].end());
+            }
+        }
+
+        bitsets.fill(in_use, words);
+        EXPECT_EQ(words.size(), 3);
+        EXPECT_EQ(unpack_words(words), expected);
+    }
+}
+
+TEST(MarkerBitsets, Empty) {
+    auto markers = mock_pairwise_markers<int>(3, 0, 0, /* seed = */ 70);
+    singlepp::MarkerBitsets<int> bitsets(0, singlepp::FlatPairwiseMarkers<int>(markers));
+    EXPECT_EQ(bitsets.num_words(), 0);
+
+    std::vector<std::uint64_t> words;
+    bitsets.fill(std::vector<int>{ 0, 2 }, words);
+    EXPECT_TRUE(words.empty());
+}
+
+TEST(MarkerBitsets, Fits) {
+    // 100 labels => 5050 pairs, 2 words per pair.
+    EXPECT_TRUE(singlepp::MarkerBitsets<int>::fits(100, 100, 5050 * 2 * 8));
+    EXPECT_FALSE(singlepp::MarkerBitsets<int>::fits(100, 100, 5050 * 2 * 8 - 1));
+    EXPECT_TRUE(singlepp::MarkerBitsets<int>::fits(100, 0, 0));
+    EXPECT_FALSE(singlepp::MarkerBitsets<int>::fits(100, 100, 0));
+
+    // Avoids overflow for huge numbers of labels.
+    EXPECT_FALSE(singlepp::MarkerBitsets<int>::fits(static_cast<std::size_t>(-1), 100, static_cast<std::size_t>(-1)));
+}
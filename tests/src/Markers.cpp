@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/Markers.hpp"
+
+#include "mock_markers.h"
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+TEST(FlatPairwiseMarkers, Nested) {
+    std::size_t nlabels = 4;
+    auto markers = mock_pairwise_markers<int>(nlabels, 10, 100, /* seed = */ 42);
+    markers[1][1] = std::vector<int>{ 5, 2, 8 };
+
+    singlepp::FlatPairwiseMarkers<int> flat(markers);
+    EXPECT_EQ(flat.num_labels(), nlabels);
+    EXPECT_EQ(flat.offsets().size(), nlabels * nlabels + 1);
+    EXPECT_EQ(flat.offsets().back(), flat.indices().size());
+
+    for (std::size_t i = 0; i < nlabels; ++i) {
+        for (std::size_t j = 0; j < nlabels; ++j) {
+            EXPECT_EQ(flat.size(i, j), markers[i][j].size());
+            EXPECT_EQ(std::vector<int>(flat.begin(i, j), flat.end(i, j)), markers[i][j]);
+        }
+    }
+
+    EXPECT_EQ(flat.to_nested(), markers);
+
+    // Round-trips via the direct constructor.
+    singlepp::FlatPairwiseMarkers<int> copy(nlabels, flat.indices(), flat.offsets());
+    EXPECT_EQ(copy.to_nested(), markers);
+}
+
+TEST(FlatPairwiseMarkers, Empty) {
+    singlepp::FlatPairwiseMarkers<int> empty;
+    EXPECT_EQ(empty.num_labels(), 0);
+    EXPECT_TRUE(empty.indices().empty());
+    EXPECT_EQ(empty.offsets().size(), 1);
+    EXPECT_TRUE(empty.to_nested().empty());
+
+    singlepp::FlatPairwiseMarkers<int> empty2(singlepp::PairwiseMarkers<int>{});
+    EXPECT_EQ(empty2.num_labels(), 0);
+    EXPECT_EQ(empty2.offsets().size(), 1);
+}
+
+static void expect_error(std::string pattern, std::size_t nlabels, std::vector<int> indices, std::vector<std::size_t> offsets) {
+    std::string msg;
+    try {
+        singlepp::FlatPairwiseMarkers<int>(nlabels, std::move(indices), std::move(offsets));
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find(pattern) != std::string::npos) << msg;
+}
+
+TEST(FlatPairwiseMarkers, Errors) {
+    expect_error("length of 'offsets'", 2, std::vector<int>{}, std::vector<std::size_t>(4));
+    expect_error("first and last", 1, std::vector<int>{ 1 }, std::vector<std::size_t>{ 0, 2 });
+    expect_error("first and last", 1, std::vector<int>{ 1 }, std::vector<std::size_t>{ 1, 1 });
+    expect_error("non-decreasing", 2, std::vector<int>{ 1, 2 }, std::vector<std::size_t>{ 0, 2, 1, 2, 2 });
+
+    singlepp::PairwiseMarkers<int> ragged(2);
+    ragged[0].resize(2);
+    ragged[1].resize(1);
+    std::string msg;
+    try {
+        singlepp::FlatPairwiseMarkers<int> flat(ragged);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("length of each entry of 'markers'") != std::string::npos);
+}
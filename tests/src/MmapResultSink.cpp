@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/MmapResultSink.hpp"
+#include "singlepp/classify_single.hpp"
+#include "singlepp/classify_integrated.hpp"
+#include "tatami/tatami.hpp"
+
+#include "mock_markers.h"
+#include "spawn_matrix.h"
+#include "train_mock.h"
+#include "temp_file.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+class MmapResultSinkTest : public ::testing::Test {
+protected:
+    static std::vector<unsigned char> slurp(const std::string& path) {
+        std::ifstream handle(path, std::ios::binary);
+        return std::vector<unsigned char>(std::istreambuf_iterator<char>(handle), std::istreambuf_iterator<char>());
+    }
+
+    template<typename Type_>
+    static Type_ read(const std::vector<unsigned char>& contents, std::size_t offset) {
+        Type_ output;
+        std::memcpy(&output, contents.data() + offset, sizeof(Type_));
+        return output;
+    }
+
+    template<typename Type_>
+    static std::vector<Type_> read_array(const std::vector<unsigned char>& contents, std::size_t offset, std::size_t n) {
+        std::vector<Type_> output(n);
+        std::memcpy(output.data(), contents.data() + offset, n * sizeof(Type_));
+        return output;
+    }
+};
+
+TEST_F(MmapResultSinkTest, Single) {
+    std::size_t ngenes = 200, nlabels = 4, nrefs = 40, ntest = 53;
+    auto trained = train_mock_single(ngenes, nlabels, nrefs, 10, /* seed = */ 10, /* ref_sparse = */ false);
+
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 13);
+    singlepp::ClassifySingleOptions<double> copt;
+    auto expected = singlepp::classify_single<int>(*test, trained, copt);
+
+    const TempFile tmp("single");
+    const auto& path = tmp.path;
+    for (int nthreads : { 1, 3 }) {
+        copt.num_threads = nthreads;
+        {
+            singlepp::MmapResultSinkOptions sopt;
+            sopt.chunk_size = 10;
+            singlepp::MmapResultSink<int, double> sink(path, ntest, nlabels, sopt);
+            singlepp::classify_single(*test, trained, sink, copt);
+            sink.flush();
+        }
+
+        auto contents = slurp(path);
+        ASSERT_GE(contents.size(), 64u);
+        EXPECT_EQ(std::string(contents.begin(), contents.begin() + 8), "SGLPPRES");
+        EXPECT_EQ(read<std::uint32_t>(contents, 8), 1u);
+        EXPECT_EQ(read<std::uint32_t>(contents, 12), sizeof(int));
+        EXPECT_EQ(read<std::uint32_t>(contents, 16), sizeof(double));
+        EXPECT_EQ(read<std::uint32_t>(contents, 20), 3u);
+        EXPECT_EQ(read<std::uint64_t>(contents, 24), ntest);
+        EXPECT_EQ(read<std::uint64_t>(contents, 32), nlabels);
+
+        const auto best_offset = read<std::uint64_t>(contents, 40);
+        const auto delta_offset = read<std::uint64_t>(contents, 48);
+        const auto scores_offset = read<std::uint64_t>(contents, 56);
+        EXPECT_EQ(best_offset % 64, 0u);
+        EXPECT_EQ(delta_offset % 64, 0u);
+        EXPECT_EQ(scores_offset % 64, 0u);
+
+        EXPECT_EQ(read_array<int>(contents, best_offset, ntest), expected.best);
+        EXPECT_EQ(read_array<double>(contents, delta_offset, ntest), expected.delta);
+        for (std::size_t l = 0; l < nlabels; ++l) {
+            EXPECT_EQ(read_array<double>(contents, scores_offset + l * ntest * sizeof(double), ntest), expected.scores[l]);
+        }
+    }
+
+    // Skipping the deltas and scores.
+    {
+        singlepp::MmapResultSinkOptions sopt;
+        sopt.chunk_size = 20;
+        sopt.store_delta = false;
+        sopt.store_scores = false;
+        singlepp::MmapResultSink<int, double> sink(path, ntest, nlabels, sopt);
+        singlepp::classify_single(*test, trained, sink, copt);
+    }
+
+    auto contents = slurp(path);
+    EXPECT_EQ(read<std::uint32_t>(contents, 20), 0u);
+    EXPECT_EQ(read<std::uint64_t>(contents, 48), 0u);
+    EXPECT_EQ(read<std::uint64_t>(contents, 56), 0u);
+    EXPECT_EQ(read_array<int>(contents, read<std::uint64_t>(contents, 40), ntest), expected.best);
+}
+
+TEST_F(MmapResultSinkTest, Integrated) {
+    std::size_t ngenes = 300, nrefs = 3, nsamples = 30, ntest = 41;
+
+    std::vector<std::shared_ptr<tatami::Matrix<double, int> > > references;
+    std::vector<std::vector<int> > labels;
+    std::vector<singlepp::TrainIntegratedInput<double, int, int> > inputs;
+    std::vector<std::vector<int> > chosen(nrefs);
+    std::mt19937_64 rng(/* seed = */ 20);
+
+    for (std::size_t r = 0; r < nrefs; ++r) {
+        const std::size_t nlabels = 3 + r;
+        references.push_back(spawn_matrix(ngenes, nsamples, /* seed = */ 21 + r));
+        labels.push_back(spawn_labels(nsamples, nlabels, /* seed = */ 31 + r));
+
+        singlepp::PerLabelMarkers<int> markers(nlabels);
+        for (auto& m : markers) {
+            fill_markers(m, 10, ngenes, rng);
+        }
+        inputs.push_back(singlepp::prepare_integrated_input<double, int>(references[r], labels[r].data(), std::move(markers)));
+
+        for (std::size_t t = 0; t < ntest; ++t) {
+            chosen[r].push_back(rng() % nlabels);
+        }
+    }
+
+    singlepp::TrainIntegratedOptions iopt;
+    auto integrated = singlepp::train_integrated(std::move(inputs), iopt);
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 40);
+    std::vector<const int*> chosen_ptrs;
+    for (const auto& ch : chosen) {
+        chosen_ptrs.push_back(ch.data());
+    }
+
+    singlepp::ClassifyIntegratedOptions<double> copt;
+    auto expected = singlepp::classify_integrated<int>(*test, chosen_ptrs, integrated, copt);
+
+    const TempFile tmp("integrated");
+    const auto& path = tmp.path;
+    for (int nthreads : { 1, 3 }) {
+        copt.num_threads = nthreads;
+        {
+            singlepp::MmapResultSinkOptions sopt;
+            sopt.chunk_size = 8;
+            singlepp::MmapResultSink<int, double> sink(path, ntest, nrefs, sopt);
+            singlepp::classify_integrated(*test, chosen_ptrs, integrated, sink, copt);
+        }
+
+        auto contents = slurp(path);
+        EXPECT_EQ(read<std::uint64_t>(contents, 32), nrefs);
+        EXPECT_EQ(read_array<int>(contents, read<std::uint64_t>(contents, 40), ntest), expected.best);
+        EXPECT_EQ(read_array<double>(contents, read<std::uint64_t>(contents, 48), ntest), expected.delta);
+        const auto scores_offset = read<std::uint64_t>(contents, 56);
+        for (std::size_t r = 0; r < nrefs; ++r) {
+            EXPECT_EQ(read_array<double>(contents, scores_offset + r * ntest * sizeof(double), ntest), expected.scores[r]);
+        }
+    }
+}
+
+TEST_F(MmapResultSinkTest, Errors) {
+    std::string msg;
+    try {
+        singlepp::MmapResultSinkOptions sopt;
+        singlepp::MmapResultSink<int, double> sink("/this/directory/does/not/exist/foo.bin", 10, 2, sopt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("failed to open") != std::string::npos);
+}
+
+TEST_F(MmapResultSinkTest, Mismatch) {
+    std::size_t ngenes = 200, nlabels = 4, nrefs = 40, ntest = 53;
+    auto trained = train_mock_single(ngenes, nlabels, nrefs, 10, /* seed = */ 20, /* ref_sparse = */ false);
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 23);
+    singlepp::ClassifySingleOptions<double> copt;
+
+    const TempFile tmp("mismatch");
+    singlepp::MmapResultSinkOptions sopt;
+    sopt.chunk_size = 10;
+
+    std::string msg;
+    try {
+        singlepp::MmapResultSink<int, double> sink(tmp.path, ntest - 1, nlabels, sopt);
+        singlepp::classify_single(*test, trained, sink, copt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("number of cells") != std::string::npos);
+
+    for (auto bad_labels : { nlabels - 1, nlabels + 1 }) {
+        msg.clear();
+        try {
+            singlepp::MmapResultSink<int, double> sink(tmp.path, ntest, bad_labels, sopt);
+            singlepp::classify_single(*test, trained, sink, copt);
+        } catch (std::exception& e) {
+            msg = e.what();
+        }
+        EXPECT_TRUE(msg.find("number of labels") != std::string::npos);
+    }
+
+    // Label mismatches are fine if the scores are not stored.
+    sopt.store_scores = false;
+    {
+        singlepp::MmapResultSink<int, double> sink(tmp.path, ntest, nlabels + 1, sopt);
+        singlepp::classify_single(*test, trained, sink, copt);
+    }
+}
@@ -0,0 +1,304 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/PreRankedTest.hpp"
+#include "singlepp/MmapPreRankedTest.hpp"
+#include "singlepp/classify_single.hpp"
+#include "singlepp/classify_integrated.hpp"
+#include "tatami/tatami.hpp"
+
+#include "mock_markers.h"
+#include "spawn_matrix.h"
+#include "temp_file.h"
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <numeric>
+#include <fstream>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+class PreRankedTestTest : public ::testing::Test {
+protected:
+    inline static constexpr size_t ngenes = 300;
+    inline static constexpr size_t nrefs = 2;
+    inline static constexpr size_t nprofiles = 40;
+    inline static constexpr size_t ntest = 37;
+
+    inline static std::vector<singlepp::TrainedSingle<int, double> > trained_single;
+    inline static std::optional<singlepp::TrainedIntegrated<int> > trained_integrated;
+    inline static std::shared_ptr<const tatami::Matrix<double, int> > dense_test, sparse_test;
+
+    static void SetUpTestSuite() {
+        singlepp::TrainSingleOptions sopt;
+        std::vector<singlepp::TrainIntegratedInput<double, int, int> > inputs;
+        std::vector<std::vector<int> > labels(nrefs);
+
+        for (size_t r = 0; r < nrefs; ++r) {
+            size_t nlabels = 4 + r;
+            std::shared_ptr<const tatami::Matrix<double, int> > ref = spawn_sparse_matrix(ngenes, nprofiles, /* seed = */ 50 + r, /* density = */ 0.4);
+            if (r == 1) {
+                ref = tatami::convert_to_compressed_sparse<double, int>(*ref, true, {});
+            }
+            labels[r] = spawn_labels(nprofiles, nlabels, /* seed = */ 60 + r);
+            auto markers = mock_pairwise_markers<int>(nlabels, 10, ngenes, /* seed = */ 70 + r);
+            trained_single.push_back(singlepp::train_single(*ref, labels[r].data(), markers, sopt));
+            inputs.push_back(singlepp::prepare_integrated_input(ref, labels[r].data(), markers));
+        }
+
+        singlepp::TrainIntegratedOptions iopt;
+        trained_integrated.emplace(singlepp::train_integrated(inputs, iopt));
+
+        dense_test = spawn_sparse_matrix(ngenes, ntest, /* seed = */ 80, /* density = */ 0.3);
+        sparse_test = tatami::convert_to_compressed_sparse<double, int>(*dense_test, true, {});
+    }
+
+    static std::vector<int> all_rows() {
+        std::vector<int> output(ngenes);
+        std::iota(output.begin(), output.end(), 0);
+        return output;
+    }
+
+    static void compare_pre_ranked(const singlepp::PreRankedTest<double, int>& left, const singlepp::PreRankedTest<double, int>& right) {
+        EXPECT_EQ(left.test_nrow(), right.test_nrow());
+        EXPECT_EQ(left.num_cells(), right.num_cells());
+        EXPECT_EQ(left.is_sparse(), right.is_sparse());
+        EXPECT_EQ(left.subset(), right.subset());
+        ASSERT_EQ(left.num_entries(), right.num_entries());
+        EXPECT_EQ(std::vector<std::uint64_t>(left.pointers(), left.pointers() + left.num_cells() + 1), std::vector<std::uint64_t>(right.pointers(), right.pointers() + right.num_cells() + 1));
+        EXPECT_EQ(std::vector<double>(left.values(), left.values() + left.num_entries()), std::vector<double>(right.values(), right.values() + right.num_entries()));
+        EXPECT_EQ(std::vector<int>(left.indices(), left.indices() + left.num_entries()), std::vector<int>(right.indices(), right.indices() + right.num_entries()));
+    }
+};
+
+TEST_F(PreRankedTestTest, Build) {
+    // Unsorted and duplicated subsets are sanitized.
+    std::vector<int> subset{ 10, 5, 200, 5, 0, 299, 10 };
+    singlepp::BuildPreRankedTestOptions opt;
+    auto pre = singlepp::build_pre_ranked_test(*dense_test, subset, opt);
+    EXPECT_EQ(pre.test_nrow(), ngenes);
+    EXPECT_EQ(pre.num_cells(), ntest);
+    EXPECT_FALSE(pre.is_sparse());
+    std::vector<int> expected_subset{ 0, 5, 10, 200, 299 };
+    EXPECT_EQ(pre.subset(), expected_subset);
+    EXPECT_EQ(pre.num_entries(), ntest * expected_subset.size());
+
+    auto ext = dense_test->dense_column();
+    std::vector<double> buffer(ngenes);
+    for (size_t c = 0; c < ntest; ++c) {
+        auto ptr = ext->fetch(c, buffer.data());
+        std::vector<std::pair<double, int> > expected;
+        for (size_t s = 0; s < expected_subset.size(); ++s) {
+            expected.emplace_back(ptr[expected_subset[s]], s);
+        }
+        std::sort(expected.begin(), expected.end());
+
+        std::vector<std::pair<double, int> > observed;
+        for (auto i = pre.pointers()[c]; i < pre.pointers()[c + 1]; ++i) {
+            observed.emplace_back(pre.values()[i], pre.indices()[i]);
+        }
+        EXPECT_EQ(observed, expected);
+    }
+
+    // Only the structural non-zeros are stored for sparse matrices.
+    auto spre = singlepp::build_pre_ranked_test(*sparse_test, subset, opt);
+    EXPECT_TRUE(spre.is_sparse());
+    EXPECT_LT(spre.num_entries(), pre.num_entries());
+
+    // Same results with multiple threads.
+    opt.num_threads = 3;
+    auto ppre = singlepp::build_pre_ranked_test(*dense_test, subset, opt);
+    compare_pre_ranked(pre, ppre);
+    auto pspre = singlepp::build_pre_ranked_test(*sparse_test, subset, opt);
+    compare_pre_ranked(spre, pspre);
+}
+
+TEST_F(PreRankedTestTest, Single) {
+    for (const auto& test : std::vector<std::shared_ptr<const tatami::Matrix<double, int> > >{ dense_test, sparse_test }) {
+        singlepp::BuildPreRankedTestOptions bopt;
+        auto exact = singlepp::build_pre_ranked_test(*test, trained_single.front().subset(), bopt);
+        auto superset = singlepp::build_pre_ranked_test(*test, all_rows(), bopt);
+
+        for (const auto& tr : trained_single) {
+            for (bool fine_tune : { false, true }) {
+                for (int nthreads : { 1, 3 }) {
+                    singlepp::ClassifySingleOptions<double> copt;
+                    copt.fine_tune = fine_tune;
+                    copt.num_threads = nthreads;
+                    auto ref = singlepp::classify_single<int>(*test, tr, copt);
+
+                    auto res = singlepp::classify_single<int>(superset, tr, copt);
+                    EXPECT_EQ(res.best, ref.best);
+                    EXPECT_EQ(res.scores, ref.scores);
+                    EXPECT_EQ(res.delta, ref.delta);
+
+                    if (tr.subset() == exact.subset()) {
+                        auto eres = singlepp::classify_single<int>(exact, tr, copt);
+                        EXPECT_EQ(eres.best, ref.best);
+                        EXPECT_EQ(eres.scores, ref.scores);
+                        EXPECT_EQ(eres.delta, ref.delta);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_F(PreRankedTestTest, Integrated) {
+    for (const auto& test : std::vector<std::shared_ptr<const tatami::Matrix<double, int> > >{ dense_test, sparse_test }) {
+        std::vector<std::vector<int> > assigned;
+        singlepp::ClassifySingleOptions<double> sopt;
+        for (const auto& tr : trained_single) {
+            assigned.push_back(singlepp::classify_single<int>(*test, tr, sopt).best);
+        }
+        std::vector<const int*> assigned_ptrs;
+        for (const auto& a : assigned) {
+            assigned_ptrs.push_back(a.data());
+        }
+
+        singlepp::BuildPreRankedTestOptions bopt;
+        auto exact = singlepp::build_pre_ranked_test(*test, trained_integrated->subset(), bopt);
+        auto superset = singlepp::build_pre_ranked_test(*test, all_rows(), bopt);
+
+        for (bool fine_tune : { false, true }) {
+            for (int nthreads : { 1, 3 }) {
+                singlepp::ClassifyIntegratedOptions<double> iopt;
+                iopt.fine_tune = fine_tune;
+                iopt.num_threads = nthreads;
+                auto ref = singlepp::classify_integrated<int>(*test, assigned_ptrs, *trained_integrated, iopt);
+
+                for (const auto* pre : { &exact, &superset }) {
+                    auto res = singlepp::classify_integrated<int>(*pre, assigned_ptrs, *trained_integrated, iopt);
+                    EXPECT_EQ(res.best, ref.best);
+                    EXPECT_EQ(res.scores, ref.scores);
+                    EXPECT_EQ(res.delta, ref.delta);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(PreRankedTestTest, SaveAndLoad) {
+    const TempFile tmp("pre-ranked");
+    const auto& path = tmp.path;
+    for (const auto& test : std::vector<std::shared_ptr<const tatami::Matrix<double, int> > >{ dense_test, sparse_test }) {
+        singlepp::BuildPreRankedTestOptions bopt;
+        auto pre = singlepp::build_pre_ranked_test(*test, all_rows(), bopt);
+        singlepp::save_pre_ranked_test(pre, path);
+
+        auto read = singlepp::read_pre_ranked_test<double, int>(path);
+        compare_pre_ranked(pre, read);
+        auto loaded = singlepp::load_pre_ranked_test<double, int>(path);
+        compare_pre_ranked(pre, loaded);
+
+        // Moving preserves the views into owned or mapped memory.
+        auto moved_read = std::move(read);
+        compare_pre_ranked(pre, moved_read);
+        auto moved_loaded = std::move(loaded);
+        compare_pre_ranked(pre, moved_loaded);
+
+        singlepp::ClassifySingleOptions<double> copt;
+        copt.fine_tune = true;
+        auto ref = singlepp::classify_single<int>(*test, trained_single.back(), copt);
+        auto res = singlepp::classify_single<int>(moved_loaded, trained_single.back(), copt);
+        EXPECT_EQ(res.best, ref.best);
+        EXPECT_EQ(res.scores, ref.scores);
+        EXPECT_EQ(res.delta, ref.delta);
+    }
+
+    // Works with empty subsets and no cells.
+    {
+        auto empty = tatami::DenseColumnMatrix<double, int>(ngenes, 0, std::vector<double>());
+        singlepp::BuildPreRankedTestOptions bopt;
+        auto pre = singlepp::build_pre_ranked_test(empty, std::vector<int>(), bopt);
+        EXPECT_EQ(pre.num_cells(), 0);
+        EXPECT_EQ(pre.num_entries(), 0);
+        singlepp::save_pre_ranked_test(pre, path);
+        compare_pre_ranked(pre, singlepp::read_pre_ranked_test<double, int>(path));
+        compare_pre_ranked(pre, singlepp::load_pre_ranked_test<double, int>(path));
+    }
+}
+
+TEST_F(PreRankedTestTest, Errors) {
+    singlepp::BuildPreRankedTestOptions bopt;
+    std::string msg;
+    try {
+        singlepp::build_pre_ranked_test(*dense_test, std::vector<int>{ static_cast<int>(ngenes) }, bopt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("less than the number of rows") != std::string::npos);
+
+    // Classifier subset is not contained in the pre-ranked subset.
+    auto partial = singlepp::build_pre_ranked_test(*dense_test, std::vector<int>{ 0, 1, 2 }, bopt);
+    msg.clear();
+    try {
+        singlepp::ClassifySingleOptions<double> copt;
+        singlepp::classify_single<int>(partial, trained_single.front(), copt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("subset of the rows") != std::string::npos);
+
+    msg.clear();
+    try {
+        auto wrong = spawn_matrix(ngenes + 1, ntest, /* seed = */ 90);
+        auto pre = singlepp::build_pre_ranked_test(*wrong, all_rows(), bopt);
+        singlepp::ClassifySingleOptions<double> copt;
+        singlepp::classify_single<int>(pre, trained_single.front(), copt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("number of rows") != std::string::npos);
+
+    // Malformed files.
+    const TempFile tmp("pre-ranked-errors");
+    const auto& path = tmp.path;
+    {
+        std::ofstream handle(path, std::ios::binary);
+        handle << "FOOBAR";
+    }
+    msg.clear();
+    try {
+        singlepp::read_pre_ranked_test<double, int>(path);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("not a pre-ranked test file") != std::string::npos);
+
+    msg.clear();
+    try {
+        singlepp::load_pre_ranked_test<double, int>(path);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("not a pre-ranked test file") != std::string::npos);
+
+    singlepp::save_pre_ranked_test(partial, path);
+    msg.clear();
+    try {
+        singlepp::read_pre_ranked_test<float, int>(path);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("inconsistent sizes") != std::string::npos);
+
+    msg.clear();
+    try {
+        singlepp::load_pre_ranked_test<double, int>(path + ".missing");
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("failed to open") != std::string::npos);
+
+    // Truncated file.
+    std::filesystem::resize_file(path, 200);
+    msg.clear();
+    try {
+        singlepp::load_pre_ranked_test<double, int>(path);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("inconsistent array offsets") != std::string::npos);
+}
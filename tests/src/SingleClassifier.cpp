@@ -0,0 +1,271 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/SingleClassifier.hpp"
+#include "singlepp/classify_single.hpp"
+#include "tatami/tatami.hpp"
+
+#include "spawn_matrix.h"
+#include "train_mock.h"
+
+#include <memory>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+class SingleClassifierTest : public ::testing::TestWithParam<std::tuple<bool, bool, int> > {
+protected:
+    inline static std::size_t ngenes = 200, nlabels = 4, nrefs = 60, ntest = 53;
+
+    // Column-major test values with plenty of zeros, so that the sparse representation is meaningful.
+    static std::vector<double> spawn_values(std::size_t nr, std::size_t nc, unsigned long long seed) {
+        std::vector<double> output(nr * nc);
+        std::mt19937_64 rng(seed);
+        std::normal_distribution<> ndist;
+        std::uniform_real_distribution<> udist;
+        for (auto& o : output) {
+            if (udist(rng) < 0.3) {
+                o = ndist(rng);
+            }
+        }
+        return output;
+    }
+
+    static void compare(const singlepp::ClassifySingleResults<int, double>& expected, const singlepp::ClassifySingleResults<int, double>& observed) {
+        EXPECT_EQ(expected.best, observed.best);
+        EXPECT_EQ(expected.delta, observed.delta);
+        EXPECT_EQ(expected.scores, observed.scores);
+    }
+};
+
+TEST_P(SingleClassifierTest, Chunks) {
+    auto param = GetParam();
+    bool ref_sparse = std::get<0>(param);
+    bool fine_tune = std::get<1>(param);
+    int nthreads = std::get<2>(param);
+
+    auto trained = train_mock_single(ngenes, nlabels, nrefs, 10, /* seed = */ 100, /* ref_sparse = */ ref_sparse);
+
+    auto values = spawn_values(ngenes, ntest, /* seed = */ 103);
+    tatami::DenseColumnMatrix<double, int> dense_test(ngenes, ntest, values);
+    auto sparse_test = tatami::convert_to_compressed_sparse<double, int>(dense_test, false, {});
+
+    singlepp::ClassifySingleOptions<double> copt;
+    copt.fine_tune = fine_tune;
+    auto expected_dense = singlepp::classify_single<int>(dense_test, trained, copt);
+    auto expected_sparse = singlepp::classify_single<int>(*sparse_test, trained, copt);
+
+    // Setting up CSC buffers for the sparse chunks.
+    std::vector<std::size_t> indptrs(1);
+    std::vector<int> indices;
+    std::vector<double> nonzeros;
+    for (std::size_t c = 0; c < ntest; ++c) {
+        for (std::size_t g = 0; g < ngenes; ++g) {
+            auto val = values[c * ngenes + g];
+            if (val) {
+                indices.push_back(g);
+                nonzeros.push_back(val);
+            }
+        }
+        indptrs.push_back(indices.size());
+    }
+
+    copt.num_threads = nthreads;
+    singlepp::SingleClassifier<double, int, double, int> classifier(trained, copt);
+    singlepp::ClassifySingleResults<int, double> observed_dense(ntest, nlabels), observed_sparse(ntest, nlabels);
+
+    // Alternating between dense and sparse chunks to check that the workspaces don't interfere with each other.
+    const std::size_t chunk_size = 7;
+    for (std::size_t start = 0; start < ntest; start += chunk_size) {
+        const auto length = std::min(chunk_size, ntest - start);
+
+        auto create_buffers = [&](singlepp::ClassifySingleResults<int, double>& res) -> singlepp::ClassifySingleBuffers<int, double> {
+            singlepp::ClassifySingleBuffers<int, double> buffers;
+            buffers.best = res.best.data() + start;
+            buffers.delta = res.delta.data() + start;
+            for (auto& s : res.scores) {
+                buffers.scores.push_back(s.data() + start);
+            }
+            return buffers;
+        };
+
+        classifier.classify_dense(length, values.data() + start * ngenes, create_buffers(observed_dense));
+        classifier.classify_sparse(length, indptrs.data() + start, indices.data(), nonzeros.data(), create_buffers(observed_sparse));
+    }
+
+    compare(expected_dense, observed_dense);
+    compare(expected_sparse, observed_sparse);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    SingleClassifier,
+    SingleClassifierTest,
+    ::testing::Combine(
+        ::testing::Values(false, true), // whether the reference is sparse.
+        ::testing::Values(false, true), // whether to fine-tune.
+        ::testing::Values(1, 3) // number of threads.
+    )
+);
+
+TEST(SingleClassifier, Statistics) {
+    std::size_t ngenes = 300, nlabels = 5, nrefs = 50, ntest = 40;
+    auto trained = train_mock_single(ngenes, nlabels, nrefs, 10, /* seed = */ 200, /* ref_sparse = */ false);
+
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 203);
+    auto ext = test->dense_column();
+    std::vector<double> values(ngenes * ntest);
+    for (std::size_t c = 0; c < ntest; ++c) {
+        auto ptr = ext->fetch(c, values.data() + c * ngenes);
+        tatami::copy_n(ptr, ngenes, values.data() + c * ngenes);
+    }
+
+    singlepp::ClassifySingleOptions<double> copt;
+    std::vector<int> best(ntest);
+    std::vector<double> delta(ntest);
+    singlepp::ClassifySingleBuffers<int, double> buffers;
+    buffers.best = best.data();
+    buffers.delta = delta.data();
+    buffers.scores.resize(nlabels, NULL);
+    singlepp::FineTuneStatistics stats;
+    buffers.fine_tune_statistics = &stats;
+    std::vector<singlepp::SearchCounters> counters;
+    buffers.search_counters = &counters;
+    singlepp::classify_single(*test, trained, buffers, copt);
+
+    // Statistics are only reported for the chunk in which they were requested, i.e., the second half of the test matrix.
+    singlepp::SingleClassifier<double, int, double, int> classifier(trained, copt);
+    std::vector<int> chunk_best(ntest);
+    singlepp::ClassifySingleBuffers<int, double> chunk_buffers;
+    chunk_buffers.best = chunk_best.data();
+    chunk_buffers.delta = NULL;
+    chunk_buffers.scores.resize(nlabels, NULL);
+    classifier.classify_dense(ntest / 2, values.data(), chunk_buffers);
+
+    singlepp::FineTuneStatistics chunk_stats;
+    chunk_buffers.fine_tune_statistics = &chunk_stats;
+    std::vector<singlepp::SearchCounters> chunk_counters;
+    chunk_buffers.search_counters = &chunk_counters;
+    chunk_buffers.best += ntest / 2;
+    classifier.classify_dense(ntest - ntest / 2, values.data() + (ntest / 2) * ngenes, chunk_buffers);
+    EXPECT_EQ(best, chunk_best);
+
+    std::vector<std::size_t> expected_iterations(stats.num_iterations.begin() + ntest / 2, stats.num_iterations.end());
+    EXPECT_EQ(chunk_stats.num_iterations, expected_iterations);
+    ASSERT_EQ(chunk_counters.size(), nlabels);
+    for (std::size_t l = 0; l < nlabels; ++l) {
+        EXPECT_GT(chunk_counters[l].seed_distances, 0);
+        EXPECT_LT(chunk_counters[l].seed_distances, counters[l].seed_distances);
+    }
+}
+
+TEST(SingleClassifier, Errors) {
+    std::size_t ngenes = 100, nlabels = 3, nrefs = 20;
+    auto trained = train_mock_single(ngenes, nlabels, nrefs, 5, /* seed = */ 300, /* ref_sparse = */ false);
+
+    singlepp::ClassifySingleOptions<double> copt;
+    copt.quantile = 2;
+    std::string msg;
+    try {
+        singlepp::SingleClassifier<double, int, double, int> classifier(trained, copt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("[0, 1]") != std::string::npos);
+
+    copt.quantile = 0.8;
+    singlepp::SingleClassifier<double, int, double, int> classifier(trained, copt);
+    std::vector<double> values(ngenes);
+    int best;
+    singlepp::ClassifySingleBuffers<int, double> buffers;
+    buffers.best = &best;
+    buffers.delta = NULL;
+    msg.clear();
+    try {
+        classifier.classify_dense(1, values.data(), buffers);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("number of labels") != std::string::npos);
+}
+
+TEST(SingleClassifier, TopK) {
+    std::size_t ngenes = 200, nlabels = 5, nrefs = 50, ntest = 30, num_top = 2;
+    auto trained = train_mock_single(ngenes, nlabels, nrefs, 10, /* seed = */ 400, /* ref_sparse = */ false);
+
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 403);
+    singlepp::ClassifySingleOptions<double> copt;
+    auto expected = singlepp::classify_single_top<int>(*test, trained, num_top, copt);
+
+    auto ext = test->dense_column();
+    std::vector<double> values(ngenes * ntest);
+    for (std::size_t c = 0; c < ntest; ++c) {
+        auto ptr = ext->fetch(c, values.data() + c * ngenes);
+        tatami::copy_n(ptr, ngenes, values.data() + c * ngenes);
+    }
+
+    singlepp::SingleClassifier<double, int, double, int> classifier(trained, copt);
+    std::vector<int> best(ntest), top_labels(ntest * num_top);
+    std::vector<double> top_scores(ntest * num_top);
+    const std::size_t chunk_size = 7;
+    for (std::size_t start = 0; start < ntest; start += chunk_size) {
+        const auto length = std::min(chunk_size, ntest - start);
+        singlepp::ClassifySingleBuffers<int, double> buffers;
+        buffers.best = best.data() + start;
+        buffers.delta = NULL;
+        buffers.scores.resize(nlabels, NULL);
+        buffers.top_k = num_top;
+        buffers.top_labels = top_labels.data() + start * num_top;
+        buffers.top_scores = top_scores.data() + start * num_top;
+        classifier.classify_dense(length, values.data() + start * ngenes, buffers);
+    }
+
+    EXPECT_EQ(best, expected.best);
+    EXPECT_EQ(top_labels, expected.top_labels);
+    EXPECT_EQ(top_scores, expected.top_scores);
+}
+
+TEST(SingleClassifier, Range) {
+    std::size_t ngenes = 200, nlabels = 4, nrefs = 50, ntest = 37;
+    auto trained = train_mock_single(ngenes, nlabels, nrefs, 10, /* seed = */ 500, /* ref_sparse = */ false);
+
+    std::vector<std::shared_ptr<tatami::Matrix<double, int> > > tests;
+    tests.push_back(spawn_sparse_matrix(ngenes, ntest, /* seed = */ 503, 0.3));
+    tests.push_back(tatami::convert_to_compressed_sparse<double, int>(*(tests.front()), false, {}));
+
+    singlepp::ClassifySingleOptions<double> copt;
+    copt.num_threads = 3;
+    singlepp::SingleClassifier<double, int, double, int> classifier(trained, copt);
+
+    // Classifying the test matrix in consecutive ranges of columns should give the same results as classify_single().
+    for (const auto& test : tests) {
+        auto expected = singlepp::classify_single<int>(*test, trained, copt);
+        singlepp::ClassifySingleResults<int, double> observed(ntest, nlabels);
+        const int chunk_size = 10;
+        for (int start = 0; start < static_cast<int>(ntest); start += chunk_size) {
+            const int length = std::min(chunk_size, static_cast<int>(ntest) - start);
+            singlepp::ClassifySingleBuffers<int, double> buffers;
+            buffers.best = observed.best.data() + start;
+            buffers.delta = observed.delta.data() + start;
+            for (auto& s : observed.scores) {
+                buffers.scores.push_back(s.data() + start);
+            }
+            classifier.classify(*test, start, length, buffers);
+        }
+        EXPECT_EQ(expected.best, observed.best);
+        EXPECT_EQ(expected.delta, observed.delta);
+        EXPECT_EQ(expected.scores, observed.scores);
+    }
+
+    std::string msg;
+    try {
+        singlepp::ClassifySingleResults<int, double> observed(ntest, nlabels);
+        singlepp::ClassifySingleBuffers<int, double> buffers;
+        buffers.best = observed.best.data();
+        buffers.scores.resize(nlabels, NULL);
+        classifier.classify(*(tests.front()), 30, 10, buffers);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("range of columns") != std::string::npos);
+}
@@ -3,6 +3,10 @@
 #include "singlepp/scaled_ranks.hpp"
 #include "singlepp/SubsetRemapper.hpp"
 
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
 TEST(SubsetRemapper, Subsets) {
     singlepp::SubsetRemapper<int> remapper(10);
     EXPECT_EQ(remapper.capacity(), 10);
@@ -96,3 +100,66 @@ TEST(SubsetRemapper, SubsetSmallType) {
     EXPECT_EQ(output[2].first, 2.0);
     EXPECT_EQ(output[2].second, 0);
 }
+
+TEST(SubsetRemapper, Set) {
+    singlepp::SubsetRemapper<int> remapper(150);
+    remapper.add(20); // should be wiped by set().
+
+    std::vector<std::uint64_t> words(3);
+    words[0] = (static_cast<std::uint64_t>(1) << 5) | (static_cast<std::uint64_t>(1) << 63);
+    words[2] = (static_cast<std::uint64_t>(1) << 0) | (static_cast<std::uint64_t>(1) << 21);
+    remapper.set(words);
+    EXPECT_EQ(remapper.size(), 4);
+
+    singlepp::RankedVector<double, int> input;
+    for (int i = 0; i < 150; ++i) {
+        input.emplace_back(-i, i);
+    }
+    std::reverse(input.begin(), input.end());
+
+    singlepp::RankedVector<double, int> output;
+    remapper.remap(input, output);
+    ASSERT_EQ(output.size(), 4);
+
+    // Indices are assigned in increasing order.
+    EXPECT_EQ(output[0].first, -149);
+    EXPECT_EQ(output[0].second, 3);
+    EXPECT_EQ(output[1].first, -128);
+    EXPECT_EQ(output[1].second, 2);
+    EXPECT_EQ(output[2].first, -63);
+    EXPECT_EQ(output[2].second, 1);
+    EXPECT_EQ(output[3].first, -5);
+    EXPECT_EQ(output[3].second, 0);
+
+    // Repeated calls replace the previous subset.
+    std::fill(words.begin(), words.end(), 0);
+    words[1] = 1;
+    remapper.set(words);
+    remapper.remap(input, output);
+    ASSERT_EQ(output.size(), 1);
+    EXPECT_EQ(output[0].first, -64);
+    EXPECT_EQ(output[0].second, 0);
+}
+
+TEST(SubsetRemapper, Retained) {
+    singlepp::SubsetRemapper<int> remapper(10);
+    remapper.add(7);
+    remapper.add(2);
+
+    singlepp::RankedVector<double, int> input;
+    for (int i = 0; i < 10; ++i) {
+        input.emplace_back(static_cast<double>(i) / 10, i);
+    }
+
+    singlepp::RankedVector<double, int> output, retained;
+    retained.emplace_back(-1, 0); // retained entries are appended.
+    remapper.remap(input.cbegin(), input.cend(), output, retained);
+
+    singlepp::RankedVector<double, int> expected;
+    remapper.remap(input, expected);
+    EXPECT_EQ(output, expected);
+
+    ASSERT_EQ(retained.size(), 3);
+    EXPECT_EQ(retained[1], input[2]);
+    EXPECT_EQ(retained[2], input[7]);
+}
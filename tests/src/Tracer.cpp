@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/Tracer.hpp"
+#include "singlepp/train_single.hpp"
+#include "singlepp/classify_single.hpp"
+
+#include "spawn_matrix.h"
+#include "mock_markers.h"
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstddef>
+#include <algorithm>
+
+static std::size_t count_events(const singlepp::Tracer& tracer, const std::string& name) {
+    const auto& events = tracer.events();
+    return std::count_if(events.begin(), events.end(), [&](const singlepp::TraceEvent& ev) -> bool { return ev.name == name; });
+}
+
+static double get_counter(const singlepp::TraceEvent& ev, const std::string& name) {
+    for (const auto& counter : ev.counters) {
+        if (counter.first == name) {
+            return counter.second;
+        }
+    }
+    return -1;
+}
+
+TEST(Tracer, ThreadTracer) {
+    singlepp::Tracer tracer;
+    {
+        singlepp::ThreadTracer thread(&tracer, 2);
+        EXPECT_TRUE(thread.enabled());
+        const auto foo = thread.add_phase("foo");
+        const auto bar = thread.add_phase("bar");
+
+        thread.begin("outer");
+        thread.begin("inner");
+        thread.count("whee", 5);
+        thread.end();
+
+        thread.lap_start();
+        thread.lap(foo);
+        thread.lap(bar);
+        thread.lap(foo);
+        thread.count_phases();
+        thread.end();
+
+        EXPECT_TRUE(tracer.events().empty()); // not submitted until destruction.
+    }
+
+    const auto& events = tracer.events();
+    ASSERT_EQ(events.size(), 2);
+    EXPECT_EQ(events[0].name, "outer");
+    EXPECT_EQ(events[0].thread, 2);
+    ASSERT_EQ(events[0].counters.size(), 2);
+    EXPECT_EQ(events[0].counters[0].first, "foo");
+    EXPECT_EQ(events[0].counters[1].first, "bar");
+    EXPECT_LE(events[0].counters[0].second + events[0].counters[1].second, events[0].duration);
+
+    EXPECT_EQ(events[1].name, "inner");
+    EXPECT_GE(events[1].start, events[0].start);
+    EXPECT_LE(events[1].start + events[1].duration, events[0].start + events[0].duration);
+    ASSERT_EQ(events[1].counters.size(), 1);
+    EXPECT_EQ(events[1].counters[0].second, 5);
+
+    tracer.clear();
+    EXPECT_TRUE(tracer.events().empty());
+
+    // Everything is a no-op without a tracer.
+    singlepp::ThreadTracer noop(NULL, 0);
+    EXPECT_FALSE(noop.enabled());
+    noop.begin("outer");
+    noop.count("whee", 5);
+    noop.end();
+}
+
+TEST(Tracer, ChromeTrace) {
+    singlepp::Tracer tracer;
+    {
+        singlepp::ThreadTracer thread(&tracer, 1);
+        thread.begin("fo\"o");
+        thread.count("bar", 1.5);
+        thread.end();
+        thread.begin("whee");
+        thread.end();
+    }
+
+    std::stringstream ss;
+    tracer.write_chrome_trace(ss);
+    const auto output = ss.str();
+
+    EXPECT_EQ(output.rfind("{\"traceEvents\":[", 0), 0);
+    EXPECT_NE(output.find("\"name\":\"fo\\\"o\""), std::string::npos);
+    EXPECT_NE(output.find("\"args\":{\"bar\":1.500}"), std::string::npos);
+    EXPECT_NE(output.find("\"name\":\"whee\""), std::string::npos);
+    EXPECT_NE(output.find("\"tid\":1"), std::string::npos);
+    EXPECT_EQ(std::count(output.begin(), output.end(), '{'), std::count(output.begin(), output.end(), '}'));
+
+    // Stream state is restored.
+    ss << 0.1234567;
+    EXPECT_NE(ss.str().find("0.123457"), std::string::npos);
+}
+
+TEST(Tracer, TrainAndClassify) {
+    size_t ngenes = 200;
+    size_t nlabels = 4;
+    size_t nrefs = 50;
+    size_t ntest = 40;
+
+    auto refs = spawn_sparse_matrix(ngenes, nrefs, /* seed = */ 21, /* density = */ 0.3);
+    auto labels = spawn_labels(nrefs, nlabels, /* seed = */ 22);
+    auto markers = mock_pairwise_markers<int>(nlabels, 10, ngenes, /* seed = */ 23);
+    auto mat = spawn_matrix(ngenes, ntest, /* seed = */ 24);
+
+    for (int nthreads : { 1, 3 }) {
+        singlepp::Tracer tracer;
+
+        singlepp::TrainSingleOptions bopt;
+        bopt.num_threads = nthreads;
+        bopt.tracer = &tracer;
+        auto trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+
+        EXPECT_EQ(count_events(tracer, "rank_reference"), nthreads);
+        EXPECT_EQ(count_events(tracer, "build_index"), nlabels);
+        EXPECT_EQ(count_events(tracer, "select_seeds"), nlabels);
+
+        singlepp::ClassifySingleOptions<double> copt;
+        copt.num_threads = nthreads;
+        auto ref = singlepp::classify_single<int>(*mat, trained, copt);
+        copt.tracer = &tracer;
+        auto res = singlepp::classify_single<int>(*mat, trained, copt);
+        EXPECT_EQ(ref.best, res.best);
+        EXPECT_EQ(ref.delta, res.delta);
+
+        EXPECT_EQ(count_events(tracer, "classify_single"), nthreads);
+        EXPECT_EQ(count_events(tracer, "setup"), nthreads);
+
+        double total_cells = 0;
+        for (const auto& ev : tracer.events()) {
+            if (ev.name == "classify_single") {
+                total_cells += get_counter(ev, "cells");
+                EXPECT_GE(get_counter(ev, "extract_us"), 0);
+                EXPECT_GE(get_counter(ev, "fill_ranks_us"), 0);
+                EXPECT_GE(get_counter(ev, "scaled_ranks_us"), 0);
+                EXPECT_GE(get_counter(ev, "search_us"), 0);
+                EXPECT_GE(get_counter(ev, "fine_tune_us"), 0);
+            }
+        }
+        EXPECT_EQ(total_cells, ntest);
+    }
+}
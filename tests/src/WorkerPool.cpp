@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/WorkerPool.hpp"
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+TEST(WorkerPool, Blocks) {
+    for (int nthreads : { 1, 2, 3, 7 }) {
+        singlepp::WorkerPool pool(nthreads);
+        EXPECT_EQ(pool.num_threads(), nthreads);
+
+        // Re-using the same pool for multiple jobs with different numbers of tasks.
+        for (int ntasks : { 0, 1, 5, 6, 20, 101 }) {
+            std::vector<int> visited(ntasks), owner(ntasks, -1);
+            pool.run([&](int t, int start, int length) -> void {
+                EXPECT_GE(t, 0);
+                EXPECT_LT(t, nthreads);
+                EXPECT_GT(length, 0);
+                for (int i = start; i < start + length; ++i) {
+                    ++visited[i];
+                    owner[i] = t;
+                }
+            }, ntasks);
+
+            EXPECT_EQ(visited, std::vector<int>(ntasks, 1));
+            for (int i = 1; i < ntasks; ++i) {
+                EXPECT_LE(owner[i - 1], owner[i]); // blocks are contiguous and in order of the thread index.
+            }
+        }
+    }
+
+    singlepp::WorkerPool pool(0);
+    EXPECT_EQ(pool.num_threads(), 1);
+}
+
+TEST(WorkerPool, Errors) {
+    singlepp::WorkerPool pool(3);
+
+    std::string msg;
+    try {
+        pool.run([&](int t, int, int) -> void {
+            if (t == 2) {
+                throw std::runtime_error("foo");
+            }
+        }, 10);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_EQ(msg, "foo");
+
+    // Pool is still usable after an error.
+    std::vector<int> visited(10);
+    pool.run([&](int, int start, int length) -> void {
+        for (int i = start; i < start + length; ++i) {
+            ++visited[i];
+        }
+    }, 10);
+    EXPECT_EQ(visited, std::vector<int>(10, 1));
+}
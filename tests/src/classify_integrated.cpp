@@ -604,6 +604,85 @@ TEST_F(ClassifyIntegratedOtherTest, Mismatch) {
     EXPECT_TRUE(failed);
 }
 
+TEST_F(ClassifyIntegratedOtherTest, FineTuneStatistics) {
+    singlepp::TrainIntegratedOptions iopt;
+    auto integrated = singlepp::train_integrated(integrated_inputs, iopt);
+
+    size_t ntest = 50;
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 169);
+    auto chosen = mock_best_choices(ntest, num_labels, /* seed = */ 170);
+    auto chosen_ptrs = pointerize_best_choices(chosen);
+
+    singlepp::ClassifyIntegratedOptions<double> copt;
+    auto ref = singlepp::classify_integrated<int>(*test, chosen_ptrs, integrated, copt);
+
+    std::vector<int> best(ntest);
+    std::vector<double> delta(ntest);
+    std::vector<std::vector<double> > scores(nrefs, std::vector<double>(ntest));
+    singlepp::ClassifyIntegratedBuffers<int, double> buffers;
+    buffers.best = best.data();
+    buffers.delta = delta.data();
+    for (auto& s : scores) {
+        buffers.scores.push_back(s.data());
+    }
+    singlepp::FineTuneStatistics stats;
+    buffers.fine_tune_statistics = &stats;
+    singlepp::classify_integrated(*test, chosen_ptrs, integrated, buffers, copt);
+
+    EXPECT_EQ(best, ref.best);
+    EXPECT_EQ(delta, ref.delta);
+
+    ASSERT_EQ(stats.num_iterations.size(), ntest);
+    std::size_t total = 0;
+    for (auto n : stats.num_iterations) {
+        total += n;
+    }
+    EXPECT_GT(total, 0);
+    EXPECT_EQ(stats.num_labels.size(), total);
+    EXPECT_EQ(stats.num_markers.size(), total);
+    for (std::size_t i = 0; i < total; ++i) {
+        EXPECT_GT(stats.num_labels[i], 1);
+        EXPECT_LT(stats.num_labels[i], nrefs);
+        EXPECT_LE(stats.num_markers[i], integrated.subset().size());
+    }
+    EXPECT_GT(stats.num_profiles, 0);
+
+    // Same statistics with multiple threads.
+    copt.num_threads = 3;
+    singlepp::FineTuneStatistics pstats;
+    buffers.fine_tune_statistics = &pstats;
+    singlepp::classify_integrated(*test, chosen_ptrs, integrated, buffers, copt);
+    EXPECT_EQ(stats.num_iterations, pstats.num_iterations);
+    EXPECT_EQ(stats.num_labels, pstats.num_labels);
+    EXPECT_EQ(stats.num_markers, pstats.num_markers);
+    EXPECT_EQ(stats.num_profiles, pstats.num_profiles);
+}
+
+TEST_F(ClassifyIntegratedOtherTest, MemoryUsage) {
+    singlepp::TrainIntegratedOptions iopt;
+    auto integrated = singlepp::train_integrated(integrated_inputs, iopt);
+    auto usage = integrated.memory_usage();
+
+    EXPECT_GE(usage.subset, integrated.subset().size() * sizeof(int));
+    ASSERT_EQ(usage.references.size(), nrefs);
+
+    std::size_t expected_total = usage.subset;
+    for (std::size_t r = 0; r < nrefs; ++r) {
+        const auto& ref = usage.references[r];
+        EXPECT_EQ(ref.labels.size(), integrated.num_labels(r));
+        EXPECT_EQ(ref.markers, 0);
+        EXPECT_EQ(ref.subset, 0);
+        for (const auto& lab : ref.labels) {
+            EXPECT_GT(lab.markers, 0);
+            EXPECT_GT(lab.ranked, 0);
+            EXPECT_EQ(lab.data, 0);
+            EXPECT_EQ(lab.distances, 0);
+        }
+        expected_total += ref.total();
+    }
+    EXPECT_EQ(usage.total(), expected_total);
+}
+
 TEST_F(ClassifyIntegratedOtherTest, FineTuneEdgeCase) {
     singlepp::TrainIntegratedOptions iopt;
     auto integrated = singlepp::train_integrated(integrated_inputs, iopt);
@@ -43,7 +43,8 @@ TEST_P(ClassifySingleSimpleTest, Simple) {
 
     // Implementing the reference score calculation.
     auto original_markers = markers;
-    auto subset = singlepp::subset_to_markers<int>(ngenes, markers);
+    singlepp::FlatPairwiseMarkers<int> flat_markers(markers);
+    auto subset = singlepp::subset_to_markers<int>(ngenes, flat_markers);
     auto naive = naive_method(nlabels, labels, refs, mat, subset, quantile);
 
     const int NC = mat->ncol();
@@ -496,6 +497,79 @@ TEST(FineTuneSingle, Sparse) {
     }
 }
 
+template<bool query_sparse_, bool ref_sparse_>
+void compare_fine_tune_variants(const singlepp::TrainedSingle<int, double>& trained, const tatami::Matrix<double, int>& test, std::size_t nlabels) {
+    // Using a small cache that only fits later iterations, to check that we correctly fall back to the full reference ranks.
+    const auto nmarkers = trained.subset().size();
+    singlepp::FineTuneSingle<query_sparse_, ref_sparse_, int, int, double, double> ft(trained), ft_cached(trained, 1000000), ft_small(trained, 200000);
+    singlepp::QueryBuffers<query_sparse_, ref_sparse_, int, double> qb(nmarkers);
+    auto qdeets = create_precomputed_quantile_details<ref_sparse_>(trained, 0.8);
+
+    singlepp::MarkerBitsets<int> bitsets(nmarkers, trained.flat_markers());
+    singlepp::FineTuneSingle<query_sparse_, ref_sparse_, int, int, double, double> ft_bits(trained, 0, &bitsets), ft_bits_cached(trained, 1000000, &bitsets);
+
+    auto wrk = test.dense_column(trained.subset());
+    std::vector<double> buffer(nmarkers);
+    const int ntest = test.ncol();
+
+    for (int t = 0; t < ntest; ++t) {
+        auto vec = wrk->fetch(t, buffer.data()); 
+        auto ranked = fill_ranks<int>(nmarkers, vec);
+        if constexpr(query_sparse_) {
+            singlepp::RankedVector<double, int> sparse_ranked;
+            for (auto r : ranked) {
+                if (r.first) {
+                    sparse_ranked.push_back(r);
+                }
+            }
+            ranked.swap(sparse_ranked);
+        }
+
+        // Using small differences in the initial scores so that we get multiple iterations.
+        std::vector<double> scores(nlabels);
+        for (std::size_t l = 0; l < nlabels; ++l) {
+            scores[l] = 0.5 - static_cast<double>((l + t) % nlabels) * 0.01;
+        }
+
+        auto score_copy = scores;
+        auto expected = ft.run(ranked, trained, qdeets, 0.05, qb, score_copy);
+        score_copy = scores;
+        auto cached = ft_cached.run(ranked, trained, qdeets, 0.05, qb, score_copy);
+        EXPECT_EQ(expected, cached);
+        score_copy = scores;
+        auto small = ft_small.run(ranked, trained, qdeets, 0.05, qb, score_copy);
+        EXPECT_EQ(expected, small);
+
+        // Bitsets should give the same markers in the same order.
+        score_copy = scores;
+        auto bits = ft_bits.run(ranked, trained, qdeets, 0.05, qb, score_copy);
+        EXPECT_EQ(expected, bits);
+        score_copy = scores;
+        auto bits_cached = ft_bits_cached.run(ranked, trained, qdeets, 0.05, qb, score_copy);
+        EXPECT_EQ(bits, bits_cached);
+    }
+}
+
+TEST(FineTuneSingle, Variants) {
+    size_t ngenes = 500;
+    size_t nlabels = 8;
+    size_t nprofiles = 100;
+
+    auto markers = mock_pairwise_markers<int>(nlabels, 10, ngenes, /* seed = */ 4160); 
+    auto labels = spawn_labels(nprofiles, nlabels, /* seed = */ 4170);
+    auto reference = spawn_sparse_matrix(ngenes, nprofiles, /* seed = */ 4180, /* density = */ 0.3);
+    auto test = spawn_sparse_matrix(ngenes, 50, /* seed = */ 4190, /* density = */ 0.2);
+
+    auto trained = singlepp::train_single<double>(*reference, labels.data(), markers, {});
+    compare_fine_tune_variants<false, false>(trained, *test, nlabels);
+    compare_fine_tune_variants<true, false>(trained, *test, nlabels);
+
+    auto sparse_reference = tatami::convert_to_compressed_sparse<double, int>(*reference, true, {});
+    auto sparse_trained = singlepp::train_single<double>(*sparse_reference, labels.data(), markers, {});
+    compare_fine_tune_variants<false, true>(sparse_trained, *test, nlabels);
+    compare_fine_tune_variants<true, true>(sparse_trained, *test, nlabels);
+}
+
 /********************************************/
 
 TEST(ClassifySingle, Simple) {
@@ -555,6 +629,44 @@ TEST(ClassifySingle, NoShared) {
     EXPECT_EQ(output.delta, std::vector<double>(mat->ncol())); // all-zeros, no differences between first and second.
 }
 
+TEST(ClassifySingle, FlatMarkers) {
+    size_t ngenes = 200;
+    size_t nlabels = 4;
+    size_t nrefs = 50;
+
+    auto mat = spawn_matrix(ngenes, 20, /* seed = */ 142);
+    auto refs = spawn_matrix(ngenes, nrefs, /* seed = */ 143);
+    auto labels = spawn_labels(nrefs, nlabels, /* seed = */ 144);
+    auto markers = mock_pairwise_markers<int>(nlabels, 20, ngenes, /* seed = */ 145); 
+    singlepp::FlatPairwiseMarkers<int> flat(markers);
+
+    singlepp::TrainSingleOptions bopt;
+    singlepp::ClassifySingleOptions<double> copt;
+    auto ref_trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+    auto ref_output = singlepp::classify_single<int>(*mat, ref_trained, copt);
+
+    auto trained = singlepp::train_single(*refs, labels.data(), flat, bopt);
+    EXPECT_EQ(trained.flat_markers().to_nested(), ref_trained.flat_markers().to_nested());
+    EXPECT_EQ(trained.markers(), trained.flat_markers().to_nested()); // deprecated nested accessor.
+    EXPECT_EQ(&(trained.markers()), &(trained.markers())); // cached after the first call.
+    auto copy = trained;
+    EXPECT_NE(&(copy.markers()), &(trained.markers()));
+    EXPECT_EQ(copy.markers(), trained.markers());
+    auto output = singlepp::classify_single<int>(*mat, trained, copt);
+    EXPECT_EQ(output.best, ref_output.best);
+    EXPECT_EQ(output.delta, ref_output.delta);
+    EXPECT_EQ(output.scores, ref_output.scores);
+
+    // Same for the intersection.
+    std::vector<int> ids(ngenes);
+    std::iota(ids.begin(), ids.end(), 0);
+    std::vector<int> ref_ids(ids.rbegin(), ids.rend());
+    auto inter_ref_trained = singlepp::train_single<double, int>(ngenes, ids.data(), *refs, ref_ids.data(), labels.data(), markers, NULL, bopt);
+    auto inter_trained = singlepp::train_single<double, int>(ngenes, ids.data(), *refs, ref_ids.data(), labels.data(), flat, NULL, bopt);
+    EXPECT_EQ(inter_trained.flat_markers().to_nested(), inter_ref_trained.flat_markers().to_nested());
+    EXPECT_EQ(inter_trained.subset(), inter_ref_trained.subset());
+}
+
 TEST(ClassifySingle, Nulls) {
     // Mocking up the test and references.
     size_t ngenes = 200;
@@ -765,6 +877,207 @@ TEST(ClassifySingle, NoGenes) {
     }
 }
 
+TEST(ClassifySingle, FineTuneStatistics) {
+    size_t ngenes = 300;
+    size_t nlabels = 6;
+    size_t nrefs = 60;
+    size_t ntest = 50;
+
+    auto mat = spawn_matrix(ngenes, ntest, /* seed = */ 242);
+    auto refs = spawn_matrix(ngenes, nrefs, /* seed = */ 243);
+    auto labels = spawn_labels(nrefs, nlabels, /* seed = */ 244);
+    auto markers = mock_pairwise_markers<int>(nlabels, 10, ngenes, /* seed = */ 245); 
+
+    singlepp::TrainSingleOptions bopt;
+    auto trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+    singlepp::ClassifySingleOptions<double> copt;
+    auto ref = singlepp::classify_single<int>(*mat, trained, copt);
+
+    std::vector<int> best(ntest);
+    std::vector<double> delta(ntest);
+    singlepp::ClassifySingleBuffers<int, double> buffers;
+    buffers.best = best.data();
+    buffers.delta = delta.data();
+    buffers.scores.resize(nlabels, NULL);
+    singlepp::FineTuneStatistics stats;
+    buffers.fine_tune_statistics = &stats;
+    singlepp::classify_single(*mat, trained, buffers, copt);
+
+    // Collecting statistics doesn't change the results.
+    EXPECT_EQ(best, ref.best);
+    EXPECT_EQ(delta, ref.delta);
+
+    ASSERT_EQ(stats.num_iterations.size(), ntest);
+    std::size_t total = 0;
+    for (auto n : stats.num_iterations) {
+        total += n;
+    }
+    EXPECT_GT(total, 0);
+    EXPECT_EQ(stats.num_labels.size(), total);
+    EXPECT_EQ(stats.num_markers.size(), total);
+    for (std::size_t i = 0; i < total; ++i) {
+        EXPECT_GT(stats.num_labels[i], 1);
+        EXPECT_LT(stats.num_labels[i], nlabels);
+        EXPECT_LE(stats.num_markers[i], trained.subset().size());
+    }
+    EXPECT_GT(stats.num_profiles, 0);
+    EXPECT_GE(stats.seconds, 0);
+
+    // Labels and markers should decrease across iterations for each cell.
+    std::size_t counter = 0;
+    for (auto n : stats.num_iterations) {
+        for (std::size_t i = 1; i < n; ++i) {
+            EXPECT_LT(stats.num_labels[counter + i], stats.num_labels[counter + i - 1]);
+            EXPECT_LE(stats.num_markers[counter + i], stats.num_markers[counter + i - 1]);
+        }
+        counter += n;
+    }
+
+    auto summary = singlepp::summarize_fine_tune_statistics(stats);
+    EXPECT_EQ(summary.num_cells, ntest);
+    EXPECT_EQ(summary.total_iterations, total);
+    EXPECT_EQ(summary.max_iterations, *std::max_element(stats.num_iterations.begin(), stats.num_iterations.end()));
+    EXPECT_GT(summary.mean_labels, 1);
+    EXPECT_GT(summary.mean_markers, 0);
+    EXPECT_EQ(summary.num_profiles, stats.num_profiles);
+
+    // Same statistics with multiple threads.
+    {
+        copt.num_threads = 3;
+        singlepp::FineTuneStatistics pstats;
+        buffers.fine_tune_statistics = &pstats;
+        singlepp::classify_single(*mat, trained, buffers, copt);
+        EXPECT_EQ(stats.num_iterations, pstats.num_iterations);
+        EXPECT_EQ(stats.num_labels, pstats.num_labels);
+        EXPECT_EQ(stats.num_markers, pstats.num_markers);
+        EXPECT_EQ(stats.num_profiles, pstats.num_profiles);
+        copt.num_threads = 1;
+    }
+
+    // Zero iterations without fine-tuning.
+    {
+        copt.fine_tune = false;
+        buffers.fine_tune_statistics = &stats;
+        singlepp::classify_single(*mat, trained, buffers, copt);
+        EXPECT_EQ(stats.num_iterations, std::vector<std::size_t>(ntest));
+        EXPECT_TRUE(stats.num_labels.empty());
+        EXPECT_EQ(stats.num_profiles, 0);
+    }
+}
+
+TEST(ClassifySingle, SearchCounters) {
+    size_t ngenes = 300;
+    size_t nlabels = 5;
+    size_t nrefs = 200;
+    size_t ntest = 50;
+
+    auto mat = spawn_matrix(ngenes, ntest, /* seed = */ 252);
+    auto labels = spawn_labels(nrefs, nlabels, /* seed = */ 254);
+    auto markers = mock_pairwise_markers<int>(nlabels, 10, ngenes, /* seed = */ 255); 
+    std::vector<int> label_sizes(nlabels);
+    for (auto l : labels) {
+        ++label_sizes[l];
+    }
+
+    for (int sparse = 0; sparse < 2; ++sparse) {
+        std::shared_ptr<tatami::Matrix<double, int> > refs = spawn_sparse_matrix(ngenes, nrefs, /* seed = */ 253, /* density = */ 0.3);
+        if (sparse) {
+            refs = tatami::convert_to_compressed_sparse<double, int>(*refs, true, {});
+        }
+        singlepp::TrainSingleOptions bopt;
+        auto trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+        EXPECT_EQ(trained.built().sparse.has_value(), static_cast<bool>(sparse));
+        singlepp::ClassifySingleOptions<double> copt;
+        auto ref = singlepp::classify_single<int>(*mat, trained, copt);
+
+        std::vector<int> best(ntest);
+        std::vector<double> delta(ntest);
+        singlepp::ClassifySingleBuffers<int, double> buffers;
+        buffers.best = best.data();
+        buffers.delta = delta.data();
+        buffers.scores.resize(nlabels, NULL);
+        std::vector<singlepp::SearchCounters> counters;
+        buffers.search_counters = &counters;
+        singlepp::classify_single(*mat, trained, buffers, copt);
+
+        EXPECT_EQ(best, ref.best);
+        EXPECT_EQ(delta, ref.delta);
+
+        ASSERT_EQ(counters.size(), nlabels);
+        for (size_t l = 0; l < nlabels; ++l) {
+            const auto& current = counters[l];
+            EXPECT_GT(current.seed_distances, 0);
+            EXPECT_EQ(current.seed_distances % ntest, 0);
+            EXPECT_LE(current.seed_distances + current.candidate_distances, ntest * label_sizes[l]); // each profile is only visited once per cell.
+            EXPECT_LE(current.heap_insertions, current.candidate_distances);
+        }
+
+        // Same results with multiple threads.
+        copt.num_threads = 3;
+        std::vector<singlepp::SearchCounters> pcounters;
+        buffers.search_counters = &pcounters;
+        singlepp::classify_single(*mat, trained, buffers, copt);
+        ASSERT_EQ(pcounters.size(), nlabels);
+        for (size_t l = 0; l < nlabels; ++l) {
+            EXPECT_EQ(counters[l].seed_distances, pcounters[l].seed_distances);
+            EXPECT_EQ(counters[l].skipped_clusters, pcounters[l].skipped_clusters);
+            EXPECT_EQ(counters[l].truncated_clusters, pcounters[l].truncated_clusters);
+            EXPECT_EQ(counters[l].candidate_distances, pcounters[l].candidate_distances);
+            EXPECT_EQ(counters[l].heap_insertions, pcounters[l].heap_insertions);
+        }
+    }
+}
+
+TEST(ClassifySingle, MemoryUsage) {
+    size_t ngenes = 300;
+    size_t nlabels = 4;
+    size_t nrefs = 80;
+
+    auto labels = spawn_labels(nrefs, nlabels, /* seed = */ 262);
+    auto markers = mock_pairwise_markers<int>(nlabels, 10, ngenes, /* seed = */ 263); 
+    singlepp::TrainSingleOptions bopt;
+
+    auto dense_refs = spawn_matrix(ngenes, nrefs, /* seed = */ 261);
+    auto dense_trained = singlepp::train_single(*dense_refs, labels.data(), markers, bopt);
+    auto dense_usage = dense_trained.memory_usage();
+
+    const auto num_markers = dense_trained.subset().size();
+    EXPECT_GE(dense_usage.subset, num_markers * sizeof(int));
+    EXPECT_GE(dense_usage.markers, dense_trained.flat_markers().indices().size() * sizeof(int));
+    ASSERT_EQ(dense_usage.labels.size(), nlabels);
+
+    std::size_t expected_total = dense_usage.subset + dense_usage.markers;
+    std::size_t total_data = 0;
+    for (const auto& lab : dense_usage.labels) {
+        EXPECT_GT(lab.data, 0);
+        EXPECT_GT(lab.ranked, 0);
+        EXPECT_GT(lab.distances, 0);
+        EXPECT_GT(lab.seed_ranges, 0);
+        EXPECT_EQ(lab.value, 0);
+        EXPECT_EQ(lab.index, 0);
+        EXPECT_EQ(lab.indptrs, 0);
+        EXPECT_EQ(lab.markers, 0);
+        expected_total += lab.total();
+        total_data += lab.data;
+    }
+    EXPECT_EQ(dense_usage.total(), expected_total);
+    EXPECT_GE(total_data, nrefs * num_markers * sizeof(double));
+
+    auto sparse_refs = tatami::convert_to_compressed_sparse<double, int>(*spawn_sparse_matrix(ngenes, nrefs, /* seed = */ 261, /* density = */ 0.2), true, {});
+    auto sparse_trained = singlepp::train_single(*sparse_refs, labels.data(), markers, bopt);
+    auto sparse_usage = sparse_trained.memory_usage();
+    ASSERT_EQ(sparse_usage.labels.size(), nlabels);
+    for (const auto& lab : sparse_usage.labels) {
+        EXPECT_EQ(lab.data, 0);
+        EXPECT_GT(lab.value, 0);
+        EXPECT_GT(lab.index, 0);
+        EXPECT_GT(lab.indptrs, 0);
+        EXPECT_GT(lab.ranked, 0);
+        EXPECT_GT(lab.distances, 0);
+    }
+    EXPECT_EQ(sparse_usage.subset, dense_usage.subset);
+}
+
 TEST(ClassifySingle, SingleLabel) {
     size_t ngenes = 100;
     size_t nlabels = 1;
@@ -795,3 +1108,259 @@ TEST(ClassifySingle, SingleLabel) {
         EXPECT_TRUE(std::isnan(d));
     }
 }
+
+TEST(ClassifySingle, Subset) {
+    size_t ngenes = 200;
+    size_t nlabels = 4;
+    size_t nrefs = 40;
+    size_t ntest = 50;
+
+    auto refs = spawn_matrix(ngenes, nrefs, /* seed = */ 99);
+    auto labels = spawn_labels(nrefs, nlabels, /* seed = */ 999);
+    auto markers = mock_pairwise_markers<int>(nlabels, 20, ngenes, /* seed = */ 9999); 
+
+    singlepp::TrainSingleOptions bopt;
+    auto trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+
+    // Unsorted with duplicates, to check that each result goes to the right place.
+    std::vector<int> columns { 47, 3, 3, 20, 0, 49, 11, 12, 13, 30 };
+
+    for (bool sparse : { false, true }) {
+        std::shared_ptr<tatami::Matrix<double, int> > test = spawn_sparse_matrix(ngenes, ntest, /* seed = */ 99999, 0.3);
+        if (sparse) {
+            test = tatami::convert_to_compressed_sparse<double, int>(*test, true, {});
+        }
+
+        singlepp::ClassifySingleOptions<double> copt;
+        auto full = singlepp::classify_single<int>(*test, trained, copt);
+
+        for (int nthreads : { 1, 3 }) {
+            copt.num_threads = nthreads;
+            auto sub = singlepp::classify_single_subset<int>(*test, columns, trained, copt);
+            ASSERT_EQ(sub.best.size(), columns.size());
+            for (size_t i = 0; i < columns.size(); ++i) {
+                auto c = columns[i];
+                EXPECT_EQ(sub.best[i], full.best[c]);
+                EXPECT_EQ(sub.delta[i], full.delta[c]);
+                for (size_t l = 0; l < nlabels; ++l) {
+                    EXPECT_EQ(sub.scores[l][i], full.scores[l][c]);
+                }
+            }
+        }
+    }
+
+    // Empty subset is a no-op.
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 99999);
+    singlepp::ClassifySingleOptions<double> copt;
+    auto empty = singlepp::classify_single_subset<int>(*test, std::vector<int>{}, trained, copt);
+    EXPECT_TRUE(empty.best.empty());
+
+    std::string msg;
+    try {
+        singlepp::classify_single_subset<int>(*test, std::vector<int>{ 0, static_cast<int>(ntest) }, trained, copt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("less than the number of columns") != std::string::npos);
+}
+
+TEST(ClassifySingle, TopK) {
+    size_t ngenes = 200;
+    size_t nlabels = 6;
+    size_t nrefs = 60;
+    size_t ntest = 40;
+
+    auto refs = spawn_matrix(ngenes, nrefs, /* seed = */ 88);
+    auto labels = spawn_labels(nrefs, nlabels, /* seed = */ 888);
+    auto markers = mock_pairwise_markers<int>(nlabels, 20, ngenes, /* seed = */ 8888); 
+
+    singlepp::TrainSingleOptions bopt;
+    auto trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 88888);
+
+    singlepp::ClassifySingleOptions<double> copt;
+    auto full = singlepp::classify_single<int>(*test, trained, copt);
+
+    for (size_t k : { 1, 3, 10 }) {
+        for (int nthreads : { 1, 3 }) {
+            copt.num_threads = nthreads;
+            auto top = singlepp::classify_single_top<int>(*test, trained, k, copt);
+            const size_t expected_k = std::min(k, nlabels);
+            ASSERT_EQ(top.top_k, expected_k);
+            EXPECT_EQ(top.best, full.best);
+            EXPECT_EQ(top.delta, full.delta);
+            ASSERT_EQ(top.top_labels.size(), expected_k * ntest);
+            ASSERT_EQ(top.top_scores.size(), expected_k * ntest);
+
+            for (size_t c = 0; c < ntest; ++c) {
+                std::vector<std::pair<double, int> > ordered;
+                for (size_t l = 0; l < nlabels; ++l) {
+                    ordered.emplace_back(-full.scores[l][c], l);
+                }
+                std::sort(ordered.begin(), ordered.end());
+                for (size_t i = 0; i < expected_k; ++i) {
+                    EXPECT_EQ(top.top_labels[c * expected_k + i], ordered[i].second);
+                    EXPECT_EQ(top.top_scores[c * expected_k + i], -ordered[i].first);
+                }
+            }
+        }
+    }
+}
+
+TEST(ClassifySingle, PruneLabels) {
+    // Creating a reference where each label has its own tightly clustered profile,
+    // so that most labels are clearly worse than the best label for each test cell and can be pruned.
+    size_t nlabels = 20;
+    size_t block = 10;
+    size_t ngenes = nlabels * block;
+    size_t per_label = 12;
+    size_t nrefs = nlabels * per_label;
+    size_t ntest = 60;
+
+    std::mt19937_64 rng(/* seed = */ 77);
+    std::normal_distribution<> ndist;
+    std::uniform_int_distribution<int> ldist(0, nlabels - 1);
+
+    std::vector<double> centers(ngenes * nlabels);
+    for (auto& x : centers) {
+        x = ndist(rng);
+    }
+
+    std::vector<int> labels(nrefs);
+    std::vector<double> ref_values(ngenes * nrefs);
+    for (size_t r = 0; r < nrefs; ++r) {
+        labels[r] = r % nlabels;
+        auto curval = ref_values.data() + r * ngenes;
+        auto curcenter = centers.data() + labels[r] * ngenes;
+        for (size_t g = 0; g < ngenes; ++g) {
+            curval[g] = curcenter[g] + ndist(rng) * 0.1;
+        }
+    }
+
+    std::vector<double> test_values(ngenes * ntest);
+    for (size_t c = 0; c < ntest; ++c) {
+        auto curval = test_values.data() + c * ngenes;
+        auto curcenter = centers.data() + ldist(rng) * ngenes;
+        for (size_t g = 0; g < ngenes; ++g) {
+            curval[g] = curcenter[g] + ndist(rng) * 0.2;
+        }
+    }
+    auto dense_test = std::make_shared<tatami::DenseColumnMatrix<double, int> >(ngenes, ntest, std::move(test_values));
+    auto sparse_test = tatami::convert_to_compressed_sparse<double, int>(*dense_test, true, {});
+
+    singlepp::PairwiseMarkers<int> markers(nlabels);
+    for (size_t l = 0; l < nlabels; ++l) {
+        markers[l].resize(nlabels);
+        for (size_t l2 = 0; l2 < nlabels; ++l2) {
+            if (l != l2) {
+                for (size_t g = 0; g < block; ++g) {
+                    markers[l][l2].push_back(l * block + g);
+                }
+            }
+        }
+    }
+
+    for (bool ref_sparse : { false, true }) {
+        std::shared_ptr<tatami::Matrix<double, int> > refs = std::make_shared<tatami::DenseColumnMatrix<double, int> >(ngenes, nrefs, ref_values);
+        if (ref_sparse) {
+            refs = tatami::convert_to_compressed_sparse<double, int>(*refs, true, {});
+        }
+        singlepp::TrainSingleOptions bopt;
+        auto trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+
+        for (bool fine_tune : { false, true }) {
+            for (bool test_sparse : { false, true }) {
+                const auto& test = (test_sparse ? *sparse_test : *dense_test);
+                singlepp::ClassifySingleOptions<double> copt;
+                copt.fine_tune = fine_tune;
+
+                std::vector<int> best(ntest);
+                std::vector<double> delta(ntest);
+                singlepp::ClassifySingleBuffers<int, double> buffers;
+                buffers.best = best.data();
+                buffers.delta = delta.data();
+                buffers.scores.resize(nlabels, NULL);
+                std::vector<singlepp::SearchCounters> counters;
+                buffers.search_counters = &counters;
+
+                copt.prune_labels = false;
+                singlepp::classify_single(test, trained, buffers, copt);
+                auto expected_best = best;
+                auto expected_delta = delta;
+                auto expected_counters = counters;
+
+                copt.prune_labels = true;
+                for (int nthreads : { 1, 3 }) {
+                    copt.num_threads = nthreads;
+                    singlepp::classify_single(test, trained, buffers, copt);
+                    EXPECT_EQ(best, expected_best);
+                    EXPECT_EQ(delta, expected_delta);
+                }
+
+                // Pruning should actually skip some of the neighbor searches.
+                size_t expected_total = 0, observed_total = 0;
+                for (size_t l = 0; l < nlabels; ++l) {
+                    EXPECT_EQ(counters[l].seed_distances, expected_counters[l].seed_distances);
+                    expected_total += expected_counters[l].candidate_distances;
+                    observed_total += counters[l].candidate_distances;
+                }
+                EXPECT_LT(observed_total, expected_total);
+
+                // Pruning is ignored if the scores are requested.
+                auto full = singlepp::classify_single<int>(test, trained, copt);
+                EXPECT_EQ(full.best, expected_best);
+                EXPECT_EQ(full.delta, expected_delta);
+            }
+        }
+    }
+}
+
+TEST(ClassifySingle, CellMajorScores) {
+    size_t ngenes = 200;
+    size_t nlabels = 5;
+    size_t nrefs = 50;
+    size_t ntest = 30;
+
+    auto refs = spawn_matrix(ngenes, nrefs, /* seed = */ 66);
+    auto labels = spawn_labels(nrefs, nlabels, /* seed = */ 666);
+    auto markers = mock_pairwise_markers<int>(nlabels, 20, ngenes, /* seed = */ 6666); 
+
+    singlepp::TrainSingleOptions bopt;
+    auto trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 66666);
+
+    singlepp::ClassifySingleOptions<double> copt;
+    auto full = singlepp::classify_single<int>(*test, trained, copt);
+
+    for (int nthreads : { 1, 3 }) {
+        copt.num_threads = nthreads;
+        std::vector<int> best(ntest);
+        std::vector<float> cell_major(ntest * nlabels);
+        std::vector<singlepp::FixedPointScore> fixed(ntest * nlabels);
+        singlepp::ClassifySingleBuffers<int, double> buffers;
+        buffers.best = best.data();
+        buffers.delta = NULL;
+        buffers.scores.resize(nlabels, NULL);
+        buffers.cell_major_scores = cell_major.data();
+        buffers.cell_major_fixed_scores = fixed.data();
+        singlepp::classify_single(*test, trained, buffers, copt);
+
+        EXPECT_EQ(best, full.best);
+        for (size_t c = 0; c < ntest; ++c) {
+            for (size_t l = 0; l < nlabels; ++l) {
+                const double expected = full.scores[l][c];
+                EXPECT_EQ(cell_major[c * nlabels + l], static_cast<float>(expected));
+                EXPECT_EQ(fixed[c * nlabels + l], singlepp::encode_fixed_point_score(expected));
+                EXPECT_LT(std::abs(singlepp::decode_fixed_point_score(fixed[c * nlabels + l]) - expected), 2e-5);
+            }
+        }
+    }
+
+    // Checking the boundaries of the fixed-point encoding.
+    EXPECT_EQ(singlepp::encode_fixed_point_score(-1.0), 0);
+    EXPECT_EQ(singlepp::encode_fixed_point_score(1.0), 65535);
+    EXPECT_EQ(singlepp::encode_fixed_point_score(2.0), 65535);
+    EXPECT_EQ(singlepp::encode_fixed_point_score(-2.0), 0);
+    EXPECT_EQ(singlepp::decode_fixed_point_score(0), -1.0);
+    EXPECT_EQ(singlepp::decode_fixed_point_score(65535), 1.0);
+}
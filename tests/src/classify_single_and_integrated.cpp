@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/classify_single_and_integrated.hpp"
+#include "singlepp/classify_single.hpp"
+#include "singlepp/classify_integrated.hpp"
+#include "tatami/tatami.hpp"
+
+#include "mock_markers.h"
+#include "spawn_matrix.h"
+
+#include <memory>
+#include <vector>
+#include <random>
+#include <optional>
+
+class ClassifySingleAndIntegratedTest : public ::testing::Test {
+protected:
+    inline static constexpr size_t ngenes = 500;
+    inline static constexpr size_t nrefs = 3;
+    inline static constexpr size_t ntest = 47;
+
+    inline static std::vector<singlepp::TrainedSingle<int, double> > trained_single;
+    inline static std::vector<const singlepp::TrainedSingle<int, double>*> single_ptrs;
+    inline static std::optional<singlepp::TrainedIntegrated<int> > trained_integrated;
+    inline static std::vector<std::vector<int> > labels;
+
+    static void SetUpTestSuite() {
+        singlepp::TrainSingleOptions sopt;
+        std::vector<singlepp::TrainIntegratedInput<double, int, int> > inputs;
+        labels.resize(nrefs);
+
+        for (size_t r = 0; r < nrefs; ++r) {
+            size_t nlabels = 3 + r;
+            size_t nprofiles = 40;
+            std::shared_ptr<const tatami::Matrix<double, int> > ref = spawn_sparse_matrix(ngenes, nprofiles, /* seed = */ 10 + r, /* density = */ 0.4);
+            if (r == 1) {
+                ref = tatami::convert_to_compressed_sparse<double, int>(*ref, true, {});
+            }
+            labels[r] = spawn_labels(nprofiles, nlabels, /* seed = */ 20 + r);
+
+            auto markers = mock_pairwise_markers<int>(nlabels, 15, ngenes, /* seed = */ 30 + r);
+            trained_single.push_back(singlepp::train_single(*ref, labels[r].data(), markers, sopt));
+
+            // Using different markers for integration, so that its universe is not a subset of the single-reference subsets.
+            singlepp::PerLabelMarkers<int> integrated_markers(nlabels);
+            std::mt19937_64 rng(/* seed = */ 40 + r);
+            for (auto& im : integrated_markers) {
+                fill_markers(im, 20, ngenes, rng);
+            }
+            inputs.push_back(singlepp::prepare_integrated_input(ref, labels[r].data(), std::move(integrated_markers)));
+        }
+
+        for (const auto& tr : trained_single) {
+            single_ptrs.push_back(&tr);
+        }
+
+        singlepp::TrainIntegratedOptions iopt;
+        trained_integrated.emplace(singlepp::train_integrated(inputs, iopt));
+    }
+};
+
+TEST_F(ClassifySingleAndIntegratedTest, Basic) {
+    auto dense_test = spawn_sparse_matrix(ngenes, ntest, /* seed = */ 99, /* density = */ 0.3);
+    auto sparse_test = tatami::convert_to_compressed_sparse<double, int>(*dense_test, true, {});
+
+    for (bool fine_tune : { false, true }) {
+        for (int nthreads : { 1, 3 }) {
+            singlepp::ClassifySingleOptions<double> sopt;
+            sopt.fine_tune = fine_tune;
+            sopt.num_threads = nthreads;
+            singlepp::ClassifyIntegratedOptions<double> iopt;
+            iopt.fine_tune = fine_tune;
+
+            for (const auto& test : std::vector<std::shared_ptr<const tatami::Matrix<double, int> > >{ dense_test, sparse_test }) {
+                std::vector<std::vector<int> > assigned;
+                for (const auto& tr : trained_single) {
+                    assigned.push_back(singlepp::classify_single<int>(*test, tr, sopt).best);
+                }
+                std::vector<const int*> assigned_ptrs;
+                for (const auto& a : assigned) {
+                    assigned_ptrs.push_back(a.data());
+                }
+                auto ref = singlepp::classify_integrated<int>(*test, assigned_ptrs, *trained_integrated, iopt);
+
+                auto fused = singlepp::classify_single_and_integrated<int, int>(*test, single_ptrs, *trained_integrated, sopt, iopt);
+                EXPECT_EQ(fused.assigned, assigned);
+                EXPECT_EQ(fused.integrated.best, ref.best);
+                EXPECT_EQ(fused.integrated.scores, ref.scores);
+                EXPECT_EQ(fused.integrated.delta, ref.delta);
+            }
+        }
+    }
+}
+
+TEST_F(ClassifySingleAndIntegratedTest, FineTuneStatistics) {
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 199);
+
+    singlepp::ClassifySingleOptions<double> sopt;
+    singlepp::ClassifyIntegratedOptions<double> iopt;
+    auto ref = singlepp::classify_single_and_integrated<int, int>(*test, single_ptrs, *trained_integrated, sopt, iopt);
+
+    std::vector<std::vector<int> > assigned(nrefs, std::vector<int>(ntest));
+    std::vector<singlepp::ClassifySingleBuffers<int, double> > single_buffers(nrefs);
+    for (size_t r = 0; r < nrefs; ++r) {
+        single_buffers[r].best = assigned[r].data();
+        single_buffers[r].scores.resize(trained_single[r].num_labels());
+    }
+
+    std::vector<int> best(ntest);
+    singlepp::ClassifyIntegratedBuffers<int, double> integrated_buffers;
+    integrated_buffers.best = best.data();
+    integrated_buffers.delta = NULL;
+    integrated_buffers.scores.resize(nrefs);
+    singlepp::FineTuneStatistics stats;
+    integrated_buffers.fine_tune_statistics = &stats;
+
+    singlepp::classify_single_and_integrated(*test, single_ptrs, *trained_integrated, single_buffers, integrated_buffers, sopt, iopt);
+    EXPECT_EQ(assigned, ref.assigned);
+    EXPECT_EQ(best, ref.integrated.best);
+    EXPECT_EQ(stats.num_iterations.size(), ntest);
+
+    // Same statistics with multiple threads.
+    sopt.num_threads = 3;
+    singlepp::FineTuneStatistics pstats;
+    integrated_buffers.fine_tune_statistics = &pstats;
+    singlepp::classify_single_and_integrated(*test, single_ptrs, *trained_integrated, single_buffers, integrated_buffers, sopt, iopt);
+    EXPECT_EQ(best, ref.integrated.best);
+    EXPECT_EQ(stats.num_iterations, pstats.num_iterations);
+    EXPECT_EQ(stats.num_labels, pstats.num_labels);
+    EXPECT_EQ(stats.num_markers, pstats.num_markers);
+    EXPECT_EQ(stats.num_profiles, pstats.num_profiles);
+}
+
+TEST_F(ClassifySingleAndIntegratedTest, Errors) {
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 299);
+    singlepp::ClassifySingleOptions<double> sopt;
+    singlepp::ClassifyIntegratedOptions<double> iopt;
+
+    std::string msg;
+    try {
+        std::vector<const singlepp::TrainedSingle<int, double>*> partial(single_ptrs.begin(), single_ptrs.begin() + 2);
+        singlepp::classify_single_and_integrated<int, int>(*test, partial, *trained_integrated, sopt, iopt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("number of references") != std::string::npos);
+
+    msg.clear();
+    try {
+        auto swapped = single_ptrs;
+        std::swap(swapped[0], swapped[1]);
+        singlepp::classify_single_and_integrated<int, int>(*test, swapped, *trained_integrated, sopt, iopt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("number of labels") != std::string::npos);
+
+    msg.clear();
+    try {
+        std::vector<singlepp::ClassifySingleBuffers<int, double> > single_buffers(nrefs);
+        singlepp::ClassifyIntegratedBuffers<int, double> integrated_buffers;
+        integrated_buffers.best = NULL;
+        integrated_buffers.delta = NULL;
+        singlepp::classify_single_and_integrated(*test, single_ptrs, *trained_integrated, single_buffers, integrated_buffers, sopt, iopt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("non-NULL") != std::string::npos);
+
+    msg.clear();
+    try {
+        auto wrong = spawn_matrix(ngenes + 1, ntest, /* seed = */ 299);
+        singlepp::classify_single_and_integrated<int, int>(*wrong, single_ptrs, *trained_integrated, sopt, iopt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("number of rows") != std::string::npos);
+}
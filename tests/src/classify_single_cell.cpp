@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/classify_single_cell.hpp"
+#include "singlepp/classify_single.hpp"
+#include "tatami/tatami.hpp"
+
+#include "spawn_matrix.h"
+#include "train_mock.h"
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+class ClassifySingleCellTest : public ::testing::TestWithParam<std::tuple<bool, bool, int> > {};
+
+TEST_P(ClassifySingleCellTest, Consistency) {
+    auto param = GetParam();
+    bool ref_sparse = std::get<0>(param);
+    bool fine_tune = std::get<1>(param);
+    int nthreads = std::get<2>(param);
+
+    // Using lots of labels to check that the parallelization across labels is correct.
+    std::size_t ngenes = 300, nlabels = 8, nrefs = 100, ntest = 30;
+    auto trained = train_mock_single(ngenes, nlabels, nrefs, 10, /* seed = */ 600, /* ref_sparse = */ ref_sparse);
+
+    auto test = spawn_sparse_matrix(ngenes, ntest, /* seed = */ 603, 0.3);
+    singlepp::ClassifySingleOptions<double> copt;
+    copt.fine_tune = fine_tune;
+    copt.fine_tune_threshold = 0.1; // more labels in each fine-tuning iteration.
+    auto expected = singlepp::classify_single<int>(*test, trained, copt);
+    auto sparse_test = tatami::convert_to_compressed_sparse<double, int>(*test, false, {});
+    auto expected_sparse = singlepp::classify_single<int>(*sparse_test, trained, copt);
+
+    copt.num_threads = nthreads;
+    singlepp::ClassifySingleCellWorkspace<double, int, double, int> workspace(trained, copt);
+    std::vector<double> buffer(ngenes), scores(nlabels);
+    std::vector<int> ibuffer(ngenes);
+    auto dext = test->dense_column();
+    auto sext = sparse_test->sparse_column();
+
+    for (std::size_t c = 0; c < ntest; ++c) {
+        auto ptr = dext->fetch(c, buffer.data());
+        auto res = singlepp::classify_single_cell_dense(ptr, workspace, scores.data());
+        EXPECT_EQ(res.best, expected.best[c]);
+        EXPECT_EQ(res.delta, expected.delta[c]);
+        for (std::size_t l = 0; l < nlabels; ++l) {
+            EXPECT_EQ(scores[l], expected.scores[l][c]);
+        }
+
+        auto range = sext->fetch(c, buffer.data(), ibuffer.data());
+        auto sres = singlepp::classify_single_cell_sparse(range.number, range.value, range.index, workspace);
+        EXPECT_EQ(sres.best, expected_sparse.best[c]);
+        EXPECT_EQ(sres.delta, expected_sparse.delta[c]);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ClassifySingleCell,
+    ClassifySingleCellTest,
+    ::testing::Combine(
+        ::testing::Values(false, true), // whether the reference is sparse.
+        ::testing::Values(false, true), // whether to fine-tune.
+        ::testing::Values(1, 3, 20) // number of threads, including more threads than labels.
+    )
+);
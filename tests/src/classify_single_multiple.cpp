@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/classify_single_multiple.hpp"
+#include "tatami/tatami.hpp"
+
+#include "mock_markers.h"
+#include "spawn_matrix.h"
+
+#include <memory>
+#include <vector>
+
+class ClassifySingleMultipleTest : public ::testing::Test {
+protected:
+    inline static constexpr size_t ngenes = 300;
+    inline static constexpr size_t ntest = 51;
+
+    static std::vector<singlepp::TrainedSingle<int, double> > build_references() {
+        std::vector<singlepp::TrainedSingle<int, double> > output;
+        singlepp::TrainSingleOptions bopt;
+
+        // Using different numbers of labels and markers so that the subsets only partially overlap.
+        std::vector<size_t> nlabels { 3, 5, 4 };
+        std::vector<int> ntop { 10, 20, 5 };
+        for (size_t r = 0; r < nlabels.size(); ++r) {
+            size_t nrefs = 40 + r * 10;
+            auto refs = spawn_sparse_matrix(ngenes, nrefs, /* seed = */ 100 + r, /* density = */ 0.3);
+            auto labels = spawn_labels(nrefs, nlabels[r], /* seed = */ 200 + r);
+            auto markers = mock_pairwise_markers<int>(nlabels[r], ntop[r], ngenes, /* seed = */ 300 + r);
+
+            // Using a sparse reference for one of them to check that we handle a mix of index representations.
+            if (r == 1) {
+                auto sparse_refs = tatami::convert_to_compressed_sparse<double, int>(*refs, true, {});
+                output.push_back(singlepp::train_single(*sparse_refs, labels.data(), markers, bopt));
+            } else {
+                output.push_back(singlepp::train_single(*refs, labels.data(), markers, bopt));
+            }
+        }
+
+        return output;
+    }
+};
+
+TEST_F(ClassifySingleMultipleTest, Basic) {
+    auto trained = build_references();
+    std::vector<const singlepp::TrainedSingle<int, double>*> ptrs;
+    for (const auto& tr : trained) {
+        ptrs.push_back(&tr);
+    }
+
+    auto dense_test = spawn_sparse_matrix(ngenes, ntest, /* seed = */ 999, /* density = */ 0.2);
+    auto sparse_test = tatami::convert_to_compressed_sparse<double, int>(*dense_test, true, {});
+
+    for (bool fine_tune : { false, true }) {
+        for (int nthreads : { 1, 3 }) {
+            singlepp::ClassifySingleOptions<double> copt;
+            copt.fine_tune = fine_tune;
+            copt.num_threads = nthreads;
+
+            auto multi = singlepp::classify_single_multiple<int>(*dense_test, ptrs, copt);
+            ASSERT_EQ(multi.size(), trained.size());
+            for (size_t r = 0; r < trained.size(); ++r) {
+                auto ref = singlepp::classify_single<int>(*dense_test, trained[r], copt);
+                EXPECT_EQ(ref.best, multi[r].best);
+                EXPECT_EQ(ref.delta, multi[r].delta);
+                EXPECT_EQ(ref.scores, multi[r].scores);
+            }
+
+            auto smulti = singlepp::classify_single_multiple<int>(*sparse_test, ptrs, copt);
+            ASSERT_EQ(smulti.size(), trained.size());
+            for (size_t r = 0; r < trained.size(); ++r) {
+                auto ref = singlepp::classify_single<int>(*sparse_test, trained[r], copt);
+                EXPECT_EQ(ref.best, smulti[r].best);
+                EXPECT_EQ(ref.delta, smulti[r].delta);
+                EXPECT_EQ(ref.scores, smulti[r].scores);
+            }
+        }
+    }
+}
+
+TEST_F(ClassifySingleMultipleTest, Buffers) {
+    auto trained = build_references();
+    std::vector<const singlepp::TrainedSingle<int, double>*> ptrs;
+    for (const auto& tr : trained) {
+        ptrs.push_back(&tr);
+    }
+    auto test = spawn_matrix(ngenes, ntest, /* seed = */ 1999);
+
+    // Only requesting some outputs for each reference, which also enables label pruning for the references without scores.
+    singlepp::ClassifySingleOptions<double> copt;
+    std::vector<std::vector<int> > best(trained.size(), std::vector<int>(ntest));
+    std::vector<double> delta(ntest);
+    std::vector<double> top_scores(ntest * 2);
+    std::vector<singlepp::FineTuneStatistics> stats(trained.size());
+    std::vector<std::vector<singlepp::SearchCounters> > counters(trained.size());
+
+    std::vector<singlepp::ClassifySingleBuffers<int, double> > buffers(trained.size());
+    for (size_t r = 0; r < trained.size(); ++r) {
+        buffers[r].best = best[r].data();
+        buffers[r].scores.resize(trained[r].num_labels());
+        buffers[r].fine_tune_statistics = &(stats[r]);
+        buffers[r].search_counters = &(counters[r]);
+    }
+    buffers[0].delta = delta.data();
+    buffers[2].top_k = 2;
+    buffers[2].top_scores = top_scores.data();
+    singlepp::classify_single_multiple(*test, ptrs, buffers, copt);
+
+    for (size_t r = 0; r < trained.size(); ++r) {
+        auto ref = singlepp::classify_single<int>(*test, trained[r], copt);
+        EXPECT_EQ(ref.best, best[r]);
+        if (r == 0) {
+            EXPECT_EQ(ref.delta, delta);
+        }
+        EXPECT_EQ(stats[r].num_iterations.size(), ntest);
+        EXPECT_EQ(counters[r].size(), trained[r].num_labels());
+
+        if (r == 2) {
+            for (size_t c = 0; c < ntest; ++c) {
+                std::vector<double> current;
+                for (const auto& s : ref.scores) {
+                    current.push_back(s[c]);
+                }
+                std::sort(current.begin(), current.end());
+                EXPECT_EQ(top_scores[c * 2], current.back());
+                EXPECT_EQ(top_scores[c * 2 + 1], current[current.size() - 2]);
+            }
+        }
+    }
+}
+
+TEST_F(ClassifySingleMultipleTest, Errors) {
+    auto trained = build_references();
+    std::vector<const singlepp::TrainedSingle<int, double>*> ptrs{ &(trained[0]) };
+    singlepp::ClassifySingleOptions<double> copt;
+
+    auto test = spawn_matrix(ngenes + 1, ntest, /* seed = */ 2999);
+    std::string msg;
+    try {
+        singlepp::classify_single_multiple<int>(*test, ptrs, copt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("number of rows") != std::string::npos);
+
+    msg.clear();
+    auto test2 = spawn_matrix(ngenes, ntest, /* seed = */ 2999);
+    std::vector<singlepp::ClassifySingleBuffers<int, double> > buffers(2);
+    try {
+        singlepp::classify_single_multiple(*test2, ptrs, buffers, copt);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("same length") != std::string::npos);
+
+    // Empty set of references is a no-op.
+    auto empty = singlepp::classify_single_multiple<int>(*test2, std::vector<const singlepp::TrainedSingle<int, double>*>(), copt);
+    EXPECT_TRUE(empty.empty());
+}
@@ -5,6 +5,8 @@
 
 #include <algorithm>
 #include <vector>
+#include <random>
+#include <limits>
 
 #include "fill_ranks.h"
 
@@ -101,3 +103,51 @@ TEST(CorrelationsToScore, FloatConversion) {
 
     EXPECT_GT(inaccurate, 0);
 }
+
+TEST(SmallestL2, Basic) {
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> dist(0, 1);
+    singlepp::SmallestL2<int, double> smallest;
+
+    for (int n = 1; n <= 20; ++n) {
+        std::vector<double> l2(n);
+        for (auto& x : l2) {
+            x = dist(rng);
+        }
+        l2.push_back(l2.front()); // adding some ties.
+
+        for (double quantile : { 0.0, 0.1, 0.33, 0.5, 0.8, 0.95, 1.0 }) {
+            auto deets = singlepp::precompute_quantile_details<int, double>(l2.size(), quantile);
+            smallest.reset(deets);
+            double prev_bound = std::numeric_limits<double>::infinity();
+            for (auto x : l2) {
+                smallest.add(x);
+                EXPECT_LE(smallest.bound(), prev_bound); // bound should never increase.
+                prev_bound = smallest.bound();
+            }
+            EXPECT_EQ(smallest.score(deets), l2_to_score(l2, quantile));
+        }
+    }
+}
+
+TEST(SmallestL2, Bound) {
+    std::vector<double> l2 { 0.5, 0.1, 0.4, 0.2, 0.3 };
+    auto deets = singlepp::precompute_quantile_details<int, double>(l2.size(), 0.5); // right_index = 2.
+    singlepp::SmallestL2<int, double> smallest;
+    smallest.reset(deets);
+
+    smallest.add(l2[0]);
+    smallest.add(l2[1]);
+    EXPECT_EQ(smallest.bound(), std::numeric_limits<double>::infinity());
+    smallest.add(l2[2]);
+    EXPECT_EQ(smallest.bound(), 0.5);
+    smallest.add(l2[3]);
+    EXPECT_EQ(smallest.bound(), 0.4);
+
+    // Anything above the bound has no effect.
+    smallest.add(100);
+    EXPECT_EQ(smallest.bound(), 0.4);
+    smallest.add(l2[4]);
+    EXPECT_EQ(smallest.bound(), 0.3);
+    EXPECT_EQ(smallest.score(deets), l2_to_score(l2, 0.5));
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/estimate_resources.hpp"
+
+#include "spawn_matrix.h"
+#include "mock_markers.h"
+
+#include <vector>
+#include <cstddef>
+#include <memory>
+
+class EstimateResourcesTest : public ::testing::TestWithParam<int> {};
+
+TEST_P(EstimateResourcesTest, Single) {
+    const bool sparse = GetParam();
+    size_t ngenes = 500;
+    size_t nlabels = 5;
+    size_t nrefs = 200;
+    double density = 0.2;
+
+    std::shared_ptr<tatami::Matrix<double, int> > refs = spawn_sparse_matrix(ngenes, nrefs, /* seed = */ 51, /* density = */ density);
+    if (sparse) {
+        refs = tatami::convert_to_compressed_sparse<double, int>(*refs, true, {});
+    }
+    auto labels = spawn_labels(nrefs, nlabels, /* seed = */ 52);
+    auto markers = mock_pairwise_markers<int>(nlabels, 20, ngenes, /* seed = */ 53);
+
+    singlepp::TrainSingleOptions bopt;
+    auto trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+
+    singlepp::ReferenceDimensions dims;
+    dims.num_profiles = nrefs;
+    dims.num_labels = nlabels;
+    dims.num_markers = trained.subset().size();
+    for (const auto& x : markers) {
+        for (const auto& y : x) {
+            dims.num_marker_entries += y.size();
+        }
+    }
+    dims.sparse = sparse;
+    dims.density = density;
+
+    singlepp::EstimateResourcesOptions eopt;
+    auto train_est = singlepp::estimate_train_single(dims, bopt, eopt);
+    EXPECT_GT(train_est.output_memory, 0);
+    EXPECT_GT(train_est.peak_memory, train_est.output_memory);
+    EXPECT_GT(train_est.operations, 0);
+    EXPECT_GT(train_est.seconds, 0);
+
+    // Estimate should be in the right ballpark.
+    const double actual = trained.memory_usage().total();
+    EXPECT_GT(train_est.output_memory, actual * 0.5);
+    EXPECT_LT(train_est.output_memory, actual * 2);
+
+    // More threads reduce the runtime but increase the memory.
+    bopt.num_threads = 4;
+    auto ptrain_est = singlepp::estimate_train_single(dims, bopt, eopt);
+    EXPECT_GT(ptrain_est.peak_memory, train_est.peak_memory);
+    EXPECT_EQ(ptrain_est.output_memory, train_est.output_memory);
+    EXPECT_LT(ptrain_est.seconds, train_est.seconds);
+
+    singlepp::TestDimensions tdims;
+    tdims.num_cells = 1000;
+    tdims.sparse = sparse;
+    singlepp::ClassifySingleOptions<double> copt;
+    auto class_est = singlepp::estimate_classify_single(dims, tdims, copt, eopt);
+    EXPECT_EQ(class_est.output_memory, tdims.num_cells * (sizeof(int) + (nlabels + 1) * sizeof(double)));
+    EXPECT_GT(class_est.peak_memory, class_est.output_memory);
+    EXPECT_GT(class_est.operations, 0);
+
+    // Turning off fine-tuning reduces both.
+    copt.fine_tune = false;
+    auto nofine_est = singlepp::estimate_classify_single(dims, tdims, copt, eopt);
+    EXPECT_LT(nofine_est.peak_memory, class_est.peak_memory);
+    EXPECT_LT(nofine_est.operations, class_est.operations);
+
+    // More cells increase everything.
+    copt.fine_tune = true;
+    tdims.num_cells *= 2;
+    auto more_est = singlepp::estimate_classify_single(dims, tdims, copt, eopt);
+    EXPECT_GT(more_est.peak_memory, class_est.peak_memory);
+    EXPECT_EQ(more_est.operations, class_est.operations * 2);
+}
+
+TEST_P(EstimateResourcesTest, Integrated) {
+    const bool sparse = GetParam();
+    size_t ngenes = 500;
+    double density = 0.2;
+
+    std::vector<std::shared_ptr<tatami::Matrix<double, int> > > refs;
+    std::vector<std::vector<int> > labels;
+    std::vector<singlepp::TrainIntegratedInput<double, int, int> > inputs;
+    std::vector<singlepp::ReferenceDimensions> dims;
+
+    for (size_t r = 0; r < 3; ++r) {
+        size_t nlabels = 3 + r, nprofiles = 50 + r * 20;
+        refs.push_back(spawn_sparse_matrix(ngenes, nprofiles, /* seed = */ 60 + r, /* density = */ density));
+        if (sparse) {
+            refs.back() = tatami::convert_to_compressed_sparse<double, int>(*(refs.back()), true, {});
+        }
+        labels.push_back(spawn_labels(nprofiles, nlabels, /* seed = */ 70 + r));
+
+        auto pairwise = mock_pairwise_markers<int>(nlabels, 20, ngenes, /* seed = */ 80 + r);
+        std::vector<std::vector<int> > per_label(nlabels);
+        for (size_t l = 0; l < nlabels; ++l) {
+            per_label[l] = pairwise[l][(l + 1) % nlabels];
+        }
+        inputs.push_back(singlepp::prepare_integrated_input<double, int>(refs.back(), labels.back().data(), per_label));
+
+        singlepp::ReferenceDimensions current;
+        current.num_profiles = nprofiles;
+        current.num_labels = nlabels;
+        for (const auto& x : inputs.back().markers) {
+            current.num_marker_entries += x.size();
+        }
+        current.sparse = sparse;
+        current.density = density;
+        dims.push_back(current);
+    }
+
+    singlepp::TrainIntegratedOptions iopt;
+    auto integrated = singlepp::train_integrated(inputs, iopt);
+    const auto num_universe = integrated.subset().size();
+
+    singlepp::EstimateResourcesOptions eopt;
+    auto train_est = singlepp::estimate_train_integrated(dims, num_universe, iopt, eopt);
+    EXPECT_GT(train_est.peak_memory, train_est.output_memory);
+    const double actual = integrated.memory_usage().total();
+    EXPECT_GT(train_est.output_memory, actual * 0.5);
+    EXPECT_LT(train_est.output_memory, actual * 2);
+
+    singlepp::TestDimensions tdims;
+    tdims.num_cells = 1000;
+    singlepp::ClassifyIntegratedOptions<double> copt;
+    auto class_est = singlepp::estimate_classify_integrated(dims, num_universe, tdims, copt, eopt);
+    EXPECT_EQ(class_est.output_memory, tdims.num_cells * (sizeof(int) + (dims.size() + 1) * sizeof(double)));
+    EXPECT_GT(class_est.peak_memory, class_est.output_memory);
+
+    copt.fine_tune = false;
+    auto nofine_est = singlepp::estimate_classify_integrated(dims, num_universe, tdims, copt, eopt);
+    EXPECT_LT(nofine_est.operations, class_est.operations);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    EstimateResources,
+    EstimateResourcesTest,
+    ::testing::Values(0, 1)
+);
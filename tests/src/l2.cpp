@@ -3,6 +3,10 @@
 #include "singlepp/l2.hpp"
 #include "singlepp/build_reference.hpp"
 
+#include <limits>
+
+#include "fill_ranks.h"
+
 TEST(ComputeL2, Dense) {
     std::vector<double> a{ 1.2, -0.5, 2.3, 5.6, -4.4 };
     std::vector<double> b{ -.2, -5.1, 4.4, 1.6,  0.2 };
@@ -28,6 +32,33 @@ TEST(ComputeL2, Dense) {
     EXPECT_FLOAT_EQ(scaled, expected);
 }
 
+TEST(ComputeL2, DenseBounded) {
+    std::vector<double> a{ 1.2, -0.5, 2.3, 5.6, -4.4, 0.1, 3.3 };
+    std::vector<double> b{ -.2, -5.1, 4.4, 1.6,  0.2, 2.9, -1.0 };
+
+    const int N = b.size();
+    auto scaled_a = quick_scaled_ranks(a);
+    auto paired_b = fill_ranks(N, b.data());
+    std::vector<double> buffer_b(N);
+    auto expected = singlepp::scaled_ranks_dense_l2(N, scaled_a.data(), paired_b, buffer_b.data());
+
+    // Same result if the bound is not exceeded.
+    EXPECT_EQ(singlepp::scaled_ranks_dense_l2(N, scaled_a.data(), paired_b, buffer_b.data(), std::numeric_limits<double>::infinity()), expected);
+    EXPECT_EQ(singlepp::scaled_ranks_dense_l2(N, scaled_a.data(), paired_b, buffer_b.data(), expected), expected);
+
+    // Otherwise, we get something greater than the bound.
+    auto bounded = singlepp::scaled_ranks_dense_l2(N, scaled_a.data(), paired_b, buffer_b.data(), expected / 2);
+    EXPECT_GT(bounded, expected / 2);
+    EXPECT_LE(bounded, expected);
+    EXPECT_GT(singlepp::scaled_ranks_dense_l2(N, scaled_a.data(), paired_b, buffer_b.data(), 0.0), 0);
+
+    // Works correctly with no-variance profiles.
+    std::vector<double> c(N, 1);
+    auto paired_c = fill_ranks(N, c.data());
+    auto expected_c = singlepp::scaled_ranks_dense_l2(N, scaled_a.data(), paired_c, buffer_b.data());
+    EXPECT_EQ(singlepp::scaled_ranks_dense_l2(N, scaled_a.data(), paired_c, buffer_b.data(), 1.0), expected_c);
+}
+
 TEST(ComputeL2, Densify) {
     std::vector<double> x{ -1, -.2, -1, -1, -5.1, -1, 4.4, -1, 1.6 };
 
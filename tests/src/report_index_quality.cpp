@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/report_index_quality.hpp"
+
+#include "spawn_matrix.h"
+#include "mock_markers.h"
+
+#include <vector>
+#include <cstddef>
+#include <cmath>
+#include <memory>
+
+class ReportIndexQualityTest : public ::testing::TestWithParam<int> {};
+
+TEST_P(ReportIndexQualityTest, Basic) {
+    const bool sparse = GetParam();
+    size_t ngenes = 200;
+    size_t nlabels = 4;
+    size_t nrefs = 150;
+
+    std::shared_ptr<tatami::Matrix<double, int> > refs = spawn_sparse_matrix(ngenes, nrefs, /* seed = */ 31, /* density = */ 0.3);
+    if (sparse) {
+        refs = tatami::convert_to_compressed_sparse<double, int>(*refs, true, {});
+    }
+    auto labels = spawn_labels(nrefs, nlabels, /* seed = */ 32);
+    auto markers = mock_pairwise_markers<int>(nlabels, 10, ngenes, /* seed = */ 33);
+    std::vector<std::size_t> label_sizes(nlabels);
+    for (auto l : labels) {
+        ++label_sizes[l];
+    }
+
+    singlepp::TrainSingleOptions bopt;
+    auto trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+    EXPECT_EQ(trained.built().sparse.has_value(), sparse);
+
+    singlepp::ReportIndexQualityOptions<double> ropt;
+    auto report = singlepp::report_index_quality(trained, ropt);
+    ASSERT_EQ(report.size(), nlabels);
+
+    for (std::size_t l = 0; l < nlabels; ++l) {
+        const auto& current = report[l];
+        EXPECT_EQ(current.num_profiles, label_sizes[l]);
+        EXPECT_EQ(current.num_seeds, static_cast<std::size_t>(std::round(std::sqrt(label_sizes[l])))); // no duplicates in random data.
+        EXPECT_EQ(current.num_duplicates, 0);
+        EXPECT_GE(current.min_cluster_size, 1);
+        EXPECT_LE(current.min_cluster_size, current.median_cluster_size);
+        EXPECT_LE(current.median_cluster_size, current.max_cluster_size);
+        EXPECT_GT(current.max_radius, 0);
+        EXPECT_LE(current.median_radius, current.max_radius);
+        EXPECT_GE(current.pruning_efficiency, 0);
+        EXPECT_LT(current.pruning_efficiency, 1);
+    }
+
+    // Same results with multiple threads.
+    ropt.num_threads = 3;
+    auto preport = singlepp::report_index_quality(trained, ropt);
+    for (std::size_t l = 0; l < nlabels; ++l) {
+        EXPECT_EQ(report[l].pruning_efficiency, preport[l].pruning_efficiency);
+    }
+
+    // No estimation without probes.
+    ropt.num_probes = 0;
+    auto noprobe = singlepp::report_index_quality(trained, ropt);
+    for (std::size_t l = 0; l < nlabels; ++l) {
+        EXPECT_EQ(noprobe[l].num_seeds, report[l].num_seeds);
+        EXPECT_EQ(noprobe[l].pruning_efficiency, 0);
+    }
+}
+
+TEST_P(ReportIndexQualityTest, Duplicates) {
+    const bool sparse = GetParam();
+    size_t ngenes = 100;
+    size_t nlabels = 2;
+
+    // Every profile is duplicated 5 times.
+    size_t nunique = 10, nrefs = nunique * 5;
+    auto unique = spawn_sparse_matrix(ngenes, nunique, /* seed = */ 41, /* density = */ 0.3);
+    auto uext = unique->dense_column();
+    std::vector<double> buffer(ngenes * nrefs);
+    for (size_t c = 0; c < nrefs; ++c) {
+        auto ptr = uext->fetch(c % nunique, buffer.data() + c * ngenes);
+        tatami::copy_n(ptr, ngenes, buffer.data() + c * ngenes);
+    }
+    std::shared_ptr<tatami::Matrix<double, int> > refs(new tatami::DenseColumnMatrix<double, int>(ngenes, nrefs, std::move(buffer)));
+    if (sparse) {
+        refs = tatami::convert_to_compressed_sparse<double, int>(*refs, true, {});
+    }
+
+    std::vector<int> labels(nrefs);
+    for (size_t c = 0; c < nrefs; ++c) {
+        labels[c] = c % nlabels;
+    }
+    auto markers = mock_pairwise_markers<int>(nlabels, 20, ngenes, /* seed = */ 43);
+
+    singlepp::TrainSingleOptions bopt;
+    auto trained = singlepp::train_single(*refs, labels.data(), markers, bopt);
+    EXPECT_EQ(trained.built().sparse.has_value(), sparse);
+    singlepp::ReportIndexQualityOptions<double> ropt;
+    auto report = singlepp::report_index_quality(trained, ropt);
+
+    ASSERT_EQ(report.size(), nlabels);
+    for (const auto& current : report) {
+        EXPECT_EQ(current.num_profiles, nrefs / nlabels);
+        EXPECT_EQ(current.num_seeds, nunique / nlabels); // one seed for each group of duplicates.
+        EXPECT_EQ(current.num_duplicates, current.num_profiles - current.num_seeds);
+        EXPECT_LT(current.max_radius, 1e-6);
+        EXPECT_EQ(current.min_cluster_size, 5);
+        EXPECT_EQ(current.max_cluster_size, 5);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ReportIndexQuality,
+    ReportIndexQualityTest,
+    ::testing::Values(0, 1)
+);
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include "singlepp/train_single.hpp"
+#include "singlepp/classify_single.hpp"
+
+#include "simulate_counts.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+TEST(SimulateCounts, Markers) {
+    SimulateTruthOptions topt;
+    topt.num_genes = 500;
+    topt.num_labels = 4;
+    topt.program_size = 30;
+    auto truth = simulate_truth(topt);
+    auto markers = simulate_pairwise_markers(truth, 10);
+
+    ASSERT_EQ(markers.size(), 4);
+    for (int l1 = 0; l1 < 4; ++l1) {
+        ASSERT_EQ(markers[l1].size(), 4);
+        const auto& program = truth.programs[l1];
+        for (int l2 = 0; l2 < 4; ++l2) {
+            const auto& current = markers[l1][l2];
+            if (l1 == l2) {
+                EXPECT_TRUE(current.empty());
+                continue;
+            }
+
+            // All markers should be in the program of the first label, as nothing else is upregulated.
+            EXPECT_EQ(current.size(), 10);
+            for (auto g : current) {
+                EXPECT_TRUE(std::binary_search(program.begin(), program.end(), g));
+            }
+        }
+    }
+}
+
+TEST(SimulateCounts, Sparsity) {
+    SimulateTruthOptions topt;
+    topt.num_genes = 500;
+    auto truth = simulate_truth(topt);
+
+    auto density = [](const SimulatedCounts& sim) -> double {
+        return static_cast<double>(sim.counts.size() - std::count(sim.counts.begin(), sim.counts.end(), 0)) / sim.counts.size();
+    };
+
+    auto bulk = simulate_counts(truth, bulk_shape(20, 100));
+    EXPECT_EQ(bulk.num_profiles, 20);
+    EXPECT_EQ(bulk.counts.size(), 20 * 500);
+    auto deep = density(bulk);
+    EXPECT_GT(deep, 0.95);
+
+    auto sc = simulate_counts(truth, single_cell_shape(100, 100));
+    auto shallow = density(sc);
+    EXPECT_LT(shallow, deep);
+
+    auto sopt = single_cell_shape(100, 100);
+    sopt.dropout = 0.5;
+    auto dropped = simulate_counts(truth, sopt);
+    EXPECT_LT(density(dropped), shallow);
+
+    // All labels are present.
+    for (const auto& sim : { bulk, sc }) {
+        for (int l = 0; l < truth.num_labels; ++l) {
+            EXPECT_NE(std::find(sim.labels.begin(), sim.labels.end(), l), sim.labels.end());
+        }
+    }
+}
+
+TEST(SimulateCounts, Classification) {
+    SimulateTruthOptions topt;
+    topt.num_genes = 1000;
+    topt.num_labels = 5;
+    auto truth = simulate_truth(topt);
+    auto markers = simulate_pairwise_markers(truth, 20);
+
+    // Classifying single-cell data with a bulk reference should mostly recover the true labels.
+    auto ref = simulate_counts(truth, bulk_shape(25, 100));
+    auto test = simulate_counts(truth, single_cell_shape(200, 200));
+
+    for (bool sparse : { false, true }) {
+        auto refmat = (sparse ? ref.sparse() : ref.dense());
+        auto testmat = (sparse ? test.sparse() : test.dense());
+        auto trained = singlepp::train_single(*refmat, ref.labels.data(), markers, singlepp::TrainSingleOptions());
+        auto res = singlepp::classify_single(*testmat, trained, singlepp::ClassifySingleOptions<double>());
+
+        std::size_t correct = 0;
+        for (std::size_t c = 0; c < test.labels.size(); ++c) {
+            correct += (res.best[c] == test.labels[c]);
+        }
+        EXPECT_GT(static_cast<double>(correct) / test.labels.size(), 0.9);
+    }
+}
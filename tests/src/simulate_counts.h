@@ -0,0 +1,229 @@
+#ifndef SINGLEPP_SIMULATE_COUNTS_H
+#define SINGLEPP_SIMULATE_COUNTS_H
+
+#include "singlepp/Markers.hpp"
+#include "tatami/tatami.hpp"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <memory>
+#include <cmath>
+#include <cstddef>
+
+/*
+ * Simulation of count data with some realistic structure, for use in tests and benchmarks.
+ * Each label has its own "program" of marker genes that are upregulated relative to a shared baseline.
+ * Counts are then sampled from a negative binomial distribution around each label's means, scaled by a per-profile library size.
+ * This gives cluster structure that is more similar to real data than uniform noise, which matters for the KMKNN search.
+ *
+ * The ground truth (i.e., the means) is simulated separately from the counts,
+ * so that references and test datasets can be sampled with different shapes from the same truth.
+ */
+
+struct SimulateTruthOptions {
+    int num_genes = 2000;
+    int num_labels = 5;
+
+    // Baseline abundances are log-normally distributed across genes.
+    double baseline_meanlog = 0;
+    double baseline_sdlog = 1.5;
+
+    // Number of genes in each label's program, and the log-fold change of those genes in that label.
+    // Programs are sampled independently for each label and may overlap.
+    int program_size = 50;
+    double program_logfc = 2;
+
+    unsigned long long seed = 42;
+};
+
+struct SimulatedTruth {
+    int num_genes = 0;
+    int num_labels = 0;
+
+    // Matrix of relative abundances, where each column corresponds to a label and sums to 1.
+    std::vector<double> abundances;
+
+    // Genes in the program for each label.
+    std::vector<std::vector<int> > programs;
+};
+
+inline SimulatedTruth simulate_truth(const SimulateTruthOptions& options) {
+    SimulatedTruth output;
+    output.num_genes = options.num_genes;
+    output.num_labels = options.num_labels;
+    const std::size_t ng = options.num_genes;
+
+    std::mt19937_64 rng(options.seed);
+    std::lognormal_distribution<> baseline_dist(options.baseline_meanlog, options.baseline_sdlog);
+    std::vector<double> baseline(ng);
+    for (auto& b : baseline) {
+        b = baseline_dist(rng);
+    }
+
+    output.abundances.resize(ng * options.num_labels);
+    output.programs.resize(options.num_labels);
+    std::vector<int> order(ng);
+    const double multiplier = std::exp(options.program_logfc);
+
+    for (int l = 0; l < options.num_labels; ++l) {
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), rng);
+        auto& program = output.programs[l];
+        program.insert(program.end(), order.begin(), order.begin() + std::min<std::size_t>(options.program_size, ng));
+        std::sort(program.begin(), program.end());
+
+        const auto ptr = output.abundances.data() + ng * l;
+        std::copy(baseline.begin(), baseline.end(), ptr);
+        for (auto g : program) {
+            ptr[g] *= multiplier;
+        }
+
+        const double total = std::accumulate(ptr, ptr + ng, 0.0);
+        for (std::size_t g = 0; g < ng; ++g) {
+            ptr[g] /= total;
+        }
+    }
+
+    return output;
+}
+
+// Pairwise markers for each label against every other label, based on the largest log-fold changes between their true abundances.
+// This mimics the output of a perfect marker detection method, e.g., from the singler_classic_markers library.
+inline singlepp::PairwiseMarkers<int> simulate_pairwise_markers(const SimulatedTruth& truth, int num_markers) {
+    const std::size_t ng = truth.num_genes;
+    singlepp::PairwiseMarkers<int> output(truth.num_labels);
+    std::vector<int> order(ng);
+    std::vector<double> logfc(ng);
+
+    for (int l1 = 0; l1 < truth.num_labels; ++l1) {
+        output[l1].resize(truth.num_labels);
+        const auto ptr1 = truth.abundances.data() + ng * l1;
+        for (int l2 = 0; l2 < truth.num_labels; ++l2) {
+            if (l1 == l2) {
+                continue;
+            }
+
+            const auto ptr2 = truth.abundances.data() + ng * l2;
+            for (std::size_t g = 0; g < ng; ++g) {
+                logfc[g] = std::log(ptr1[g]) - std::log(ptr2[g]);
+            }
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&](int left, int right) -> bool { return logfc[left] > logfc[right]; });
+
+            // Only reporting genes that are actually upregulated.
+            auto& current = output[l1][l2];
+            for (std::size_t g = 0; g < ng && current.size() < static_cast<std::size_t>(num_markers); ++g) {
+                if (logfc[order[g]] <= 0) {
+                    break;
+                }
+                current.push_back(order[g]);
+            }
+        }
+    }
+
+    return output;
+}
+
+struct SimulateCountsOptions {
+    int num_profiles = 100;
+
+    // Library sizes are log-normally distributed across profiles.
+    // Smaller library sizes will yield sparser matrices.
+    double library_size = 5000;
+    double library_sdlog = 0.5;
+
+    // Negative binomial dispersion, where the variance is 'mu + dispersion * mu^2'.
+    double dispersion = 0.2;
+
+    // Additional probability of observing a zero count, on top of the zeros from the negative binomial distribution.
+    double dropout = 0;
+
+    unsigned long long seed = 69;
+};
+
+// Bulk references have a few deeply sequenced profiles per label with little variability.
+inline SimulateCountsOptions bulk_shape(int num_profiles, unsigned long long seed) {
+    SimulateCountsOptions output;
+    output.num_profiles = num_profiles;
+    output.library_size = 2e7;
+    output.library_sdlog = 0.2;
+    output.dispersion = 0.05;
+    output.seed = seed;
+    return output;
+}
+
+// Single-cell datasets have many shallow profiles with high variability.
+inline SimulateCountsOptions single_cell_shape(int num_cells, unsigned long long seed) {
+    SimulateCountsOptions output;
+    output.num_profiles = num_cells;
+    output.library_size = 5000;
+    output.library_sdlog = 0.5;
+    output.dispersion = 0.5;
+    output.seed = seed;
+    return output;
+}
+
+struct SimulatedCounts {
+    int num_genes = 0;
+    int num_profiles = 0;
+
+    // Column-major matrix of counts.
+    std::vector<double> counts;
+
+    // Label for each profile. Each label is guaranteed to be present if 'num_profiles' is no less than the number of labels.
+    std::vector<int> labels;
+
+    std::shared_ptr<tatami::Matrix<double, int> > dense() const {
+        return std::shared_ptr<tatami::Matrix<double, int> >(new tatami::DenseColumnMatrix<double, int>(num_genes, num_profiles, counts));
+    }
+
+    std::shared_ptr<tatami::Matrix<double, int> > sparse() const {
+        return tatami::convert_to_compressed_sparse<double, int>(*dense(), false, {});
+    }
+};
+
+inline SimulatedCounts simulate_counts(const SimulatedTruth& truth, const SimulateCountsOptions& options) {
+    SimulatedCounts output;
+    output.num_genes = truth.num_genes;
+    output.num_profiles = options.num_profiles;
+    const std::size_t ng = truth.num_genes;
+    std::mt19937_64 rng(options.seed);
+
+    output.labels.resize(options.num_profiles);
+    for (int p = 0; p < options.num_profiles; ++p) {
+        output.labels[p] = (p < truth.num_labels ? p : rng() % truth.num_labels);
+    }
+    std::shuffle(output.labels.begin(), output.labels.end(), rng);
+
+    output.counts.resize(ng * options.num_profiles);
+    std::lognormal_distribution<> libdist(std::log(options.library_size), options.library_sdlog);
+    std::uniform_real_distribution<> udist;
+
+    for (int p = 0; p < options.num_profiles; ++p) {
+        const double libsize = libdist(rng);
+        const auto abundances = truth.abundances.data() + ng * output.labels[p];
+        const auto optr = output.counts.data() + ng * p;
+
+        for (std::size_t g = 0; g < ng; ++g) {
+            if (options.dropout > 0 && udist(rng) < options.dropout) {
+                continue;
+            }
+
+            // Sampling from the negative binomial distribution as a gamma-Poisson mixture.
+            double mu = libsize * abundances[g];
+            if (options.dispersion > 0) {
+                const double shape = 1 / options.dispersion;
+                mu = std::gamma_distribution<>(shape, mu / shape)(rng);
+            }
+            if (mu > 0) {
+                optr[g] = std::poisson_distribution<long long>(mu)(rng);
+            }
+        }
+    }
+
+    return output;
+}
+
+#endif
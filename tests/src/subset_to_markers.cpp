@@ -12,8 +12,9 @@ TEST(SubsetToMarkers, Simple) {
     size_t nlabels = 4;
     size_t ngenes = 100;
     auto markers = mock_pairwise_markers<int>(nlabels, 20, ngenes, /* seed = */ 42);
-    auto copy = markers;
-    auto subs = singlepp::subset_to_markers<int>(ngenes, copy);
+    singlepp::FlatPairwiseMarkers<int> flat(markers);
+    auto subs = singlepp::subset_to_markers<int>(ngenes, flat);
+    auto copy = flat.to_nested();
 
     EXPECT_TRUE(std::is_sorted(subs.begin(), subs.end()));
     EXPECT_LT(subs.size(), ngenes); // not every gene is there, otherwise it would be a trivial test.
@@ -62,8 +63,9 @@ TEST(SubsetToMarkers, DiagonalOnly) {
     size_t ngenes = 100;
     auto markers = mock_diagonal_markers<int>(nlabels, 20, ngenes, /* seed = */ 666);
 
-    auto copy = markers;
-    auto subs = singlepp::subset_to_markers<int>(ngenes, copy);
+    singlepp::FlatPairwiseMarkers<int> flat(markers);
+    auto subs = singlepp::subset_to_markers<int>(ngenes, flat);
+    auto copy = flat.to_nested();
     EXPECT_LT(subs.size(), ngenes); // not every gene is there, otherwise it would be a trivial test.
 
     for (size_t i = 0; i < nlabels; ++i) {
@@ -93,8 +95,9 @@ TEST_P(SubsetToMarkersIntersectTest, Basic) {
     auto markers = mock_pairwise_markers<int>(nlabels, 20, ref_ngenes, /* seed = */ base_seed);
     auto inter = mock_intersection<int>(test_ngenes, ref_ngenes, shared, /* seed = */ base_seed + 13);
 
-    auto mcopy = markers;
-    auto unzipped = singlepp::subset_to_markers<int>(test_ngenes, inter, ref_ngenes, mcopy);
+    singlepp::FlatPairwiseMarkers<int> flat(markers);
+    auto unzipped = singlepp::subset_to_markers<int>(test_ngenes, inter, ref_ngenes, flat);
+    auto mcopy = flat.to_nested();
 
     {
         EXPECT_LE(unzipped.first.size(), inter.size());
@@ -164,8 +167,9 @@ TEST_P(SubsetToMarkersIntersectTest, Diagonal) {
     auto markers = mock_diagonal_markers<int>(nlabels, 20, ref_ngenes, /* seed = */ base_seed + 94025);
     auto inter = mock_intersection<int>(test_ngenes, ref_ngenes, shared, /* seed = */ base_seed + 123908);
 
-    auto mcopy = markers;
-    auto unzipped = singlepp::subset_to_markers<int>(test_ngenes, inter, ref_ngenes, mcopy);
+    singlepp::FlatPairwiseMarkers<int> flat(markers);
+    auto unzipped = singlepp::subset_to_markers<int>(test_ngenes, inter, ref_ngenes, flat);
+    auto mcopy = flat.to_nested();
 
     {
         EXPECT_LE(unzipped.first.size(), inter.size());
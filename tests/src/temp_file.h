@@ -0,0 +1,30 @@
+#ifndef SINGLEPP_TEMP_FILE_H
+#define SINGLEPP_TEMP_FILE_H
+
+#include <string>
+#include <random>
+#include <cstdio>
+#include <filesystem>
+
+// Unique path in the temporary directory, so that concurrent test runs do not clobber each other's files.
+// The file (if it was created) is removed when this object goes out of scope, even if the test fails early.
+class TempFile {
+public:
+    TempFile(const std::string& name) {
+        std::random_device rd;
+        std::mt19937_64 rng((static_cast<unsigned long long>(rd()) << 32) | rd());
+        path = (std::filesystem::temp_directory_path() / ("singlepp-" + name + "-" + std::to_string(rng()) + ".bin")).string();
+    }
+
+    ~TempFile() {
+        std::remove(path.c_str());
+    }
+
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+public:
+    std::string path;
+};
+
+#endif
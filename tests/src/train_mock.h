@@ -0,0 +1,33 @@
+#ifndef SINGLEPP_TRAIN_MOCK_H
+#define SINGLEPP_TRAIN_MOCK_H
+
+#include "singlepp/train_single.hpp"
+#include "tatami/tatami.hpp"
+
+#include "mock_markers.h"
+#include "spawn_matrix.h"
+
+#include <memory>
+#include <cstddef>
+
+// Trains a classifier on a simulated reference with 50% sparsity, random labels and mock markers.
+// The reference, labels and markers are generated with 'seed', 'seed + 1' and 'seed + 2', respectively.
+inline singlepp::TrainedSingle<int, double> train_mock_single(
+    std::size_t ngenes,
+    std::size_t nlabels,
+    std::size_t nrefs,
+    std::size_t nmarkers,
+    unsigned long long seed,
+    bool ref_sparse)
+{
+    std::shared_ptr<tatami::Matrix<double, int> > refs = spawn_sparse_matrix(ngenes, nrefs, seed, 0.5);
+    if (ref_sparse) {
+        refs = tatami::convert_to_compressed_sparse<double, int>(*refs, true, {});
+    }
+    auto labels = spawn_labels(nrefs, nlabels, seed + 1);
+    auto markers = mock_pairwise_markers<int>(nlabels, nmarkers, ngenes, seed + 2);
+    singlepp::TrainSingleOptions topt;
+    return singlepp::train_single(*refs, labels.data(), markers, topt);
+}
+
+#endif